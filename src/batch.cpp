@@ -0,0 +1,142 @@
+/**
+ * @file batch.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "batch.h"
+#include "simd_math.h"
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+void applyOperationBatch(OpCode op, double *__restrict values, const double *__restrict right, size_t count,
+                         ErrorMode mode)
+{
+    bool report = mode == ErrorMode::Report;
+    const SimdKernels &kernels = simdKernels();
+    switch (op)
+    {
+    case OpCode::Add:
+        for (size_t i = 0; i < count; ++i)
+            values[i] = values[i] + right[i];
+        break;
+    case OpCode::Subtract:
+        for (size_t i = 0; i < count; ++i)
+            values[i] = values[i] - right[i];
+        break;
+    case OpCode::Multiply:
+        for (size_t i = 0; i < count; ++i)
+            values[i] = values[i] * right[i];
+        break;
+    case OpCode::Divide:
+    {
+        // Look for a zero denominator first so the division loop has no branch
+        bool zero = false;
+        for (size_t i = 0; report && i < count; ++i)
+            zero |= right[i] == 0.0;
+        if (zero)
+            failOperation(op);
+        for (size_t i = 0; i < count; ++i)
+            values[i] = values[i] / right[i];
+        break;
+    }
+    case OpCode::Power:
+        kernels.pow(values, right, values, count);
+        break;
+    case OpCode::Negate:
+        for (size_t i = 0; i < count; ++i)
+            values[i] = -values[i];
+        break;
+    case OpCode::Sin:
+        kernels.sin(values, values, count);
+        break;
+    case OpCode::Cos:
+        kernels.cos(values, values, count);
+        break;
+    case OpCode::Tan:
+        kernels.tan(values, values, count);
+        break;
+    case OpCode::Cot:
+    {
+        kernels.tan(values, values, count);
+        bool zero = false;
+        for (size_t i = 0; report && i < count; ++i)
+            zero |= values[i] == 0.0;
+        if (zero)
+            failOperation(op);
+        for (size_t i = 0; i < count; ++i)
+            values[i] = 1.0 / values[i];
+        break;
+    }
+    case OpCode::Ln:
+        kernels.ln(values, values, count);
+        break;
+    case OpCode::Log:
+        kernels.log10(values, values, count);
+        break;
+    case OpCode::Sqrt:
+    {
+        bool negative = false;
+        for (size_t i = 0; report && i < count; ++i)
+            negative |= values[i] < 0.0;
+        if (negative)
+            failOperation(op);
+        for (size_t i = 0; i < count; ++i)
+            values[i] = std::sqrt(values[i]);
+        break;
+    }
+    case OpCode::Sinh:
+        kernels.sinh(values, values, count);
+        break;
+    case OpCode::Cosh:
+        kernels.cosh(values, values, count);
+        break;
+    case OpCode::Tanh:
+        kernels.tanh(values, values, count);
+        break;
+    case OpCode::Coth:
+        // Infinity for division by zero, as in CothNode
+        kernels.tanh(values, values, count);
+        for (size_t i = 0; i < count; ++i)
+            values[i] = values[i] != 0 ? 1 / values[i] : HUGE_VAL;
+        break;
+    case OpCode::Sech:
+        kernels.cosh(values, values, count);
+        for (size_t i = 0; i < count; ++i)
+            values[i] = 1 / values[i];
+        break;
+    case OpCode::Csch:
+        kernels.sinh(values, values, count);
+        for (size_t i = 0; i < count; ++i)
+            values[i] = values[i] != 0 ? 1 / values[i] : HUGE_VAL;
+        break;
+    default: // Factorial has no array version
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (!report && !(values[i] >= 0.0))
+                values[i] = NAN;
+            else
+                values[i] = applyOperation(op, values[i], 0.0);
+        }
+        break;
+    }
+}
+
+const double *BatchContext::column(size_t slot) const
+{
+    if (columns_ == nullptr)
+        throw std::out_of_range("No column given for variable slot " + std::to_string(slot));
+    return columns_[slot] + offset_;
+}
+
+double *BatchContext::acquire()
+{
+    if (used_ == buffers_.size())
+    {
+        buffers_.push_back(std::make_unique<double[]>(BatchChunkSize));
+    }
+    return buffers_[used_++].get();
+}
@@ -0,0 +1,64 @@
+/**
+ * @file batch.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "opcode.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Batch evaluation works on chunks of this many rows at a time. A chunk of
+// doubles (8 KB) stays in L1/L2 while every operation of the formula runs over it.
+constexpr size_t BatchChunkSize = 1024;
+
+// What batch evaluation does with an operand outside the domain of its operation
+enum class ErrorMode : uint8_t
+{
+    Report,   // throw the ExpressionError, like applyOperation
+    Propagate // write the IEEE result (inf or NaN) for that row and go on
+};
+
+// Applies the operation to a chunk in place: values[i] = op(values[i], right[i]).
+// right is only read for binary operations. Arithmetic loops are kept simple so
+// that the compiler can vectorize them, and the transcendental functions use the
+// selected SIMD kernels (simd_math.h). Error cases are handled as mode says.
+void applyOperationBatch(OpCode op, double *__restrict values, const double *__restrict right, size_t count,
+                         ErrorMode mode = ErrorMode::Report);
+
+// State shared by the nodes while a chunk is evaluated: where the input columns
+// are and a pool of scratch chunks for intermediate results.
+class BatchContext
+{
+public:
+    explicit BatchContext(const double *const *columns, ErrorMode mode = ErrorMode::Report)
+        : columns_(columns), mode_(mode) {}
+
+    ErrorMode mode() const { return mode_; }
+
+    // Values of the variable in the given slot for the current chunk
+    const double *column(size_t slot) const;
+
+    // Moves to the chunk starting at the given row
+    void setOffset(size_t offset) { offset_ = offset; }
+
+    // Scratch chunks are handed out and given back in stack order
+    double *acquire();
+    void release() { --used_; }
+
+private:
+    const double *const *columns_;
+    ErrorMode mode_;
+    size_t offset_ = 0;
+    std::vector<std::unique_ptr<double[]>> buffers_;
+    size_t used_ = 0;
+};
+
+#endif // BATCH_H
@@ -0,0 +1,72 @@
+/**
+ * @file bench_batch.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "parser.h"
+
+// Times the callable once and returns rows per second
+template <typename Run>
+static double rowsPerSecond(Run run, size_t rows)
+{
+    auto start = std::chrono::steady_clock::now();
+    run();
+    auto stop = std::chrono::steady_clock::now();
+    return rows / std::chrono::duration<double>(stop - start).count();
+}
+
+int main()
+{
+    const size_t rows = 1 << 20;
+    std::vector<double> x(rows), y(rows);
+    for (size_t i = 0; i < rows; ++i)
+    {
+        x[i] = 1.0 + i * 1e-6;
+        y[i] = 2.0 - i * 1e-7;
+    }
+    const double *columns[] = {x.data(), y.data()};
+    std::vector<double> out(rows);
+
+    std::vector<std::string> formulas = {
+        "x * y + x / (y + 1) - 3 * x",
+        "sqrt(x) * y^2 + x^3",
+        "sin(x) * cos(y) + ln(x)",
+    };
+
+    Parser parser;
+    std::cout << "formula\ttree rows/s\tcompiled rows/s\ttree batch rows/s\tcompiled batch rows/s" << std::endl;
+
+    for (const auto &formula : formulas)
+    {
+        NodePtr tree = parser.parse(formula, {"x", "y"});
+        CompiledExpression compiled = parser.compile(formula, {"x", "y"});
+
+        double treeRate = rowsPerSecond([&] {
+            for (size_t i = 0; i < rows; ++i)
+            {
+                double values[] = {x[i], y[i]};
+                out[i] = tree->evaluate(values);
+            } }, rows);
+        double compiledRate = rowsPerSecond([&] {
+            for (size_t i = 0; i < rows; ++i)
+            {
+                double values[] = {x[i], y[i]};
+                out[i] = compiled.evaluate(values);
+            } }, rows);
+        double treeBatchRate = rowsPerSecond([&] { tree->evaluateBatch(columns, rows, out.data()); }, rows);
+        double compiledBatchRate = rowsPerSecond([&] { compiled.evaluateBatch(columns, rows, out.data()); }, rows);
+        sink = out[rows - 1];
+
+        std::cout << formula << '\t' << treeRate << '\t' << compiledRate << '\t' << treeBatchRate << '\t' << compiledBatchRate << std::endl;
+    }
+
+    return 0;
+}
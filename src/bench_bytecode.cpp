@@ -0,0 +1,51 @@
+/**
+ * @file bench_bytecode.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "bytecode.h"
+#include "parser.h"
+
+int main()
+{
+    std::vector<std::string> corpus = {
+        "3.5 + 4.5",
+        "(3.5 + 3.2) * 2 - 4.2 / (1.2 * 2.3)",
+        "sinh(1) + cosh(1) * tanh(1) - coth(1) / sech(1) + csch(1)",
+        "sin(0.5) * cos(0.25) + tan(0.125) - cot(1.5708) + ln(2.71) + log(100) + sqrt(144) + 2^-0.5 + 5!",
+    };
+
+    std::string flat = "1";
+    for (int i = 0; i < 200; ++i)
+    {
+        flat += " + 1.25 * 3 - 0.5 / 2";
+    }
+    corpus.push_back(flat);
+
+    Parser parser;
+    std::cout << "nodes\ttree evals/s\tflat evals/s\tbytecode evals/s" << std::endl;
+
+    std::vector<double> scratch;
+    for (const auto &source : corpus)
+    {
+        FlatExpression flatExpression = parser.parseFlat(source);
+        NodePtr tree = flatExpression.toTree();
+        Bytecode program = Bytecode::compile(tree);
+
+        int iterations = static_cast<int>(20000000 / flatExpression.size());
+        double treeRate = evaluationsPerSecond([&] { return tree->evaluate(); }, iterations);
+        double flatRate = evaluationsPerSecond([&] { return flatExpression.evaluateWith(scratch); }, iterations);
+        double bytecodeRate = evaluationsPerSecond([&] { return program.evaluate(); }, iterations);
+
+        std::cout << flatExpression.size() << '\t' << treeRate << '\t' << flatRate << '\t' << bytecodeRate << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file bench_compiled_expression.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "parser.h"
+
+int main()
+{
+    Parser parser;
+    const int inputs = 200000;
+
+    // Before variables existed, every new input meant formatting and parsing a new string
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < inputs; ++i)
+    {
+        std::string x = std::to_string(i * 0.001);
+        std::string expression = "(" + x + ")^2 + 1.5 * 0.25 - sin(" + x + ")";
+        sink = parser.parse(expression)->evaluate();
+    }
+    auto stop = std::chrono::steady_clock::now();
+    double reparseRate = inputs / std::chrono::duration<double>(stop - start).count();
+
+    CompiledExpression compiled = parser.compile("x^2 + rate * t0 - sin(x)", {"x", "rate", "t0"});
+
+    double values[3] = {0.0, 1.5, 0.25};
+    size_t x = compiled.slot("x");
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < inputs * 50; ++i)
+    {
+        values[x] = i * 0.001;
+        sink = compiled.evaluate(values);
+    }
+    stop = std::chrono::steady_clock::now();
+    double compiledRate = inputs * 50 / std::chrono::duration<double>(stop - start).count();
+
+    std::cout << "re-parse per input: " << reparseRate << " evals/s" << std::endl;
+    std::cout << "compile once:       " << compiledRate << " evals/s" << std::endl;
+    std::cout << "speedup:            " << compiledRate / reparseRate << "x" << std::endl;
+
+    return 0;
+}
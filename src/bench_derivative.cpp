@@ -0,0 +1,59 @@
+/**
+ * @file bench_derivative.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "bytecode.h"
+#include "derivative.h"
+#include "parser.h"
+
+int main()
+{
+    std::vector<std::string> corpus = {
+        "x^2 + y * z - x * y / (z + 1) + (x - y) * (y - z)",
+        "sinh(x) + cosh(y) * tanh(z) - coth(x) / sech(y) + csch(z)",
+        "sin(x) * cos(y) + tan(z) - cot(x) + ln(y) + log(z) + sqrt(x) + y^-0.5 + 5!",
+        "sin(x * y) + cos(x * y) * sin(x * y) - sqrt(x * y + z)",
+        "x^y^z / (1 + (x / z)^y) + tanh(x * y - z)",
+    };
+    std::string nested = "x";
+    for (int i = 0; i < 12; ++i)
+        nested = "sin(" + nested + " * y + z)";
+    corpus.push_back(nested);
+
+    Parser parser;
+    std::vector<std::string> names = {"x", "y", "z"};
+    std::vector<double> values = {0.7, 1.3, 2.1};
+    std::cout << "formula\tvariable\tnodes\tderivative nodes\tdistinct\tshared\tcost\tderivative cost\t"
+              << "ns\tderivative ns\tbuild us" << std::endl;
+
+    for (size_t formula = 0; formula < corpus.size(); ++formula)
+    {
+        NodePtr tree = parser.parse(corpus[formula], names);
+        Bytecode original = Bytecode::compile(tree);
+        for (const auto &name : names)
+        {
+            DerivativeStats stats;
+            NodePtr derivative = differentiate(tree, name, &stats);
+            Bytecode derived = Bytecode::compile(derivative);
+
+            double originalTime = nanosecondsPerCall([&] { return original.evaluate(values); }, 1000000);
+            double derivativeTime = nanosecondsPerCall([&] { return derived.evaluate(values); }, 1000000);
+            double buildTime = nanosecondsPerCall([&] { return differentiate(tree, name)->evaluate(values); }, 2000) / 1000;
+
+            std::cout << formula << '\t' << name << '\t' << stats.originalNodes << '\t' << stats.derivativeNodes << '\t'
+                      << stats.distinctNodes << '\t' << stats.sharedNodes << '\t' << stats.originalCost << '\t'
+                      << stats.derivativeCost << '\t' << originalTime << '\t' << derivativeTime << '\t' << buildTime
+                      << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file bench_errors.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * The success path of the try* functions and of ErrorMode::Propagate against
+ * the plain functions, and what a reported error costs.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "parser.h"
+
+namespace
+{
+    template <typename Run>
+    double nanosecondsPerCall(int iterations, Run run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            run(i);
+        }
+        auto stop = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(stop - start).count() / iterations;
+    }
+
+    void report(const char *label, double plain, double checked)
+    {
+        std::cout << label << plain << " -> " << checked << " ns (" << (checked / plain - 1) * 100 << "%)" << std::endl;
+    }
+}
+
+int main()
+{
+    Parser parser;
+    std::vector<std::string> variableNames = {"x", "y"};
+    std::string source = "sqrt(x * x + y * y) / (1 + x) + cot(y + 1) - ln(x + 2) * 3!";
+    NodePtr tree = parser.parse(source, variableNames);
+    CompiledExpression compiled = parser.compile(source, variableNames);
+
+    const int evaluations = 2000000;
+    double values[2] = {0.0, 0.75};
+    double plainTree = nanosecondsPerCall(evaluations, [&](int i)
+                                          { values[0] = i * 1e-6; sink = tree->evaluate(values); });
+    double checkedTree = nanosecondsPerCall(evaluations, [&](int i)
+                                            { values[0] = i * 1e-6; sink = *tree->tryEvaluate(values); });
+    double plainCompiled = nanosecondsPerCall(evaluations, [&](int i)
+                                              { values[0] = i * 1e-6; sink = compiled.evaluate(values); });
+    double checkedCompiled = nanosecondsPerCall(evaluations, [&](int i)
+                                                { values[0] = i * 1e-6; sink = *compiled.tryEvaluate(values); });
+
+    const int parses = 200000;
+    double plainParse = nanosecondsPerCall(parses, [&](int)
+                                           { sink = parser.parseFlat(source, variableNames).size(); });
+    double checkedParse = nanosecondsPerCall(parses, [&](int)
+                                             { sink = parser.tryParseFlat(source, variableNames)->size(); });
+
+    const size_t rows = 1 << 20;
+    std::vector<double> xs(rows), ys(rows, 0.75), out(rows);
+    for (size_t row = 0; row < rows; ++row)
+        xs[row] = row * 1e-6;
+    const double *columns[] = {xs.data(), ys.data()};
+    const int batches = 20;
+    double reportBatch = nanosecondsPerCall(batches, [&](int)
+                                            { compiled.evaluateBatch(columns, rows, out.data()); sink = out[0]; }) / rows;
+    double propagateBatch = nanosecondsPerCall(batches, [&](int)
+                                               { compiled.evaluateBatch(columns, rows, out.data(), ErrorMode::Propagate); sink = out[0]; }) / rows;
+
+    std::cout << "success path, plain -> checked" << std::endl;
+    report("  tree evaluate:     ", plainTree, checkedTree);
+    report("  compiled evaluate: ", plainCompiled, checkedCompiled);
+    report("  parse:             ", plainParse, checkedParse);
+    report("  batch per row:     ", reportBatch, propagateBatch);
+
+    std::cout << "failure path" << std::endl;
+    std::string bad = "1 + (2 * x";
+    std::cout << "  tryParse error:    " << nanosecondsPerCall(parses, [&](int)
+                                                               { sink = parser.tryParse(bad, variableNames).ok(); })
+              << " ns" << std::endl;
+    NodePtr division = parser.parse("1 / (x - x)", variableNames);
+    std::cout << "  tryEvaluate error: " << nanosecondsPerCall(parses, [&](int)
+                                                               { sink = division->tryEvaluate(values).ok(); })
+              << " ns" << std::endl;
+
+    return 0;
+}
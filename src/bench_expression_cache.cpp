@@ -0,0 +1,119 @@
+/**
+ * @file bench_expression_cache.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bench_util.h"
+#include "expression_cache.h"
+#include "parser.h"
+
+namespace
+{
+    const size_t Formulas = 3000;
+    const size_t RequestsPerThread = 100000;
+
+    // Requests drawn from the formulas with a skewed distribution, as a web tier
+    // sees them: a few formulas are very common, most are rare
+    std::vector<size_t> makeRequests(unsigned seed)
+    {
+        std::mt19937 random(seed);
+        std::exponential_distribution<double> skew(6.0);
+        std::vector<size_t> requests(RequestsPerThread);
+        for (auto &request : requests)
+            request = static_cast<size_t>(skew(random) * Formulas) % Formulas;
+        return requests;
+    }
+
+    // Requests per second over all threads; handle(formula index) serves one request
+    template <typename Handle>
+    double requestRate(size_t threads, const Handle &handle)
+    {
+        std::vector<std::vector<size_t>> requests;
+        for (size_t t = 0; t < threads; ++t)
+            requests.push_back(makeRequests(static_cast<unsigned>(t + 1)));
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]
+                                 {
+                                     for (size_t request : requests[t])
+                                         handle(request);
+                                 });
+        }
+        for (auto &worker : workers)
+            worker.join();
+        auto stop = std::chrono::steady_clock::now();
+        return threads * RequestsPerThread / std::chrono::duration<double>(stop - start).count();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t maxThreads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : std::thread::hardware_concurrency();
+    maxThreads = std::max<size_t>(maxThreads, 1);
+
+    std::vector<std::string> variableNames = {"x", "rate"};
+    std::vector<std::string> formulas;
+    for (size_t i = 0; i < Formulas; ++i)
+    {
+        formulas.push_back("sin(x * " + std::to_string(i % 97) + ".5) + rate ^ 2 * cos(x - " + std::to_string(i) +
+                           ") / (1 + sqrt(x * x + rate))");
+    }
+
+    std::vector<double> rates;
+    std::vector<ExpressionCacheStats> stats;
+    std::vector<std::string> labels;
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        labels.push_back(std::to_string(threads) + " thread(s), parse every request");
+        rates.push_back(requestRate(threads, [&](size_t formula)
+                                    {
+                                        thread_local Parser parser;
+                                        double values[2] = {0.5, 1.5};
+                                        sink = parser.compile(formulas[formula], variableNames).evaluate(values);
+                                    }));
+        stats.push_back({});
+
+        for (size_t shards : {1, 16})
+        {
+            for (size_t maxEntries : {Formulas, Formulas / 4})
+            {
+                ExpressionCache cache({.maxEntries = maxEntries, .shards = shards});
+                labels.push_back(std::to_string(threads) + " thread(s), " + std::to_string(shards) + " shard(s), " +
+                                 std::to_string(maxEntries) + " entries");
+                rates.push_back(requestRate(threads, [&](size_t formula)
+                                            {
+                                                double values[2] = {0.5, 1.5};
+                                                sink = cache.get(formulas[formula], variableNames)->compiled.evaluate(values);
+                                            }));
+                stats.push_back(cache.stats());
+            }
+        }
+    }
+
+    for (size_t i = 0; i < rates.size(); ++i)
+    {
+        std::cout << labels[i] << ": " << rates[i] << " requests/s";
+        if (stats[i].hits + stats[i].misses > 0)
+        {
+            std::cout << " (hit rate " << 100.0 * stats[i].hits / (stats[i].hits + stats[i].misses) << "%, "
+                      << stats[i].evictions << " evictions, " << stats[i].bytes / 1024 << " KiB)";
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
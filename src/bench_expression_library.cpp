@@ -0,0 +1,137 @@
+/**
+ * @file bench_expression_library.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "corpus.h"
+#include "expression_library.h"
+#include "parser.h"
+
+// Runs the callable a few times and returns the fastest run in milliseconds
+template <typename Run>
+static double bestMilliseconds(Run run, int repetitions = 5)
+{
+    double best = 1e300;
+    for (int i = 0; i < repetitions; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto stop = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(stop - start).count());
+    }
+    return best;
+}
+
+int main()
+{
+    CorpusGenerator generator;
+    const std::vector<std::string> &names = CorpusGenerator::variableNames();
+    const std::vector<double> &values = CorpusGenerator::variableValues();
+    std::string path = (std::filesystem::temp_directory_path() / "bench_expression_library.mplib").string();
+
+    std::cout << "formulas\tsource KB\tlibrary KB\tparse ms\twrite ms\topen ms\topen+lookup ms\t"
+              << "parse+evaluate ms\topen+lookup+evaluate ms" << std::endl;
+    for (size_t count : {250, 1000, 2500})
+    {
+        // Four shapes of formula, count of each
+        std::vector<std::string> formulas, keys;
+        size_t sourceBytes = 0;
+        for (const FormulaSet &set : generator.formulaSets(count, 16))
+        {
+            for (size_t i = 0; i < set.formulas.size(); ++i)
+            {
+                formulas.push_back(set.formulas[i]);
+                keys.push_back(set.name + "/" + std::to_string(i));
+                sourceBytes += set.formulas[i].size();
+            }
+        }
+
+        // Today's startup: parse and compile every formula
+        Parser parser;
+        std::vector<CompiledExpression> compiled;
+        double parseTime = bestMilliseconds(
+            [&]
+            {
+                compiled.clear();
+                for (const auto &formula : formulas)
+                    compiled.push_back(parser.compile(formula, names));
+            });
+
+        double writeTime = bestMilliseconds(
+            [&]
+            {
+                ExpressionLibraryWriter writer;
+                for (size_t i = 0; i < formulas.size(); ++i)
+                    writer.add(keys[i], compiled[i]);
+                writer.write(path);
+            });
+
+        size_t libraryBytes = 0;
+        double openTime = bestMilliseconds([&] { libraryBytes = ExpressionLibrary::open(path).byteSize(); });
+        double lookupTime = bestMilliseconds(
+            [&]
+            {
+                ExpressionLibrary library = ExpressionLibrary::open(path);
+                double sum = 0;
+                for (const auto &key : keys)
+                    sum += library.at(key).variableCount();
+                sink = sum;
+            });
+
+        // Until every formula has been evaluated once, from the source or from the file
+        double parseEvaluateTime = bestMilliseconds(
+            [&]
+            {
+                double sum = 0;
+                for (const auto &formula : formulas)
+                    sum += parser.compile(formula, names).evaluate(values);
+                sink = sum;
+            });
+        double libraryEvaluateTime = bestMilliseconds(
+            [&]
+            {
+                ExpressionLibrary library = ExpressionLibrary::open(path);
+                double sum = 0;
+                for (const auto &key : keys)
+                    sum += library.at(key).evaluate(values);
+                sink = sum;
+            });
+
+        std::cout << formulas.size() << '\t' << sourceBytes / 1024 << '\t' << libraryBytes / 1024 << '\t' << parseTime
+                  << '\t' << writeTime << '\t' << openTime << '\t' << lookupTime << '\t' << parseEvaluateTime << '\t'
+                  << libraryEvaluateTime << std::endl;
+
+        // Evaluating from the mapped pages runs the same interpreter as the owned program
+        ExpressionLibrary library = ExpressionLibrary::open(path);
+        LibraryExpression mapped = library.at(keys[0]);
+        const int iterations = 2000000;
+        double ownedTime = bestMilliseconds(
+            [&]
+            {
+                for (int i = 0; i < iterations; ++i)
+                    sink = compiled[0].evaluate(values);
+            }, 3);
+        double mappedTime = bestMilliseconds(
+            [&]
+            {
+                for (int i = 0; i < iterations; ++i)
+                    sink = mapped.evaluate(values);
+            }, 3);
+        std::cout << "  evaluate ns: compiled " << ownedTime * 1e6 / iterations << ", mapped "
+                  << mappedTime * 1e6 / iterations << std::endl;
+    }
+
+    std::remove(path.c_str());
+    return 0;
+}
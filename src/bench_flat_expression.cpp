@@ -0,0 +1,98 @@
+/**
+ * @file bench_flat_expression.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "parser.h"
+
+// Bytes requested from the heap, to measure how much a NodePtr tree takes
+static size_t allocatedBytes = 0;
+
+void *operator new(std::size_t size)
+{
+    allocatedBytes += size;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+int main()
+{
+    std::vector<std::string> corpus = {
+        "(3.5 + 3.2) * 2 - 4.2 / (1.2 * 2.3)",
+        "sinh(1) + cosh(1) * tanh(1) - coth(1) / sech(1) + csch(1)",
+        "sin(0.5) * cos(0.25) + tan(0.125) - cot(1.5708) + ln(2.71) + log(100) + sqrt(144) + 2^-0.5 + 5!",
+    };
+
+    std::string flat = "1";
+    for (int i = 0; i < 200; ++i)
+    {
+        flat += " + 1.25 * 3 - 0.5 / 2";
+    }
+    corpus.push_back(flat);
+
+    Parser parser;
+
+    std::vector<FlatExpression> flatExpressions;
+    std::vector<NodePtr> trees;
+    std::vector<size_t> treeBytes;
+    for (const auto &expression : corpus)
+    {
+        flatExpressions.push_back(parser.parseFlat(expression));
+
+        // toTree also allocates one temporary NodePtr per node, which is not part of the tree
+        size_t before = allocatedBytes;
+        trees.push_back(flatExpressions.back().toTree());
+        treeBytes.push_back(allocatedBytes - before - flatExpressions.back().size() * sizeof(NodePtr));
+    }
+
+    std::cout << "nodes\ttree bytes\tflat bytes\ttree ns/node\tflat ns/node" << std::endl;
+
+    std::vector<double> scratch;
+    for (size_t i = 0; i < corpus.size(); ++i)
+    {
+        size_t nodeCount = flatExpressions[i].size();
+        int iterations = static_cast<int>(4000000 / nodeCount) + 1;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int j = 0; j < iterations; ++j)
+        {
+            sink = trees[i]->evaluate();
+        }
+        auto middle = std::chrono::steady_clock::now();
+        for (int j = 0; j < iterations; ++j)
+        {
+            sink = flatExpressions[i].evaluateWith(scratch);
+        }
+        auto stop = std::chrono::steady_clock::now();
+
+        double treeTime = std::chrono::duration<double, std::nano>(middle - start).count();
+        double flatTime = std::chrono::duration<double, std::nano>(stop - middle).count();
+        double work = static_cast<double>(iterations) * nodeCount;
+
+        std::cout << nodeCount << '\t' << treeBytes[i] << '\t' << flatExpressions[i].memoryFootprint() << '\t'
+                  << treeTime / work << '\t' << flatTime / work << std::endl;
+    }
+
+    return 0;
+}
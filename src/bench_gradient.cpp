@@ -0,0 +1,92 @@
+/**
+ * @file bench_gradient.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "gradient.h"
+#include "parser.h"
+
+int main()
+{
+    // Model formulas with parameters p0..p<k-1> at a fixed data point
+    std::vector<std::pair<std::string, size_t>> corpus = {
+        {"p0 * x + p1", 2},
+        {"p0 * 2.718281828459045^(p1 * x) + p2 * sin(p3 * x + p4)", 5},
+        {"p0 / (1 + (x / p1)^p2) + p3 * tanh(p4 * x - p5) + p6 * sqrt(p7 + x^2)", 8},
+    };
+    std::string polynomial = "p0";
+    for (int i = 1; i < 32; ++i)
+    {
+        polynomial += " + p" + std::to_string(i) + " * x^" + std::to_string(i);
+    }
+    corpus.push_back({polynomial, 32});
+
+    Parser parser;
+    std::cout << "parameters\tevaluate ns\tfinite difference ns\ttape ns\ttape / evaluate\tbatch ns per row" << std::endl;
+
+    for (const auto &[source, parameters] : corpus)
+    {
+        std::vector<std::string> names;
+        for (size_t i = 0; i < parameters; ++i)
+            names.push_back("p" + std::to_string(i));
+        names.push_back("x");
+        std::vector<double> values(names.size());
+        for (size_t i = 0; i < values.size(); ++i)
+            values[i] = 0.5 + 0.125 * static_cast<double>(i);
+
+        CompiledExpression compiled = parser.compile(source, names);
+        GradientTape tape(parser.parseFlat(source, names));
+        std::vector<double> gradient(names.size()), scratch, shifted = values;
+
+        int iterations = 2000000 / static_cast<int>(parameters);
+        double evaluateTime = nanosecondsPerCall([&] { return compiled.evaluate(values); }, iterations);
+        // One evaluation per parameter plus the base point
+        double differenceTime = nanosecondsPerCall(
+            [&]
+            {
+                double base = compiled.evaluate(shifted);
+                for (size_t i = 0; i < parameters; ++i)
+                {
+                    shifted[i] += 1e-7;
+                    gradient[i] = (compiled.evaluate(shifted) - base) * 1e7;
+                    shifted[i] = values[i];
+                }
+                return gradient[0];
+            },
+            iterations);
+        double tapeTime = nanosecondsPerCall([&] { return tape.evaluate(values, gradient, scratch); }, iterations);
+
+        // Batch: the same point repeated over many rows
+        const size_t rows = 4096;
+        std::vector<std::vector<double>> columns(names.size()), gradientColumns(names.size(), std::vector<double>(rows));
+        std::vector<const double *> columnPointers;
+        std::vector<double *> gradientPointers;
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            columns[i].assign(rows, values[i]);
+            columnPointers.push_back(columns[i].data());
+            gradientPointers.push_back(gradientColumns[i].data());
+        }
+        std::vector<double> out(rows);
+        double batchTime = nanosecondsPerCall(
+                               [&]
+                               {
+                                   tape.evaluateBatch(columnPointers.data(), rows, out.data(), gradientPointers.data());
+                                   return out[0];
+                               },
+                               iterations / static_cast<int>(rows) + 1) /
+                           rows;
+
+        std::cout << parameters << '\t' << evaluateTime << '\t' << differenceTime << '\t' << tapeTime << '\t'
+                  << tapeTime / evaluateTime << '\t' << batchTime << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file bench_incremental.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "incremental.h"
+#include "parser.h"
+
+// A term of input i, cycling through a few shapes
+static std::string term(const std::string &input, size_t i)
+{
+    switch (i % 5)
+    {
+    case 0:
+        return "1.5 * " + input;
+    case 1:
+        return "sin(" + input + ")";
+    case 2:
+        return "sqrt(" + input + " + 1)";
+    case 3:
+        return input + "^2 / (" + input + " + 2)";
+    default:
+        return "ln(" + input + " + 3)";
+    }
+}
+
+// t0 + t1 + ... as one left-to-right chain: an input near the start is deep in it
+static std::string chain(const std::vector<std::string> &names)
+{
+    std::string source = term(names[0], 0);
+    for (size_t i = 1; i < names.size(); ++i)
+        source += " + " + term(names[i], i);
+    return source;
+}
+
+// The same sum as a balanced tree of parentheses
+static std::string balanced(const std::vector<std::string> &names, size_t begin, size_t end)
+{
+    if (end - begin == 1)
+        return term(names[begin], begin);
+    size_t middle = (begin + end) / 2;
+    return "(" + balanced(names, begin, middle) + ") + (" + balanced(names, middle, end) + ")";
+}
+
+// Every input appears in two neighbouring terms, and the terms feed one product
+static std::string coupled(const std::vector<std::string> &names)
+{
+    std::string sum, product;
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        const std::string &next = names[(i + 1) % names.size()];
+        sum += (i ? " + (" : "(") + names[i] + " - " + next + ")^2";
+        if (i % 8 == 0)
+            product += (i ? " * cos(" : "cos(") + names[i] + " * " + next + ")";
+    }
+    return sum + " + " + product;
+}
+
+int main()
+{
+    Parser parser;
+    std::cout << "formula\tinputs\tnodes\tfull ns\tupdate ns\tnodes per update\tunchanged ns" << std::endl;
+
+    for (size_t inputs : {16, 64, 256})
+    {
+        std::vector<std::string> names;
+        std::vector<double> values;
+        for (size_t i = 0; i < inputs; ++i)
+        {
+            names.push_back("v" + std::to_string(i));
+            values.push_back(0.5 + 0.01 * i);
+        }
+
+        std::vector<std::pair<std::string, std::string>> formulas = {
+            {"chain", chain(names)}, {"balanced", balanced(names, 0, inputs)}, {"coupled", coupled(names)}};
+        for (const auto &[label, source] : formulas)
+        {
+            FlatExpression flat = parser.parseFlat(source, names);
+            std::vector<double> scratch;
+            double fullTime = nanosecondsPerCall([&] { return flat.evaluateWith(scratch, values); }, 200000);
+
+            // One input changes per tick, cycling through all of them
+            IncrementalExpression incremental(flat, values);
+            incremental.value();
+            size_t tick = 0;
+            size_t before = incremental.totalRecomputed();
+            const int updates = 200000;
+            double updateTime = nanosecondsPerCall(
+                [&]
+                {
+                    size_t slot = tick++ % inputs;
+                    incremental.set(slot, values[slot] + 0.001 * (tick % 7));
+                    return incremental.value();
+                },
+                updates);
+            double nodesPerUpdate = double(incremental.totalRecomputed() - before) / updates;
+
+            // Ticks where the input is set to the value it has cost nothing
+            double unchangedTime = nanosecondsPerCall(
+                [&]
+                {
+                    incremental.set(size_t(0), incremental.variable(0));
+                    return incremental.value();
+                },
+                updates);
+
+            std::cout << label << '\t' << inputs << '\t' << flat.size() << '\t' << fullTime << '\t' << updateTime << '\t'
+                      << nodesPerUpdate << '\t' << unchangedTime << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,209 @@
+/**
+ * @file bench_matrix.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "bench_util.h"
+#include "math_module.h"
+#include "matrix.h"
+
+using Nested = std::vector<std::vector<double>>;
+
+// Runs the callable iterations times, a few times over, and returns the fastest
+// run in microseconds per iteration
+template <typename Run>
+static double bestMicroseconds(Run run, size_t iterations, int repetitions)
+{
+    double best = 1e300;
+    for (int i = 0; i < repetitions; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t k = 0; k < iterations; ++k)
+            run();
+        auto stop = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::micro>(stop - start).count() / double(iterations));
+    }
+    return best;
+}
+
+// The textbook version on nested vectors the new code replaces: elimination
+// with partial pivoting one row at a time, and the inverse one column at a time
+static int nestedLu(Nested &a, std::vector<size_t> &pivots)
+{
+    size_t n = a.size();
+    int sign = 1;
+    pivots.resize(n);
+    for (size_t k = 0; k < n; ++k)
+    {
+        size_t pivot = k;
+        for (size_t i = k + 1; i < n; ++i)
+        {
+            if (std::abs(a[i][k]) > std::abs(a[pivot][k]))
+                pivot = i;
+        }
+        pivots[k] = pivot;
+        if (pivot != k)
+        {
+            std::swap(a[k], a[pivot]);
+            sign = -sign;
+        }
+        if (a[k][k] == 0)
+            return 0;
+        for (size_t i = k + 1; i < n; ++i)
+        {
+            a[i][k] /= a[k][k];
+            for (size_t j = k + 1; j < n; ++j)
+                a[i][j] -= a[i][k] * a[k][j];
+        }
+    }
+    return sign;
+}
+
+static std::vector<double> nestedSolve(const Nested &lu, const std::vector<size_t> &pivots, std::vector<double> b)
+{
+    size_t n = lu.size();
+    for (size_t k = 0; k < n; ++k)
+        std::swap(b[k], b[pivots[k]]);
+    for (size_t i = 0; i < n; ++i)
+    {
+        for (size_t j = 0; j < i; ++j)
+            b[i] -= lu[i][j] * b[j];
+    }
+    for (size_t i = n; i-- > 0;)
+    {
+        for (size_t j = i + 1; j < n; ++j)
+            b[i] -= lu[i][j] * b[j];
+        b[i] /= lu[i][i];
+    }
+    return b;
+}
+
+static double nestedDeterminant(Nested a)
+{
+    std::vector<size_t> pivots;
+    double result = nestedLu(a, pivots);
+    for (size_t i = 0; i < a.size(); ++i)
+        result *= a[i][i];
+    return result;
+}
+
+static Nested nestedInverse(Nested a)
+{
+    size_t n = a.size();
+    std::vector<size_t> pivots;
+    nestedLu(a, pivots);
+    Nested result(n, std::vector<double>(n));
+    for (size_t j = 0; j < n; ++j)
+    {
+        std::vector<double> e(n);
+        e[j] = 1;
+        std::vector<double> column = nestedSolve(a, pivots, std::move(e));
+        for (size_t i = 0; i < n; ++i)
+            result[i][j] = column[i];
+    }
+    return result;
+}
+
+// Largest entry of A X - I
+static double residual(const Matrix &a, const Matrix &x)
+{
+    Matrix product = a * x;
+    double worst = 0;
+    for (size_t i = 0; i < a.rows(); ++i)
+    {
+        for (size_t j = 0; j < a.rows(); ++j)
+            worst = std::max(worst, std::abs(product(i, j) - (i == j ? 1.0 : 0.0)));
+    }
+    return worst;
+}
+
+// Times the fixed-size inverse for the sizes it is meant for
+template <size_t N>
+static double fixedInverse(const Matrix &a, size_t iterations, int repetitions)
+{
+    FixedMatrix<N> fixed;
+    std::copy(a.data(), a.data() + N * N, fixed.data());
+    return bestMicroseconds([&] { sink = inverse(fixed)(0, 0); }, iterations, repetitions);
+}
+
+static double fixedInverse(const Matrix &a, size_t iterations, int repetitions)
+{
+    switch (a.rows())
+    {
+    case 2:
+        return fixedInverse<2>(a, iterations, repetitions);
+    case 4:
+        return fixedInverse<4>(a, iterations, repetitions);
+    case 8:
+        return fixedInverse<8>(a, iterations, repetitions);
+    case 16:
+        return fixedInverse<16>(a, iterations, repetitions);
+    default:
+        return std::nan("");
+    }
+}
+
+int main()
+{
+    std::mt19937_64 random(42);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+    std::cout << "microseconds per call; residual is the largest entry of A inverse(A) - I" << std::endl;
+    std::cout << "n\tnested det\tMatrix det\tnested solve\tMatrix solve\tnested inverse\tMatrix inverse\t"
+              << "FixedMatrix inverse\tnested residual\tMatrix residual" << std::endl;
+    for (size_t n = 2; n <= 1024; n *= 2)
+    {
+        Matrix a(n, n);
+        for (size_t k = 0; k < n * n; ++k)
+            a.data()[k] = uniform(random);
+        Nested nested = a.toRows();
+        std::vector<double> b(n);
+        for (double &value : b)
+            value = uniform(random);
+
+        size_t iterations = std::max<size_t>(1, (size_t(1) << 22) / (n * n * n));
+        int repetitions = n >= 256 ? 1 : 5;
+
+        double nestedDet = bestMicroseconds([&] { sink = nestedDeterminant(nested); }, iterations, repetitions);
+        double matrixDet = bestMicroseconds([&] { sink = determinant(a); }, iterations, repetitions);
+        double nestedSolveTime = bestMicroseconds(
+            [&]
+            {
+                Nested lu = nested;
+                std::vector<size_t> pivots;
+                nestedLu(lu, pivots);
+                sink = nestedSolve(lu, pivots, b)[0];
+            },
+            iterations, repetitions);
+        double matrixSolve = bestMicroseconds([&] { sink = solve(a, b)[0]; }, iterations, repetitions);
+
+        Nested nestedResult;
+        Matrix matrixResult;
+        double nestedInverseTime = bestMicroseconds([&] { nestedResult = nestedInverse(nested); }, iterations,
+                                                    repetitions);
+        double matrixInverse = bestMicroseconds([&] { matrixResult = inverse(a); }, iterations, repetitions);
+        double fixed = fixedInverse(a, iterations, repetitions);
+
+        std::cout << n << '\t' << nestedDet << '\t' << matrixDet << '\t' << nestedSolveTime << '\t' << matrixSolve
+                  << '\t' << nestedInverseTime << '\t' << matrixInverse << '\t' << fixed << '\t'
+                  << residual(a, Matrix::fromRows(nestedResult)) << '\t' << residual(a, matrixResult) << std::endl;
+    }
+
+    // The 2x2 path the old function took, now a wrapper over FixedMatrix<2>
+    Nested two = {{4, 7}, {2, 6}};
+    double wrapper = bestMicroseconds([&] { sink = inverse2x2Matrix(two)[0][0]; }, 1000000, 5);
+    FixedMatrix<2> fixedTwo{{4, 7, 2, 6}};
+    double fixedTwoTime = bestMicroseconds([&] { sink = inverse(fixedTwo)(0, 0); }, 1000000, 5);
+    std::cout << "2x2\tinverse2x2Matrix " << wrapper * 1000 << " ns\tinverse(FixedMatrix<2>) " << fixedTwoTime * 1000
+              << " ns" << std::endl;
+    return 0;
+}
@@ -0,0 +1,154 @@
+/**
+ * @file bench_multi_expression.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "corpus.h"
+#include "multi_expression.h"
+#include "parser.h"
+
+// Runs the callable a few times and returns the fastest run in nanoseconds per iteration
+template <typename Run>
+static double nanosecondsPerIteration(Run run, int iterations, int repetitions = 5)
+{
+    double best = 1e300;
+    for (int r = 0; r < repetitions; ++r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+            run();
+        auto stop = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(stop - start).count() / iterations);
+    }
+    return best;
+}
+
+// 40 pricing formulas built from the same handful of terms, as in a pricing step
+static std::vector<std::string> pricingFormulas()
+{
+    const std::vector<std::string> terms = {
+        "price * qty",
+        "(price - cost) * qty",
+        "(1 + rate)^-t",
+        "vol * sqrt(t)",
+        "(ln(price / strike) + (rate + vol^2 / 2) * t) / (vol * sqrt(t))",
+        "fee * qty",
+        "(price - strike) / price",
+        "sqrt(price * strike)",
+        "cost * qty * (1 + rate)",
+        "ln(price / cost)"};
+    const char *operators[] = {" + ", " - ", " * ", " / "};
+
+    std::vector<std::string> formulas;
+    for (size_t k = 0; k < 40; ++k)
+    {
+        const std::string &a = terms[k % terms.size()];
+        const std::string &b = terms[(3 * k + 1) % terms.size()];
+        const std::string &c = terms[(7 * k + 2) % terms.size()];
+        formulas.push_back("(" + a + ")" + operators[k % 4] + "(" + b + ")" + operators[(k / 4) % 4] + "(" + c +
+                           ") * " + std::to_string(1 + k % 7) + ".5");
+    }
+    return formulas;
+}
+
+static void run(const std::string &label, const std::vector<std::string> &formulas,
+                const std::vector<std::string> &names, const std::vector<double> &values)
+{
+    Parser parser;
+    std::vector<NodePtr> trees;
+    std::vector<CompiledExpression> compiled;
+    for (const auto &formula : formulas)
+    {
+        trees.push_back(parser.parse(formula, names));
+        compiled.push_back(parser.compile(formula, names));
+    }
+    MultiExpression fused = MultiExpression::compile(parser, formulas, names);
+    const FusionStats &stats = fused.stats();
+
+    std::cout << label << ": " << formulas.size() << " formulas" << std::endl;
+    std::cout << "  operations\t" << stats.separateOperations << " -> " << stats.fusedOperations << std::endl;
+    std::cout << "  instructions\t" << stats.separateInstructions << " -> " << stats.fusedInstructions << std::endl;
+    std::cout << "  variable reads\t" << stats.separateVariableReads << " -> " << stats.fusedVariableReads
+              << std::endl;
+
+    // One set of inputs, every formula
+    std::vector<double> out(formulas.size());
+    const int iterations = 20000;
+    double treeTime = nanosecondsPerIteration(
+        [&]
+        {
+            for (size_t k = 0; k < trees.size(); ++k)
+                out[k] = trees[k]->evaluate(values);
+            sink = out.back();
+        }, iterations);
+    double compiledTime = nanosecondsPerIteration(
+        [&]
+        {
+            for (size_t k = 0; k < compiled.size(); ++k)
+                out[k] = compiled[k].evaluate(values);
+            sink = out.back();
+        }, iterations);
+    double fusedTime = nanosecondsPerIteration(
+        [&]
+        {
+            fused.evaluate(values, out);
+            sink = out.back();
+        }, iterations);
+    std::cout << "  scalar ns\ttrees " << treeTime << ", compiled " << compiledTime << ", fused " << fusedTime
+              << std::endl;
+
+    // 4096 rows of the same inputs, slightly varied
+    const size_t rows = 4096;
+    std::vector<std::vector<double>> columnData(names.size());
+    std::vector<const double *> columns;
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        for (size_t row = 0; row < rows; ++row)
+            columnData[i].push_back(values[i] * (1 + 0.001 * double(row % 97)));
+        columns.push_back(columnData[i].data());
+    }
+    std::vector<std::vector<double>> outData(formulas.size(), std::vector<double>(rows));
+    std::vector<double *> outColumns;
+    for (auto &column : outData)
+        outColumns.push_back(column.data());
+
+    double compiledBatchTime = nanosecondsPerIteration(
+        [&]
+        {
+            for (size_t k = 0; k < compiled.size(); ++k)
+                compiled[k].evaluateBatch(columns.data(), rows, outColumns[k]);
+            sink = outData.back().back();
+        }, 20);
+    double fusedBatchTime = nanosecondsPerIteration(
+        [&]
+        {
+            fused.evaluateBatch(columns.data(), rows, outColumns.data());
+            sink = outData.back().back();
+        }, 20);
+    std::cout << "  batch ns/row\tcompiled " << compiledBatchTime / rows << ", fused " << fusedBatchTime / rows
+              << std::endl;
+}
+
+int main()
+{
+    const std::vector<std::string> pricingNames = {"price", "cost", "qty", "rate", "t", "vol", "strike", "fee"};
+    const std::vector<double> pricingValues = {101.5, 87.25, 12, 0.035, 1.5, 0.22, 95, 0.75};
+    run("pricing", pricingFormulas(), pricingNames, pricingValues);
+
+    // Unrelated formulas share little more than variables and constants
+    CorpusGenerator generator;
+    std::vector<std::string> corpus;
+    for (const FormulaSet &set : generator.formulaSets(10, 16))
+        corpus.insert(corpus.end(), set.formulas.begin(), set.formulas.end());
+    run("corpus", corpus, CorpusGenerator::variableNames(), CorpusGenerator::variableValues());
+    return 0;
+}
@@ -0,0 +1,59 @@
+/**
+ * @file bench_native_expression.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "native_expression.h"
+#include "parser.h"
+
+int main()
+{
+    std::vector<std::string> corpus = {
+        "x + y",
+        "(x + 3.2) * 2 - y / (1.2 * z)",
+        "x^2 + y * z - x * y / (z + 1) + (x - y) * (y - z)",
+        "sinh(x) + cosh(y) * tanh(z) - coth(x) / sech(y) + csch(z)",
+        "sin(x) * cos(y) + tan(z) - cot(x) + ln(y) + log(z) + sqrt(x) + y^-0.5 + 5!",
+        "sin(x * y) + cos(x * y) * sin(x * y) - sqrt(x * y + z)",
+    };
+
+    std::string flat = "x";
+    for (int i = 0; i < 200; ++i)
+    {
+        flat += " + 1.25 * y - z / 2";
+    }
+    corpus.push_back(flat);
+
+    if (!NativeExpression::supported())
+        std::cout << "No native code on this platform: the native column runs the bytecode" << std::endl;
+
+    Parser parser;
+    std::vector<std::string> names = {"x", "y", "z"};
+    std::vector<double> values = {0.7, 1.3, 2.1};
+    std::cout << "nodes\tcode bytes\ttree evals/s\tbytecode evals/s\tnative evals/s\tnative / tree" << std::endl;
+
+    for (const auto &source : corpus)
+    {
+        NodePtr tree = parser.parse(source, names);
+        CompiledExpression compiled = parser.compile(source, names);
+        NativeExpression native(compiled);
+
+        size_t nodes = parser.parseFlat(source, names).size();
+        int iterations = static_cast<int>(20000000 / nodes);
+        double treeRate = evaluationsPerSecond([&] { return tree->evaluate(values); }, iterations);
+        double bytecodeRate = evaluationsPerSecond([&] { return compiled.evaluate(values); }, iterations);
+        double nativeRate = evaluationsPerSecond([&] { return native.evaluate(values); }, iterations);
+
+        std::cout << nodes << '\t' << native.codeSize() << '\t' << treeRate << '\t' << bytecodeRate << '\t' << nativeRate
+                  << '\t' << nativeRate / treeRate << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file bench_optimizer.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "optimizer.h"
+#include "parser.h"
+
+namespace
+{
+    const int Evaluations = 2000000;
+
+    template <typename Evaluate>
+    double evaluationRate(Evaluate evaluate)
+    {
+        double values[2] = {0.0, 1.5};
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < Evaluations; ++i)
+        {
+            values[0] = i * 1e-6;
+            sink = evaluate(values);
+        }
+        auto stop = std::chrono::steady_clock::now();
+        return Evaluations / std::chrono::duration<double>(stop - start).count();
+    }
+}
+
+int main()
+{
+    Parser parser;
+    std::vector<std::string> variableNames = {"x", "y"};
+    std::vector<std::string> expressions = {
+        "sqrt(144) * x + 2 * 3.14159 / 4",
+        "x^2 + y^2 - 2 * x * y * cos(3.14159 / 3)",
+        "(x * 1 + 0) / 8 + ln(10) * y / 2 - 5!",
+        "x^3 - 4 * x^2 + y^4 / 3",
+        "sin(x) * (log(100) + 3!) / (2^10) - sinh(1) * y"};
+
+    for (bool fastMath : {false, true})
+    {
+        std::cout << (fastMath ? "fast math" : "IEEE") << std::endl;
+        for (const auto &source : expressions)
+        {
+            NodePtr tree = parser.parse(source, variableNames);
+
+            OptimizeStats stats;
+            NodePtr optimized = optimize(tree, {fastMath}, &stats);
+            CompiledExpression compiled(Bytecode::compile(tree), variableNames);
+            CompiledExpression compiledOptimized(Bytecode::compile(optimized), variableNames);
+
+            double treeRate = evaluationRate([&](const double *values)
+                                             { return tree->evaluate({values, 2}); });
+            double optimizedTreeRate = evaluationRate([&](const double *values)
+                                                      { return optimized->evaluate({values, 2}); });
+            double compiledRate = evaluationRate([&](const double *values)
+                                                 { return compiled.evaluate({values, 2}); });
+            double optimizedCompiledRate = evaluationRate([&](const double *values)
+                                                          { return compiledOptimized.evaluate({values, 2}); });
+
+            std::cout << "  " << source << std::endl;
+            std::cout << "    nodes:    " << stats.nodesBefore << " -> " << stats.nodesAfter << " (" << stats.constantsFolded
+                      << " folded, " << stats.powersReduced << " powers, " << stats.divisionsReduced << " divisions, "
+                      << stats.identitiesRemoved << " identities)" << std::endl;
+            std::cout << "    tree:     " << treeRate << " -> " << optimizedTreeRate << " evals/s ("
+                      << optimizedTreeRate / treeRate << "x)" << std::endl;
+            std::cout << "    compiled: " << compiledRate << " -> " << optimizedCompiledRate << " evals/s ("
+                      << optimizedCompiledRate / compiledRate << "x)" << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file bench_parallel.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "parallel_evaluation.h"
+#include "parser.h"
+
+// Times the callable once and returns items per second
+template <typename Run>
+static double itemsPerSecond(Run run, size_t items)
+{
+    auto start = std::chrono::steady_clock::now();
+    run();
+    auto stop = std::chrono::steady_clock::now();
+    return items / std::chrono::duration<double>(stop - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    // Worker counts double up to the number of hardware threads, or up to argv[1]
+    size_t maxWorkers = argc > 1 ? std::stoul(argv[1]) : std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+    const size_t rows = 1 << 22;
+    std::vector<double> x(rows), y(rows), out(rows), reference(rows);
+    for (size_t i = 0; i < rows; ++i)
+    {
+        x[i] = 1.0 + i * 1e-6;
+        y[i] = 2.0 - i * 1e-7;
+    }
+    const double *columns[] = {x.data(), y.data()};
+
+    Parser parser;
+    CompiledExpression formula = parser.compile("sin(x) * cos(y) + ln(x) * sqrt(y) - x^2 / (y + 1)", {"x", "y"});
+    std::vector<CompiledExpression> expressions;
+    for (int i = 0; i < 20000; ++i)
+        expressions.push_back(parser.compile("sin(x + " + std::to_string(i) + ") * cos(y) + ln(x + 1) * sqrt(y)", {"x", "y"}));
+
+    formula.evaluateBatch(columns, rows, reference.data());
+    std::vector<double> values = {1.5, 2.5};
+    std::vector<double> results(expressions.size());
+
+    std::cout << "hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+    std::cout << "workers\trows/s\tspeedup\tefficiency\texpressions/s\tspeedup\tidentical" << std::endl;
+
+    double baseRows = 0, baseExpressions = 0;
+    for (size_t workers = 1; workers <= maxWorkers; workers *= 2)
+    {
+        ThreadPool pool(workers, true);
+        // The vector kernels, as the single-threaded reference uses
+        double rowRate = itemsPerSecond([&] { evaluateBatchParallel(pool, formula, columns, rows, out.data(),
+                                                                   DefaultRowGrain, ErrorMode::Report,
+                                                                   simdKernels().level); }, rows);
+        double expressionRate = itemsPerSecond([&] {
+            for (int repeat = 0; repeat < 10; ++repeat)
+                evaluateEachParallel(pool, expressions, values, results.data());
+        }, 10 * expressions.size());
+        if (workers == 1)
+        {
+            baseRows = rowRate;
+            baseExpressions = expressionRate;
+        }
+
+        bool identical = true;
+        for (size_t i = 0; i < rows; ++i)
+            identical &= out[i] == reference[i];
+        sink = results[0];
+
+        std::cout << workers << '\t' << rowRate << '\t' << rowRate / baseRows << '\t' << rowRate / baseRows / workers << '\t'
+                  << expressionRate << '\t' << expressionRate / baseExpressions << '\t' << (identical ? "yes" : "no")
+                  << std::endl;
+    }
+
+    return 0;
+}
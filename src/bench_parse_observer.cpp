@@ -0,0 +1,61 @@
+/**
+ * @file bench_parse_observer.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * Build once as is and once with -DMATHPARSER_PARSE_OBSERVER to see what the
+ * hooks cost when they are compiled in, and what each observer adds.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "parser.h"
+
+// Keeps the parses from being optimized away
+volatile size_t sink;
+
+namespace
+{
+    double nanosecondsPerParse(Parser &parser, const std::string &expression)
+    {
+        const int iterations = 200000;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            sink = parser.parseFlat(expression, {"x", "y"}).size();
+        }
+        auto stop = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(stop - start).count() / iterations;
+    }
+}
+
+int main()
+{
+    Parser parser;
+    std::string expression = "sin(x) * cos(y) + ln(x + 1) * sqrt(y) - x^2 / (y + 1) + 3!";
+
+#ifdef MATHPARSER_PARSE_OBSERVER
+    std::cout << "hooks compiled in, no observer: " << nanosecondsPerParse(parser, expression) << " ns/parse" << std::endl;
+
+    ParseMetrics metrics;
+    parser.setObserver(&metrics);
+    std::cout << "metrics:                        " << nanosecondsPerParse(parser, expression) << " ns/parse" << std::endl;
+
+    std::ofstream devNull("/dev/null");
+    ParseTrace trace(devNull);
+    parser.setObserver(&trace);
+    std::cout << "token trace to /dev/null:       " << nanosecondsPerParse(parser, expression) << " ns/parse" << std::endl;
+    parser.setObserver(nullptr);
+
+    std::cout << std::endl;
+    metrics.snapshot().write(std::cout);
+#else
+    std::cout << "hooks compiled out:             " << nanosecondsPerParse(parser, expression) << " ns/parse" << std::endl;
+#endif
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file bench_parser.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "parser.h"
+
+// "((((1))))" with the given nesting depth
+static std::string nestedExpression(int depth)
+{
+    return std::string(depth, '(') + "1" + std::string(depth, ')');
+}
+
+// "1 + 2 * 3 - 4 / 5 + ..." with the given number of operands
+static std::string flatExpression(int operands)
+{
+    const char operators[] = {'+', '*', '-', '/'};
+    std::string expression = "1";
+    for (int i = 1; i < operands; ++i)
+    {
+        expression += ' ';
+        expression += operators[i % 4];
+        expression += ' ';
+        expression += std::to_string(i % 9 + 1);
+    }
+    return expression;
+}
+
+// Parses the expression repeatedly and returns the time per token in nanoseconds
+static double nanosecondsPerToken(Parser &parser, const std::string &expression)
+{
+    size_t tokenCount = parser.tokenize(expression).size();
+    int iterations = static_cast<int>(2000000 / tokenCount) + 1;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        NodePtr root = parser.parse(expression);
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(stop - start).count() / (static_cast<double>(iterations) * tokenCount);
+}
+
+int main()
+{
+    Parser parser;
+
+    const int sizes[] = {64, 256, 1024, 4096};
+    double nested[4];
+    double flat[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        nested[i] = nanosecondsPerToken(parser, nestedExpression(sizes[i]));
+        flat[i] = nanosecondsPerToken(parser, flatExpression(sizes[i]));
+    }
+
+    // Linear parsing shows up as a flat ns/token column while the size grows
+    std::cout << "size\tnested ns/token\tflat ns/token" << std::endl;
+    for (int i = 0; i < 4; ++i)
+    {
+        std::cout << sizes[i] << '\t' << nested[i] << '\t' << flat[i] << std::endl;
+    }
+
+    return 0;
+}
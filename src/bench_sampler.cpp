@@ -0,0 +1,194 @@
+/**
+ * @file bench_sampler.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "parser.h"
+#include "sampler.h"
+
+// Runs the callable a few times and returns the fastest run in milliseconds
+template <typename Run>
+static double bestMilliseconds(Run run, int repetitions = 5)
+{
+    double best = 1e300;
+    for (int i = 0; i < repetitions; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto stop = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(stop - start).count());
+    }
+    return best;
+}
+
+struct CurveCase
+{
+    std::string formula;
+    double a, b, yMin, yMax;
+};
+
+struct HeatmapCase
+{
+    std::string formula;
+    double x0, x1, y0, y1, zMin, zMax;
+};
+
+// Compares a curve with the dense grid of one sample per pixel column the plot
+// would otherwise use: the largest distance in pixels between the two, and the
+// dense points the adaptive curve leaves out (inside a gap at a pole or domain edge)
+static void curve(ThreadPool &pool, const CurveCase &test)
+{
+    Parser parser;
+    CompiledExpression expression = parser.compile(test.formula, {"x"});
+    CurveOptions options;
+    options.yMin = test.yMin;
+    options.yMax = test.yMax;
+
+    size_t n = options.width + 1;
+    std::vector<double> xs(n), ys(n);
+    for (size_t k = 0; k < n; ++k)
+        xs[k] = test.a + (test.b - test.a) * double(k) / double(options.width);
+    double pointTime = bestMilliseconds(
+        [&]
+        {
+            for (size_t k = 0; k < n; ++k)
+            {
+                double x = xs[k];
+                Result<double> y = expression.tryEvaluate(std::span<const double>(&x, 1));
+                ys[k] = y.valueOr(std::numeric_limits<double>::quiet_NaN());
+            }
+            sink = ys.back();
+        });
+    const double *column = xs.data();
+    double denseTime = bestMilliseconds(
+        [&]
+        {
+            expression.evaluateBatch(&column, n, ys.data(), ErrorMode::Propagate);
+            sink = ys.back();
+        });
+
+    Polyline adaptive;
+    double adaptiveTime = bestMilliseconds([&] { adaptive = sampleCurve(expression, test.a, test.b, options); });
+    options.pool = &pool;
+    double parallelTime = bestMilliseconds([&] { sink = sampleCurve(expression, test.a, test.b, options).y[0]; });
+
+    double scale = double(options.height) / (test.yMax - test.yMin);
+    auto pixel = [&](double y) { return (std::clamp(y, test.yMin, test.yMax) - test.yMin) * scale; };
+    double worst = 0;
+    size_t gaps = 0;
+    for (size_t k = 0; k < n; ++k)
+    {
+        if (!std::isfinite(ys[k]))
+            continue;
+        size_t right = std::lower_bound(adaptive.x.begin(), adaptive.x.end(), xs[k]) - adaptive.x.begin();
+        size_t left = right > 0 ? right - 1 : 0;
+        right = std::min(right, adaptive.x.size() - 1);
+        if (adaptive.x[right] - xs[k] < 1e-9 * (test.b - test.a))
+            left = right;
+        double ya = adaptive.y[left], yb = adaptive.y[right];
+        if (!std::isfinite(ya) || !std::isfinite(yb))
+        {
+            ++gaps;
+            continue;
+        }
+        double t = left == right ? 0 : (xs[k] - adaptive.x[left]) / (adaptive.x[right] - adaptive.x[left]);
+        worst = std::max(worst, std::abs(pixel(ya + t * (yb - ya)) - pixel(ys[k])));
+    }
+
+    std::cout << test.formula << '\t' << n << '\t' << adaptive.evaluations << '\t' << pointTime << '\t' << denseTime
+              << '\t' << adaptiveTime << '\t' << parallelTime << '\t' << worst << '\t' << gaps << std::endl;
+}
+
+// Compares a heatmap with the full evaluation of every pixel, as 8-bit colour levels
+static void heatmap(ThreadPool &pool, const HeatmapCase &test, size_t size)
+{
+    Parser parser;
+    CompiledExpression expression = parser.compile(test.formula, {"x", "y"});
+    HeatmapOptions options;
+    options.zMin = test.zMin;
+    options.zMax = test.zMax;
+
+    std::vector<double> xs(size * size), ys(size * size), dense(size * size);
+    for (size_t j = 0; j < size; ++j)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            xs[j * size + i] = test.x0 + (double(i) + 0.5) * (test.x1 - test.x0) / double(size);
+            ys[j * size + i] = test.y0 + (double(j) + 0.5) * (test.y1 - test.y0) / double(size);
+        }
+    }
+    const double *columns[] = {xs.data(), ys.data()};
+    double denseTime = bestMilliseconds(
+        [&]
+        {
+            expression.evaluateBatch(columns, dense.size(), dense.data(), ErrorMode::Propagate);
+            sink = dense.back();
+        }, 3);
+
+    // Both reuse their output buffer from one frame to the next, as the dense loop does
+    Heatmap adaptive, parallel;
+    double adaptiveTime = bestMilliseconds(
+        [&] { sampleHeatmap(expression, test.x0, test.x1, test.y0, test.y1, size, size, adaptive, options); }, 3);
+    options.pool = &pool;
+    double parallelTime = bestMilliseconds(
+        [&] { sampleHeatmap(expression, test.x0, test.x1, test.y0, test.y1, size, size, parallel, options); }, 3);
+
+    auto colour = [&](double z)
+    {
+        if (!std::isfinite(z))
+            return -1.0;
+        return std::min(std::floor((std::clamp(z, test.zMin, test.zMax) - test.zMin) * 256 / (test.zMax - test.zMin)),
+                        255.0);
+    };
+    double worst = 0;
+    size_t off = 0;
+    for (size_t k = 0; k < dense.size(); ++k)
+    {
+        double difference = std::abs(colour(dense[k]) - colour(adaptive.values[k]));
+        worst = std::max(worst, difference);
+        off += difference > 1;
+    }
+
+    std::cout << test.formula << '\t' << dense.size() << '\t' << adaptive.evaluations << '\t' << denseTime << '\t'
+              << adaptiveTime << '\t' << parallelTime << '\t' << worst << '\t' << off << std::endl;
+}
+
+int main()
+{
+    ThreadPool pool;
+
+    std::cout << "curve, 1024 x 600 pixels" << std::endl;
+    std::cout << "formula\tdense points\tadaptive points\tpoint by point ms\tdense batch ms\tadaptive ms\t"
+              << "adaptive parallel ms\tmax px off\tdense points in gaps" << std::endl;
+    for (const CurveCase &test : std::vector<CurveCase>{{"sin(x) + 0.3 * cos(7 * x)", -10, 10, -1.5, 1.5},
+                                                         {"x^3 - 2 * x", -2, 2, -5, 5},
+                                                         {"1 / (1 + 25 * x^2)", -1, 1, 0, 1.1},
+                                                         {"tan(x)", -6, 6, -10, 10},
+                                                         {"cot(x) * x", -9, 9, -20, 20},
+                                                         {"sqrt(4 - x^2)", -3, 3, 0, 2.5},
+                                                         {"ln(x) * x", -1, 3, -1, 3.5},
+                                                         {"sin(1 / x)", -1, 1, -1.2, 1.2}})
+        curve(pool, test);
+
+    std::cout << "heatmap, 512 x 512 pixels, 256 levels" << std::endl;
+    std::cout << "formula\tdense pixels\tadaptive evaluations\tdense ms\tadaptive ms\tadaptive parallel ms\t"
+              << "max levels off\tpixels off by more than 1" << std::endl;
+    for (const HeatmapCase &test : std::vector<HeatmapCase>{{"sin(x) * cos(y)", -5, 5, -5, 5, -1, 1},
+                                                             {"x^2 - y^2", -2, 2, -2, 2, -4, 4},
+                                                             {"sin(x * y)", -4, 4, -4, 4, -1, 1},
+                                                             {"sqrt(1 - x^2 - y^2)", -1.2, 1.2, -1.2, 1.2, 0, 1},
+                                                             {"tan(x + y)", -3, 3, -3, 3, -5, 5},
+                                                             {"1 / ((x - 0.5)^2 + y^2 + 0.05)", -2, 2, -2, 2, 0, 20}})
+        heatmap(pool, test, 512);
+    return 0;
+}
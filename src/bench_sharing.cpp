@@ -0,0 +1,98 @@
+/**
+ * @file bench_sharing.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "parser.h"
+
+namespace
+{
+    const int Evaluations = 1000000;
+    const int Parses = 20000;
+
+    template <typename Evaluate>
+    double evaluationRate(Evaluate evaluate)
+    {
+        double values[2] = {0.0, 0.75};
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < Evaluations; ++i)
+        {
+            values[0] = i * 1e-6;
+            sink = evaluate(values);
+        }
+        auto stop = std::chrono::steady_clock::now();
+        return Evaluations / std::chrono::duration<double>(stop - start).count();
+    }
+
+    double parseRate(Parser &parser, const std::string &source, const std::vector<std::string> &variableNames)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < Parses; ++i)
+        {
+            sink = parser.parseFlat(source, variableNames).size();
+        }
+        auto stop = std::chrono::steady_clock::now();
+        return Parses / std::chrono::duration<double>(stop - start).count();
+    }
+}
+
+int main()
+{
+    Parser parser;
+    std::vector<std::string> variableNames = {"x", "y"};
+
+    // A sum of terms that all reuse the same few subexpressions
+    std::string generated = "0";
+    for (int i = 1; i <= 12; ++i)
+    {
+        generated += " + sin(x * y) * cos(x - y) ^ " + std::to_string(i % 4 + 1) + " / sqrt(1 + x * x + y * y)";
+    }
+    std::vector<std::string> expressions = {
+        "sin(x * y) + cos(x * y) * sin(x * y)",
+        "sqrt(x * x + y * y) / (1 + sqrt(x * x + y * y)) + ln(1 + sqrt(x * x + y * y))",
+        "tanh(x + y) * (1 - tanh(x + y) ^ 2) + sech(x + y) * tanh(x + y)",
+        generated};
+
+    for (const auto &source : expressions)
+    {
+        parser.setInterning(false);
+        double plainParseRate = parseRate(parser, source, variableNames);
+        FlatExpression plainFlat = parser.parseFlat(source, variableNames);
+        CompiledExpression plain = parser.compile(source, variableNames);
+        parser.setInterning(true);
+        double sharedParseRate = parseRate(parser, source, variableNames);
+        FlatExpression sharedFlat = parser.parseFlat(source, variableNames);
+        InternStats stats = parser.internStats();
+        CompiledExpression shared = parser.compile(source, variableNames);
+
+        std::vector<double> scratch;
+        double plainFlatRate = evaluationRate([&](const double *values)
+                                              { return plainFlat.evaluateWith(scratch, {values, 2}); });
+        double sharedFlatRate = evaluationRate([&](const double *values)
+                                               { return sharedFlat.evaluateWith(scratch, {values, 2}); });
+        double plainRate = evaluationRate([&](const double *values)
+                                          { return plain.evaluate({values, 2}); });
+        double sharedRate = evaluationRate([&](const double *values)
+                                           { return shared.evaluate({values, 2}); });
+
+        std::cout << (source.size() > 80 ? source.substr(0, 77) + "..." : source) << std::endl;
+        std::cout << "  nodes:    " << stats.nodes << " -> " << stats.nodes - stats.duplicateHits << " ("
+                  << stats.duplicateHits << " duplicate hits, " << shared.program().localCount() << " shared values)"
+                  << std::endl;
+        std::cout << "  parse:    " << plainParseRate << " -> " << sharedParseRate << " parses/s" << std::endl;
+        std::cout << "  flat:     " << plainFlatRate << " -> " << sharedFlatRate << " evals/s ("
+                  << sharedFlatRate / plainFlatRate << "x)" << std::endl;
+        std::cout << "  compiled: " << plainRate << " -> " << sharedRate << " evals/s (" << sharedRate / plainRate
+                  << "x)" << std::endl;
+    }
+
+    return 0;
+}
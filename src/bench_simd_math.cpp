@@ -0,0 +1,118 @@
+/**
+ * @file bench_simd_math.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "simd_math.h"
+
+struct Function
+{
+    std::string name;
+    UnaryKernel SimdKernels::*unary;
+    BinaryKernel SimdKernels::*binary;
+    long double (*reference)(long double, long double);
+    double low, high;
+    bool logarithmic; // arguments spread as 2^u with u in [low, high)
+};
+
+// Distance of result from the reference in units of the last place of the result
+static double ulpError(double result, long double reference)
+{
+    if (std::isnan(result) || std::isnan(reference))
+        return std::isnan(result) == std::isnan(static_cast<double>(reference)) ? 0 : INFINITY;
+    double rounded = static_cast<double>(reference);
+    if (std::isinf(rounded) || std::isinf(result))
+        return result == rounded ? 0 : INFINITY;
+    double ulp = std::nextafter(std::fabs(rounded), INFINITY) - std::fabs(rounded);
+    return static_cast<double>(std::fabs(static_cast<long double>(result) - reference) / ulp);
+}
+
+// Times the kernel over the first values of x and y, which stay in cache so the
+// memory bandwidth does not hide the kernel. Returns values per second.
+static double valuesPerSecond(const SimdKernels &kernels, const Function &function, const std::vector<double> &x,
+                              const std::vector<double> &y, std::vector<double> &out)
+{
+    const size_t block = 4096;
+    const int repeats = 5000;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r)
+    {
+        if (function.unary != nullptr)
+            (kernels.*function.unary)(x.data(), out.data(), block);
+        else
+            (kernels.*function.binary)(x.data(), y.data(), out.data(), block);
+    }
+    auto stop = std::chrono::steady_clock::now();
+    sink = out[block / 2];
+    return repeats * block / std::chrono::duration<double>(stop - start).count();
+}
+
+int main()
+{
+    const size_t count = 1 << 21;
+    std::vector<Function> functions = {
+        {"exp", &SimdKernels::exp, nullptr, [](long double v, long double) { return expl(v); }, -745, 710, false},
+        {"ln", &SimdKernels::ln, nullptr, [](long double v, long double) { return logl(v); }, -1074, 1024, true},
+        {"log10", &SimdKernels::log10, nullptr, [](long double v, long double) { return log10l(v); }, -1074, 1024, true},
+        {"sin", &SimdKernels::sin, nullptr, [](long double v, long double) { return sinl(v); }, -1e5, 1e5, false},
+        {"sin small", &SimdKernels::sin, nullptr, [](long double v, long double) { return sinl(v); }, -4, 4, false},
+        {"cos", &SimdKernels::cos, nullptr, [](long double v, long double) { return cosl(v); }, -1e5, 1e5, false},
+        {"cos small", &SimdKernels::cos, nullptr, [](long double v, long double) { return cosl(v); }, -4, 4, false},
+        {"tan", &SimdKernels::tan, nullptr, [](long double v, long double) { return tanl(v); }, -1e5, 1e5, false},
+        {"sinh", &SimdKernels::sinh, nullptr, [](long double v, long double) { return sinhl(v); }, -711, 711, false},
+        {"sinh small", &SimdKernels::sinh, nullptr, [](long double v, long double) { return sinhl(v); }, -2, 2, false},
+        {"cosh", &SimdKernels::cosh, nullptr, [](long double v, long double) { return coshl(v); }, -711, 711, false},
+        {"tanh", &SimdKernels::tanh, nullptr, [](long double v, long double) { return tanhl(v); }, -20, 20, false},
+        {"tanh small", &SimdKernels::tanh, nullptr, [](long double v, long double) { return tanhl(v); }, -2, 2, false},
+        {"pow", nullptr, &SimdKernels::pow, [](long double a, long double b) { return powl(a, b); }, -30, 30, true},
+    };
+
+    std::mt19937_64 random(42);
+    std::vector<double> x(count), y(count), out(count);
+    SimdLevel best = detectSimdLevel();
+    std::cout << "detected: " << simdLevelName(best) << std::endl;
+    std::cout << "function\tlevel\tvalues/s\tspeedup\tmax ULP" << std::endl;
+
+    for (const auto &function : functions)
+    {
+        std::uniform_real_distribution<double> argument(function.low, function.high);
+        std::uniform_real_distribution<double> exponent(-40, 40);
+        for (size_t i = 0; i < count; ++i)
+        {
+            x[i] = function.logarithmic ? std::exp2(argument(random)) : argument(random);
+            y[i] = exponent(random);
+        }
+
+        double scalarRate = 0;
+        for (int level = 0; level <= static_cast<int>(best); ++level)
+        {
+            const SimdKernels &kernels = simdKernels(static_cast<SimdLevel>(level));
+            double rate = valuesPerSecond(kernels, function, x, y, out);
+            if (level == 0)
+                scalarRate = rate;
+
+            if (function.unary != nullptr)
+                (kernels.*function.unary)(x.data(), out.data(), count);
+            else
+                (kernels.*function.binary)(x.data(), y.data(), out.data(), count);
+            double maxError = 0;
+            for (size_t i = 0; i < count; ++i)
+                maxError = std::max(maxError, ulpError(out[i], function.reference(x[i], y[i])));
+
+            std::cout << function.name << '\t' << simdLevelName(kernels.level) << '\t' << rate << '\t'
+                      << rate / scalarRate << '\t' << maxError << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file bench_static_expression.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "native_expression.h"
+#include "parser.h"
+#include "static_expression.h"
+
+// Times one formula through the tree, the bytecode, native code and the compile-time parse
+template <typename Formula>
+static void measure(Parser &parser)
+{
+    std::string source(Formula::source());
+    std::vector<std::string> names = {"x", "y", "z"};
+    NodePtr tree = parser.parse(source, names);
+    CompiledExpression compiled = parser.compile(source, names);
+    NativeExpression native(compiled);
+
+    // Volatile inputs stop the compiler from folding the static formula into a constant
+    volatile double x = 0.7, y = 1.3, z = 2.1;
+    std::vector<double> values = {x, y, z};
+    int iterations = static_cast<int>(20000000 / Formula::nodeCount());
+    double treeRate = evaluationsPerSecond([&] { return tree->evaluate(values); }, iterations);
+    double bytecodeRate = evaluationsPerSecond([&] { return compiled.evaluate(values); }, iterations);
+    double nativeRate = evaluationsPerSecond([&] { return native.evaluate(values); }, iterations);
+    double staticRate = evaluationsPerSecond([&] { return Formula()(x, y, z); }, iterations);
+
+    std::cout << Formula::nodeCount() << '\t' << treeRate << '\t' << bytecodeRate << '\t' << nativeRate << '\t' << staticRate
+              << '\t' << staticRate / treeRate << std::endl;
+}
+
+int main()
+{
+    Parser parser;
+    std::cout << "nodes\ttree evals/s\tbytecode evals/s\tnative evals/s\tstatic evals/s\tstatic / tree" << std::endl;
+
+    measure<StaticExpression<"x + y", "x", "y", "z">>(parser);
+    measure<StaticExpression<"(x + 3.2) * 2 - y / (1.2 * z)", "x", "y", "z">>(parser);
+    measure<StaticExpression<"x^2 + y * z - x * y / (z + 1) + (x - y) * (y - z)", "x", "y", "z">>(parser);
+    measure<StaticExpression<"sinh(x) + cosh(y) * tanh(z) - coth(x) / sech(y) + csch(z)", "x", "y", "z">>(parser);
+    measure<StaticExpression<"sin(x) * cos(y) + tan(z) - cot(x) + ln(y) + log(z) + sqrt(x) + y^-0.5 + 5!", "x", "y", "z">>(
+        parser);
+    measure<StaticExpression<"sin(x * y) + cos(x * y) * sin(x * y) - sqrt(x * y + z)", "x", "y", "z">>(parser);
+
+    return 0;
+}
@@ -0,0 +1,309 @@
+/**
+ * @file bench_suite.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * Measures tokenize, build and evaluate separately on the generated corpus
+ * (corpus.h) and inverse2x2Matrix on generated matrices. Prints a table and,
+ * with --json=FILE, writes the results for comparing builds and releases.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "corpus.h"
+#include "math_module.h"
+#include "native_expression.h"
+#include "parser.h"
+#include "simd_math.h"
+
+// Every heap allocation in the process goes through here, so we can count them
+static size_t allocationCount = 0;
+
+void *operator new(std::size_t size)
+{
+    ++allocationCount;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+    struct Options
+    {
+        std::string jsonPath;
+        std::string filter; // only run benchmarks whose "corpus/stage" contains this
+        double minTime = 0.1; // seconds per repetition
+        int repetitions = 5;
+        size_t count = 64; // formulas per set
+        size_t size = 24;  // typical terms, calls or nesting depth per formula
+        uint64_t seed = 2023;
+    };
+
+    struct Measurement
+    {
+        std::string corpus;
+        std::string stage;
+        double nanosecondsPerOp;   // median of the repetitions
+        double allocationsPerOp;
+        double opsPerSecond;
+        double bytesPerSecond;     // source text processed; 0 for evaluation
+    };
+
+    // Runs pass (ops operations over bytes bytes of source) repeatedly: first to
+    // find how many passes fill minTime, then repetitions times with that count
+    template <typename Pass>
+    Measurement measure(const Options &options, const std::string &corpus, const std::string &stage, size_t ops,
+                        size_t bytes, Pass pass)
+    {
+        using Clock = std::chrono::steady_clock;
+        auto timePasses = [&](size_t passes)
+        {
+            auto start = Clock::now();
+            for (size_t i = 0; i < passes; ++i)
+                pass();
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        };
+
+        pass(); // warm up: buffers grow to their final size once
+        size_t passes = 1;
+        while (timePasses(passes) < options.minTime && passes < (size_t(1) << 30))
+            passes *= 2;
+
+        std::vector<double> times;
+        times.reserve(options.repetitions);
+        size_t allocationsBefore = allocationCount;
+        for (int i = 0; i < options.repetitions; ++i)
+            times.push_back(timePasses(passes));
+        size_t allocations = allocationCount - allocationsBefore;
+        std::sort(times.begin(), times.end());
+
+        double operations = double(ops) * passes;
+        double seconds = times[times.size() / 2];
+        return {corpus,
+                stage,
+                seconds * 1e9 / operations,
+                allocations / (operations * options.repetitions),
+                operations / seconds,
+                double(bytes) * passes / seconds};
+    }
+
+    std::string jsonString(const std::string &text)
+    {
+        std::string quoted = "\"";
+        for (char ch : text)
+        {
+            if (ch == '"' || ch == '\\')
+                quoted += '\\';
+            if (static_cast<unsigned char>(ch) >= 0x20)
+                quoted += ch;
+        }
+        return quoted + "\"";
+    }
+
+    void writeJson(std::ostream &out, const Options &options, const std::vector<Measurement> &measurements)
+    {
+        out << std::setprecision(9);
+        out << "{\n";
+        out << "  \"context\": {\n";
+#ifdef __VERSION__
+        out << "    \"compiler\": " << jsonString(__VERSION__) << ",\n";
+#endif
+        out << "    \"simd\": " << jsonString(simdLevelName(simdKernels().level)) << ",\n";
+        out << "    \"seed\": " << options.seed << ",\n";
+        out << "    \"formulas_per_set\": " << options.count << ",\n";
+        out << "    \"formula_size\": " << options.size << ",\n";
+        out << "    \"min_time\": " << options.minTime << ",\n";
+        out << "    \"repetitions\": " << options.repetitions << "\n";
+        out << "  },\n";
+        out << "  \"benchmarks\": [";
+        for (size_t i = 0; i < measurements.size(); ++i)
+        {
+            const Measurement &m = measurements[i];
+            out << (i == 0 ? "\n" : ",\n");
+            out << "    {\"corpus\": " << jsonString(m.corpus) << ", \"stage\": " << jsonString(m.stage)
+                << ", \"ns_per_op\": " << m.nanosecondsPerOp << ", \"allocations_per_op\": " << m.allocationsPerOp
+                << ", \"ops_per_second\": " << m.opsPerSecond << ", \"bytes_per_second\": " << m.bytesPerSecond
+                << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    bool parseOptions(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string argument = argv[i];
+            size_t equals = argument.find('=');
+            std::string name = argument.substr(0, equals);
+            std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+            if (value.empty())
+                return false;
+            if (name == "--json")
+                options.jsonPath = value;
+            else if (name == "--filter")
+                options.filter = value;
+            else if (name == "--min-time")
+                options.minTime = std::stod(value);
+            else if (name == "--repetitions")
+                options.repetitions = std::max(1, std::stoi(value));
+            else if (name == "--count")
+                options.count = std::max<size_t>(1, std::stoul(value));
+            else if (name == "--size")
+                options.size = std::max<size_t>(1, std::stoul(value));
+            else if (name == "--seed")
+                options.seed = std::stoull(value);
+            else
+                return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--json=FILE] [--filter=TEXT] [--min-time=SECONDS] [--repetitions=N] [--count=N] [--size=N]"
+                     " [--seed=N]"
+                  << std::endl;
+        return 1;
+    }
+
+    CorpusGenerator generator(options.seed);
+    const std::vector<std::string> &variableNames = CorpusGenerator::variableNames();
+    const std::vector<double> &variableValues = CorpusGenerator::variableValues();
+    Parser parser;
+
+    std::vector<Measurement> measurements;
+    auto selected = [&](const std::string &corpus, const std::string &stage)
+    {
+        return (corpus + "/" + stage).find(options.filter) != std::string::npos;
+    };
+
+    for (const FormulaSet &set : generator.formulaSets(options.count, options.size))
+    {
+        const std::vector<std::string> &formulas = set.formulas;
+        size_t bytes = 0;
+        for (const auto &formula : formulas)
+            bytes += formula.size();
+
+        if (selected(set.name, "tokenize"))
+        {
+            measurements.push_back(measure(options, set.name, "tokenize", formulas.size(), bytes, [&]
+                                           {
+                                               for (const auto &formula : formulas)
+                                                   sink = parser.tokenize(formula).size();
+                                           }));
+        }
+
+        if (selected(set.name, "buildTree"))
+        {
+            std::vector<std::vector<Token>> tokens;
+            for (const auto &formula : formulas)
+                tokens.push_back(parser.tokenize(formula));
+            measurements.push_back(measure(options, set.name, "buildTree", formulas.size(), bytes, [&]
+                                           {
+                                               for (size_t i = 0; i < formulas.size(); ++i)
+                                                   sink = parser.build(formulas[i], tokens[i], variableNames).size();
+                                           }));
+        }
+
+        if (selected(set.name, "evaluate") || selected(set.name, "evaluate_compiled") ||
+            selected(set.name, "evaluate_native"))
+        {
+            std::vector<NodePtr> trees;
+            std::vector<CompiledExpression> programs;
+            std::vector<NativeExpression> natives;
+            for (const auto &formula : formulas)
+            {
+                trees.push_back(parser.parse(formula, variableNames));
+                programs.push_back(parser.compile(formula, variableNames));
+                natives.emplace_back(programs.back());
+            }
+            if (selected(set.name, "evaluate"))
+            {
+                measurements.push_back(measure(options, set.name, "evaluate", trees.size(), 0, [&]
+                                               {
+                                                   for (const auto &tree : trees)
+                                                       sink = tree->evaluate(variableValues);
+                                               }));
+            }
+            if (selected(set.name, "evaluate_compiled"))
+            {
+                measurements.push_back(measure(options, set.name, "evaluate_compiled", programs.size(), 0, [&]
+                                               {
+                                                   for (const auto &program : programs)
+                                                       sink = program.evaluate(variableValues);
+                                               }));
+            }
+            if (selected(set.name, "evaluate_native"))
+            {
+                measurements.push_back(measure(options, set.name, "evaluate_native", natives.size(), 0, [&]
+                                               {
+                                                   for (const auto &native : natives)
+                                                       sink = native.evaluate(variableValues);
+                                               }));
+            }
+        }
+    }
+
+    if (selected("matrix_2x2", "inverse2x2Matrix"))
+    {
+        std::vector<std::vector<std::vector<double>>> matrices;
+        for (size_t i = 0; i < options.count; ++i)
+            matrices.push_back(generator.invertibleMatrix());
+        measurements.push_back(measure(options, "matrix_2x2", "inverse2x2Matrix", matrices.size(), 0, [&]
+                                       {
+                                           for (const auto &matrix : matrices)
+                                               sink = inverse2x2Matrix(matrix)[0][0];
+                                       }));
+    }
+
+    std::cout << std::left << std::setw(18) << "corpus" << std::setw(20) << "stage" << std::right << std::setw(12)
+              << "ns/op" << std::setw(12) << "allocs/op" << std::setw(14) << "ops/s" << std::setw(10) << "MB/s"
+              << std::endl;
+    std::cout << std::fixed;
+    for (const Measurement &m : measurements)
+    {
+        std::cout << std::left << std::setw(18) << m.corpus << std::setw(20) << m.stage << std::right
+                  << std::setprecision(1) << std::setw(12) << m.nanosecondsPerOp << std::setprecision(2)
+                  << std::setw(12) << m.allocationsPerOp << std::setprecision(0) << std::setw(14) << m.opsPerSecond
+                  << std::setprecision(1) << std::setw(10) << m.bytesPerSecond / 1e6 << std::endl;
+    }
+
+    if (!options.jsonPath.empty())
+    {
+        std::ofstream json(options.jsonPath);
+        writeJson(json, options, measurements);
+        if (!json)
+        {
+            std::cerr << "Could not write " << options.jsonPath << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
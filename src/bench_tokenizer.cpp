@@ -0,0 +1,89 @@
+/**
+ * @file bench_tokenizer.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include "parser.h"
+
+// Every heap allocation in the process goes through here, so we can count them
+static size_t allocationCount = 0;
+
+void *operator new(std::size_t size)
+{
+    ++allocationCount;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+int main()
+{
+    std::vector<std::string> corpus = {
+        "3.5 + 4.5",
+        "(3.5 + 3.2) * 2 - 4.2 / (1.2 * 2.3)",
+        "sinh(1) + cosh(1) * tanh(1) - coth(1) / sech(1) + csch(1)",
+        "sin(0.5) * cos(0.25) + tan(0.125) - cot(1.5708)",
+        "ln(2.71) + log(100) + sqrt(144) + 2^-0.5 + 5!",
+        "1e-5 * 2.5E2 + 6.02214076e23 / 1.380649e-23",
+    };
+
+    // One long expression on top of the short ones
+    std::string flat = "1";
+    for (int i = 0; i < 1000; ++i)
+    {
+        flat += " + 1.25e1 * 3";
+    }
+    corpus.push_back(flat);
+
+    Parser parser;
+
+    // Warm up: the token buffer grows to its largest size once
+    for (const auto &expression : corpus)
+    {
+        parser.tokenize(expression);
+    }
+
+    const int iterations = 2000;
+    size_t tokenCount = 0;
+    size_t allocationsBefore = allocationCount;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        for (const auto &expression : corpus)
+        {
+            tokenCount += parser.tokenize(expression).size();
+        }
+    }
+
+    auto stop = std::chrono::steady_clock::now();
+    size_t allocations = allocationCount - allocationsBefore;
+    double nanoseconds = std::chrono::duration<double, std::nano>(stop - start).count();
+
+    std::cout << "tokens:            " << tokenCount << std::endl;
+    std::cout << "ns/token:          " << nanoseconds / tokenCount << std::endl;
+    std::cout << "tokens/s:          " << tokenCount / (nanoseconds * 1e-9) << std::endl;
+    std::cout << "allocations:       " << allocations << std::endl;
+    std::cout << "allocations/token: " << static_cast<double>(allocations) / tokenCount << std::endl;
+
+    return allocations == 0 ? 0 : 1;
+}
@@ -0,0 +1,45 @@
+/**
+ * @file bench_util.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * Helpers shared by the bench_* programs.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <chrono>
+
+// Benchmarks store their results here, which keeps the work from being optimized away
+inline volatile double sink;
+
+// Runs the callable repeatedly and returns the nanoseconds per call
+template <typename Run>
+double nanosecondsPerCall(Run run, int iterations)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        sink = run();
+    }
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / iterations;
+}
+
+// Runs the callable repeatedly and returns evaluations per second
+template <typename Evaluate>
+double evaluationsPerSecond(Evaluate evaluate, int iterations)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        sink = evaluate();
+    }
+    auto stop = std::chrono::steady_clock::now();
+    return iterations / std::chrono::duration<double>(stop - start).count();
+}
+
+#endif
@@ -0,0 +1,586 @@
+/**
+ * @file bytecode.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "bytecode.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+// Values (8 MB) that the stack of chunks of evaluateRows may take up
+constexpr size_t BatchStackBudget = size_t(1) << 20;
+
+struct Bytecode::SharedValues
+{
+    // Keyed by Node or FlatNode address; leaves are not counted, pushing them again is as cheap as a Load
+    std::unordered_map<const void *, uint32_t> uses;
+    std::unordered_map<const void *, uint32_t> locals;
+};
+
+namespace
+{
+    bool isLeaf(OpCode op)
+    {
+        return op == OpCode::Constant || op == OpCode::Variable;
+    }
+
+    // Counts the parents of every operation node; a shared subtree is walked only once
+    void countUses(const Node &root, std::unordered_map<const void *, uint32_t> &uses)
+    {
+        std::vector<const Node *> pending = {&root};
+        while (!pending.empty())
+        {
+            const Node &node = *pending.back();
+            pending.pop_back();
+            for (size_t i = 0; i < node.operandCount(); ++i)
+            {
+                const Node &operand = *node.operand(i);
+                if (!isLeaf(operand.opcode()) && ++uses[&operand] == 1)
+                    pending.push_back(&operand);
+            }
+        }
+    }
+}
+
+Bytecode Bytecode::compile(const NodePtr &root)
+{
+    Bytecode program;
+    SharedValues shared;
+    countUses(*root, shared.uses);
+    program.emitTree(*root, shared);
+    return program;
+}
+
+Bytecode Bytecode::compile(const FlatExpression &expression)
+{
+    const uint32_t root = static_cast<uint32_t>(expression.size() - 1);
+    return compile(expression, std::span<const uint32_t>(&root, 1));
+}
+
+Bytecode Bytecode::compile(const FlatExpression &expression, std::span<const uint32_t> roots)
+{
+    Bytecode program;
+    SharedValues shared;
+    const std::vector<FlatNode> &nodes = expression.nodes();
+    for (const FlatNode &node : nodes)
+    {
+        int arity = opcodeArity(node.op);
+        if (arity >= 1 && !isLeaf(nodes[node.operands.left].op))
+            ++shared.uses[&nodes[node.operands.left]];
+        if (arity == 2 && !isLeaf(nodes[node.operands.right].op))
+            ++shared.uses[&nodes[node.operands.right]];
+    }
+
+    // Every output is a use too, so a root that is also an operand, or a root of
+    // several outputs, is stored when it is computed
+    if (roots.size() > 1)
+    {
+        for (uint32_t root : roots)
+        {
+            if (!isLeaf(nodes[root].op))
+                ++shared.uses[&nodes[root]];
+        }
+    }
+    for (uint32_t root : roots)
+        program.emitFlat(expression, root, shared);
+    return program;
+}
+
+Bytecode Bytecode::fromView(const BytecodeView &view)
+{
+    Bytecode program;
+    program.code_.assign(view.code().begin(), view.code().end());
+    program.constants_.assign(view.constants().begin(), view.constants().end());
+    program.slots_.assign(view.slots().begin(), view.slots().end());
+    program.locals_.assign(view.locals().begin(), view.locals().end());
+    program.variableCount_ = view.variableCount();
+    program.localCount_ = view.localCount();
+    program.depth_ = 1;
+    program.maxStackDepth_ = view.maxStackDepth();
+    return program;
+}
+
+void Bytecode::emit(OpCode op)
+{
+    code_.push_back(op);
+
+    // An operation pops its operands and pushes one result
+    depth_ = depth_ - opcodeArity(op) + 1;
+    if (depth_ > maxStackDepth_)
+    {
+        maxStackDepth_ = depth_;
+    }
+}
+
+void Bytecode::emitConstant(double value)
+{
+    constants_.push_back(value);
+    emit(OpCode::Constant);
+}
+
+void Bytecode::emitVariable(uint32_t slot)
+{
+    slots_.push_back(slot);
+    if (slot >= variableCount_)
+    {
+        variableCount_ = slot + 1;
+    }
+    emit(OpCode::Variable);
+}
+
+bool Bytecode::emitLoad(const void *node, SharedValues &shared)
+{
+    auto local = shared.locals.find(node);
+    if (local == shared.locals.end())
+        return false;
+
+    locals_.push_back(local->second);
+    emit(OpCode::Load);
+    return true;
+}
+
+void Bytecode::emitStore(const void *node, SharedValues &shared)
+{
+    auto uses = shared.uses.find(node);
+    if (uses == shared.uses.end() || uses->second < 2)
+        return;
+
+    uint32_t local = static_cast<uint32_t>(localCount_++);
+    shared.locals.emplace(node, local);
+    locals_.push_back(local);
+    emit(OpCode::Store);
+}
+
+// Both emitters walk with an explicit stack, so the depth of the expression is
+// not limited by the call stack. Each frame is a node whose operands are being
+// emitted, with the number emitted so far.
+
+void Bytecode::emitTree(const Node &root, SharedValues &shared)
+{
+    struct Frame
+    {
+        const Node *node;
+        size_t done;
+    };
+    std::vector<Frame> frames = {{&root, 0}};
+
+    while (!frames.empty())
+    {
+        Frame &frame = frames.back();
+        const Node &node = *frame.node;
+        if (frame.done == 0)
+        {
+            if (node.opcode() == OpCode::Constant)
+            {
+                emitConstant(static_cast<const ConstantNode &>(node).value());
+                frames.pop_back();
+                continue;
+            }
+            if (node.opcode() == OpCode::Variable)
+            {
+                emitVariable(static_cast<uint32_t>(static_cast<const VariableNode &>(node).slot()));
+                frames.pop_back();
+                continue;
+            }
+            if (emitLoad(&node, shared))
+            {
+                frames.pop_back();
+                continue;
+            }
+        }
+
+        if (frame.done < node.operandCount())
+        {
+            const Node *operand = node.operand(frame.done++).get();
+            frames.push_back({operand, 0});
+            continue;
+        }
+        emit(node.opcode());
+        emitStore(&node, shared);
+        frames.pop_back();
+    }
+}
+
+void Bytecode::emitFlat(const FlatExpression &expression, uint32_t root, SharedValues &shared)
+{
+    struct Frame
+    {
+        uint32_t index;
+        int done;
+    };
+    std::vector<Frame> frames = {{root, 0}};
+
+    while (!frames.empty())
+    {
+        Frame &frame = frames.back();
+        const FlatNode &node = expression.nodes()[frame.index];
+        if (frame.done == 0)
+        {
+            if (node.op == OpCode::Constant)
+            {
+                emitConstant(node.value);
+                frames.pop_back();
+                continue;
+            }
+            if (node.op == OpCode::Variable)
+            {
+                emitVariable(node.operands.left);
+                frames.pop_back();
+                continue;
+            }
+            if (emitLoad(&node, shared))
+            {
+                frames.pop_back();
+                continue;
+            }
+        }
+
+        if (frame.done < opcodeArity(node.op))
+        {
+            uint32_t operand = frame.done++ == 0 ? node.operands.left : node.operands.right;
+            frames.push_back({operand, 0});
+            continue;
+        }
+        emit(node.op);
+        emitStore(&node, shared);
+        frames.pop_back();
+    }
+}
+
+void BytecodeView::checkVariables(size_t count) const
+{
+    if (count < variableCount_)
+    {
+        throw std::out_of_range("Expected " + std::to_string(variableCount_) + " variable values, got " +
+                                std::to_string(count));
+    }
+}
+
+void BytecodeView::checkColumns(const double *const *columns) const
+{
+    if (columns == nullptr && variableCount_ > 0)
+    {
+        throw std::out_of_range("Expected " + std::to_string(variableCount_) + " variable columns, got none");
+    }
+}
+
+double BytecodeView::evaluate(std::span<const double> variables) const
+{
+    // Checked once here so the loop can read variables unchecked
+    checkVariables(variables.size());
+
+    // Small programs run on a stack array, with the locals after the stack; deep ones need a heap buffer
+    const size_t localDepth = 64;
+    if (maxStackDepth_ + localCount_ <= localDepth)
+    {
+        double stack[localDepth];
+        return run(stack, stack + maxStackDepth_, variables.data());
+    }
+
+    std::vector<double> stack(maxStackDepth_ + localCount_);
+    return run(stack.data(), stack.data() + maxStackDepth_, variables.data());
+}
+
+void BytecodeView::evaluateOutputs(std::span<const double> variables, std::span<double> out) const
+{
+    checkVariables(variables.size());
+    if (out.empty())
+        return;
+
+    // Every output waits on the stack until the end, so the array is larger than evaluate's
+    const size_t localDepth = 256;
+    double buffer[localDepth];
+    std::vector<double> heap;
+    double *stack = buffer;
+    if (maxStackDepth_ + localCount_ > localDepth)
+    {
+        heap.resize(maxStackDepth_ + localCount_);
+        stack = heap.data();
+    }
+
+    // The first push saved the empty top register in stack[0], under the first output
+    double last = run(stack, stack + maxStackDepth_, variables.data());
+    std::copy(stack + 1, stack + out.size(), out.begin());
+    out.back() = last;
+}
+
+Result<double> BytecodeView::tryEvaluate(std::span<const double> variables) const
+{
+    try
+    {
+        return evaluate(variables);
+    }
+    catch (const ExpressionError &error)
+    {
+        return error.error();
+    }
+}
+
+void BytecodeView::evaluateBatch(const double *const *columns, size_t n, double *out, ErrorMode mode) const
+{
+    evaluateRows(columns, 0, n, out, mode);
+}
+
+void BytecodeView::evaluateRows(const double *const *columns, size_t begin, size_t end, double *out,
+                            ErrorMode mode) const
+{
+    evaluateOutputRows(columns, begin, end, &out, 1, mode);
+}
+
+void BytecodeView::evaluateOutputRows(const double *const *columns, size_t begin, size_t end, double *const *out,
+                                      size_t outputCount, ErrorMode mode) const
+{
+    checkColumns(columns);
+
+    // One chunk per stack level and per local, allocated once for all chunks. Very deep
+    // programs run shorter chunks so that this stays within BatchStackBudget values.
+    size_t levels = std::max<size_t>(maxStackDepth_, 1) + localCount_;
+    size_t chunk = std::clamp<size_t>(BatchStackBudget / levels, 16, BatchChunkSize);
+    size_t stackSize = std::max<size_t>(maxStackDepth_, 1) * chunk;
+    std::vector<double> stack(levels * chunk);
+    for (size_t offset = begin; offset < end; offset += chunk)
+    {
+        size_t count = std::min(chunk, end - offset);
+        runChunk(stack.data(), stack.data() + stackSize, columns, offset, count, chunk, mode);
+        for (size_t k = 0; k < outputCount; ++k)
+            std::copy(stack.data() + k * chunk, stack.data() + k * chunk + count, out[k] + offset);
+    }
+}
+
+void BytecodeView::runChunk(double *stack, double *locals, const double *const *columns, size_t offset, size_t count,
+                        size_t stride, ErrorMode mode) const
+{
+    const double *constant = constants_.data();
+    const uint32_t *slot = slots_.data();
+    const uint32_t *local = locals_.data();
+
+    // Start of the chunk on top of the stack
+    double *top = stack - stride;
+
+    for (OpCode op : code_)
+    {
+        switch (op)
+        {
+        case OpCode::Constant:
+            top += stride;
+            std::fill(top, top + count, *constant++);
+            break;
+        case OpCode::Variable:
+        {
+            top += stride;
+            const double *column = columns[*slot++] + offset;
+            std::copy(column, column + count, top);
+            break;
+        }
+        case OpCode::Store:
+            std::copy(top, top + count, locals + *local++ * stride);
+            break;
+        case OpCode::Load:
+        {
+            top += stride;
+            const double *value = locals + *local++ * stride;
+            std::copy(value, value + count, top);
+            break;
+        }
+        default:
+            if (opcodeArity(op) == 2)
+            {
+                applyOperationBatch(op, top - stride, top, count, mode);
+                top -= stride;
+            }
+            else
+            {
+                applyOperationBatch(op, top, nullptr, count, mode);
+            }
+            break;
+        }
+    }
+}
+
+// GCC and Clang dispatch through a table of label addresses: every instruction
+// ends in its own indirect jump, which the branch predictor tracks separately.
+// Other compilers, or builds with BYTECODE_SWITCH_DISPATCH, use a plain switch.
+#if defined(__GNUC__) && !defined(BYTECODE_SWITCH_DISPATCH)
+#define BYTECODE_COMPUTED_GOTO
+#endif
+
+#ifdef BYTECODE_COMPUTED_GOTO
+#define BYTECODE_CASE(name) op_##name:
+#define BYTECODE_DISPATCH()                                  \
+    if (pc == end)                                           \
+        return top;                                          \
+    goto *dispatchTable[static_cast<uint8_t>(*pc++)]
+#else
+#define BYTECODE_CASE(name) case OpCode::name:
+#define BYTECODE_DISPATCH() continue
+#endif
+
+double BytecodeView::run(double *stack, double *locals, const double *variables) const
+{
+    // The top of the stack is kept in a register; stack holds the values below it
+    const double *constant = constants_.data();
+    const uint32_t *slot = slots_.data();
+    const uint32_t *local = locals_.data();
+    double *below = stack;
+    double top = 0.0;
+    const OpCode *pc = code_.data();
+    const OpCode *end = pc + code_.size();
+
+#ifdef BYTECODE_COMPUTED_GOTO
+    // Same order as OpCode
+    static void *const dispatchTable[] = {
+        &&op_Constant, &&op_Variable, &&op_Add, &&op_Subtract, &&op_Multiply, &&op_Divide, &&op_Power, &&op_Negate,
+        &&op_Sin, &&op_Cos, &&op_Tan, &&op_Cot, &&op_Ln, &&op_Log, &&op_Sqrt,
+        &&op_Sinh, &&op_Cosh, &&op_Tanh, &&op_Coth, &&op_Sech, &&op_Csch, &&op_Factorial,
+        &&op_Store, &&op_Load};
+
+    BYTECODE_DISPATCH();
+#else
+    while (pc != end)
+    {
+        switch (*pc++)
+        {
+#endif
+
+    BYTECODE_CASE(Constant)
+    {
+        *below++ = top;
+        top = *constant++;
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Variable)
+    {
+        *below++ = top;
+        top = variables[*slot++];
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Add)
+    {
+        top = *--below + top;
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Subtract)
+    {
+        top = *--below - top;
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Multiply)
+    {
+        top = *--below * top;
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Divide)
+    {
+        // The zero check and its error live in applyOperation, shared with DivisionNode
+        --below;
+        top = top == 0.0 ? applyOperation(OpCode::Divide, *below, top) : *below / top;
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Power)
+    {
+        top = std::pow(*--below, top);
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Negate)
+    {
+        top = -top;
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Sin)
+    {
+        top = std::sin(top);
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Cos)
+    {
+        top = std::cos(top);
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Tan)
+    {
+        top = std::tan(top);
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Cot)
+    {
+        top = applyOperation(OpCode::Cot, top, 0.0);
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Ln)
+    {
+        top = std::log(top);
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Log)
+    {
+        top = std::log10(top);
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Sqrt)
+    {
+        top = top < 0.0 ? applyOperation(OpCode::Sqrt, top, 0.0) : std::sqrt(top);
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Sinh)
+    {
+        top = std::sinh(top);
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Cosh)
+    {
+        top = std::cosh(top);
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Tanh)
+    {
+        top = std::tanh(top);
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Coth)
+    {
+        top = applyOperation(OpCode::Coth, top, 0.0);
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Sech)
+    {
+        top = 1 / std::cosh(top);
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Csch)
+    {
+        top = applyOperation(OpCode::Csch, top, 0.0);
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Factorial)
+    {
+        top = applyOperation(OpCode::Factorial, top, 0.0);
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Store)
+    {
+        locals[*local++] = top;
+        BYTECODE_DISPATCH();
+    }
+    BYTECODE_CASE(Load)
+    {
+        *below++ = top;
+        top = locals[*local++];
+        BYTECODE_DISPATCH();
+    }
+
+#ifndef BYTECODE_COMPUTED_GOTO
+        }
+    }
+    return top;
+#endif
+}
+
+#undef BYTECODE_COMPUTED_GOTO
+#undef BYTECODE_CASE
+#undef BYTECODE_DISPATCH
@@ -0,0 +1,167 @@
+/**
+ * @file bytecode.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "batch.h"
+#include "expression_tree.h"
+#include "flat_expression.h"
+#include "opcode.h"
+#include "result.h"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// The arrays of a compiled program without owning them: those of a Bytecode, or
+// of a program stored in a mapped library file (expression_library.h). The
+// interpreter runs on views, so both evaluate the same way.
+class BytecodeView
+{
+public:
+    BytecodeView() = default;
+    BytecodeView(std::span<const OpCode> code, std::span<const double> constants, std::span<const uint32_t> slots,
+                 std::span<const uint32_t> locals, size_t variableCount, size_t localCount, size_t maxStackDepth)
+        : code_(code), constants_(constants), slots_(slots), locals_(locals), variableCount_(variableCount),
+          localCount_(localCount), maxStackDepth_(maxStackDepth) {}
+
+    // See Bytecode
+    double evaluate(std::span<const double> variables = {}) const;
+    Result<double> tryEvaluate(std::span<const double> variables = {}) const;
+    void evaluateBatch(const double *const *columns, size_t n, double *out, ErrorMode mode = ErrorMode::Report) const;
+    void evaluateRows(const double *const *columns, size_t begin, size_t end, double *out,
+                      ErrorMode mode = ErrorMode::Report) const;
+
+    // For a program compiled with several roots: out receives the value of every
+    // root, first root first, and must have one element per root
+    void evaluateOutputs(std::span<const double> variables, std::span<double> out) const;
+
+    // Same for rows begin..end-1: out[k][row] receives root k of each row
+    void evaluateOutputRows(const double *const *columns, size_t begin, size_t end, double *const *out,
+                            size_t outputCount, ErrorMode mode = ErrorMode::Report) const;
+
+    std::span<const OpCode> code() const { return code_; }
+    std::span<const double> constants() const { return constants_; }
+    std::span<const uint32_t> slots() const { return slots_; }
+    std::span<const uint32_t> locals() const { return locals_; }
+    size_t variableCount() const { return variableCount_; }
+    size_t localCount() const { return localCount_; }
+    size_t maxStackDepth() const { return maxStackDepth_; }
+
+private:
+    // locals holds localCount() values, or for runChunk chunks of stride values,
+    // the same stride as the stack's. run returns the top of the stack and leaves
+    // the values below it in stack[1..]; runChunk leaves the value at level k of
+    // the stack in stack[k * stride..].
+    double run(double *stack, double *locals, const double *variables) const;
+    void runChunk(double *stack, double *locals, const double *const *columns, size_t offset, size_t count,
+                  size_t stride, ErrorMode mode) const;
+
+    // Throws std::out_of_range when fewer values or no columns are given than the program reads
+    void checkVariables(size_t count) const;
+    void checkColumns(const double *const *columns) const;
+
+    std::span<const OpCode> code_;
+    std::span<const double> constants_;
+    std::span<const uint32_t> slots_;
+    std::span<const uint32_t> locals_;
+    size_t variableCount_ = 0;
+    size_t localCount_ = 0;
+    size_t maxStackDepth_ = 0;
+};
+
+// An expression compiled to postorder stack code. Every instruction is one
+// OpCode byte: OpCode::Constant pushes the next value from the constant pool,
+// OpCode::Variable pushes the variable in the next slot of the slot list, and
+// every other instruction pops its operands and pushes its result. A value
+// used more than once (a subtree shared in a DAG) is computed once: OpCode::Store
+// copies it into the local named by the next entry of the local list and
+// OpCode::Load pushes it again at every later use.
+class Bytecode
+{
+public:
+    // Compiles an expression tree or a flat expression
+    static Bytecode compile(const NodePtr &root);
+    static Bytecode compile(const FlatExpression &expression);
+
+    // Compiles several roots of one flat expression into a program that leaves the
+    // value of every root on the stack, first root first (BytecodeView::evaluateOutputs).
+    // A node used by several roots is computed once and kept in a local like any
+    // other shared value.
+    static Bytecode compile(const FlatExpression &expression, std::span<const uint32_t> roots);
+
+    // Copies the arrays of a view, such as a program of a mapped library
+    static Bytecode fromView(const BytecodeView &view);
+
+    // Runs the program with the variables bound by slot index. Gives the same
+    // result as Node::evaluate on the source tree.
+    double evaluate(std::span<const double> variables = {}) const { return view().evaluate(variables); }
+
+    // Same as evaluate, but returns a domain error instead of throwing it
+    Result<double> tryEvaluate(std::span<const double> variables = {}) const { return view().tryEvaluate(variables); }
+
+    // Runs the program over rows 0..n-1 of a columnar input, as Node::evaluateBatch does:
+    // every instruction processes a whole chunk of rows before the next one runs.
+    void evaluateBatch(const double *const *columns, size_t n, double *out, ErrorMode mode = ErrorMode::Report) const
+    {
+        view().evaluateRows(columns, 0, n, out, mode);
+    }
+
+    // Same as evaluateBatch for rows begin..end-1 only: out[row] receives the result of each row
+    void evaluateRows(const double *const *columns, size_t begin, size_t end, double *out,
+                      ErrorMode mode = ErrorMode::Report) const
+    {
+        view().evaluateRows(columns, begin, end, out, mode);
+    }
+
+    BytecodeView view() const
+    {
+        return BytecodeView(code_, constants_, slots_, locals_, variableCount_, localCount_, maxStackDepth_);
+    }
+
+    const std::vector<OpCode> &code() const { return code_; }
+    const std::vector<double> &constants() const { return constants_; }
+    const std::vector<uint32_t> &slots() const { return slots_; }
+    const std::vector<uint32_t> &locals() const { return locals_; }
+
+    // Number of variable values evaluate needs: one past the highest slot used
+    size_t variableCount() const { return variableCount_; }
+
+    // Largest number of values on the stack while the program runs
+    size_t maxStackDepth() const { return maxStackDepth_; }
+
+    // Number of shared values the program stores
+    size_t localCount() const { return localCount_; }
+
+private:
+    // Use counts of the operation nodes, and the locals of those already emitted
+    struct SharedValues;
+
+    void emit(OpCode op);
+    void emitConstant(double value);
+    void emitVariable(uint32_t slot);
+    void emitTree(const Node &root, SharedValues &shared);
+    void emitFlat(const FlatExpression &expression, uint32_t root, SharedValues &shared);
+
+    // Emits Load if the node was stored already; returns false if it still has to be emitted
+    bool emitLoad(const void *node, SharedValues &shared);
+
+    // Emits Store after the node's code if the node has more than one use
+    void emitStore(const void *node, SharedValues &shared);
+
+    std::vector<OpCode> code_;
+    std::vector<double> constants_;
+    std::vector<uint32_t> slots_;
+    std::vector<uint32_t> locals_;
+    size_t variableCount_ = 0;
+    size_t localCount_ = 0;
+    size_t depth_ = 0;
+    size_t maxStackDepth_ = 0;
+};
+
+#endif // BYTECODE_H
@@ -0,0 +1,23 @@
+/**
+ * @file compiled_expression.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "compiled_expression.h"
+#include <stdexcept>
+
+CompiledExpression::CompiledExpression(Bytecode program, std::vector<std::string> variableNames)
+    : program_(std::move(program)), variableNames_(std::move(variableNames)) {}
+
+size_t CompiledExpression::slot(std::string_view name) const
+{
+    for (size_t i = 0; i < variableNames_.size(); ++i)
+    {
+        if (variableNames_[i] == name)
+            return i;
+    }
+    throw std::out_of_range("Unknown variable: " + std::string(name));
+}
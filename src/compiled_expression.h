@@ -0,0 +1,49 @@
+/**
+ * @file compiled_expression.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef COMPILED_EXPRESSION_H
+#define COMPILED_EXPRESSION_H
+
+#include "bytecode.h"
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A formula parsed once and evaluated many times. Variables are bound by slot:
+// values[i] is the value of variableNames()[i].
+class CompiledExpression
+{
+public:
+    CompiledExpression(Bytecode program, std::vector<std::string> variableNames);
+
+    double evaluate(std::span<const double> values) const { return program_.evaluate(values); }
+    double evaluate() const { return program_.evaluate(); }
+
+    // Returns a domain error instead of throwing it
+    Result<double> tryEvaluate(std::span<const double> values = {}) const { return program_.tryEvaluate(values); }
+
+    // Evaluates n rows at once: columns[i] holds the n values of variableNames()[i].
+    // ErrorMode::Propagate writes inf or NaN for bad rows instead of throwing.
+    void evaluateBatch(const double *const *columns, size_t n, double *out, ErrorMode mode = ErrorMode::Report) const { program_.evaluateBatch(columns, n, out, mode); }
+
+    // Evaluates rows begin..end-1 of the same input into out[begin..end-1]
+    void evaluateRows(const double *const *columns, size_t begin, size_t end, double *out, ErrorMode mode = ErrorMode::Report) const { program_.evaluateRows(columns, begin, end, out, mode); }
+
+    // Slot of the named variable, looked up once when setting up the caller's value array
+    size_t slot(std::string_view name) const;
+
+    const std::vector<std::string> &variableNames() const { return variableNames_; }
+    const Bytecode &program() const { return program_; }
+
+private:
+    Bytecode program_;
+    std::vector<std::string> variableNames_;
+};
+
+#endif // COMPILED_EXPRESSION_H
@@ -0,0 +1,148 @@
+/**
+ * @file corpus.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "corpus.h"
+#include <cmath>
+#include <cstdio>
+
+const std::vector<std::string> &CorpusGenerator::variableNames()
+{
+    static const std::vector<std::string> names = {"x", "y", "z"};
+    return names;
+}
+
+const std::vector<double> &CorpusGenerator::variableValues()
+{
+    // All positive and not 0, so any variable can be a denominator
+    static const std::vector<double> values = {0.7, 1.3, 2.1};
+    return values;
+}
+
+std::string CorpusGenerator::number(double low, double high)
+{
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.2f", std::uniform_real_distribution<double>(low, high)(random_));
+    return text;
+}
+
+const std::string &CorpusGenerator::variable()
+{
+    return variableNames()[pick(variableNames().size())];
+}
+
+std::string CorpusGenerator::flatArithmetic(size_t terms)
+{
+    static const char *const operators[] = {" + ", " - ", " * ", " / "};
+    std::string formula = pick(2) ? variable() : number(0.5, 9.5);
+    for (size_t i = 1; i < terms; ++i)
+    {
+        formula += operators[pick(4)];
+        // Variables and numbers from 0.5 up are never 0, so "/" is always defined
+        formula += pick(2) ? variable() : number(0.5, 9.5);
+    }
+    return formula;
+}
+
+std::string CorpusGenerator::deepNesting(size_t depth)
+{
+    std::string formula = variable();
+    for (size_t i = 0; i < depth; ++i)
+    {
+        switch (pick(5))
+        {
+        case 0:
+            formula = "(" + formula + " + " + number(0.5, 9.5) + ")";
+            break;
+        case 1:
+            formula = "(" + formula + " * " + number(0.5, 1.5) + ")";
+            break;
+        case 2:
+            formula = "(" + number(0.5, 9.5) + " - " + formula + ")";
+            break;
+        case 3:
+            formula = "sin(" + formula + ")";
+            break;
+        default:
+            formula = "tanh(" + formula + ")";
+            break;
+        }
+    }
+    return formula;
+}
+
+std::string CorpusGenerator::trigHyperbolic(size_t calls)
+{
+    static const char *const functions[] = {"sin", "cos", "tan", "cot", "sinh", "cosh", "tanh", "coth", "sech", "csch"};
+    static const char *const operators[] = {" + ", " - ", " * "};
+    std::string formula;
+    for (size_t i = 0; i < calls; ++i)
+    {
+        if (i > 0)
+            formula += operators[pick(3)];
+        // Arguments stay within (0, pi), where tan is never 0 and coth and csch are finite
+        formula += functions[pick(10)];
+        formula += "(" + variable() + " * " + number(0.1, 0.9) + " + " + number(0.1, 0.9) + ")";
+    }
+    return formula;
+}
+
+std::string CorpusGenerator::factorialPower(size_t terms)
+{
+    static const char *const operators[] = {" + ", " - ", " * "};
+    std::string formula;
+    for (size_t i = 0; i < terms; ++i)
+    {
+        if (i > 0)
+            formula += operators[pick(3)];
+        switch (pick(4))
+        {
+        case 0:
+            formula += "(" + variable() + " + " + std::to_string(1 + pick(6)) + ")!";
+            break;
+        case 1:
+            formula += std::to_string(2 + pick(7)) + "!";
+            break;
+        case 2:
+        {
+            // Bases and exponents close to 1 keep the chain finite
+            formula += number(1.0, 1.5);
+            for (size_t link = 1 + pick(3); link > 0; --link)
+                formula += "^" + number(0.5, 1.5);
+            break;
+        }
+        default:
+            formula += variable() + "^" + std::to_string(2 + pick(3));
+            break;
+        }
+    }
+    return formula;
+}
+
+std::vector<FormulaSet> CorpusGenerator::formulaSets(size_t count, size_t size)
+{
+    std::vector<FormulaSet> sets = {{"flat_arithmetic", {}}, {"deep_nesting", {}}, {"trig_hyperbolic", {}}, {"factorial_power", {}}};
+    for (size_t i = 0; i < count; ++i)
+    {
+        sets[0].formulas.push_back(flatArithmetic(size / 2 + pick(size + 1)));
+        sets[1].formulas.push_back(deepNesting(size / 2 + pick(size + 1)));
+        sets[2].formulas.push_back(trigHyperbolic(size / 2 + pick(size + 1)));
+        sets[3].formulas.push_back(factorialPower(size / 2 + pick(size + 1)));
+    }
+    return sets;
+}
+
+std::vector<std::vector<double>> CorpusGenerator::invertibleMatrix()
+{
+    std::uniform_real_distribution<double> entry(-10.0, 10.0);
+    while (true)
+    {
+        std::vector<std::vector<double>> matrix = {{entry(random_), entry(random_)}, {entry(random_), entry(random_)}};
+        if (std::abs(matrix[0][0] * matrix[1][1] - matrix[0][1] * matrix[1][0]) >= 1.0)
+            return matrix;
+    }
+}
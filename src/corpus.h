@@ -0,0 +1,64 @@
+/**
+ * @file corpus.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// Formulas of one shape, used together as a benchmark input
+struct FormulaSet
+{
+    std::string name;
+    std::vector<std::string> formulas;
+};
+
+// Generates benchmark formulas. The same seed always gives the same formulas, so
+// results from different builds are measured on the same input. Every formula uses
+// only the variables in CorpusGenerator::variableNames() and evaluates without
+// errors for the values in CorpusGenerator::variableValues().
+class CorpusGenerator
+{
+public:
+    explicit CorpusGenerator(uint64_t seed = 2023) : random_(seed) {}
+
+    static const std::vector<std::string> &variableNames();
+    static const std::vector<double> &variableValues();
+
+    // "x + 2.5 * y - 0.75 / z + ...": terms joined by the four arithmetic operators
+    std::string flatArithmetic(size_t terms);
+
+    // A term wrapped in depth levels of parentheses and function calls
+    std::string deepNesting(size_t depth);
+
+    // A sum of calls to sin, cos, tan, cot and the six hyperbolic functions
+    std::string trigHyperbolic(size_t calls);
+
+    // Factorials and right-associative power chains such as "1.01^1.1^1.2"
+    std::string factorialPower(size_t terms);
+
+    // The four sets above, count formulas each, with sizes drawn around size
+    std::vector<FormulaSet> formulaSets(size_t count, size_t size);
+
+    // A 2x2 matrix whose determinant is far enough from 0 to invert
+    std::vector<std::vector<double>> invertibleMatrix();
+
+private:
+    // A number in [low, high) written with two decimals
+    std::string number(double low, double high);
+    const std::string &variable();
+    size_t pick(size_t count) { return std::uniform_int_distribution<size_t>(0, count - 1)(random_); }
+
+    std::mt19937_64 random_;
+};
+
+#endif // CORPUS_H
@@ -0,0 +1,423 @@
+/**
+ * @file derivative.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "derivative.h"
+#include "optimizer.h"
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace
+{
+    constexpr double Ln10 = 2.30258509299404568402;
+
+    bool constantValue(const NodePtr &node, double &value)
+    {
+        if (node->opcode() != OpCode::Constant)
+            return false;
+        value = static_cast<const ConstantNode &>(*node).value();
+        return true;
+    }
+
+    // Compares values only, so -0 counts as 0: the rules below are algebraic
+    bool isConstant(const NodePtr &node, double expected)
+    {
+        double value;
+        return constantValue(node, value) && value == expected;
+    }
+
+    class Differentiator
+    {
+    public:
+        // Nodes of the original are reused wherever the derivative needs an equal node
+        Differentiator(const NodePtr &root, std::string_view variable) : variable_(variable)
+        {
+            std::vector<const NodePtr *> pending = {&root};
+            while (!pending.empty())
+            {
+                const NodePtr &node = *pending.back();
+                pending.pop_back();
+                if (!remember(node))
+                    continue;
+                for (size_t i = 0; i < node->operandCount(); ++i)
+                    pending.push_back(&node->operand(i));
+            }
+        }
+
+        // Differentiates the operands of every node before the node itself,
+        // keeping the nodes still to do on an explicit stack
+        NodePtr run(const NodePtr &root)
+        {
+            std::vector<const NodePtr *> pending = {&root};
+            while (!pending.empty())
+            {
+                const NodePtr &node = *pending.back();
+                if (done_.count(node.get()))
+                {
+                    pending.pop_back();
+                    continue;
+                }
+
+                bool ready = true;
+                for (size_t i = 0; i < node->operandCount(); ++i)
+                {
+                    const NodePtr &operand = node->operand(i);
+                    if (!done_.count(operand.get()))
+                    {
+                        pending.push_back(&operand);
+                        ready = false;
+                    }
+                }
+                if (ready)
+                {
+                    done_.emplace(node.get(), derivative(node));
+                    pending.pop_back();
+                }
+            }
+
+            const NodePtr &result = done_.at(root.get());
+            return result ? result : constant(0.0);
+        }
+
+    private:
+        // An operation by opcode and operand nodes
+        struct Key
+        {
+            OpCode op;
+            const void *left;
+            const void *right;
+
+            bool operator==(const Key &other) const = default;
+        };
+
+        struct KeyHash
+        {
+            size_t operator()(const Key &key) const
+            {
+                size_t hash = std::hash<const void *>()(key.left) * 0x9E3779B97F4A7C15ull;
+                return hash ^ (std::hash<const void *>()(key.right) + static_cast<size_t>(key.op));
+            }
+        };
+
+        static Key keyOf(OpCode op, const NodePtr &left, const NodePtr &right)
+        {
+            return {op, left.get(), right ? right.get() : nullptr};
+        }
+
+        // Adds the node to the known ones; false if an equal node was known already
+        bool remember(const NodePtr &node)
+        {
+            if (node->opcode() == OpCode::Constant)
+                return constants_.emplace(bitsOf(static_cast<const ConstantNode &>(*node).value()), node).second;
+            if (node->opcode() == OpCode::Variable)
+                return variables_.emplace(node.get(), node).second;
+            NodePtr right = node->operandCount() == 2 ? node->operand(1) : nullptr;
+            return known_.emplace(keyOf(node->opcode(), node->operand(0), right), node).second;
+        }
+
+        static const void *bitsOf(double value)
+        {
+            uintptr_t bits = 0;
+            static_assert(sizeof(bits) == sizeof(value), "constants are keyed by their bits");
+            std::memcpy(&bits, &value, sizeof(bits));
+            return reinterpret_cast<const void *>(bits);
+        }
+
+        NodePtr constant(double value)
+        {
+            auto [entry, added] = constants_.emplace(bitsOf(value), nullptr);
+            if (added)
+                entry->second = std::make_shared<ConstantNode>(value);
+            return entry->second;
+        }
+
+        // The known node for op(left, right), or a new one
+        NodePtr make(OpCode op, const NodePtr &left, const NodePtr &right = nullptr)
+        {
+            auto [entry, added] = known_.emplace(keyOf(op, left, right), nullptr);
+            if (added)
+                entry->second = makeOperationNode(op, left, right);
+            return entry->second;
+        }
+
+        // op(left, right) with constant operands folded and identities removed. An
+        // operation that fails on its constant operands is kept, so it still fails.
+        NodePtr build(OpCode op, const NodePtr &left, const NodePtr &right = nullptr)
+        {
+            double leftValue, rightValue;
+            if (constantValue(left, leftValue) && (!right || constantValue(right, rightValue)))
+            {
+                NodePtr node = make(op, left, right);
+                Result<double> value = node->tryEvaluate();
+                return value ? constant(*value) : node;
+            }
+
+            switch (op)
+            {
+            case OpCode::Add:
+                if (isConstant(right, 0.0))
+                    return left;
+                if (isConstant(left, 0.0))
+                    return right;
+                if (right->opcode() == OpCode::Negate)
+                    return build(OpCode::Subtract, left, right->operand(0));
+                if (left->opcode() == OpCode::Negate)
+                    return build(OpCode::Subtract, right, left->operand(0));
+                break;
+            case OpCode::Subtract:
+                if (isConstant(right, 0.0))
+                    return left;
+                if (isConstant(left, 0.0))
+                    return build(OpCode::Negate, right);
+                if (right->opcode() == OpCode::Negate)
+                    return build(OpCode::Add, left, right->operand(0));
+                break;
+            case OpCode::Multiply:
+                // Constants go to the left, where the next rules find them
+                if (constantValue(right, rightValue))
+                    return build(OpCode::Multiply, right, left);
+                if (isConstant(left, 1.0))
+                    return right;
+                if (isConstant(left, -1.0))
+                    return build(OpCode::Negate, right);
+                if (isConstant(left, 0.0))
+                    return left;
+                if (left->opcode() == OpCode::Constant && right->opcode() == OpCode::Multiply &&
+                    right->operand(0)->opcode() == OpCode::Constant)
+                    return build(OpCode::Multiply, build(OpCode::Multiply, left, right->operand(0)), right->operand(1));
+                // Negations move outwards, where two of them cancel
+                if (left->opcode() == OpCode::Negate)
+                    return build(OpCode::Negate, build(OpCode::Multiply, left->operand(0), right));
+                if (right->opcode() == OpCode::Negate)
+                    return build(OpCode::Negate, build(OpCode::Multiply, left, right->operand(0)));
+                break;
+            case OpCode::Divide:
+                if (isConstant(right, 1.0))
+                    return left;
+                if (left->opcode() == OpCode::Negate)
+                    return build(OpCode::Negate, build(OpCode::Divide, left->operand(0), right));
+                break;
+            case OpCode::Power:
+                if (isConstant(right, 1.0))
+                    return left;
+                if (isConstant(right, 0.0))
+                    return constant(1.0);
+                break;
+            case OpCode::Negate:
+                if (left->opcode() == OpCode::Negate)
+                    return left->operand(0);
+                break;
+            default:
+                break;
+            }
+            return make(op, left, right);
+        }
+
+        // The derivative of a subtree without the variable is null rather than a 0
+        // node, so these drop the terms it would cancel
+        NodePtr add(const NodePtr &left, const NodePtr &right)
+        {
+            if (!left)
+                return right;
+            if (!right)
+                return left;
+            return build(OpCode::Add, left, right);
+        }
+
+        NodePtr negate(const NodePtr &operand)
+        {
+            return operand ? build(OpCode::Negate, operand) : nullptr;
+        }
+
+        NodePtr subtract(const NodePtr &left, const NodePtr &right)
+        {
+            if (!right)
+                return left;
+            if (!left)
+                return negate(right);
+            return build(OpCode::Subtract, left, right);
+        }
+
+        NodePtr multiply(const NodePtr &left, const NodePtr &right)
+        {
+            if (!left || !right)
+                return nullptr;
+            return build(OpCode::Multiply, left, right);
+        }
+
+        NodePtr divide(const NodePtr &numerator, const NodePtr &denominator)
+        {
+            return numerator ? build(OpCode::Divide, numerator, denominator) : nullptr;
+        }
+
+        // The derivative of one node from those of its operands (null for 0)
+        NodePtr derivative(const NodePtr &node)
+        {
+            OpCode op = node->opcode();
+            if (op == OpCode::Constant)
+                return nullptr;
+            if (op == OpCode::Variable)
+                return static_cast<const VariableNode &>(*node).name() == variable_ ? constant(1.0) : nullptr;
+
+            const NodePtr &u = node->operand(0);
+            const NodePtr &du = done_.at(u.get());
+            if (node->operandCount() == 2)
+            {
+                const NodePtr &v = node->operand(1);
+                const NodePtr &dv = done_.at(v.get());
+                if (!du && !dv)
+                    return nullptr;
+                return binaryDerivative(op, node, u, du, v, dv);
+            }
+            if (!du)
+                return nullptr;
+
+            switch (op)
+            {
+            case OpCode::Negate:
+                return negate(du);
+            case OpCode::Sin:
+                return multiply(make(OpCode::Cos, u), du);
+            case OpCode::Cos:
+                return negate(multiply(make(OpCode::Sin, u), du));
+            case OpCode::Tan:
+                // 1 + tan^2, reusing the tan node
+                return multiply(build(OpCode::Add, constant(1.0), build(OpCode::Multiply, node, node)), du);
+            case OpCode::Cot:
+                return negate(multiply(build(OpCode::Add, constant(1.0), build(OpCode::Multiply, node, node)), du));
+            case OpCode::Ln:
+                return divide(du, u);
+            case OpCode::Log:
+                return divide(du, build(OpCode::Multiply, constant(Ln10), u));
+            case OpCode::Sqrt:
+                return divide(du, build(OpCode::Multiply, constant(2.0), node));
+            case OpCode::Sinh:
+                return multiply(make(OpCode::Cosh, u), du);
+            case OpCode::Cosh:
+                return multiply(make(OpCode::Sinh, u), du);
+            case OpCode::Tanh:
+            case OpCode::Coth:
+                // 1 - tanh^2 and 1 - coth^2 = -csch^2, which is -inf where coth gives HUGE_VAL
+                return multiply(build(OpCode::Subtract, constant(1.0), build(OpCode::Multiply, node, node)), du);
+            case OpCode::Sech:
+                return negate(multiply(build(OpCode::Multiply, node, make(OpCode::Tanh, u)), du));
+            case OpCode::Csch:
+                return negate(multiply(build(OpCode::Multiply, node, make(OpCode::Coth, u)), du));
+            default: // OpCode::Factorial is a step function
+                return nullptr;
+            }
+        }
+
+        NodePtr binaryDerivative(OpCode op, const NodePtr &node, const NodePtr &u, const NodePtr &du, const NodePtr &v,
+                                 const NodePtr &dv)
+        {
+            switch (op)
+            {
+            case OpCode::Add:
+                return add(du, dv);
+            case OpCode::Subtract:
+                return subtract(du, dv);
+            case OpCode::Multiply:
+                return add(multiply(du, v), multiply(u, dv));
+            case OpCode::Divide:
+                // (u' - (u/v) * v') / v, reusing the quotient
+                return divide(subtract(du, multiply(node, dv)), v);
+            default: // OpCode::Power
+                if (!dv)
+                {
+                    NodePtr power = build(OpCode::Power, u, build(OpCode::Subtract, v, constant(1.0)));
+                    return multiply(build(OpCode::Multiply, v, power), du);
+                }
+                NodePtr logarithm = make(OpCode::Ln, u);
+                if (!du)
+                    return multiply(build(OpCode::Multiply, node, logarithm), dv);
+                return multiply(node, add(multiply(dv, logarithm), divide(multiply(v, du), u)));
+            }
+        }
+
+        std::string_view variable_;
+        std::unordered_map<const Node *, NodePtr> done_;
+        std::unordered_map<Key, NodePtr, KeyHash> known_;
+        std::unordered_map<const void *, NodePtr> constants_;
+        std::unordered_map<const Node *, NodePtr> variables_;
+    };
+
+    double operationCost(OpCode op)
+    {
+        switch (op)
+        {
+        case OpCode::Constant:
+        case OpCode::Variable:
+            return 0;
+        case OpCode::Add:
+        case OpCode::Subtract:
+        case OpCode::Multiply:
+        case OpCode::Negate:
+            return 1;
+        case OpCode::Divide:
+        case OpCode::Sqrt:
+        case OpCode::Factorial:
+            return 4;
+        case OpCode::Power:
+            return 30;
+        default:
+            return 20;
+        }
+    }
+
+    // Every node reachable from the root, once
+    std::vector<const Node *> distinctNodes(const NodePtr &root)
+    {
+        std::vector<const Node *> nodes;
+        std::unordered_set<const Node *> seen = {root.get()};
+        std::vector<const Node *> pending = {root.get()};
+        while (!pending.empty())
+        {
+            const Node *node = pending.back();
+            pending.pop_back();
+            nodes.push_back(node);
+            for (size_t i = 0; i < node->operandCount(); ++i)
+            {
+                if (seen.insert(node->operand(i).get()).second)
+                    pending.push_back(node->operand(i).get());
+            }
+        }
+        return nodes;
+    }
+}
+
+NodePtr differentiate(const NodePtr &root, std::string_view variable, DerivativeStats *stats)
+{
+    NodePtr result = Differentiator(root, variable).run(root);
+    if (stats)
+    {
+        std::vector<const Node *> original = distinctNodes(root);
+        std::vector<const Node *> derived = distinctNodes(result);
+        std::unordered_set<const Node *> originalSet(original.begin(), original.end());
+
+        *stats = DerivativeStats{};
+        stats->originalNodes = countNodes(root);
+        stats->derivativeNodes = countNodes(result);
+        stats->distinctNodes = derived.size();
+        for (const Node *node : derived)
+            stats->sharedNodes += originalSet.count(node);
+        stats->originalCost = evaluationCost(root);
+        stats->derivativeCost = evaluationCost(result);
+    }
+    return result;
+}
+
+double evaluationCost(const NodePtr &root)
+{
+    double cost = 0;
+    for (const Node *node : distinctNodes(root))
+        cost += operationCost(node->opcode());
+    return cost;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file derivative.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef DERIVATIVE_H
+#define DERIVATIVE_H
+
+#include "expression_tree.h"
+#include <cstddef>
+#include <string_view>
+
+// Sizes of a derivative next to its original
+struct DerivativeStats
+{
+    // Nodes counting shared subtrees once per use, as countNodes does: what
+    // Node::evaluate visits. Computed over the distinct nodes, so filling the
+    // stats stays linear however large these grow.
+    size_t originalNodes = 0;
+    size_t derivativeNodes = 0;
+
+    // Distinct nodes of the derivative, and how many of them belong to the original
+    size_t distinctNodes = 0;
+    size_t sharedNodes = 0;
+
+    // evaluationCost of both trees
+    double originalCost = 0;
+    double derivativeCost = 0;
+};
+
+// Returns the derivative of the expression with respect to the named variable,
+// as a tree of the usual node classes: sin(u) gives cos(u) * u', ln(u) gives
+// u' / u, u^v gives v * u^(v-1) * u' for a v without the variable and
+// u^v * (v' * ln(u) + v * u' / u) otherwise, and so on down the chain rule.
+//
+// The tree is simplified while it is built: terms without the variable are
+// dropped instead of being multiplied by zero, constants are folded and
+// identities such as x * 1 and -(-x) are removed. Subtrees of the original
+// are reused rather than copied (tan(u) gives (1 + tan(u)^2) * u' with the
+// original tan(u) node), and a subtree shared by several parents is
+// differentiated once, so the derivative stays a DAG of about the original's size.
+//
+// n! is treated as a step function with derivative 0. The derivative reports
+// its own domain errors: d/dx ln(x) is 1 / x, which fails at x = 0.
+//
+// Node::evaluate computes a shared subtree again for every use. On a chain such
+// as sin(sin(...(x)...)) every factor cos(u) reuses the chain below it, so
+// evaluating the derivative tree directly takes time quadratic in the depth
+// (seconds at ten thousand levels). Compile it (Bytecode::compile,
+// CompiledExpression or FlatExpression::fromTree), which computes every
+// distinct node once, to evaluate it in linear time.
+NodePtr differentiate(const NodePtr &root, std::string_view variable, DerivativeStats *stats = nullptr);
+
+// Rough cost of evaluating the tree once with every shared subtree computed
+// once, as Bytecode and FlatExpression do: 1 per add, subtract, multiply or
+// negation, 4 per division or square root and 20 to 30 per libm call
+double evaluationCost(const NodePtr &root);
+
+#endif // DERIVATIVE_H
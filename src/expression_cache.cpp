@@ -0,0 +1,172 @@
+/**
+ * @file expression_cache.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "expression_cache.h"
+#include "grammar.h"
+#include "parser.h"
+#include <algorithm>
+#include <functional>
+
+namespace
+{
+    // Heap bytes of one Node: the object and the shared_ptr control block
+    const size_t TreeNodeBytes = 64;
+
+    // Characters of numbers and names, which merge into one token when they touch;
+    // the tokenizer also starts a number at '.'
+    bool isWordCharacter(char ch)
+    {
+        return grammar::isLetter(ch) || grammar::isDigit(ch) || ch == '.';
+    }
+
+    // Every thread parses its misses with its own parser, outside the shard locks
+    Parser &threadParser()
+    {
+        thread_local Parser parser;
+        return parser;
+    }
+
+    std::string makeKey(std::string_view source, const std::vector<std::string> &variableNames, bool normalize)
+    {
+        std::string key = normalize ? ExpressionCache::normalize(source) : std::string(source);
+        for (const auto &name : variableNames)
+        {
+            key += '\0';
+            key += name;
+        }
+        return key;
+    }
+}
+
+ExpressionCache::ExpressionCache(const ExpressionCacheOptions &options) : options_(options)
+{
+    size_t shards = std::clamp<size_t>(options.shards, 1, std::max<size_t>(options.maxEntries, 1));
+    maxEntriesPerShard_ = std::max<size_t>((options.maxEntries + shards - 1) / shards, 1);
+    maxBytesPerShard_ = options.maxBytes == 0 ? 0 : std::max<size_t>((options.maxBytes + shards - 1) / shards, 1);
+    for (size_t i = 0; i < shards; ++i)
+    {
+        shards_.push_back(std::make_unique<Shard>());
+    }
+}
+
+std::string ExpressionCache::normalize(std::string_view source)
+{
+    std::string result;
+    result.reserve(source.size());
+    for (size_t i = 0; i < source.size(); ++i)
+    {
+        if (!grammar::isSpace(source[i]))
+        {
+            result += source[i];
+            continue;
+        }
+
+        size_t next = i;
+        while (next < source.size() && grammar::isSpace(source[next]))
+            ++next;
+        if (result.empty() || next == source.size())
+        {
+            i = next - 1;
+            continue;
+        }
+
+        char before = result.back();
+        char after = source[next];
+        bool joins = isWordCharacter(before) && isWordCharacter(after);
+        bool makesExponent = (before == 'e' || before == 'E') && (after == '+' || after == '-');
+        if (joins || makesExponent)
+            result += ' ';
+        i = next - 1;
+    }
+    return result;
+}
+
+std::shared_ptr<const CachedExpression> ExpressionCache::get(std::string_view source,
+                                                             const std::vector<std::string> &variableNames)
+{
+    std::string key = makeKey(source, variableNames, options_.normalizeWhitespace);
+    Shard &shard = *shards_[std::hash<std::string_view>()(key) % shards_.size()];
+
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto found = shard.index.find(key);
+        if (found != shard.index.end())
+        {
+            ++shard.stats.hits;
+            shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+            return found->second->value;
+        }
+        ++shard.stats.misses;
+    }
+
+    // Other lookups on the shard go on while this thread parses
+    FlatExpression flat = threadParser().parseFlat(std::string(source), variableNames);
+    auto built = std::make_shared<CachedExpression>(
+        CachedExpression{flat.toTree(), CompiledExpression(Bytecode::compile(flat), variableNames), 0});
+    const Bytecode &program = built->compiled.program();
+    built->bytes = sizeof(CachedExpression) + key.size() + flat.size() * TreeNodeBytes + program.code().size() +
+                   program.constants().size() * sizeof(double) +
+                   (program.slots().size() + program.locals().size()) * sizeof(uint32_t);
+    std::shared_ptr<const CachedExpression> value = built;
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto found = shard.index.find(key);
+    if (found != shard.index.end())
+    {
+        // Another thread parsed the same expression meanwhile; keep its entry
+        shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+        return found->second->value;
+    }
+    shard.entries.push_front({std::move(key), value});
+    shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+    ++shard.stats.entries;
+    shard.stats.bytes += value->bytes;
+    evict(shard);
+    return value;
+}
+
+void ExpressionCache::evict(Shard &shard)
+{
+    while (!shard.entries.empty() && (shard.stats.entries > maxEntriesPerShard_ ||
+                                      (maxBytesPerShard_ != 0 && shard.stats.bytes > maxBytesPerShard_)))
+    {
+        Entry &oldest = shard.entries.back();
+        shard.stats.bytes -= oldest.value->bytes;
+        --shard.stats.entries;
+        ++shard.stats.evictions;
+        shard.index.erase(oldest.key);
+        shard.entries.pop_back();
+    }
+}
+
+ExpressionCacheStats ExpressionCache::stats() const
+{
+    ExpressionCacheStats total;
+    for (const auto &shard : shards_)
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total.hits += shard->stats.hits;
+        total.misses += shard->stats.misses;
+        total.evictions += shard->stats.evictions;
+        total.entries += shard->stats.entries;
+        total.bytes += shard->stats.bytes;
+    }
+    return total;
+}
+
+void ExpressionCache::clear()
+{
+    for (const auto &shard : shards_)
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->index.clear();
+        shard->entries.clear();
+        shard->stats.entries = 0;
+        shard->stats.bytes = 0;
+    }
+}
@@ -0,0 +1,100 @@
+/**
+ * @file expression_cache.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef EXPRESSION_CACHE_H
+#define EXPRESSION_CACHE_H
+
+#include "compiled_expression.h"
+#include "expression_tree.h"
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// A parsed expression kept by ExpressionCache. Entries are never modified after
+// they are built, so one entry can be evaluated from many threads at once.
+struct CachedExpression
+{
+    NodePtr tree;
+    CompiledExpression compiled;
+
+    // Approximate heap bytes held by the entry, counted against ExpressionCacheOptions::maxBytes
+    size_t bytes;
+};
+
+struct ExpressionCacheOptions
+{
+    // Limits for the whole cache, split evenly across the shards. maxBytes = 0
+    // leaves the memory unbounded.
+    size_t maxEntries = 4096;
+    size_t maxBytes = 0;
+
+    // Each shard has its own lock and LRU list
+    size_t shards = 16;
+
+    // "x*2" and " x * 2 " share an entry
+    bool normalizeWhitespace = true;
+};
+
+struct ExpressionCacheStats
+{
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+};
+
+// Parsed expressions by source text and variable names, dropping the least
+// recently used ones past the limits. Safe to use from many threads.
+class ExpressionCache
+{
+public:
+    explicit ExpressionCache(const ExpressionCacheOptions &options = {});
+
+    // Returns the entry for the expression, parsing it on a miss. The entry stays
+    // valid for as long as the caller holds it, even after it is evicted.
+    std::shared_ptr<const CachedExpression> get(std::string_view source,
+                                                const std::vector<std::string> &variableNames = {});
+
+    ExpressionCacheStats stats() const;
+    void clear();
+
+    // Drops the whitespace the tokenizer ignores, keeping one space where removing
+    // it would join two tokens (as in "2 3" or "1e -5")
+    static std::string normalize(std::string_view source);
+
+private:
+    struct Entry
+    {
+        std::string key;
+        std::shared_ptr<const CachedExpression> value;
+    };
+
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        std::list<Entry> entries; // most recently used first
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+        ExpressionCacheStats stats;
+    };
+
+    // Drops entries from the back of the list until the shard is within its limits
+    void evict(Shard &shard);
+
+    ExpressionCacheOptions options_;
+    size_t maxEntriesPerShard_;
+    size_t maxBytesPerShard_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+#endif // EXPRESSION_CACHE_H
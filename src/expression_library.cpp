@@ -0,0 +1,412 @@
+/**
+ * @file expression_library.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "expression_library.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define EXPRESSION_LIBRARY_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr char Magic[8] = {'M', 'P', 'A', 'R', 'S', 'L', 'I', 'B'};
+    constexpr uint32_t FormatVersion = 1;
+
+    // Opcodes a program may contain: everything up to OpCode::Load
+    constexpr uint8_t OpCodeCount = static_cast<uint8_t>(OpCode::Load) + 1;
+
+    // The file starts with a header and the index; everything else is reached
+    // through offsets from the start of the file
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t entryCount;
+        uint64_t fileSize;
+        uint64_t checksum; // of the bytes after the header
+        uint64_t indexOffset;
+        uint64_t reserved;
+    };
+
+    // A string: bytes offset .. offset + length - 1 of the file
+    struct NameRecord
+    {
+        uint64_t offset;
+        uint32_t length;
+        uint32_t reserved;
+    };
+
+    struct EntryRecord
+    {
+        NameRecord name;
+        uint64_t variableNamesOffset; // variableNameCount NameRecords
+        uint64_t codeOffset;
+        uint64_t constantsOffset;
+        uint64_t slotsOffset;
+        uint64_t localsOffset;
+        uint32_t variableNameCount;
+        uint32_t codeSize;
+        uint32_t constantCount;
+        uint32_t slotCount;
+        uint32_t localReferenceCount;
+        uint32_t variableCount; // of the program: one past the highest slot it reads
+        uint32_t localCount;
+        uint32_t maxStackDepth;
+    };
+
+    static_assert(sizeof(FileHeader) == 48 && sizeof(NameRecord) == 16 && sizeof(EntryRecord) == 88,
+                  "the records are the file layout");
+
+    // 64 bits of a word-at-a-time multiply-xorshift hash; it catches truncated
+    // and damaged files, it does not authenticate them
+    uint64_t checksum(const std::byte *data, size_t size)
+    {
+        uint64_t hash = 0x9E3779B97F4A7C15ull ^ size;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, data + i, sizeof(word));
+            hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+            hash ^= hash >> 32;
+        }
+        uint64_t tail = 0;
+        std::memcpy(&tail, data + i, size - i);
+        hash = (hash ^ tail) * 0xC4CEB9FE1A85EC53ull;
+        return hash ^ (hash >> 29);
+    }
+
+    // Appends to the file being written, each part aligned to its element size
+    class FileBuilder
+    {
+    public:
+        uint64_t append(const void *data, size_t size, size_t alignment)
+        {
+            bytes_.resize((bytes_.size() + alignment - 1) / alignment * alignment);
+            uint64_t offset = bytes_.size();
+            const std::byte *first = static_cast<const std::byte *>(data);
+            bytes_.insert(bytes_.end(), first, first + size);
+            return offset;
+        }
+
+        template <typename T>
+        uint64_t append(std::span<const T> values)
+        {
+            return append(values.data(), values.size_bytes(), alignof(T) < 8 ? alignof(T) : 8);
+        }
+
+        NameRecord appendString(std::string_view text)
+        {
+            return {append(text.data(), text.size(), 1), static_cast<uint32_t>(text.size()), 0};
+        }
+
+        std::vector<std::byte> &bytes() { return bytes_; }
+
+    private:
+        std::vector<std::byte> bytes_;
+    };
+
+    template <typename T>
+    const T *recordAt(const std::byte *base, uint64_t offset)
+    {
+        return reinterpret_cast<const T *>(base + offset);
+    }
+
+    // Checks that count elements of the given size and alignment at offset lie in the file
+    void checkRange(std::span<const std::byte> data, uint64_t offset, uint64_t count, size_t elementSize,
+                    size_t alignment)
+    {
+        if (offset % alignment != 0 || offset > data.size() || count > (data.size() - offset) / elementSize)
+            throw LibraryFormatError("The library has an entry outside the file");
+    }
+
+    std::string_view nameAt(std::span<const std::byte> data, const NameRecord &record)
+    {
+        checkRange(data, record.offset, record.length, 1, 1);
+        return {reinterpret_cast<const char *>(data.data() + record.offset), record.length};
+    }
+
+    // Runs through the program the way the interpreter does, checking that it only
+    // reads the values it has and that its stack stays within maxStackDepth
+    void checkProgram(const BytecodeView &program, const EntryRecord &entry)
+    {
+        size_t constants = 0, slots = 0, locals = 0, depth = 0, maxDepth = 0;
+        for (OpCode op : program.code())
+        {
+            if (static_cast<uint8_t>(op) >= OpCodeCount)
+                throw LibraryFormatError("The library has an unknown opcode");
+            bool valid = true;
+            switch (op)
+            {
+            case OpCode::Constant:
+                valid = constants++ < program.constants().size();
+                break;
+            case OpCode::Variable:
+                valid = slots < program.slots().size() && program.slots()[slots++] < program.variableCount();
+                break;
+            case OpCode::Store:
+            case OpCode::Load:
+                valid = locals < program.locals().size() && program.locals()[locals++] < program.localCount() &&
+                        (op == OpCode::Load || depth > 0);
+                break;
+            default:
+                valid = depth >= static_cast<size_t>(opcodeArity(op));
+                break;
+            }
+            if (!valid)
+                throw LibraryFormatError("The library has a program that reads past its values");
+            if (op != OpCode::Store)
+                depth = depth - opcodeArity(op) + 1;
+            maxDepth = std::max(maxDepth, depth);
+        }
+        if (depth != 1 || maxDepth > program.maxStackDepth() || constants != program.constants().size() ||
+            slots != program.slots().size() || locals != program.locals().size() ||
+            entry.variableCount > entry.variableNameCount)
+            throw LibraryFormatError("The library has an inconsistent program");
+    }
+}
+
+void ExpressionLibraryWriter::add(std::string name, const CompiledExpression &expression)
+{
+    add(std::move(name), expression.program(), expression.variableNames());
+}
+
+void ExpressionLibraryWriter::add(std::string name, const Bytecode &program, std::vector<std::string> variableNames)
+{
+    if (program.variableCount() > variableNames.size())
+        throw std::invalid_argument("The formula " + name + " reads a variable it has no name for");
+    if (!names_.insert(name).second)
+        throw std::invalid_argument("The library already has a formula named " + name);
+    entries_.push_back({std::move(name), program, std::move(variableNames)});
+}
+
+std::vector<std::byte> ExpressionLibraryWriter::serialize() const
+{
+    if constexpr (std::endian::native != std::endian::little)
+        throw std::runtime_error("Formula libraries are written on little-endian machines only");
+
+    // The index is sorted by name, so loading can search it in place
+    std::vector<const Entry *> sorted;
+    for (const Entry &entry : entries_)
+        sorted.push_back(&entry);
+    std::sort(sorted.begin(), sorted.end(), [](const Entry *a, const Entry *b) { return a->name < b->name; });
+
+    FileBuilder file;
+    FileHeader header = {};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = FormatVersion;
+    header.entryCount = static_cast<uint32_t>(sorted.size());
+    file.append(&header, sizeof(header), 8);
+    std::vector<EntryRecord> index(sorted.size());
+    header.indexOffset = file.append(index.data(), index.size() * sizeof(EntryRecord), 8);
+
+    for (size_t i = 0; i < sorted.size(); ++i)
+    {
+        const Entry &entry = *sorted[i];
+        EntryRecord &record = index[i];
+        BytecodeView program = entry.program.view();
+
+        record.name = file.appendString(entry.name);
+        std::vector<NameRecord> names;
+        for (const std::string &name : entry.variableNames)
+            names.push_back(file.appendString(name));
+        record.variableNamesOffset = file.append(std::span<const NameRecord>(names));
+        record.constantsOffset = file.append(program.constants());
+        record.slotsOffset = file.append(program.slots());
+        record.localsOffset = file.append(program.locals());
+        record.codeOffset = file.append(program.code());
+
+        record.variableNameCount = static_cast<uint32_t>(names.size());
+        record.codeSize = static_cast<uint32_t>(program.code().size());
+        record.constantCount = static_cast<uint32_t>(program.constants().size());
+        record.slotCount = static_cast<uint32_t>(program.slots().size());
+        record.localReferenceCount = static_cast<uint32_t>(program.locals().size());
+        record.variableCount = static_cast<uint32_t>(program.variableCount());
+        record.localCount = static_cast<uint32_t>(program.localCount());
+        record.maxStackDepth = static_cast<uint32_t>(program.maxStackDepth());
+    }
+
+    // The file ends on a whole word, so a mapping of it can be read word by word
+    std::vector<std::byte> &bytes = file.bytes();
+    bytes.resize((bytes.size() + 7) / 8 * 8);
+    if (!index.empty())
+        std::memcpy(bytes.data() + header.indexOffset, index.data(), index.size() * sizeof(EntryRecord));
+    header.fileSize = bytes.size();
+    header.checksum = checksum(bytes.data() + sizeof(FileHeader), bytes.size() - sizeof(FileHeader));
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    return std::move(bytes);
+}
+
+void ExpressionLibraryWriter::write(const std::string &path) const
+{
+    std::vector<std::byte> bytes = serialize();
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (!out.flush())
+        throw std::runtime_error("Cannot write " + path);
+}
+
+std::string_view LibraryExpression::variableName(size_t slot) const
+{
+    if (slot >= variableCount_)
+        throw std::out_of_range("No variable in slot " + std::to_string(slot));
+    const NameRecord &record = static_cast<const NameRecord *>(variableNames_)[slot];
+    return {reinterpret_cast<const char *>(base_ + record.offset), record.length};
+}
+
+size_t LibraryExpression::slot(std::string_view name) const
+{
+    for (size_t i = 0; i < variableCount_; ++i)
+    {
+        if (variableName(i) == name)
+            return i;
+    }
+    throw std::out_of_range("Unknown variable: " + std::string(name));
+}
+
+CompiledExpression LibraryExpression::toCompiled() const
+{
+    std::vector<std::string> names;
+    for (size_t i = 0; i < variableCount_; ++i)
+        names.emplace_back(variableName(i));
+    return CompiledExpression(Bytecode::fromView(program_), std::move(names));
+}
+
+ExpressionLibrary ExpressionLibrary::open(const std::string &path)
+{
+#ifdef EXPRESSION_LIBRARY_MMAP
+    int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+        throw std::runtime_error("Cannot open " + path);
+    struct stat status;
+    size_t size = ::fstat(descriptor, &status) == 0 ? static_cast<size_t>(status.st_size) : 0;
+    void *memory = size >= sizeof(FileHeader) ? ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0) : MAP_FAILED;
+    ::close(descriptor);
+    if (memory == MAP_FAILED)
+        throw LibraryFormatError(path + " is not a formula library");
+
+    // The mapping lives as long as the library or any expression taken from it
+    std::shared_ptr<const void> storage(memory, [size](const void *mapped) { ::munmap(const_cast<void *>(mapped), size); });
+    return ExpressionLibrary(std::move(storage), {static_cast<const std::byte *>(memory), size});
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+        throw std::runtime_error("Cannot open " + path);
+    size_t size = static_cast<size_t>(in.tellg());
+    auto words = std::make_shared<std::vector<uint64_t>>((size + 7) / 8);
+    in.seekg(0);
+    in.read(reinterpret_cast<char *>(words->data()), static_cast<std::streamsize>(size));
+    const std::byte *bytes = reinterpret_cast<const std::byte *>(words->data());
+    return ExpressionLibrary(std::move(words), {bytes, size});
+#endif
+}
+
+ExpressionLibrary ExpressionLibrary::fromBytes(std::span<const std::byte> data)
+{
+    return ExpressionLibrary(nullptr, data);
+}
+
+ExpressionLibrary::ExpressionLibrary(std::shared_ptr<const void> storage, std::span<const std::byte> data)
+    : storage_(std::move(storage)), data_(data)
+{
+    if constexpr (std::endian::native != std::endian::little)
+        throw LibraryFormatError("Formula libraries are read on little-endian machines only");
+    if (reinterpret_cast<uintptr_t>(data.data()) % 8 != 0)
+        throw std::invalid_argument("A formula library must be 8-byte aligned in memory");
+
+    FileHeader header;
+    if (data.size() < sizeof(header))
+        throw LibraryFormatError("The data is not a formula library");
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0)
+        throw LibraryFormatError("The data is not a formula library");
+    if (header.version != FormatVersion)
+        throw LibraryFormatError("The formula library has version " + std::to_string(header.version) +
+                                 ", this build reads version " + std::to_string(FormatVersion));
+    if (header.fileSize != data.size() ||
+        header.checksum != checksum(data.data() + sizeof(header), data.size() - sizeof(header)))
+        throw LibraryFormatError("The formula library is truncated or damaged");
+
+    checkRange(data, header.indexOffset, header.entryCount, sizeof(EntryRecord), 8);
+    index_ = data.data() + header.indexOffset;
+    entryCount_ = header.entryCount;
+
+    std::string_view previous;
+    for (size_t i = 0; i < entryCount_; ++i)
+    {
+        const EntryRecord &entry = static_cast<const EntryRecord *>(index_)[i];
+        std::string_view name = nameAt(data, entry.name);
+        if (i > 0 && name <= previous)
+            throw LibraryFormatError("The formula library index is not sorted");
+        previous = name;
+
+        checkRange(data, entry.variableNamesOffset, entry.variableNameCount, sizeof(NameRecord), 8);
+        for (uint32_t slot = 0; slot < entry.variableNameCount; ++slot)
+            nameAt(data, recordAt<NameRecord>(data.data(), entry.variableNamesOffset)[slot]);
+        checkRange(data, entry.codeOffset, entry.codeSize, sizeof(OpCode), 1);
+        checkRange(data, entry.constantsOffset, entry.constantCount, sizeof(double), 8);
+        checkRange(data, entry.slotsOffset, entry.slotCount, sizeof(uint32_t), 4);
+        checkRange(data, entry.localsOffset, entry.localReferenceCount, sizeof(uint32_t), 4);
+        checkProgram((*this)[i].program(), entry);
+    }
+}
+
+LibraryExpression ExpressionLibrary::operator[](size_t index) const
+{
+    if (index >= entryCount_)
+        throw std::out_of_range("The formula library has no entry " + std::to_string(index));
+
+    const std::byte *base = data_.data();
+    const EntryRecord &entry = static_cast<const EntryRecord *>(index_)[index];
+    LibraryExpression expression;
+    expression.storage_ = storage_;
+    expression.base_ = base;
+    expression.name_ = {reinterpret_cast<const char *>(base + entry.name.offset), entry.name.length};
+    expression.variableNames_ = recordAt<NameRecord>(base, entry.variableNamesOffset);
+    expression.variableCount_ = entry.variableNameCount;
+    expression.program_ = BytecodeView({recordAt<OpCode>(base, entry.codeOffset), entry.codeSize},
+                                       {recordAt<double>(base, entry.constantsOffset), entry.constantCount},
+                                       {recordAt<uint32_t>(base, entry.slotsOffset), entry.slotCount},
+                                       {recordAt<uint32_t>(base, entry.localsOffset), entry.localReferenceCount},
+                                       entry.variableCount, entry.localCount, entry.maxStackDepth);
+    return expression;
+}
+
+bool ExpressionLibrary::find(std::string_view name, LibraryExpression &expression) const
+{
+    const EntryRecord *entries = static_cast<const EntryRecord *>(index_);
+    const std::byte *base = data_.data();
+    auto nameOf = [base](const EntryRecord &entry)
+    {
+        return std::string_view(reinterpret_cast<const char *>(base + entry.name.offset), entry.name.length);
+    };
+
+    const EntryRecord *found = std::lower_bound(entries, entries + entryCount_, name,
+                                                [&](const EntryRecord &entry, std::string_view key)
+                                                { return nameOf(entry) < key; });
+    if (found == entries + entryCount_ || nameOf(*found) != name)
+        return false;
+    expression = (*this)[static_cast<size_t>(found - entries)];
+    return true;
+}
+
+LibraryExpression ExpressionLibrary::at(std::string_view name) const
+{
+    LibraryExpression expression;
+    if (!find(name, expression))
+        throw std::out_of_range("The formula library has no formula named " + std::string(name));
+    return expression;
+}
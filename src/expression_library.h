@@ -0,0 +1,142 @@
+/**
+ * @file expression_library.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef EXPRESSION_LIBRARY_H
+#define EXPRESSION_LIBRARY_H
+
+#include "bytecode.h"
+#include "compiled_expression.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// A file of compiled formulas, written once and loaded with mmap at startup
+// instead of parsing every formula again. Each formula is stored as its
+// Bytecode arrays (opcodes, constants, variable slots and locals) and its
+// variable names, with an index sorted by name. The arrays are laid out so that
+// a loaded formula evaluates straight from the mapped pages.
+//
+// The format is versioned and little-endian, and a checksum covers everything
+// after the header. Loading checks the checksum, then that every offset lies in
+// the file and that every program only reads the constants, slots, locals and
+// stack it has, so a damaged file is rejected instead of being run.
+// See README.md for the layout.
+
+// Thrown when a file is not a valid library: wrong magic or version, checksum
+// mismatch, or an entry that points outside the file
+class LibraryFormatError : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Collects formulas and writes them as a library file
+class ExpressionLibraryWriter
+{
+public:
+    // Adds a formula under a name; names must be unique
+    void add(std::string name, const CompiledExpression &expression);
+    void add(std::string name, const Bytecode &program, std::vector<std::string> variableNames);
+
+    size_t size() const { return entries_.size(); }
+
+    // The file contents, and the same written to a file
+    std::vector<std::byte> serialize() const;
+    void write(const std::string &path) const;
+
+private:
+    struct Entry
+    {
+        std::string name;
+        Bytecode program;
+        std::vector<std::string> variableNames;
+    };
+
+    std::vector<Entry> entries_;
+    std::unordered_set<std::string> names_;
+};
+
+class ExpressionLibrary;
+
+// A formula of a loaded library. It refers to the library's memory, which it
+// keeps alive, so it can outlive the ExpressionLibrary it came from.
+class LibraryExpression
+{
+public:
+    std::string_view name() const { return name_; }
+
+    // Same as the CompiledExpression the entry was written from
+    double evaluate(std::span<const double> values = {}) const { return program_.evaluate(values); }
+    Result<double> tryEvaluate(std::span<const double> values = {}) const { return program_.tryEvaluate(values); }
+    void evaluateBatch(const double *const *columns, size_t n, double *out, ErrorMode mode = ErrorMode::Report) const
+    {
+        program_.evaluateRows(columns, 0, n, out, mode);
+    }
+
+    size_t variableCount() const { return variableCount_; }
+    std::string_view variableName(size_t slot) const;
+
+    // Slot of the named variable; throws std::out_of_range for an unknown name
+    size_t slot(std::string_view name) const;
+
+    const BytecodeView &program() const { return program_; }
+
+    // Copies the formula into an owning CompiledExpression, e.g. for NativeExpression
+    CompiledExpression toCompiled() const;
+
+private:
+    friend class ExpressionLibrary;
+
+    std::shared_ptr<const void> storage_;
+    const std::byte *base_ = nullptr;
+    std::string_view name_;
+    const void *variableNames_ = nullptr; // the entry's name records in the file
+    size_t variableCount_ = 0;
+    BytecodeView program_;
+};
+
+// A library file mapped into memory. Nothing is copied or parsed when it is
+// loaded; looking a formula up is a binary search over the index.
+class ExpressionLibrary
+{
+public:
+    // Maps the file (reads it into memory where mmap is not available)
+    static ExpressionLibrary open(const std::string &path);
+
+    // Uses bytes that the caller keeps alive and unchanged while the library and
+    // its expressions are in use; data must be 8-byte aligned
+    static ExpressionLibrary fromBytes(std::span<const std::byte> data);
+
+    size_t size() const { return entryCount_; }
+
+    // The formula at a position of the index (sorted by name)
+    LibraryExpression operator[](size_t index) const;
+
+    // The named formula; find returns false, at throws std::out_of_range, if there is none
+    bool find(std::string_view name, LibraryExpression &expression) const;
+    LibraryExpression at(std::string_view name) const;
+
+    // Mapped bytes
+    size_t byteSize() const { return data_.size(); }
+
+private:
+    ExpressionLibrary(std::shared_ptr<const void> storage, std::span<const std::byte> data);
+
+    std::shared_ptr<const void> storage_;
+    std::span<const std::byte> data_;
+    const void *index_ = nullptr; // the entry records, sorted by name
+    size_t entryCount_ = 0;
+};
+
+#endif // EXPRESSION_LIBRARY_H
@@ -7,93 +7,408 @@
  */
 
 #include "expression_tree.h"
+#include <algorithm>
+
+const NodePtr &Node::operand(size_t) const
+{
+    throw std::out_of_range("Node has no operands");
+}
+
+Result<double> Node::tryEvaluate(std::span<const double> variables) const
+{
+    try
+    {
+        return evaluate(variables);
+    }
+    catch (const ExpressionError &error)
+    {
+        return error.error();
+    }
+}
+
+void Node::evaluateBatch(const double *const *columns, size_t n, double *out, ErrorMode mode) const
+{
+    evaluateRows(columns, 0, n, out, mode);
+}
+
+void Node::evaluateRows(const double *const *columns, size_t begin, size_t end, double *out, ErrorMode mode) const
+{
+    BatchContext context(columns, mode);
+    for (size_t offset = begin; offset < end; offset += BatchChunkSize)
+    {
+        context.setOffset(offset);
+        if (depth_ <= MaxRecursionDepth)
+            computeChunk(context, std::min(BatchChunkSize, end - offset), out + offset);
+        else
+            computeChunkDeep(context, std::min(BatchChunkSize, end - offset), out + offset);
+    }
+}
+
+double Node::evaluateDeep(std::span<const double> variables) const
+{
+    // A node waiting for its operands, with the number already on values
+    struct Frame
+    {
+        const Node *node;
+        size_t done;
+    };
+    std::vector<Frame> frames = {{this, 0}};
+    std::vector<double> values;
+
+    while (!frames.empty())
+    {
+        Frame &frame = frames.back();
+        const Node *node = frame.node;
+        if (node->depth_ <= MaxRecursionDepth)
+        {
+            values.push_back(node->compute(variables));
+            frames.pop_back();
+        }
+        else if (frame.done < node->operandCount())
+        {
+            const Node *operand = node->operand(frame.done++).get();
+            frames.push_back({operand, 0});
+        }
+        else
+        {
+            double right = 0.0;
+            if (node->operandCount() == 2)
+            {
+                right = values.back();
+                values.pop_back();
+            }
+            values.back() = applyOperation(node->opcode(), values.back(), right);
+            frames.pop_back();
+        }
+    }
+
+    return values.back();
+}
+
+void Node::computeChunkDeep(BatchContext &context, size_t count, double *out) const
+{
+    // The deeper operand of a binary node is computed first, so a chain nested on
+    // either side holds two chunks at a time instead of one per level
+    struct Frame
+    {
+        const Node *node;
+        size_t done;
+        bool rightFirst;
+    };
+    std::vector<Frame> frames = {{this, 0, false}};
+    std::vector<double *> values; // chunks from context, in the order they were acquired
+
+    while (!frames.empty())
+    {
+        Frame &frame = frames.back();
+        const Node *node = frame.node;
+        size_t operands = node->operandCount();
+        if (node->depth_ <= MaxRecursionDepth)
+        {
+            values.push_back(context.acquire());
+            node->computeChunk(context, count, values.back());
+            frames.pop_back();
+        }
+        else if (frame.done < operands)
+        {
+            if (frame.done == 0 && operands == 2)
+                frame.rightFirst = node->operand(1)->depth() > node->operand(0)->depth();
+            size_t index = frame.rightFirst ? 1 - frame.done : frame.done;
+            ++frame.done;
+            frames.push_back({node->operand(index).get(), 0, false});
+        }
+        else if (operands == 1)
+        {
+            applyOperationBatch(node->opcode(), values.back(), nullptr, count, context.mode());
+            frames.pop_back();
+        }
+        else
+        {
+            double *second = values.back();
+            values.pop_back();
+            double *first = values.back();
+            if (frame.rightFirst)
+            {
+                applyOperationBatch(node->opcode(), second, first, count, context.mode());
+                std::copy(second, second + count, first);
+            }
+            else
+            {
+                applyOperationBatch(node->opcode(), first, second, count, context.mode());
+            }
+            context.release();
+            frames.pop_back();
+        }
+    }
+
+    std::copy(values.back(), values.back() + count, out);
+    context.release();
+}
+
+void Node::destroyDeepOperands()
+{
+    std::vector<NodePtr> detached;
+    detachDeepOperands(detached);
+    while (!detached.empty())
+    {
+        // Each node gives up its own deep operands before it is destroyed here
+        NodePtr node = std::move(detached.back());
+        detached.pop_back();
+        node->detachDeepOperands(detached);
+    }
+}
+
+UnaryOperationNode::~UnaryOperationNode()
+{
+    if (depth_ > MaxRecursionDepth)
+        destroyDeepOperands();
+}
+
+void UnaryOperationNode::detachDeepOperands(std::vector<NodePtr> &detached)
+{
+    if (operand_ && operand_->depth() > MaxRecursionDepth && operand_.use_count() == 1)
+        detached.push_back(std::move(operand_));
+}
+
+BinaryOperationNode::~BinaryOperationNode()
+{
+    if (depth_ > MaxRecursionDepth)
+        destroyDeepOperands();
+}
+
+void BinaryOperationNode::detachDeepOperands(std::vector<NodePtr> &detached)
+{
+    for (NodePtr *operand : {&left_, &right_})
+    {
+        if (*operand && (*operand)->depth() > MaxRecursionDepth && operand->use_count() == 1)
+            detached.push_back(std::move(*operand));
+    }
+}
+
+const NodePtr &UnaryOperationNode::operand(size_t index) const
+{
+    if (index != 0)
+        throw std::out_of_range("Unary node has a single operand");
+    return operand_;
+}
+
+const NodePtr &BinaryOperationNode::operand(size_t index) const
+{
+    if (index > 1)
+        throw std::out_of_range("Binary node has two operands");
+    return index == 0 ? left_ : right_;
+}
+
+void UnaryOperationNode::computeChunk(BatchContext &context, size_t count, double *out) const
+{
+    operand_->computeChunk(context, count, out);
+    applyOperationBatch(opcode(), out, nullptr, count, context.mode());
+}
+
+void BinaryOperationNode::computeChunk(BatchContext &context, size_t count, double *out) const
+{
+    left_->computeChunk(context, count, out);
+    double *right = context.acquire();
+    right_->computeChunk(context, count, right);
+    applyOperationBatch(opcode(), out, right, count, context.mode());
+    context.release();
+}
 
 // ConstantNode implementation
 ConstantNode::ConstantNode(double value) : value_(value) {}
-double ConstantNode::evaluate() const
+double ConstantNode::compute(std::span<const double>) const
 {
     return value_;
 }
+OpCode ConstantNode::opcode() const
+{
+    return OpCode::Constant;
+}
+void ConstantNode::computeChunk(BatchContext &, size_t count, double *out) const
+{
+    std::fill(out, out + count, value_);
+}
+
+// VariableNode implementation
+VariableNode::VariableNode(std::string name, size_t slot) : name_(std::move(name)), slot_(slot) {}
+double VariableNode::compute(std::span<const double> variables) const
+{
+    if (slot_ >= variables.size())
+        throw std::out_of_range("No value given for variable " + name_);
+    return variables[slot_];
+}
+OpCode VariableNode::opcode() const
+{
+    return OpCode::Variable;
+}
+void VariableNode::computeChunk(BatchContext &context, size_t count, double *out) const
+{
+    const double *column = context.column(slot_);
+    std::copy(column, column + count, out);
+}
 
 // AdditionNode implementation
-AdditionNode::AdditionNode(NodePtr left, NodePtr right) : left_(left), right_(right) {}
-double AdditionNode::evaluate() const
+AdditionNode::AdditionNode(NodePtr left, NodePtr right) : BinaryOperationNode(left, right) {}
+double AdditionNode::compute(std::span<const double> variables) const
 {
-    return left_->evaluate() + right_->evaluate();
+    double left = left_->evaluate(variables);
+    return left + right_->evaluate(variables);
+}
+OpCode AdditionNode::opcode() const
+{
+    return OpCode::Add;
 }
 
 // SubtractionNode implementation
-SubtractionNode::SubtractionNode(NodePtr left, NodePtr right) : left_(left), right_(right) {}
-double SubtractionNode::evaluate() const
+SubtractionNode::SubtractionNode(NodePtr left, NodePtr right) : BinaryOperationNode(left, right) {}
+double SubtractionNode::compute(std::span<const double> variables) const
+{
+    double left = left_->evaluate(variables);
+    return left - right_->evaluate(variables);
+}
+OpCode SubtractionNode::opcode() const
 {
-    return left_->evaluate() - right_->evaluate();
+    return OpCode::Subtract;
 }
 
 // MultiplicationNode implementation
-MultiplicationNode::MultiplicationNode(NodePtr left, NodePtr right) : left_(left), right_(right) {}
-double MultiplicationNode::evaluate() const
+MultiplicationNode::MultiplicationNode(NodePtr left, NodePtr right) : BinaryOperationNode(left, right) {}
+double MultiplicationNode::compute(std::span<const double> variables) const
+{
+    double left = left_->evaluate(variables);
+    return left * right_->evaluate(variables);
+}
+OpCode MultiplicationNode::opcode() const
 {
-    return left_->evaluate() * right_->evaluate();
+    return OpCode::Multiply;
 }
 
 // DivisionNode implementation
-DivisionNode::DivisionNode(NodePtr left, NodePtr right) : left_(left), right_(right) {}
-double DivisionNode::evaluate() const
+DivisionNode::DivisionNode(NodePtr left, NodePtr right) : BinaryOperationNode(left, right) {}
+double DivisionNode::compute(std::span<const double> variables) const
 {
-    double denominator = right_->evaluate();
+    double numerator = left_->evaluate(variables);
+    double denominator = right_->evaluate(variables);
     if (denominator == 0.0)
-    {
-        std::cerr << "Error: division by 0." << std::endl;
-        exit(1);
-    }
-    return left_->evaluate() / denominator;
+        failOperation(OpCode::Divide);
+    return numerator / denominator;
+}
+OpCode DivisionNode::opcode() const
+{
+    return OpCode::Divide;
+}
+
+// NegationNode implementation
+double NegationNode::compute(std::span<const double> variables) const
+{
+    return -operand_->evaluate(variables);
+}
+
+SinNode::SinNode(NodePtr operand) : UnaryOperationNode(operand) {}
+double SinNode::compute(std::span<const double> variables) const
+{
+    return std::sin(operand_->evaluate(variables));
 }
-SinNode::SinNode(NodePtr operand) : operand_(operand) {}
-double SinNode::evaluate() const
+OpCode SinNode::opcode() const
 {
-    return std::sin(operand_->evaluate());
+    return OpCode::Sin;
 }
-CosNode::CosNode(NodePtr operand) : operand_(operand) {}
-double CosNode::evaluate() const
+CosNode::CosNode(NodePtr operand) : UnaryOperationNode(operand) {}
+double CosNode::compute(std::span<const double> variables) const
 {
-    return std::cos(operand_->evaluate());
+    return std::cos(operand_->evaluate(variables));
+}
+OpCode CosNode::opcode() const
+{
+    return OpCode::Cos;
 }
 
-TanNode::TanNode(NodePtr operand) : operand_(operand) {}
-double TanNode::evaluate() const
+TanNode::TanNode(NodePtr operand) : UnaryOperationNode(operand) {}
+double TanNode::compute(std::span<const double> variables) const
+{
+    return std::tan(operand_->evaluate(variables));
+}
+OpCode TanNode::opcode() const
 {
-    return std::tan(operand_->evaluate());
+    return OpCode::Tan;
 }
 
-CotNode::CotNode(NodePtr operand) : operand_(operand) {}
-double CotNode::evaluate() const
+CotNode::CotNode(NodePtr operand) : UnaryOperationNode(operand) {}
+double CotNode::compute(std::span<const double> variables) const
 {
-    double tanValue = std::tan(operand_->evaluate());
+    double tanValue = std::tan(operand_->evaluate(variables));
     if (tanValue == 0.0)
-    {
-        std::cerr << "Error: Tan value is 0." << std::endl;
-        exit(1);
-    }
+        failOperation(OpCode::Cot);
     return 1.0 / tanValue;
 }
+OpCode CotNode::opcode() const
+{
+    return OpCode::Cot;
+}
 
-double LnNode::evaluate() const
+double LnNode::compute(std::span<const double> variables) const
 {
-    return std::log(operand_->evaluate());
+    return std::log(operand_->evaluate(variables));
 }
 
-double LogNode::evaluate() const
+double LogNode::compute(std::span<const double> variables) const
 {
-    return std::log10(operand_->evaluate());
+    return std::log10(operand_->evaluate(variables));
 }
 
-double SqrtNode::evaluate() const
+double SqrtNode::compute(std::span<const double> variables) const
 {
-    double value = operand_->evaluate();
+    double value = operand_->evaluate(variables);
     if (value < 0.0)
+        failOperation(OpCode::Sqrt);
+    return std::sqrt(value);
+}
+
+NodePtr makeOperationNode(OpCode op, NodePtr left, NodePtr right)
+{
+    switch (op)
     {
-        std::cerr << "Error: The square root of a negative number cannot be taken." << std::endl;
-        exit(1);
+    case OpCode::Add:
+        return std::make_shared<AdditionNode>(left, right);
+    case OpCode::Subtract:
+        return std::make_shared<SubtractionNode>(left, right);
+    case OpCode::Multiply:
+        return std::make_shared<MultiplicationNode>(left, right);
+    case OpCode::Divide:
+        return std::make_shared<DivisionNode>(left, right);
+    case OpCode::Power:
+        return std::make_shared<PowerNode>(left, right);
+    case OpCode::Negate:
+        return std::make_shared<NegationNode>(left);
+    case OpCode::Sin:
+        return std::make_shared<SinNode>(left);
+    case OpCode::Cos:
+        return std::make_shared<CosNode>(left);
+    case OpCode::Tan:
+        return std::make_shared<TanNode>(left);
+    case OpCode::Cot:
+        return std::make_shared<CotNode>(left);
+    case OpCode::Ln:
+        return std::make_shared<LnNode>(left);
+    case OpCode::Log:
+        return std::make_shared<LogNode>(left);
+    case OpCode::Sqrt:
+        return std::make_shared<SqrtNode>(left);
+    case OpCode::Sinh:
+        return std::make_shared<SinhNode>(left);
+    case OpCode::Cosh:
+        return std::make_shared<CoshNode>(left);
+    case OpCode::Tanh:
+        return std::make_shared<TanhNode>(left);
+    case OpCode::Coth:
+        return std::make_shared<CothNode>(left);
+    case OpCode::Sech:
+        return std::make_shared<SechNode>(left);
+    case OpCode::Csch:
+        return std::make_shared<CschNode>(left);
+    case OpCode::Factorial:
+        return std::make_shared<FactorialNode>(left);
+    default:
+        throw std::invalid_argument("Constant and variable nodes have no operands");
     }
-    return std::sqrt(value);
 }
@@ -9,18 +9,86 @@
 #ifndef EXPRESSION_TREE_H
 #define EXPRESSION_TREE_H
 
+#include "batch.h"
+#include "opcode.h"
+#include "result.h"
+#include <algorithm>
 #include <memory>
 #include <iostream>
 #include <cmath>
-
-// base node class
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Trees up to this depth are evaluated, batch evaluated and destroyed by plain
+// recursion. Deeper ones are walked with an explicit stack on the heap, and only
+// their subtrees of at most this depth recurse, so any depth that fits in memory
+// works without overflowing the call stack.
+constexpr size_t MaxRecursionDepth = 256;
+
+// base node class. Nodes are immutable once built and evaluation only reads them
+// (every evaluate call keeps its state on its own stack or BatchContext), so one
+// tree can be evaluated from any number of threads at the same time.
 class Node
 {
 public:
     virtual ~Node() = default;
 
     // Calculates the value of this node
-    virtual double evaluate() const = 0;
+    double evaluate() const { return evaluate({}); }
+
+    // Calculates the value of this node, reading variables by slot index
+    double evaluate(std::span<const double> variables) const
+    {
+        return depth_ <= MaxRecursionDepth ? compute(variables) : evaluateDeep(variables);
+    }
+
+    // Same as evaluate, but returns a domain error (division by 0, ...) instead
+    // of throwing it as an ExpressionError
+    Result<double> tryEvaluate(std::span<const double> variables = {}) const;
+
+    // Calculates the value for rows 0..n-1 of a columnar input: columns[slot] holds
+    // the n values of the variable in that slot, out receives one result per row.
+    // Rows go through the tree a chunk at a time, one node after the other.
+    // With ErrorMode::Propagate a bad row gets inf or NaN instead of stopping the batch.
+    void evaluateBatch(const double *const *columns, size_t n, double *out,
+                       ErrorMode mode = ErrorMode::Report) const;
+
+    // Same as evaluateBatch for rows begin..end-1 only: out[row] receives the result of each row
+    void evaluateRows(const double *const *columns, size_t begin, size_t end, double *out,
+                      ErrorMode mode = ErrorMode::Report) const;
+
+    // Computes the context's current chunk of rows (count <= BatchChunkSize) into out
+    virtual void computeChunk(BatchContext &context, size_t count, double *out) const = 0;
+
+    // The operation this node performs
+    virtual OpCode opcode() const = 0;
+
+    // Child nodes, left to right
+    virtual size_t operandCount() const { return 0; }
+    virtual const std::shared_ptr<Node> &operand(size_t index) const;
+
+    // Nodes on the longest path from this node down to a leaf, counting both
+    size_t depth() const { return depth_; }
+
+protected:
+    // Implemented by every node type; children are evaluated with the same variables
+    virtual double compute(std::span<const double> variables) const = 0;
+
+    // Moves out the operands that are deeper than MaxRecursionDepth and have no
+    // other owner, so that they are destroyed by a loop instead of by nested destructors
+    virtual void detachDeepOperands(std::vector<std::shared_ptr<Node>> &detached) { (void)detached; }
+
+    // Destroys the deep operands one after the other; called by the destructors of deep nodes
+    void destroyDeepOperands();
+
+    size_t depth_ = 1;
+
+private:
+    // evaluate and computeChunk for trees deeper than MaxRecursionDepth
+    double evaluateDeep(std::span<const double> variables) const;
+    void computeChunkDeep(BatchContext &context, size_t count, double *out) const;
 };
 
 using NodePtr = std::shared_ptr<Node>;
@@ -28,125 +96,165 @@ using NodePtr = std::shared_ptr<Node>;
 class UnaryOperationNode : public Node
 {
 public:
-    explicit UnaryOperationNode(NodePtr operand) : operand_(operand) {}
-    virtual ~UnaryOperationNode() = default;
+    explicit UnaryOperationNode(NodePtr operand) : operand_(operand) { depth_ = operand_->depth() + 1; }
+    virtual ~UnaryOperationNode();
+
+    size_t operandCount() const override { return 1; }
+    const NodePtr &operand(size_t index) const override;
+
+    // Computes the operand into out, then applies opcode() in place
+    void computeChunk(BatchContext &context, size_t count, double *out) const override;
 
 protected:
+    void detachDeepOperands(std::vector<NodePtr> &detached) override;
+
     NodePtr operand_;
 };
 
+class BinaryOperationNode : public Node
+{
+public:
+    BinaryOperationNode(NodePtr left, NodePtr right) : left_(left), right_(right)
+    {
+        depth_ = std::max(left_->depth(), right_->depth()) + 1;
+    }
+    virtual ~BinaryOperationNode();
+
+    size_t operandCount() const override { return 2; }
+    const NodePtr &operand(size_t index) const override;
+
+    // Computes the left operand into out and the right one into scratch, then applies opcode()
+    void computeChunk(BatchContext &context, size_t count, double *out) const override;
+
+protected:
+    void detachDeepOperands(std::vector<NodePtr> &detached) override;
+
+    NodePtr left_;
+    NodePtr right_;
+};
+
 // Node representing constant values
 class ConstantNode : public Node
 {
 public:
     ConstantNode(double value);
-    double evaluate() const override;
+    double compute(std::span<const double> variables) const override;
+    OpCode opcode() const override;
+    void computeChunk(BatchContext &context, size_t count, double *out) const override;
+
+    double value() const { return value_; }
 
 private:
     double value_;
 };
 
-// Node performing aggregation between two child nodes
-class AdditionNode : public Node
+// Node reading a variable from the values passed to evaluate
+class VariableNode : public Node
 {
 public:
-    AdditionNode(NodePtr left, NodePtr right);
-    double evaluate() const override;
+    VariableNode(std::string name, size_t slot);
+    double compute(std::span<const double> variables) const override;
+    OpCode opcode() const override;
+    void computeChunk(BatchContext &context, size_t count, double *out) const override;
+
+    const std::string &name() const { return name_; }
+    size_t slot() const { return slot_; }
 
 private:
-    NodePtr left_;
-    NodePtr right_;
+    std::string name_;
+    size_t slot_;
+};
+
+// Node performing aggregation between two child nodes
+class AdditionNode : public BinaryOperationNode
+{
+public:
+    AdditionNode(NodePtr left, NodePtr right);
+    double compute(std::span<const double> variables) const override;
+    OpCode opcode() const override;
 };
 
 // Node performing subtraction between two child nodes
-class SubtractionNode : public Node
+class SubtractionNode : public BinaryOperationNode
 {
 public:
     SubtractionNode(NodePtr left, NodePtr right);
-    double evaluate() const override;
-
-private:
-    NodePtr left_;
-    NodePtr right_;
+    double compute(std::span<const double> variables) const override;
+    OpCode opcode() const override;
 };
 
 // Node performing multiplication between two child nodes
-class MultiplicationNode : public Node
+class MultiplicationNode : public BinaryOperationNode
 {
 public:
     MultiplicationNode(NodePtr left, NodePtr right);
-    double evaluate() const override;
-
-private:
-    NodePtr left_;
-    NodePtr right_;
+    double compute(std::span<const double> variables) const override;
+    OpCode opcode() const override;
 };
 
 // Node that performs division between two child nodes
-class DivisionNode : public Node
+class DivisionNode : public BinaryOperationNode
 {
 public:
     DivisionNode(NodePtr left, NodePtr right);
-    double evaluate() const override;
+    double compute(std::span<const double> variables) const override;
+    OpCode opcode() const override;
+};
 
-private:
-    NodePtr left_;
-    NodePtr right_;
+// Node that negates its child node (unary minus)
+class NegationNode : public UnaryOperationNode
+{
+public:
+    explicit NegationNode(NodePtr operand) : UnaryOperationNode(operand) {}
+
+    double compute(std::span<const double> variables) const override;
+    OpCode opcode() const override { return OpCode::Negate; }
 };
 
-class PowerNode : public Node
+class PowerNode : public BinaryOperationNode
 {
 public:
-    PowerNode(NodePtr left, NodePtr right) : left_(left), right_(right) {}
+    PowerNode(NodePtr left, NodePtr right) : BinaryOperationNode(left, right) {}
 
-    double evaluate() const override
+    double compute(std::span<const double> variables) const override
     {
-        return std::pow(left_->evaluate(), right_->evaluate());
+        double base = left_->evaluate(variables);
+        return std::pow(base, right_->evaluate(variables));
     }
 
-private:
-    NodePtr left_;
-    NodePtr right_;
+    OpCode opcode() const override { return OpCode::Power; }
 };
 
-class SinNode : public Node
+class SinNode : public UnaryOperationNode
 {
 public:
     SinNode(NodePtr operand);
-    double evaluate() const override;
-
-private:
-    NodePtr operand_;
+    double compute(std::span<const double> variables) const override;
+    OpCode opcode() const override;
 };
 
-class CosNode : public Node
+class CosNode : public UnaryOperationNode
 {
 public:
     CosNode(NodePtr operand);
-    double evaluate() const override;
-
-private:
-    NodePtr operand_;
+    double compute(std::span<const double> variables) const override;
+    OpCode opcode() const override;
 };
 
-class TanNode : public Node
+class TanNode : public UnaryOperationNode
 {
 public:
     TanNode(NodePtr operand);
-    double evaluate() const override;
-
-private:
-    NodePtr operand_;
+    double compute(std::span<const double> variables) const override;
+    OpCode opcode() const override;
 };
 
-class CotNode : public Node
+class CotNode : public UnaryOperationNode
 {
 public:
     CotNode(NodePtr operand);
-    double evaluate() const override;
-
-private:
-    NodePtr operand_;
+    double compute(std::span<const double> variables) const override;
+    OpCode opcode() const override;
 };
 
 class LnNode : public UnaryOperationNode
@@ -154,7 +262,8 @@ class LnNode : public UnaryOperationNode
 public:
     explicit LnNode(NodePtr operand) : UnaryOperationNode(operand) {}
 
-    double evaluate() const override;
+    double compute(std::span<const double> variables) const override;
+    OpCode opcode() const override { return OpCode::Ln; }
 };
 
 class LogNode : public UnaryOperationNode
@@ -162,7 +271,8 @@ class LogNode : public UnaryOperationNode
 public:
     explicit LogNode(NodePtr operand) : UnaryOperationNode(operand) {}
 
-    double evaluate() const override;
+    double compute(std::span<const double> variables) const override;
+    OpCode opcode() const override { return OpCode::Log; }
 };
 
 class SqrtNode : public UnaryOperationNode
@@ -170,7 +280,8 @@ class SqrtNode : public UnaryOperationNode
 public:
     explicit SqrtNode(NodePtr operand) : UnaryOperationNode(operand) {}
 
-    double evaluate() const override;
+    double compute(std::span<const double> variables) const override;
+    OpCode opcode() const override { return OpCode::Sqrt; }
 };
 
 class SinhNode : public UnaryOperationNode
@@ -178,9 +289,11 @@ class SinhNode : public UnaryOperationNode
 public:
     SinhNode(const NodePtr &operand) : UnaryOperationNode(operand) {}
 
-    double evaluate() const override
+    OpCode opcode() const override { return OpCode::Sinh; }
+
+    double compute(std::span<const double> variables) const override
     {
-        return std::sinh(operand_->evaluate());
+        return std::sinh(operand_->evaluate(variables));
     }
 };
 
@@ -189,9 +302,11 @@ class CoshNode : public UnaryOperationNode
 public:
     CoshNode(const NodePtr &operand) : UnaryOperationNode(operand) {}
 
-    double evaluate() const override
+    OpCode opcode() const override { return OpCode::Cosh; }
+
+    double compute(std::span<const double> variables) const override
     {
-        return std::cosh(operand_->evaluate());
+        return std::cosh(operand_->evaluate(variables));
     }
 };
 
@@ -200,9 +315,11 @@ class TanhNode : public UnaryOperationNode
 public:
     TanhNode(const NodePtr &operand) : UnaryOperationNode(operand) {}
 
-    double evaluate() const override
+    OpCode opcode() const override { return OpCode::Tanh; }
+
+    double compute(std::span<const double> variables) const override
     {
-        return std::tanh(operand_->evaluate());
+        return std::tanh(operand_->evaluate(variables));
     }
 };
 
@@ -211,9 +328,11 @@ class CothNode : public UnaryOperationNode
 public:
     CothNode(const NodePtr &operand) : UnaryOperationNode(operand) {}
 
-    double evaluate() const override
+    OpCode opcode() const override { return OpCode::Coth; }
+
+    double compute(std::span<const double> variables) const override
     {
-        double tanhVal = std::tanh(operand_->evaluate());
+        double tanhVal = std::tanh(operand_->evaluate(variables));
         if (tanhVal != 0)
         {
             return 1 / tanhVal;
@@ -229,9 +348,11 @@ class SechNode : public UnaryOperationNode
 public:
     SechNode(const NodePtr &operand) : UnaryOperationNode(operand) {}
 
-    double evaluate() const override
+    OpCode opcode() const override { return OpCode::Sech; }
+
+    double compute(std::span<const double> variables) const override
     {
-        return 1 / std::cosh(operand_->evaluate());
+        return 1 / std::cosh(operand_->evaluate(variables));
     }
 };
 
@@ -240,9 +361,11 @@ class CschNode : public UnaryOperationNode
 public:
     CschNode(const NodePtr &operand) : UnaryOperationNode(operand) {}
 
-    double evaluate() const override
+    OpCode opcode() const override { return OpCode::Csch; }
+
+    double compute(std::span<const double> variables) const override
     {
-        double sinhVal = std::sinh(operand_->evaluate());
+        double sinhVal = std::sinh(operand_->evaluate(variables));
         if (sinhVal != 0)
         {
             return 1 / sinhVal;
@@ -258,21 +381,16 @@ class FactorialNode : public UnaryOperationNode
 public:
     FactorialNode(const NodePtr &operand) : UnaryOperationNode(operand) {}
 
-    double evaluate() const override
-    {
-        int n = static_cast<int>(operand_->evaluate());
-        if (n < 0)
-            throw std::runtime_error("Negative factorial cannot be calculated");
-        return factorial(n);
-    }
+    OpCode opcode() const override { return OpCode::Factorial; }
 
-private:
-    double factorial(int n) const
+    double compute(std::span<const double> variables) const override
     {
-        if (n <= 1)
-            return 1;
-        return n * factorial(n - 1);
+        return factorialValue(operand_->evaluate(variables));
     }
 };
 
+// Creates the node of a unary or binary operation (not Constant or Variable);
+// right is only used by binary operations
+NodePtr makeOperationNode(OpCode op, NodePtr left, NodePtr right = nullptr);
+
 #endif // EXPRESSION_TREE_H
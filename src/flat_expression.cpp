@@ -0,0 +1,313 @@
+/**
+ * @file flat_expression.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "flat_expression.h"
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace
+{
+    // The operand fields or the constant's bits, whichever the node uses
+    uint64_t nodeKey(const FlatNode &node)
+    {
+        uint64_t key;
+        std::memcpy(&key, &node.value, sizeof(key));
+        return key;
+    }
+
+    size_t nodeHash(const FlatNode &node)
+    {
+        uint64_t hash = (nodeKey(node) ^ (static_cast<uint64_t>(node.op) << 56)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(hash ^ (hash >> 29));
+    }
+}
+
+uint32_t FlatExpression::addConstant(double value)
+{
+    FlatNode node;
+    node.op = OpCode::Constant;
+    node.value = value;
+    nodes_.push_back(node);
+    return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+uint32_t FlatExpression::addVariable(uint32_t slot)
+{
+    return addBinary(OpCode::Variable, slot, 0);
+}
+
+uint32_t FlatExpression::addUnary(OpCode op, uint32_t operand)
+{
+    return addBinary(op, operand, 0);
+}
+
+uint32_t FlatExpression::addBinary(OpCode op, uint32_t left, uint32_t right)
+{
+    FlatNode node;
+    node.op = op;
+    node.operands.left = left;
+    node.operands.right = right;
+    nodes_.push_back(node);
+    return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+void FlatExpression::reserve(size_t nodeCount)
+{
+    nodes_.reserve(nodeCount);
+}
+
+double FlatExpression::evaluateWith(std::vector<double> &scratch, std::span<const double> variables) const
+{
+    // The result is the last node, and there is none to read
+    if (nodes_.empty())
+        throw std::logic_error("Cannot evaluate an empty expression");
+
+    scratch.resize(nodes_.size());
+    double *values = scratch.data();
+
+    // The common operations are inlined; everything else shares the Node semantics in applyOperation
+    for (size_t i = 0; i < nodes_.size(); ++i)
+    {
+        const FlatNode &node = nodes_[i];
+        switch (node.op)
+        {
+        case OpCode::Constant:
+            values[i] = node.value;
+            break;
+        case OpCode::Variable:
+            if (node.operands.left >= variables.size())
+                throw std::out_of_range("No value given for variable slot " + std::to_string(node.operands.left));
+            values[i] = variables[node.operands.left];
+            break;
+        case OpCode::Add:
+            values[i] = values[node.operands.left] + values[node.operands.right];
+            break;
+        case OpCode::Subtract:
+            values[i] = values[node.operands.left] - values[node.operands.right];
+            break;
+        case OpCode::Multiply:
+            values[i] = values[node.operands.left] * values[node.operands.right];
+            break;
+        case OpCode::Negate:
+            values[i] = -values[node.operands.left];
+            break;
+        default:
+            values[i] = applyOperation(node.op, values[node.operands.left], values[node.operands.right]);
+            break;
+        }
+    }
+
+    return values[nodes_.size() - 1];
+}
+
+double FlatExpression::evaluate(std::span<const double> variables) const
+{
+    std::vector<double> scratch;
+    return evaluateWith(scratch, variables);
+}
+
+NodePtr FlatExpression::toTree() const
+{
+    std::vector<NodePtr> built(nodes_.size());
+
+    for (size_t i = 0; i < nodes_.size(); ++i)
+    {
+        const FlatNode &node = nodes_[i];
+        NodePtr left = opcodeArity(node.op) == 0 ? nullptr : built[node.operands.left];
+        NodePtr right = opcodeArity(node.op) == 2 ? built[node.operands.right] : nullptr;
+
+        switch (node.op)
+        {
+        case OpCode::Constant:
+            built[i] = std::make_shared<ConstantNode>(node.value);
+            break;
+        case OpCode::Variable:
+        {
+            uint32_t slot = node.operands.left;
+            std::string name = slot < variableNames_.size() ? variableNames_[slot] : "#" + std::to_string(slot);
+            built[i] = std::make_shared<VariableNode>(name, slot);
+            break;
+        }
+        default:
+            built[i] = makeOperationNode(node.op, left, right);
+            break;
+        }
+    }
+
+    return built.empty() ? nullptr : built.back();
+}
+
+FlatExpression FlatExpression::fromTree(const Node &root)
+{
+    FlatExpression output;
+    NodeInterner interner;
+    interner.reset(output, 64);
+    std::unordered_map<const Node *, uint32_t> added;
+    std::vector<std::string> names;
+
+    // Postorder with an explicit stack, so any depth works
+    struct Frame
+    {
+        const Node *node;
+        size_t done;
+    };
+    std::vector<Frame> frames = {{&root, 0}};
+    std::vector<uint32_t> operands;
+    while (!frames.empty())
+    {
+        Frame &frame = frames.back();
+        const Node &node = *frame.node;
+        if (frame.done == 0)
+        {
+            auto found = added.find(&node);
+            if (found != added.end())
+            {
+                operands.push_back(found->second);
+                frames.pop_back();
+                continue;
+            }
+        }
+        if (frame.done < node.operandCount())
+        {
+            frames.push_back({node.operand(frame.done++).get(), 0});
+            continue;
+        }
+
+        uint32_t index;
+        if (node.opcode() == OpCode::Constant)
+        {
+            index = interner.addConstant(static_cast<const ConstantNode &>(node).value());
+        }
+        else if (node.opcode() == OpCode::Variable)
+        {
+            const VariableNode &variable = static_cast<const VariableNode &>(node);
+            if (variable.slot() >= names.size())
+                names.resize(variable.slot() + 1);
+            names[variable.slot()] = variable.name();
+            index = interner.addVariable(static_cast<uint32_t>(variable.slot()));
+        }
+        else if (node.operandCount() == 1)
+        {
+            index = interner.addUnary(node.opcode(), operands.back());
+            operands.pop_back();
+        }
+        else
+        {
+            uint32_t right = operands.back();
+            operands.pop_back();
+            index = interner.addBinary(node.opcode(), operands.back(), right);
+            operands.pop_back();
+        }
+        added.emplace(&node, index);
+        operands.push_back(index);
+        frames.pop_back();
+    }
+
+    for (size_t slot = 0; slot < names.size(); ++slot)
+    {
+        if (names[slot].empty())
+            names[slot] = "#" + std::to_string(slot);
+    }
+    output.setVariableNames(std::move(names));
+    return output;
+}
+
+size_t FlatExpression::memoryFootprint() const
+{
+    return nodes_.capacity() * sizeof(FlatNode);
+}
+
+void NodeInterner::reset(FlatExpression &output, size_t expectedNodes, bool enabled)
+{
+    output_ = &output;
+    enabled_ = enabled;
+    requests_ = 0;
+    duplicateHits_ = 0;
+    if (!enabled)
+        return;
+
+    // At most half full, so probe sequences stay short
+    size_t buckets = 16;
+    while (buckets < 2 * expectedNodes)
+        buckets *= 2;
+    table_.assign(buckets, 0);
+}
+
+uint32_t NodeInterner::addConstant(double value)
+{
+    FlatNode node;
+    node.op = OpCode::Constant;
+    node.value = value;
+    return intern(node);
+}
+
+uint32_t NodeInterner::addVariable(uint32_t slot)
+{
+    return addBinary(OpCode::Variable, slot, 0);
+}
+
+uint32_t NodeInterner::addUnary(OpCode op, uint32_t operand)
+{
+    return addBinary(op, operand, 0);
+}
+
+uint32_t NodeInterner::addBinary(OpCode op, uint32_t left, uint32_t right)
+{
+    FlatNode node;
+    node.op = op;
+    node.operands.left = left;
+    node.operands.right = right;
+    return intern(node);
+}
+
+uint32_t NodeInterner::intern(const FlatNode &node)
+{
+    ++requests_;
+    if (!enabled_)
+    {
+        return node.op == OpCode::Constant ? output_->addConstant(node.value)
+                                           : output_->addBinary(node.op, node.operands.left, node.operands.right);
+    }
+
+    size_t mask = table_.size() - 1;
+    size_t bucket = nodeHash(node) & mask;
+    uint64_t key = nodeKey(node);
+    const std::vector<FlatNode> &nodes = output_->nodes();
+    while (table_[bucket] != 0)
+    {
+        const FlatNode &existing = nodes[table_[bucket] - 1];
+        if (existing.op == node.op && nodeKey(existing) == key)
+        {
+            ++duplicateHits_;
+            return table_[bucket] - 1;
+        }
+        bucket = (bucket + 1) & mask;
+    }
+
+    uint32_t index = node.op == OpCode::Constant ? output_->addConstant(node.value)
+                                                 : output_->addBinary(node.op, node.operands.left, node.operands.right);
+    table_[bucket] = index + 1;
+    if (2 * output_->size() > table_.size())
+        grow();
+    return index;
+}
+
+void NodeInterner::grow()
+{
+    table_.assign(table_.size() * 2, 0);
+    size_t mask = table_.size() - 1;
+    const std::vector<FlatNode> &nodes = output_->nodes();
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        size_t bucket = nodeHash(nodes[i]) & mask;
+        while (table_[bucket] != 0)
+            bucket = (bucket + 1) & mask;
+        table_[bucket] = static_cast<uint32_t>(i + 1);
+    }
+}
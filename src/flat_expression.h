@@ -0,0 +1,114 @@
+/**
+ * @file flat_expression.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef FLAT_EXPRESSION_H
+#define FLAT_EXPRESSION_H
+
+#include "expression_tree.h"
+#include "opcode.h"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+// A node of a flat expression: 16 bytes. Children are indices into the same
+// node array and always come before their parent.
+struct FlatNode
+{
+    OpCode op;
+    union
+    {
+        double value; // OpCode::Constant
+        struct
+        {
+            uint32_t left;  // first operand, or the slot for OpCode::Variable
+            uint32_t right; // second operand of binary operations
+        } operands;
+    };
+};
+
+// An expression stored as one contiguous array of nodes in postorder.
+// The last node is the root.
+class FlatExpression
+{
+public:
+    // Appends a node and returns its index
+    uint32_t addConstant(double value);
+    uint32_t addVariable(uint32_t slot);
+    uint32_t addUnary(OpCode op, uint32_t operand);
+    uint32_t addBinary(OpCode op, uint32_t left, uint32_t right);
+
+    // Pre-sizes the storage for the given number of nodes
+    void reserve(size_t nodeCount);
+
+    // Calculates the value of the expression, reading variables by slot index.
+    // Throws std::logic_error for an expression with no nodes.
+    double evaluate(std::span<const double> variables = {}) const;
+
+    // Same, computing every node once, in order, into scratch: reusing the scratch
+    // buffer makes evaluation allocation free. It has its own name so that
+    // evaluate(values) with a std::vector never takes the values for scratch.
+    double evaluateWith(std::vector<double> &scratch, std::span<const double> variables = {}) const;
+
+    // Names of the variables, indexed by slot
+    void setVariableNames(std::vector<std::string> names) { variableNames_ = std::move(names); }
+    const std::vector<std::string> &variableNames() const { return variableNames_; }
+
+    // Builds the equivalent tree of Node objects
+    NodePtr toTree() const;
+
+    // Builds the flat expression of a tree. A node reached through several parents
+    // (or equal to one added before) is stored once.
+    static FlatExpression fromTree(const Node &root);
+
+    bool empty() const { return nodes_.empty(); }
+    size_t size() const { return nodes_.size(); }
+    const std::vector<FlatNode> &nodes() const { return nodes_; }
+
+    // Heap bytes held by the expression
+    size_t memoryFootprint() const;
+
+private:
+    std::vector<FlatNode> nodes_;
+    std::vector<std::string> variableNames_;
+};
+
+// Appends nodes to a FlatExpression, but returns the index of an equal node
+// added earlier instead of appending a copy: same operation and operands, or a
+// constant with the same bits. Repeated subexpressions are then stored, and
+// computed by FlatExpression::evaluate and Bytecode, once. The hash table is kept
+// between expressions, so a reused interner does not allocate in steady state.
+class NodeInterner
+{
+public:
+    // Starts appending to output. With enabled = false every node is appended.
+    void reset(FlatExpression &output, size_t expectedNodes, bool enabled = true);
+
+    uint32_t addConstant(double value);
+    uint32_t addVariable(uint32_t slot);
+    uint32_t addUnary(OpCode op, uint32_t operand);
+    uint32_t addBinary(OpCode op, uint32_t left, uint32_t right);
+
+    // Nodes requested since reset, and how many of them were found already added
+    size_t requests() const { return requests_; }
+    size_t duplicateHits() const { return duplicateHits_; }
+
+private:
+    uint32_t intern(const FlatNode &node);
+    void grow();
+
+    FlatExpression *output_ = nullptr;
+    bool enabled_ = true;
+
+    // Open addressing: node index + 1, or 0 for an empty bucket
+    std::vector<uint32_t> table_;
+    size_t requests_ = 0;
+    size_t duplicateHits_ = 0;
+};
+
+#endif // FLAT_EXPRESSION_H
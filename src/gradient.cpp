@@ -0,0 +1,405 @@
+/**
+ * @file gradient.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "gradient.h"
+#include "simd_math.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+    // Rows per chunk in evaluateBatch. Every node keeps a value and an adjoint
+    // per row, so this is smaller than BatchChunkSize to keep the chunk in cache.
+    constexpr size_t GradientChunkSize = 256;
+
+    // Values (8 MB) that the values and adjoints of a chunk may take up
+    constexpr size_t GradientBatchBudget = size_t(1) << 20;
+
+    constexpr double InverseLn10 = 0.43429448190325182765;
+
+    // d(l^r)/dl, with 0 for r = 0 even where l^(r-1) is infinite
+    double powerBaseDerivative(double l, double r, double v)
+    {
+        if (r == 0.0)
+            return 0.0;
+        return l != 0.0 ? r * (v / l) : r * std::pow(l, r - 1.0);
+    }
+
+    // d(l^r)/dr = l^r * ln(l), with 0 where l^r is 0 (l = 0 and r > 0)
+    double powerExponentDerivative(double l, double v)
+    {
+        return v == 0.0 ? 0.0 : v * std::log(l);
+    }
+
+    // Partial derivatives of a node's value v with respect to its operands l and r.
+    // Only the partials the flags ask for are computed.
+    void partials(OpCode op, double l, double r, double v, bool leftActive, bool rightActive, double &dl, double &dr)
+    {
+        switch (op)
+        {
+        case OpCode::Add:
+            dl = 1.0;
+            dr = 1.0;
+            break;
+        case OpCode::Subtract:
+            dl = 1.0;
+            dr = -1.0;
+            break;
+        case OpCode::Multiply:
+            dl = r;
+            dr = l;
+            break;
+        case OpCode::Divide:
+            dl = 1.0 / r;
+            dr = -v / r;
+            break;
+        case OpCode::Power:
+            dl = leftActive ? powerBaseDerivative(l, r, v) : 0.0;
+            dr = rightActive ? powerExponentDerivative(l, v) : 0.0;
+            break;
+        case OpCode::Negate:
+            dl = -1.0;
+            break;
+        case OpCode::Sin:
+            dl = std::cos(l);
+            break;
+        case OpCode::Cos:
+            dl = -std::sin(l);
+            break;
+        case OpCode::Tan:
+            dl = 1.0 + v * v;
+            break;
+        case OpCode::Cot:
+            dl = -(1.0 + v * v);
+            break;
+        case OpCode::Ln:
+            dl = 1.0 / l;
+            break;
+        case OpCode::Log:
+            dl = InverseLn10 / l;
+            break;
+        case OpCode::Sqrt:
+            dl = 0.5 / v;
+            break;
+        case OpCode::Sinh:
+            dl = std::cosh(l);
+            break;
+        case OpCode::Cosh:
+            dl = std::sinh(l);
+            break;
+        case OpCode::Tanh:
+        case OpCode::Coth:
+            // -csch^2 = 1 - coth^2, so coth(0) = HUGE_VAL gives -inf
+            dl = 1.0 - v * v;
+            break;
+        case OpCode::Sech:
+            dl = -v * std::tanh(l);
+            break;
+        case OpCode::Csch:
+            // -csch * coth = -csch^2 * cosh
+            dl = -v * v * std::cosh(l);
+            break;
+        default: // OpCode::Factorial is a step function
+            dl = 0.0;
+            break;
+        }
+    }
+
+    // partials for a chunk of rows. The transcendental parts use the selected
+    // SIMD kernels; under SimdLevel::Scalar every row matches partials exactly.
+    void partialsBatch(OpCode op, const double *l, const double *r, const double *v, bool leftActive, bool rightActive,
+                       double *__restrict dl, double *__restrict dr, size_t count)
+    {
+        const SimdKernels &kernels = simdKernels();
+        switch (op)
+        {
+        case OpCode::Add:
+        case OpCode::Subtract:
+            std::fill(dl, dl + count, 1.0);
+            std::fill(dr, dr + count, op == OpCode::Add ? 1.0 : -1.0);
+            break;
+        case OpCode::Multiply:
+            std::copy(r, r + count, dl);
+            std::copy(l, l + count, dr);
+            break;
+        case OpCode::Divide:
+            for (size_t i = 0; i < count; ++i)
+            {
+                dl[i] = 1.0 / r[i];
+                dr[i] = -v[i] / r[i];
+            }
+            break;
+        case OpCode::Power:
+            for (size_t i = 0; leftActive && i < count; ++i)
+                dl[i] = powerBaseDerivative(l[i], r[i], v[i]);
+            for (size_t i = 0; rightActive && i < count; ++i)
+                dr[i] = powerExponentDerivative(l[i], v[i]);
+            break;
+        case OpCode::Sin:
+            kernels.cos(l, dl, count);
+            break;
+        case OpCode::Cos:
+            kernels.sin(l, dl, count);
+            for (size_t i = 0; i < count; ++i)
+                dl[i] = -dl[i];
+            break;
+        case OpCode::Sinh:
+            kernels.cosh(l, dl, count);
+            break;
+        case OpCode::Cosh:
+            kernels.sinh(l, dl, count);
+            break;
+        case OpCode::Sech:
+            kernels.tanh(l, dl, count);
+            for (size_t i = 0; i < count; ++i)
+                dl[i] = -v[i] * dl[i];
+            break;
+        case OpCode::Csch:
+            kernels.cosh(l, dl, count);
+            for (size_t i = 0; i < count; ++i)
+                dl[i] = -v[i] * v[i] * dl[i];
+            break;
+        default:
+            for (size_t i = 0; i < count; ++i)
+            {
+                double unused;
+                partials(op, l[i], 0.0, v[i], true, false, dl[i], unused);
+            }
+            break;
+        }
+    }
+}
+
+GradientTape::GradientTape(FlatExpression expression) : expression_(std::move(expression))
+{
+    if (expression_.empty())
+        throw std::invalid_argument("Cannot differentiate an empty expression");
+
+    const std::vector<FlatNode> &nodes = expression_.nodes();
+    flags_.resize(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        const FlatNode &node = nodes[i];
+        int arity = opcodeArity(node.op);
+        uint8_t flags = 0;
+        if (node.op == OpCode::Variable)
+        {
+            flags = Active;
+            variableCount_ = std::max<size_t>(variableCount_, node.operands.left + 1);
+        }
+        if (arity >= 1 && (flags_[node.operands.left] & Active))
+            flags |= Active | LeftActive;
+        if (arity == 2 && (flags_[node.operands.right] & Active))
+            flags |= Active | RightActive;
+        flags_[i] = flags;
+    }
+}
+
+double GradientTape::evaluate(std::span<const double> variables, std::span<double> gradient,
+                              std::vector<double> &scratch) const
+{
+    if (variables.size() < variableCount_)
+        throw std::out_of_range("No value given for variable slot " + std::to_string(variableCount_ - 1));
+    if (gradient.size() < variableCount_)
+        throw std::out_of_range("The gradient needs " + std::to_string(variableCount_) + " entries");
+
+    const std::vector<FlatNode> &nodes = expression_.nodes();
+    size_t n = nodes.size();
+    scratch.resize(2 * n);
+    double *values = scratch.data();
+    double *adjoints = values + n;
+
+    // Forward: the tape records every node's value, as FlatExpression::evaluate computes it
+    for (size_t i = 0; i < n; ++i)
+    {
+        const FlatNode &node = nodes[i];
+        switch (node.op)
+        {
+        case OpCode::Constant:
+            values[i] = node.value;
+            break;
+        case OpCode::Variable:
+            values[i] = variables[node.operands.left];
+            break;
+        case OpCode::Add:
+            values[i] = values[node.operands.left] + values[node.operands.right];
+            break;
+        case OpCode::Subtract:
+            values[i] = values[node.operands.left] - values[node.operands.right];
+            break;
+        case OpCode::Multiply:
+            values[i] = values[node.operands.left] * values[node.operands.right];
+            break;
+        case OpCode::Negate:
+            values[i] = -values[node.operands.left];
+            break;
+        default:
+            values[i] = applyOperation(node.op, values[node.operands.left], values[node.operands.right]);
+            break;
+        }
+    }
+
+    // Backward: adjoints[i] is d(result)/d(node i) once every parent of node i has been visited
+    std::fill(gradient.begin(), gradient.end(), 0.0);
+    std::fill(adjoints, adjoints + n, 0.0);
+    adjoints[n - 1] = 1.0;
+    for (size_t i = n; i-- > 0;)
+    {
+        uint8_t flags = flags_[i];
+        if (!(flags & Active))
+            continue;
+        const FlatNode &node = nodes[i];
+        double adjoint = adjoints[i];
+        uint32_t left = node.operands.left;
+        uint32_t right = node.operands.right;
+        // The arithmetic is inlined; an inactive operand's adjoint is written but never read
+        switch (node.op)
+        {
+        case OpCode::Variable:
+            gradient[left] += adjoint;
+            break;
+        case OpCode::Add:
+            adjoints[left] += adjoint;
+            adjoints[right] += adjoint;
+            break;
+        case OpCode::Subtract:
+            adjoints[left] += adjoint;
+            adjoints[right] -= adjoint;
+            break;
+        case OpCode::Multiply:
+            adjoints[left] += adjoint * values[right];
+            adjoints[right] += adjoint * values[left];
+            break;
+        case OpCode::Negate:
+            adjoints[left] -= adjoint;
+            break;
+        default:
+        {
+            double dl = 0.0, dr = 0.0;
+            double rightValue = opcodeArity(node.op) == 2 ? values[right] : 0.0;
+            partials(node.op, values[left], rightValue, values[i], flags & LeftActive, flags & RightActive, dl, dr);
+            if (flags & LeftActive)
+                adjoints[left] += adjoint * dl;
+            if (flags & RightActive)
+                adjoints[right] += adjoint * dr;
+            break;
+        }
+        }
+    }
+
+    return values[n - 1];
+}
+
+double GradientTape::evaluate(std::span<const double> variables, std::span<double> gradient) const
+{
+    std::vector<double> scratch;
+    return evaluate(variables, gradient, scratch);
+}
+
+Result<double> GradientTape::tryEvaluate(std::span<const double> variables, std::span<double> gradient) const
+{
+    try
+    {
+        return evaluate(variables, gradient);
+    }
+    catch (const ExpressionError &error)
+    {
+        return error.error();
+    }
+}
+
+void GradientTape::evaluateBatch(const double *const *columns, size_t n, double *out, double *const *gradients,
+                                 ErrorMode mode) const
+{
+    if (variableCount_ > 0 && (columns == nullptr || gradients == nullptr))
+        throw std::out_of_range("No column given for variable slot " + std::to_string(variableCount_ - 1));
+
+    const std::vector<FlatNode> &nodes = expression_.nodes();
+    size_t size = nodes.size();
+    // Large tapes run shorter chunks, down to a row at a time, so that the scratch
+    // stays within GradientBatchBudget values; nor is it larger than the batch
+    const size_t stride = std::min(std::clamp<size_t>(GradientBatchBudget / (2 * size + 2), 1, GradientChunkSize),
+                                   std::max<size_t>(n, 1));
+
+    // Node-major: the rows of node i start at values + i * stride, its adjoints at adjoints + i * stride
+    std::vector<double> scratch((2 * size + 2) * stride);
+    double *values = scratch.data();
+    double *adjoints = values + size * stride;
+    double *dl = adjoints + size * stride;
+    double *dr = dl + stride;
+
+    for (size_t offset = 0; offset < n; offset += stride)
+    {
+        size_t count = std::min(stride, n - offset);
+        for (size_t i = 0; i < size; ++i)
+        {
+            const FlatNode &node = nodes[i];
+            double *row = values + i * stride;
+            if (node.op == OpCode::Constant)
+            {
+                std::fill(row, row + count, node.value);
+            }
+            else if (node.op == OpCode::Variable)
+            {
+                const double *column = columns[node.operands.left] + offset;
+                std::copy(column, column + count, row);
+            }
+            else
+            {
+                const double *left = values + node.operands.left * stride;
+                std::copy(left, left + count, row);
+                applyOperationBatch(node.op, row, values + node.operands.right * stride, count, mode);
+            }
+        }
+        std::copy(values + (size - 1) * stride, values + (size - 1) * stride + count, out + offset);
+
+        for (size_t slot = 0; slot < variableCount_; ++slot)
+        {
+            if (gradients[slot] != nullptr)
+                std::fill(gradients[slot] + offset, gradients[slot] + offset + count, 0.0);
+        }
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (flags_[i] & Active)
+                std::fill(adjoints + i * stride, adjoints + i * stride + count, i + 1 == size ? 1.0 : 0.0);
+        }
+        for (size_t i = size; i-- > 0;)
+        {
+            uint8_t flags = flags_[i];
+            if (!(flags & Active))
+                continue;
+            const FlatNode &node = nodes[i];
+            const double *adjoint = adjoints + i * stride;
+            if (node.op == OpCode::Variable)
+            {
+                double *gradient = gradients[node.operands.left];
+                for (size_t k = 0; gradient != nullptr && k < count; ++k)
+                    gradient[offset + k] += adjoint[k];
+                continue;
+            }
+
+            const double *left = values + node.operands.left * stride;
+            const double *right = values + node.operands.right * stride;
+            partialsBatch(node.op, left, right, values + i * stride, flags & LeftActive, flags & RightActive, dl, dr,
+                          count);
+            if (flags & LeftActive)
+            {
+                double *target = adjoints + node.operands.left * stride;
+                for (size_t k = 0; k < count; ++k)
+                    target[k] += adjoint[k] * dl[k];
+            }
+            if (flags & RightActive)
+            {
+                double *target = adjoints + node.operands.right * stride;
+                for (size_t k = 0; k < count; ++k)
+                    target[k] += adjoint[k] * dr[k];
+            }
+        }
+    }
+}
@@ -0,0 +1,74 @@
+/**
+ * @file gradient.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef GRADIENT_H
+#define GRADIENT_H
+
+#include "batch.h"
+#include "expression_tree.h"
+#include "flat_expression.h"
+#include "result.h"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+// Reverse-mode automatic differentiation. The tape is the expression's node
+// array in postorder: evaluating runs it forward once, recording each node's
+// value, then backward once, accumulating d(result)/d(node) from the root down
+// to the variables with the partial derivatives of each node. The whole
+// gradient costs a few evaluations, whatever the number of variables.
+//
+// Derivatives are those of the function the nodes compute:
+//   x^y          y * x^(y-1) and x^y * ln(x); 0 for x^0 and for d/dy at x = 0
+//   coth, csch   -inf at 0, where the node gives HUGE_VAL
+//   n!           0, as the node truncates its operand to an integer
+// Nodes that do not depend on a variable are skipped in the backward sweep.
+class GradientTape
+{
+public:
+    explicit GradientTape(FlatExpression expression);
+    explicit GradientTape(const Node &root) : GradientTape(FlatExpression::fromTree(root)) {}
+
+    // Returns the value of the expression and writes d(value)/d(variables[slot])
+    // to gradient[slot]; slots the expression does not use get 0. The recorded
+    // values live in scratch, so reusing it makes evaluation allocation free.
+    // Errors are the ones Node::evaluate reports.
+    double evaluate(std::span<const double> variables, std::span<double> gradient, std::vector<double> &scratch) const;
+    double evaluate(std::span<const double> variables, std::span<double> gradient) const;
+
+    // Same as evaluate, but returns a domain error instead of throwing it
+    Result<double> tryEvaluate(std::span<const double> variables, std::span<double> gradient) const;
+
+    // evaluate for rows 0..n-1 of a columnar input: columns[slot] holds the n values
+    // of a variable, out the n results and gradients[slot] the n derivatives with
+    // respect to it, for every slot below variableCount() (null skips that slot).
+    // Rows run through the tape a chunk at a time, in shorter chunks for large
+    // tapes so the scratch stays around 8 MB; the SIMD kernels are used as in
+    // Node::evaluateBatch. With ErrorMode::Propagate a bad row gets inf or NaN.
+    void evaluateBatch(const double *const *columns, size_t n, double *out, double *const *gradients,
+                       ErrorMode mode = ErrorMode::Report) const;
+
+    // Number of values and gradient entries evaluate needs: one past the highest slot used
+    size_t variableCount() const { return variableCount_; }
+
+    const FlatExpression &expression() const { return expression_; }
+    const std::vector<std::string> &variableNames() const { return expression_.variableNames(); }
+
+private:
+    // Flags per node: whether the result depends on the node, and on each operand
+    static constexpr uint8_t Active = 1;
+    static constexpr uint8_t LeftActive = 2;
+    static constexpr uint8_t RightActive = 4;
+
+    FlatExpression expression_;
+    std::vector<uint8_t> flags_;
+    size_t variableCount_ = 0;
+};
+
+#endif // GRADIENT_H
@@ -0,0 +1,242 @@
+/**
+ * @file grammar.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * The tokens and operator table shared by Parser and the compile-time front
+ * end in static_expression.h, so both read every formula the same way.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef GRAMMAR_H
+#define GRAMMAR_H
+
+#include "opcode.h"
+#include <cstdint>
+#include <string_view>
+
+// Kinds of tokens produced by the tokenizer
+enum class TokenKind : uint8_t
+{
+    Number,
+    Identifier,
+    Plus,
+    Minus,
+    Star,
+    Slash,
+    Caret,
+    Bang,
+    LeftParen,
+    RightParen,
+    Sin,
+    Cos,
+    Tan,
+    Cot,
+    Sinh,
+    Cosh,
+    Tanh,
+    Coth,
+    Sech,
+    Csch,
+    Ln,
+    Log,
+    Sqrt
+};
+
+// A token refers back into the source text; numbers carry their parsed value
+struct Token
+{
+    TokenKind kind;
+    uint32_t offset;
+    uint32_t length;
+    double value;
+};
+
+namespace grammar
+{
+    constexpr bool isDigit(char ch)
+    {
+        return ch >= '0' && ch <= '9';
+    }
+
+    constexpr bool isLetter(char ch)
+    {
+        return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+    }
+
+    constexpr bool isSpace(char ch)
+    {
+        return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || ch == '\v' || ch == '\f';
+    }
+
+    // Token of a one-character operator or parenthesis; false for any other character
+    constexpr bool lookupSymbol(char ch, TokenKind &kind)
+    {
+        switch (ch)
+        {
+        case '+':
+            kind = TokenKind::Plus;
+            return true;
+        case '-':
+            kind = TokenKind::Minus;
+            return true;
+        case '*':
+            kind = TokenKind::Star;
+            return true;
+        case '/':
+            kind = TokenKind::Slash;
+            return true;
+        case '^':
+            kind = TokenKind::Caret;
+            return true;
+        case '!':
+            kind = TokenKind::Bang;
+            return true;
+        case '(':
+            kind = TokenKind::LeftParen;
+            return true;
+        case ')':
+            kind = TokenKind::RightParen;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Looks a function name up with a single switch on its length
+    constexpr bool lookupKeyword(std::string_view word, TokenKind &kind)
+    {
+        switch (word.size())
+        {
+        case 2:
+            if (word == "ln")
+            {
+                kind = TokenKind::Ln;
+                return true;
+            }
+            return false;
+        case 3:
+            if (word == "sin")
+                kind = TokenKind::Sin;
+            else if (word == "cos")
+                kind = TokenKind::Cos;
+            else if (word == "tan")
+                kind = TokenKind::Tan;
+            else if (word == "cot")
+                kind = TokenKind::Cot;
+            else if (word == "log")
+                kind = TokenKind::Log;
+            else
+                return false;
+            return true;
+        case 4:
+            if (word == "sinh")
+                kind = TokenKind::Sinh;
+            else if (word == "cosh")
+                kind = TokenKind::Cosh;
+            else if (word == "tanh")
+                kind = TokenKind::Tanh;
+            else if (word == "coth")
+                kind = TokenKind::Coth;
+            else if (word == "sech")
+                kind = TokenKind::Sech;
+            else if (word == "csch")
+                kind = TokenKind::Csch;
+            else if (word == "sqrt")
+                kind = TokenKind::Sqrt;
+            else
+                return false;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Binding power of the binary operators; 0 means the token is not one
+    constexpr int binaryPrecedence(TokenKind kind)
+    {
+        switch (kind)
+        {
+        case TokenKind::Plus:
+        case TokenKind::Minus:
+            return 10;
+        case TokenKind::Star:
+        case TokenKind::Slash:
+            return 20;
+        case TokenKind::Caret:
+            return 40;
+        default:
+            return 0;
+        }
+    }
+
+    // Unary minus binds tighter than "*" but looser than "^", so -2^2 is -(2^2)
+    constexpr int UnaryPrecedence = 30;
+
+    // Postfix "!" binds tightest of all
+    constexpr int FactorialPrecedence = 50;
+
+    // "sin" to "csch" need parentheses around their operand; ln, log and sqrt also take a bare one
+    constexpr bool needsParenthesis(TokenKind kind)
+    {
+        return kind >= TokenKind::Sin && kind <= TokenKind::Csch;
+    }
+
+    constexpr bool isFunction(TokenKind kind)
+    {
+        return kind >= TokenKind::Sin;
+    }
+
+    constexpr OpCode binaryOpcode(TokenKind kind)
+    {
+        switch (kind)
+        {
+        case TokenKind::Plus:
+            return OpCode::Add;
+        case TokenKind::Minus:
+            return OpCode::Subtract;
+        case TokenKind::Star:
+            return OpCode::Multiply;
+        case TokenKind::Slash:
+            return OpCode::Divide;
+        default: // TokenKind::Caret
+            return OpCode::Power;
+        }
+    }
+
+    constexpr OpCode functionOpcode(TokenKind kind)
+    {
+        switch (kind)
+        {
+        case TokenKind::Sin:
+            return OpCode::Sin;
+        case TokenKind::Cos:
+            return OpCode::Cos;
+        case TokenKind::Tan:
+            return OpCode::Tan;
+        case TokenKind::Cot:
+            return OpCode::Cot;
+        case TokenKind::Sinh:
+            return OpCode::Sinh;
+        case TokenKind::Cosh:
+            return OpCode::Cosh;
+        case TokenKind::Tanh:
+            return OpCode::Tanh;
+        case TokenKind::Coth:
+            return OpCode::Coth;
+        case TokenKind::Sech:
+            return OpCode::Sech;
+        case TokenKind::Csch:
+            return OpCode::Csch;
+        case TokenKind::Ln:
+            return OpCode::Ln;
+        case TokenKind::Log:
+            return OpCode::Log;
+        default: // TokenKind::Sqrt
+            return OpCode::Sqrt;
+        }
+    }
+}
+
+#endif // GRAMMAR_H
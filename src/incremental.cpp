@@ -0,0 +1,211 @@
+/**
+ * @file incremental.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "incremental.h"
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <numeric>
+#include <stdexcept>
+
+namespace
+{
+    // Values compare by bits, so a NaN that stays NaN is unchanged and -0 differs from 0
+    bool sameBits(double a, double b)
+    {
+        return std::bit_cast<uint64_t>(a) == std::bit_cast<uint64_t>(b);
+    }
+}
+
+IncrementalExpression::IncrementalExpression(FlatExpression expression, std::span<const double> variables)
+    : expression_(std::move(expression))
+{
+    if (expression_.empty())
+        throw std::invalid_argument("Cannot evaluate an empty expression");
+
+    const std::vector<FlatNode> &nodes = expression_.nodes();
+    size_t size = nodes.size();
+    size_t variableCount = 0;
+    for (const FlatNode &node : nodes)
+    {
+        if (node.op == OpCode::Variable)
+            variableCount = std::max<size_t>(variableCount, node.operands.left + 1);
+    }
+    if (variables.size() < variableCount)
+        throw std::out_of_range("No value given for variable slot " + std::to_string(variableCount - 1));
+    inputs_.assign(variables.begin(), variables.begin() + variableCount);
+    values_.resize(size);
+    queued_.resize(size);
+
+    // Counting pass, then the lists; an operand used twice by a node (x * x) lists the node once
+    parentStart_.assign(size + 1, 0);
+    useStart_.assign(variableCount + 1, 0);
+    auto forEachOperand = [&](auto &&visit)
+    {
+        for (uint32_t i = 0; i < size; ++i)
+        {
+            const FlatNode &node = nodes[i];
+            int arity = opcodeArity(node.op);
+            if (arity >= 1)
+                visit(node.operands.left, i);
+            if (arity == 2 && node.operands.right != node.operands.left)
+                visit(node.operands.right, i);
+        }
+    };
+    forEachOperand([&](uint32_t operand, uint32_t) { ++parentStart_[operand + 1]; });
+    for (const FlatNode &node : nodes)
+    {
+        if (node.op == OpCode::Variable)
+            ++useStart_[node.operands.left + 1];
+    }
+    std::partial_sum(parentStart_.begin(), parentStart_.end(), parentStart_.begin());
+    std::partial_sum(useStart_.begin(), useStart_.end(), useStart_.begin());
+
+    parents_.resize(parentStart_.back());
+    uses_.resize(useStart_.back());
+    std::vector<uint32_t> next(parentStart_.begin(), parentStart_.end() - 1);
+    forEachOperand([&](uint32_t operand, uint32_t parent) { parents_[next[operand]++] = parent; });
+    next.assign(useStart_.begin(), useStart_.end() - 1);
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        if (nodes[i].op == OpCode::Variable)
+            uses_[next[nodes[i].operands.left]++] = i;
+    }
+}
+
+void IncrementalExpression::set(size_t slot, double value)
+{
+    if (slot >= inputs_.size())
+        throw std::out_of_range("The expression has no variable slot " + std::to_string(slot));
+    if (sameBits(inputs_[slot], value))
+        return;
+
+    inputs_[slot] = value;
+    // Before the first value() everything is computed anyway
+    if (!computed_)
+        return;
+    for (uint32_t i = useStart_[slot]; i < useStart_[slot + 1]; ++i)
+        markDirty(uses_[i]);
+}
+
+void IncrementalExpression::set(std::string_view name, double value)
+{
+    const std::vector<std::string> &names = expression_.variableNames();
+    for (size_t slot = 0; slot < names.size(); ++slot)
+    {
+        if (names[slot] != name)
+            continue;
+        // A declared variable the expression does not use changes nothing
+        if (slot < inputs_.size())
+            set(slot, value);
+        return;
+    }
+    throw std::out_of_range("Unknown variable: " + std::string(name));
+}
+
+void IncrementalExpression::update(std::span<const double> variables)
+{
+    if (variables.size() < inputs_.size())
+        throw std::out_of_range("No value given for variable slot " + std::to_string(inputs_.size() - 1));
+    for (size_t slot = 0; slot < inputs_.size(); ++slot)
+        set(slot, variables[slot]);
+}
+
+void IncrementalExpression::markDirty(uint32_t node)
+{
+    if (queued_[node])
+        return;
+    queued_[node] = 1;
+    dirty_.push_back(node);
+    std::push_heap(dirty_.begin(), dirty_.end(), std::greater<>());
+}
+
+double IncrementalExpression::compute(uint32_t index) const
+{
+    const FlatNode &node = expression_.nodes()[index];
+    const double *values = values_.data();
+
+    // The same operations FlatExpression::evaluate inlines, and applyOperation for the rest
+    switch (node.op)
+    {
+    case OpCode::Constant:
+        return node.value;
+    case OpCode::Variable:
+        return inputs_[node.operands.left];
+    case OpCode::Add:
+        return values[node.operands.left] + values[node.operands.right];
+    case OpCode::Subtract:
+        return values[node.operands.left] - values[node.operands.right];
+    case OpCode::Multiply:
+        return values[node.operands.left] * values[node.operands.right];
+    case OpCode::Negate:
+        return -values[node.operands.left];
+    default:
+        return applyOperation(node.op, values[node.operands.left], values[node.operands.right]);
+    }
+}
+
+double IncrementalExpression::value()
+{
+    lastRecomputed_ = 0;
+    size_t size = values_.size();
+
+    if (!computed_)
+    {
+        // First call: every node once, in order. If one fails, it and the nodes
+        // after it stay dirty for the next call.
+        computed_ = true;
+        for (uint32_t i = 0; i < size; ++i)
+        {
+            try
+            {
+                values_[i] = compute(i);
+            }
+            catch (...)
+            {
+                for (uint32_t rest = i; rest < size; ++rest)
+                    markDirty(rest);
+                throw;
+            }
+            ++lastRecomputed_;
+            ++totalRecomputed_;
+        }
+        return values_.back();
+    }
+
+    while (!dirty_.empty())
+    {
+        uint32_t node = dirty_.front();
+        // A failing node stays queued, and its parents keep their old values
+        double value = compute(node);
+        std::pop_heap(dirty_.begin(), dirty_.end(), std::greater<>());
+        dirty_.pop_back();
+        queued_[node] = 0;
+        ++lastRecomputed_;
+        ++totalRecomputed_;
+
+        if (sameBits(values_[node], value))
+            continue;
+        values_[node] = value;
+        for (uint32_t i = parentStart_[node]; i < parentStart_[node + 1]; ++i)
+            markDirty(parents_[i]);
+    }
+    return values_.back();
+}
+
+Result<double> IncrementalExpression::tryValue()
+{
+    try
+    {
+        return value();
+    }
+    catch (const ExpressionError &error)
+    {
+        return error.error();
+    }
+}
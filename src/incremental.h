@@ -0,0 +1,89 @@
+/**
+ * @file incremental.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "expression_tree.h"
+#include "flat_expression.h"
+#include "result.h"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Keeps the value of every node of a flat expression between evaluations, so
+// that after a few inputs change only the nodes depending on them are
+// recomputed. Each node knows its parents; changing a variable marks its nodes
+// dirty, and value() recomputes dirty nodes in postorder, marking a node's
+// parents dirty only when the node's value actually changed. Updating one of
+// dozens of inputs then costs the path from that input to the root.
+//
+// Results and errors are those of FlatExpression::evaluate with the current
+// inputs. A node that fails stays dirty, so value() keeps reporting the error
+// until an input change fixes it.
+class IncrementalExpression
+{
+public:
+    // The inputs start as variables[slot]; nothing is computed until value()
+    IncrementalExpression(FlatExpression expression, std::span<const double> variables);
+    IncrementalExpression(const Node &root, std::span<const double> variables)
+        : IncrementalExpression(FlatExpression::fromTree(root), variables) {}
+
+    // Changes one input. Setting the value it already has (same bits) does nothing.
+    void set(size_t slot, double value);
+    void set(std::string_view name, double value);
+
+    // Changes every input that differs from variables[slot]
+    void update(std::span<const double> variables);
+
+    // The result for the current inputs, recomputing what the changes since the
+    // last call affect
+    double value();
+
+    // Same as value, but returns a domain error instead of throwing it
+    Result<double> tryValue();
+
+    double variable(size_t slot) const { return inputs_.at(slot); }
+
+    // Number of inputs: one past the highest slot used
+    size_t variableCount() const { return inputs_.size(); }
+
+    // Nodes computed by the last call to value, and by all calls so far
+    size_t lastRecomputed() const { return lastRecomputed_; }
+    size_t totalRecomputed() const { return totalRecomputed_; }
+
+    const FlatExpression &expression() const { return expression_; }
+
+private:
+    void markDirty(uint32_t node);
+    double compute(uint32_t node) const;
+
+    FlatExpression expression_;
+    std::vector<double> inputs_;
+    std::vector<double> values_;
+
+    // Parents of node i are parents_[parentStart_[i] .. parentStart_[i + 1]),
+    // and the variable nodes of slot s are uses_[useStart_[s] .. useStart_[s + 1])
+    std::vector<uint32_t> parentStart_;
+    std::vector<uint32_t> parents_;
+    std::vector<uint32_t> useStart_;
+    std::vector<uint32_t> uses_;
+
+    // Min-heap of the dirty nodes; parents come after their operands, so the
+    // smallest index can always be computed next
+    std::vector<uint32_t> dirty_;
+    std::vector<uint8_t> queued_;
+    bool computed_ = false;
+
+    size_t lastRecomputed_ = 0;
+    size_t totalRecomputed_ = 0;
+};
+
+#endif // INCREMENTAL_H
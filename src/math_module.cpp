@@ -8,20 +8,12 @@
 
 #include "math_module.h"
 #include <vector>
-#include <stdexcept> 
 
 std::vector<std::vector<double>> inverse2x2Matrix(const std::vector<std::vector<double>> &matrix)
 {
-    double determinant = matrix[0][0] * matrix[1][1] - matrix[0][1] * matrix[1][0];
-    if (determinant == 0)
-    {
-        // non-inverse matrix
-        throw std::runtime_error("The determinant is 0, the matrix has no inverse.");
-    }
-
-    std::vector<std::vector<double>> inverse = {
-        {matrix[1][1] / determinant, -matrix[0][1] / determinant},
-        {-matrix[1][0] / determinant, matrix[0][0] / determinant}};
-
-    return inverse;
+    // The closed form of inverse(FixedMatrix<2>), which throws SingularMatrixError
+    // (a std::runtime_error) with the same message for a zero determinant
+    FixedMatrix<2> fixed{{matrix[0][0], matrix[0][1], matrix[1][0], matrix[1][1]}};
+    FixedMatrix<2> result = inverse(fixed);
+    return {{result(0, 0), result(0, 1)}, {result(1, 0), result(1, 1)}};
 }
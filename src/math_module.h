@@ -6,6 +6,8 @@
  *
  */
 
+#include "matrix.h"
 #include <vector>
 
+// Kept for existing callers; Matrix and FixedMatrix in matrix.h take any size
 std::vector<std::vector<double>> inverse2x2Matrix(const std::vector<std::vector<double>> &matrix);
@@ -0,0 +1,671 @@
+/**
+ * @file mathparser_eval.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * mathparser-eval evaluates one formula over every row of a CSV file or of a
+ * file of little-endian doubles and writes the results in the same format.
+ * A reader thread parses chunks of rows, the main thread evaluates them with
+ * CompiledExpression::evaluateBatch and a writer thread formats them, all
+ * sharing a fixed set of chunk buffers, so I/O and compute overlap and memory
+ * stays the same whatever the size of the input.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "parser.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MATHPARSER_EVAL_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Chunks in flight: one being read, one evaluated and one written, plus one spare
+    constexpr size_t ChunkCount = 4;
+
+    // Largest --chunk: 16M rows, 128 MB per column of each chunk buffer
+    constexpr size_t MaxChunkRows = 1 << 24;
+
+    // Bytes read from a stream at a time, and the longest CSV line accepted
+    constexpr size_t ReadSize = 1 << 20;
+    constexpr size_t MaxLineLength = 64 << 20;
+
+    enum class Format
+    {
+        Csv,
+        Binary
+    };
+
+    struct Options
+    {
+        Format format = Format::Csv;
+        std::string formula;
+        std::string inputPath; // empty for stdin
+        std::vector<std::string> columns;
+        std::string resultName = "result";
+        ErrorMode errorMode = ErrorMode::Report;
+        size_t chunkRows = 4 * BatchChunkSize;
+        bool quiet = false;
+    };
+
+    // An error in the input or the formula, reported with where it happened
+    class InputError : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    // Bytes of the input from the current position on. A regular file is mapped
+    // and the pages behind the position are given back as it advances; anything
+    // else (a pipe, or a platform without mmap) is read into a buffer that is
+    // refilled as it is consumed.
+    class Input
+    {
+    public:
+        explicit Input(const std::string &path)
+        {
+#ifdef MATHPARSER_EVAL_MMAP
+            int descriptor = path.empty() ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY);
+            if (descriptor < 0)
+                throw InputError("Cannot open " + path);
+            struct stat status;
+            if (::fstat(descriptor, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0)
+            {
+                size_t size = static_cast<size_t>(status.st_size);
+                void *memory = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+                if (memory != MAP_FAILED)
+                {
+                    ::madvise(memory, size, MADV_SEQUENTIAL);
+                    mapped_ = static_cast<const char *>(memory);
+                    mappedSize_ = size;
+                    end_ = size;
+                    ended_ = true;
+                }
+            }
+            if (mapped_ || path.empty())
+            {
+                if (!path.empty())
+                    ::close(descriptor);
+                file_ = mapped_ ? nullptr : stdin;
+                return;
+            }
+            ::close(descriptor);
+#endif
+            file_ = path.empty() ? stdin : std::fopen(path.c_str(), "rb");
+            if (!file_)
+                throw InputError("Cannot open " + path);
+            ownsFile_ = !path.empty();
+        }
+
+        ~Input()
+        {
+#ifdef MATHPARSER_EVAL_MMAP
+            if (mapped_)
+                ::munmap(const_cast<char *>(mapped_), mappedSize_);
+#endif
+            if (ownsFile_)
+                std::fclose(file_);
+        }
+
+        Input(const Input &) = delete;
+        Input &operator=(const Input &) = delete;
+
+        // Everything available from the current position, reading until there are
+        // at least minimum bytes unless the input ends first
+        std::string_view peek(size_t minimum)
+        {
+            if (mapped_)
+                return {mapped_ + begin_, end_ - begin_};
+
+            if (end_ - begin_ < minimum && !ended_)
+            {
+                // Move the unconsumed bytes to the front, then fill up behind them
+                std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+                end_ -= begin_;
+                begin_ = 0;
+                buffer_.resize(std::max(buffer_.size(), std::max(minimum, ReadSize)));
+                while (end_ < minimum && !ended_)
+                {
+                    size_t read = std::fread(buffer_.data() + end_, 1, buffer_.size() - end_, file_);
+                    end_ += read;
+                    if (read == 0)
+                    {
+                        if (std::ferror(file_))
+                            throw InputError("Error reading the input");
+                        ended_ = true;
+                    }
+                }
+            }
+            return {buffer_.data() + begin_, end_ - begin_};
+        }
+
+        void consume(size_t bytes)
+        {
+            begin_ += bytes;
+#ifdef MATHPARSER_EVAL_MMAP
+            // Mapped pages that were read are dropped in steps of a few MB, so the
+            // resident size stays small for any file size
+            constexpr size_t ReleaseStep = 8 << 20;
+            if (mapped_ && begin_ - released_ >= ReleaseStep)
+            {
+                size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+                size_t until = begin_ / page * page;
+                ::madvise(const_cast<char *>(mapped_) + released_, until - released_, MADV_DONTNEED);
+                released_ = until;
+            }
+#endif
+        }
+
+        // Whether the last peek returned everything up to the end of the input
+        bool ended() const { return ended_; }
+
+    private:
+        const char *mapped_ = nullptr;
+        size_t mappedSize_ = 0;
+        size_t released_ = 0;
+
+        std::FILE *file_ = nullptr;
+        bool ownsFile_ = false;
+        std::vector<char> buffer_;
+
+        size_t begin_ = 0;
+        size_t end_ = 0;
+        bool ended_ = false;
+    };
+
+    // Rows firstRow .. firstRow + rows - 1: the input column of slot s starts at
+    // columns[s * capacity], and results holds one value per row
+    struct Chunk
+    {
+        size_t firstRow = 0;
+        size_t rows = 0;
+        std::vector<double> columns;
+        std::vector<double> results;
+    };
+
+    // Hands chunks from one stage to the next. Closing wakes the receiver once the
+    // queue is empty; aborting drops everything and wakes all of them.
+    class Channel
+    {
+    public:
+        void push(Chunk *chunk)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            chunks_.push_back(chunk);
+            ready_.notify_one();
+        }
+
+        // Waits for the next chunk; null once the channel is closed and empty, or aborted
+        Chunk *pop()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ready_.wait(lock, [this] { return !chunks_.empty() || closed_ || aborted_; });
+            if (aborted_ || chunks_.empty())
+                return nullptr;
+            Chunk *chunk = chunks_.front();
+            chunks_.pop_front();
+            return chunk;
+        }
+
+        void close()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            ready_.notify_all();
+        }
+
+        void abort()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            aborted_ = true;
+            ready_.notify_all();
+        }
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable ready_;
+        std::deque<Chunk *> chunks_;
+        bool closed_ = false;
+        bool aborted_ = false;
+    };
+
+    // Doubles are stored little-endian whatever the machine
+    double fromLittleEndian(const char *bytes)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, bytes, sizeof(bits));
+        if constexpr (std::endian::native == std::endian::big)
+            bits = __builtin_bswap64(bits);
+        return std::bit_cast<double>(bits);
+    }
+
+    void toLittleEndian(double value, char *bytes)
+    {
+        uint64_t bits = std::bit_cast<uint64_t>(value);
+        if constexpr (std::endian::native == std::endian::big)
+            bits = __builtin_bswap64(bits);
+        std::memcpy(bytes, &bits, sizeof(bits));
+    }
+
+    std::vector<std::string> splitNames(std::string_view text)
+    {
+        std::vector<std::string> names;
+        while (true)
+        {
+            size_t comma = text.find(',');
+            std::string_view name = text.substr(0, comma);
+            size_t first = name.find_first_not_of(" \t");
+            size_t last = name.find_last_not_of(" \t\r");
+            names.emplace_back(first == std::string_view::npos ? "" : name.substr(first, last - first + 1));
+            if (comma == std::string_view::npos)
+                return names;
+            text.remove_prefix(comma + 1);
+        }
+    }
+
+    // Reads rows into chunks until the input ends
+    class Reader
+    {
+    public:
+        Reader(Input &input, const Options &options) : input_(input), options_(options) {}
+
+        void setColumnCount(size_t count) { columnCount_ = count; }
+
+        // Fills the chunk with up to chunkRows rows; false if there are none left
+        bool fill(Chunk &chunk)
+        {
+            chunk.firstRow = rowsRead_;
+            chunk.rows = 0;
+            if (options_.format == Format::Binary)
+                fillBinary(chunk);
+            else
+                fillCsv(chunk);
+            rowsRead_ += chunk.rows;
+            return chunk.rows > 0;
+        }
+
+        // The CSV header line, or the empty string at the end of the input
+        std::string header()
+        {
+            size_t want = ReadSize;
+            while (true)
+            {
+                std::string_view view = input_.peek(want);
+                size_t newline = view.find('\n');
+                if (newline != std::string_view::npos || input_.ended())
+                {
+                    std::string line(view.substr(0, newline));
+                    input_.consume(newline == std::string_view::npos ? view.size() : newline + 1);
+                    ++line_;
+                    return line;
+                }
+                want = growLine(view.size());
+            }
+        }
+
+    private:
+        void fillBinary(Chunk &chunk)
+        {
+            size_t record = columnCount_ * sizeof(double);
+            std::string_view view = input_.peek(record * options_.chunkRows);
+            size_t rows = std::min(options_.chunkRows, view.size() / record);
+            if (rows == 0 && !view.empty())
+                throw InputError("The input ends inside row " + std::to_string(rowsRead_ + 1));
+
+            const char *bytes = view.data();
+            for (size_t row = 0; row < rows; ++row)
+            {
+                for (size_t column = 0; column < columnCount_; ++column, bytes += sizeof(double))
+                    chunk.columns[column * options_.chunkRows + row] = fromLittleEndian(bytes);
+            }
+            input_.consume(rows * record);
+            chunk.rows = rows;
+        }
+
+        void fillCsv(Chunk &chunk)
+        {
+            size_t want = ReadSize;
+            while (chunk.rows < options_.chunkRows)
+            {
+                std::string_view view = input_.peek(want);
+                if (view.empty())
+                    return;
+
+                // Complete lines only; the last line may lack its newline
+                size_t used = 0;
+                while (chunk.rows < options_.chunkRows && used < view.size())
+                {
+                    size_t newline = view.find('\n', used);
+                    if (newline == std::string_view::npos && !input_.ended())
+                        break;
+                    size_t end = newline == std::string_view::npos ? view.size() : newline;
+                    ++line_;
+                    std::string_view line = view.substr(used, end - used);
+                    if (!line.empty() && line.back() == '\r')
+                        line.remove_suffix(1);
+                    if (!line.empty())
+                        parseLine(line, chunk);
+                    used = newline == std::string_view::npos ? view.size() : newline + 1;
+                }
+                input_.consume(used);
+                want = used > 0 ? ReadSize : growLine(view.size());
+            }
+        }
+
+        size_t growLine(size_t size)
+        {
+            if (size >= MaxLineLength)
+                throw InputError("Line " + std::to_string(line_ + 1) + " is longer than " +
+                                 std::to_string(MaxLineLength) + " bytes");
+            return std::min(MaxLineLength, 2 * size + 1);
+        }
+
+        void parseLine(std::string_view line, Chunk &chunk)
+        {
+            const char *position = line.data();
+            const char *end = line.data() + line.size();
+            for (size_t column = 0; column < columnCount_; ++column)
+            {
+                while (position < end && (*position == ' ' || *position == '\t'))
+                    ++position;
+                if (position < end && *position == '+')
+                    ++position;
+                double value;
+                auto [next, error] = std::from_chars(position, end, value);
+                if (error == std::errc::result_out_of_range) // 1e999 or 1e-999: strtod gives inf or 0
+                    value = std::strtod(std::string(position, next).c_str(), nullptr);
+                else if (error != std::errc())
+                    throw InputError("Line " + std::to_string(line_) + ", column " + std::to_string(column + 1) +
+                                     ": not a number");
+                position = next;
+                while (position < end && (*position == ' ' || *position == '\t'))
+                    ++position;
+                bool last = column + 1 == columnCount_;
+                if (last ? position != end : position == end || *position != ',')
+                    throw InputError("Line " + std::to_string(line_) + ": expected " + std::to_string(columnCount_) +
+                                     " numbers separated by commas");
+                ++position;
+                chunk.columns[column * options_.chunkRows + chunk.rows] = value;
+            }
+            ++chunk.rows;
+        }
+
+        Input &input_;
+        const Options &options_;
+        size_t columnCount_ = 0;
+        size_t rowsRead_ = 0;
+        size_t line_ = 0;
+    };
+
+    // Formats and writes the results of a chunk
+    class Writer
+    {
+    public:
+        explicit Writer(Format format) : format_(format) {}
+
+        void header(const std::string &name)
+        {
+            if (format_ == Format::Csv)
+                write(name + "\n");
+        }
+
+        void write(const Chunk &chunk)
+        {
+            text_.clear();
+            if (format_ == Format::Binary)
+            {
+                text_.resize(chunk.rows * sizeof(double));
+                for (size_t row = 0; row < chunk.rows; ++row)
+                    toLittleEndian(chunk.results[row], text_.data() + row * sizeof(double));
+            }
+            else
+            {
+                // Shortest text that reads back as the same double
+                char number[32];
+                for (size_t row = 0; row < chunk.rows; ++row)
+                {
+                    char *end = std::to_chars(number, number + sizeof(number), chunk.results[row]).ptr;
+                    text_.append(number, end);
+                    text_.push_back('\n');
+                }
+            }
+            write(text_);
+        }
+
+    private:
+        void write(const std::string &text)
+        {
+            if (std::fwrite(text.data(), 1, text.size(), stdout) != text.size())
+                throw InputError("Error writing the output");
+        }
+
+        Format format_;
+        std::string text_;
+    };
+
+    bool parseOptions(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string argument = argv[i];
+            if (argument.rfind("--", 0) != 0)
+            {
+                if (!options.formula.empty())
+                    return false;
+                options.formula = argument;
+                continue;
+            }
+            if (argument == "--quiet")
+            {
+                options.quiet = true;
+                continue;
+            }
+
+            size_t equals = argument.find('=');
+            std::string name = argument.substr(0, equals);
+            std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+            if (value.empty())
+                return false;
+            if (name == "--format" && (value == "csv" || value == "binary"))
+                options.format = value == "csv" ? Format::Csv : Format::Binary;
+            else if (name == "--input")
+                options.inputPath = value;
+            else if (name == "--columns")
+                options.columns = splitNames(value);
+            else if (name == "--name")
+                options.resultName = value;
+            else if (name == "--errors" && (value == "report" || value == "propagate"))
+                options.errorMode = value == "report" ? ErrorMode::Report : ErrorMode::Propagate;
+            else if (name == "--chunk")
+            {
+                // A positive row count: no sign, no trailing characters and no absurd sizes
+                size_t rows = 0;
+                auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), rows);
+                if (error != std::errc() || end != value.data() + value.size() || rows == 0 || rows > MaxChunkRows)
+                    return false;
+                options.chunkRows = rows;
+            }
+            else
+                return false;
+        }
+        return !options.formula.empty() && (options.format == Format::Csv || !options.columns.empty());
+    }
+
+    // The first row of the chunk the formula fails on, with the error
+    std::string failingRow(const CompiledExpression &expression, const Chunk &chunk, size_t capacity)
+    {
+        size_t count = expression.variableNames().size();
+        std::vector<double> values(count);
+        for (size_t row = 0; row < chunk.rows; ++row)
+        {
+            for (size_t slot = 0; slot < count; ++slot)
+                values[slot] = chunk.columns[slot * capacity + row];
+            Result<double> result = expression.tryEvaluate(values);
+            if (!result)
+                return "Row " + std::to_string(chunk.firstRow + row + 1) + ": " + result.error().message();
+        }
+        return "Evaluation failed";
+    }
+
+    int run(const Options &options)
+    {
+        Input input(options.inputPath);
+        std::vector<std::string> names = options.columns;
+        Reader reader(input, options);
+        if (names.empty())
+        {
+            std::string header = reader.header();
+            if (header.empty())
+                throw InputError("The input has no header line");
+            names = splitNames(header);
+        }
+        reader.setColumnCount(names.size());
+
+        Parser parser;
+        Result<CompiledExpression> compiled = parser.tryCompile(options.formula, names);
+        if (!compiled)
+            throw InputError("Formula: " + compiled.error().message());
+        const CompiledExpression &expression = *compiled;
+
+        Writer writer(options.format);
+        writer.header(options.resultName);
+
+        std::vector<Chunk> chunks(ChunkCount);
+        Channel empty, parsed, evaluated;
+        for (Chunk &chunk : chunks)
+        {
+            chunk.columns.resize(names.size() * options.chunkRows);
+            chunk.results.resize(options.chunkRows);
+            empty.push(&chunk);
+        }
+
+        // The first error of any stage stops all of them
+        std::mutex errorMutex;
+        std::exception_ptr error;
+        auto fail = [&](std::exception_ptr exception)
+        {
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error)
+                    error = exception;
+            }
+            empty.abort();
+            parsed.abort();
+            evaluated.abort();
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        std::thread readerThread([&]
+        {
+            try
+            {
+                while (Chunk *chunk = empty.pop())
+                {
+                    if (!reader.fill(*chunk))
+                        break;
+                    parsed.push(chunk);
+                }
+                parsed.close();
+            }
+            catch (...)
+            {
+                fail(std::current_exception());
+            }
+        });
+        size_t rows = 0;
+        std::thread writerThread([&]
+        {
+            try
+            {
+                while (Chunk *chunk = evaluated.pop())
+                {
+                    writer.write(*chunk);
+                    rows += chunk->rows;
+                    empty.push(chunk);
+                }
+            }
+            catch (...)
+            {
+                fail(std::current_exception());
+            }
+        });
+
+        std::vector<const double *> columns(names.size());
+        while (Chunk *chunk = parsed.pop())
+        {
+            for (size_t slot = 0; slot < columns.size(); ++slot)
+                columns[slot] = chunk->columns.data() + slot * options.chunkRows;
+            try
+            {
+                expression.evaluateBatch(columns.data(), chunk->rows, chunk->results.data(), options.errorMode);
+            }
+            catch (const ExpressionError &)
+            {
+                fail(std::make_exception_ptr(InputError(failingRow(expression, *chunk, options.chunkRows))));
+                break;
+            }
+            evaluated.push(chunk);
+        }
+        evaluated.close();
+        readerThread.join();
+        writerThread.join();
+        std::fflush(stdout);
+        if (error)
+            std::rethrow_exception(error);
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!options.quiet)
+            std::cerr << "mathparser-eval: " << rows << " rows in " << seconds << " s, "
+                      << (seconds > 0 ? rows / seconds : 0.0) << " rows/s" << std::endl;
+        return 0;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--format=csv|binary] [--input=FILE] [--columns=NAMES] [--name=NAME]"
+                     " [--errors=report|propagate] [--chunk=ROWS] [--quiet] FORMULA\n\n"
+                     "Evaluates FORMULA for every row of the input (stdin by default) and writes one result\n"
+                     "per row to stdout in the same format. A CSV input starts with a header naming its\n"
+                     "columns, unless --columns names them; a binary input is rows of little-endian doubles,\n"
+                     "one per name in --columns. The formula refers to the columns by name."
+                  << std::endl;
+        return 2;
+    }
+
+    try
+    {
+        return run(options);
+    }
+    catch (const std::exception &exception)
+    {
+        std::cerr << "mathparser-eval: " << exception.what() << std::endl;
+        return 1;
+    }
+}
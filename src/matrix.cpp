@@ -0,0 +1,290 @@
+/**
+ * @file matrix.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "matrix.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+
+namespace
+{
+    // Columns of the right operand kept in cache while every row of the product passes over them
+    constexpr size_t ColumnTile = 256;
+
+    // c -= a * b for an m x k a and a k x n b, all row-major with the given row
+    // strides. The product is taken in tiles of LuBlockSize x ColumnTile of b
+    // (128 KB), and four rows of b at a time, so each pass over a row of c does
+    // eight flops per value loaded and stored. Zeros of a are skipped, which saves
+    // most of the work when the right hand sides are columns of the identity.
+    void subtractProduct(double *c, size_t ldc, const double *a, size_t lda, const double *b, size_t ldb, size_t m,
+                         size_t n, size_t k)
+    {
+        for (size_t p0 = 0; p0 < k; p0 += LuBlockSize)
+        {
+            size_t p1 = std::min(p0 + LuBlockSize, k);
+            for (size_t j0 = 0; j0 < n; j0 += ColumnTile)
+            {
+                size_t width = std::min(ColumnTile, n - j0);
+                for (size_t i = 0; i < m; ++i)
+                {
+                    double *__restrict row = c + i * ldc + j0;
+                    const double *factors = a + i * lda;
+                    size_t p = p0;
+                    for (; p + 4 <= p1; p += 4)
+                    {
+                        double f0 = factors[p], f1 = factors[p + 1], f2 = factors[p + 2], f3 = factors[p + 3];
+                        if (f0 == 0 && f1 == 0 && f2 == 0 && f3 == 0)
+                            continue;
+                        const double *__restrict b0 = b + p * ldb + j0;
+                        const double *__restrict b1 = b0 + ldb;
+                        const double *__restrict b2 = b1 + ldb;
+                        const double *__restrict b3 = b2 + ldb;
+                        for (size_t j = 0; j < width; ++j)
+                            row[j] -= f0 * b0[j] + f1 * b1[j] + f2 * b2[j] + f3 * b3[j];
+                    }
+                    for (; p < p1; ++p)
+                    {
+                        double f = factors[p];
+                        if (f == 0)
+                            continue;
+                        const double *__restrict bp = b + p * ldb + j0;
+                        for (size_t j = 0; j < width; ++j)
+                            row[j] -= f * bp[j];
+                    }
+                }
+            }
+        }
+    }
+
+    // row -= f * other over count values
+    void subtractRow(double *__restrict row, double f, const double *__restrict other, size_t count)
+    {
+        for (size_t j = 0; j < count; ++j)
+            row[j] -= f * other[j];
+    }
+}
+
+Matrix Matrix::identity(size_t n)
+{
+    Matrix result(n, n);
+    for (size_t i = 0; i < n; ++i)
+        result(i, i) = 1.0;
+    return result;
+}
+
+Matrix Matrix::fromRows(const std::vector<std::vector<double>> &rows)
+{
+    Matrix result(rows.size(), rows.empty() ? 0 : rows[0].size());
+    for (size_t r = 0; r < rows.size(); ++r)
+    {
+        if (rows[r].size() != result.columns_)
+            throw std::invalid_argument("Row " + std::to_string(r) + " has " + std::to_string(rows[r].size()) +
+                                        " values, expected " + std::to_string(result.columns_));
+        std::copy(rows[r].begin(), rows[r].end(), result.row(r));
+    }
+    return result;
+}
+
+std::vector<std::vector<double>> Matrix::toRows() const
+{
+    std::vector<std::vector<double>> result(rows_);
+    for (size_t r = 0; r < rows_; ++r)
+        result[r].assign(row(r), row(r) + columns_);
+    return result;
+}
+
+Matrix operator*(const Matrix &left, const Matrix &right)
+{
+    if (left.columns() != right.rows())
+        throw std::invalid_argument("Cannot multiply a " + std::to_string(left.rows()) + "x" +
+                                    std::to_string(left.columns()) + " matrix by a " + std::to_string(right.rows()) +
+                                    "x" + std::to_string(right.columns()) + " matrix");
+
+    // Row i of the product is the sum of the rows of right weighted by row i of left
+    Matrix result(left.rows(), right.columns());
+    for (size_t i = 0; i < left.rows(); ++i)
+    {
+        for (size_t p = 0; p < left.columns(); ++p)
+            subtractRow(result.row(i), -left(i, p), right.row(p), right.columns());
+    }
+    return result;
+}
+
+int luDecompose(double *values, size_t n, size_t *pivots)
+{
+    // Rounding leaves a pivot of a singular matrix around eps ||A|| rather than 0,
+    // so pivots up to n eps ||A|| (the largest row sum) count as zero
+    double norm = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        double sum = 0;
+        for (size_t j = 0; j < n; ++j)
+            sum += std::abs(values[i * n + j]);
+        norm = std::max(norm, sum);
+    }
+    double tolerance = double(n) * std::numeric_limits<double>::epsilon() * norm;
+
+    int sign = 1;
+    bool singular = false;
+    for (size_t k0 = 0; k0 < n; k0 += LuBlockSize)
+    {
+        size_t k1 = std::min(k0 + LuBlockSize, n);
+
+        // Factor the panel of columns k0..k1-1 one column at a time, updating only
+        // the panel. Rows are swapped over their whole width.
+        for (size_t j = k0; j < k1; ++j)
+        {
+            size_t pivot = j;
+            double largest = std::abs(values[j * n + j]);
+            for (size_t i = j + 1; i < n; ++i)
+            {
+                double candidate = std::abs(values[i * n + j]);
+                if (candidate > largest)
+                {
+                    largest = candidate;
+                    pivot = i;
+                }
+            }
+            pivots[j] = pivot;
+            if (pivot != j)
+            {
+                std::swap_ranges(values + j * n, values + (j + 1) * n, values + pivot * n);
+                sign = -sign;
+            }
+
+            // A zero column below the diagonal: nothing to eliminate, and U has a zero pivot
+            double diagonal = values[j * n + j];
+            if (std::abs(diagonal) <= tolerance)
+            {
+                singular = true;
+                continue;
+            }
+            for (size_t i = j + 1; i < n; ++i)
+            {
+                double *row = values + i * n;
+                double l = row[j] /= diagonal;
+                if (l != 0)
+                    subtractRow(row + j + 1, l, values + j * n + j + 1, k1 - j - 1);
+            }
+        }
+        if (k1 == n)
+            break;
+
+        // The rows of U right of the panel: U12 = L11^-1 A12
+        for (size_t j = k0; j < k1; ++j)
+        {
+            for (size_t i = j + 1; i < k1; ++i)
+            {
+                double l = values[i * n + j];
+                if (l != 0)
+                    subtractRow(values + i * n + k1, l, values + j * n + k1, n - k1);
+            }
+        }
+
+        // The trailing matrix: A22 -= L21 U12, where nearly all the work is
+        subtractProduct(values + k1 * n + k1, n, values + k1 * n + k0, n, values + k0 * n + k1, n, n - k1, n - k1,
+                        k1 - k0);
+    }
+    return singular ? 0 : sign;
+}
+
+void luSolve(const double *factors, const size_t *pivots, size_t n, double *x, size_t count)
+{
+    for (size_t k = 0; k < n; ++k)
+    {
+        if (pivots[k] != k)
+            std::swap_ranges(x + k * count, x + (k + 1) * count, x + pivots[k] * count);
+    }
+
+    // L Y = P B, top down: each block of rows first takes the rows above it as one product
+    for (size_t i0 = 0; i0 < n; i0 += LuBlockSize)
+    {
+        size_t i1 = std::min(i0 + LuBlockSize, n);
+        subtractProduct(x + i0 * count, count, factors + i0 * n, n, x, count, i1 - i0, count, i0);
+        for (size_t i = i0; i < i1; ++i)
+        {
+            for (size_t p = i0; p < i; ++p)
+            {
+                double l = factors[i * n + p];
+                if (l != 0)
+                    subtractRow(x + i * count, l, x + p * count, count);
+            }
+        }
+    }
+
+    // U X = Y, bottom up in the same blocks
+    for (size_t i1 = n; i1 > 0;)
+    {
+        size_t i0 = (i1 - 1) / LuBlockSize * LuBlockSize;
+        subtractProduct(x + i0 * count, count, factors + i0 * n + i1, n, x + i1 * count, count, i1 - i0, count,
+                        n - i1);
+        for (size_t i = i1; i-- > i0;)
+        {
+            double *row = x + i * count;
+            for (size_t p = i + 1; p < i1; ++p)
+            {
+                double u = factors[i * n + p];
+                if (u != 0)
+                    subtractRow(row, u, x + p * count, count);
+            }
+            double diagonal = factors[i * n + i];
+            for (size_t j = 0; j < count; ++j)
+                row[j] /= diagonal;
+        }
+        i1 = i0;
+    }
+}
+
+LuDecomposition::LuDecomposition(Matrix matrix) : factors_(std::move(matrix))
+{
+    if (factors_.rows() != factors_.columns())
+        throw std::invalid_argument("LU decomposition needs a square matrix, got " + std::to_string(factors_.rows()) +
+                                    "x" + std::to_string(factors_.columns()));
+    pivots_.resize(factors_.rows());
+    sign_ = luDecompose(factors_.data(), factors_.rows(), pivots_.data());
+}
+
+double LuDecomposition::determinant() const
+{
+    if (singular())
+        return 0.0;
+    double result = sign_;
+    for (size_t i = 0; i < factors_.rows(); ++i)
+        result *= factors_(i, i);
+    return result;
+}
+
+std::vector<double> LuDecomposition::solve(std::span<const double> b) const
+{
+    if (b.size() != factors_.rows())
+        throw std::invalid_argument("Expected " + std::to_string(factors_.rows()) + " right hand side values, got " +
+                                    std::to_string(b.size()));
+    if (singular())
+        throw SingularMatrixError();
+    std::vector<double> x(b.begin(), b.end());
+    luSolve(factors_.data(), pivots_.data(), factors_.rows(), x.data(), 1);
+    return x;
+}
+
+Matrix LuDecomposition::solve(const Matrix &b) const
+{
+    if (b.rows() != factors_.rows())
+        throw std::invalid_argument("Expected " + std::to_string(factors_.rows()) + " right hand side rows, got " +
+                                    std::to_string(b.rows()));
+    if (singular())
+        throw SingularMatrixError();
+    Matrix x = b;
+    luSolve(factors_.data(), pivots_.data(), factors_.rows(), x.data(), x.columns());
+    return x;
+}
+
+Matrix LuDecomposition::inverse() const
+{
+    return solve(Matrix::identity(factors_.rows()));
+}
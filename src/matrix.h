@@ -0,0 +1,190 @@
+/**
+ * @file matrix.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+// Thrown by inverse and solve for a matrix whose LU decomposition has a zero
+// pivot. It is a std::runtime_error, as inverse2x2Matrix has always thrown.
+class SingularMatrixError : public std::runtime_error
+{
+public:
+    SingularMatrixError() : std::runtime_error("The determinant is 0, the matrix has no inverse.") {}
+};
+
+// A matrix of doubles sized at runtime, stored row by row in one contiguous
+// buffer: element (r, c) is values()[r * columns() + c]
+class Matrix
+{
+public:
+    Matrix() = default;
+    Matrix(size_t rows, size_t columns, double value = 0.0)
+        : rows_(rows), columns_(columns), values_(rows * columns, value) {}
+
+    static Matrix identity(size_t n);
+
+    // Converts from and to the nested layout; rows must all have the same length
+    static Matrix fromRows(const std::vector<std::vector<double>> &rows);
+    std::vector<std::vector<double>> toRows() const;
+
+    size_t rows() const { return rows_; }
+    size_t columns() const { return columns_; }
+
+    double &operator()(size_t row, size_t column) { return values_[row * columns_ + column]; }
+    double operator()(size_t row, size_t column) const { return values_[row * columns_ + column]; }
+
+    double *row(size_t row) { return values_.data() + row * columns_; }
+    const double *row(size_t row) const { return values_.data() + row * columns_; }
+
+    double *data() { return values_.data(); }
+    const double *data() const { return values_.data(); }
+
+    bool operator==(const Matrix &other) const = default;
+
+private:
+    size_t rows_ = 0;
+    size_t columns_ = 0;
+    std::vector<double> values_;
+};
+
+// Matrix product; throws std::invalid_argument when the sizes do not match
+Matrix operator*(const Matrix &left, const Matrix &right);
+
+// A rows x columns matrix with its values in a std::array, for sizes known at
+// compile time: no heap allocation, and the functions below run on the stack
+template <size_t Rows, size_t Columns = Rows>
+class FixedMatrix
+{
+public:
+    static constexpr size_t rows() { return Rows; }
+    static constexpr size_t columns() { return Columns; }
+
+    double &operator()(size_t row, size_t column) { return values[row * Columns + column]; }
+    double operator()(size_t row, size_t column) const { return values[row * Columns + column]; }
+
+    double *data() { return values.data(); }
+    const double *data() const { return values.data(); }
+
+    bool operator==(const FixedMatrix &other) const = default;
+
+    // Row by row; public so that FixedMatrix<2> m{{a, b, c, d}} works
+    std::array<double, Rows * Columns> values{};
+};
+
+// The LU kernels on a caller's row-major n x n buffer, shared by Matrix and
+// FixedMatrix. luDecompose overwrites values with L (below the diagonal, unit
+// diagonal implied) and U, swapping rows for partial pivoting: at step k row k
+// was swapped with row pivots[k]. It works in panels of LuBlockSize columns, so
+// most of the work is one blocked matrix product per panel. It returns the sign
+// of the row permutation, or 0 if a pivot was at most n eps ||A|| in magnitude
+// (||A|| the largest row sum of absolute values): the matrix is singular to
+// working precision, and its determinant is taken to be 0.
+constexpr size_t LuBlockSize = 64;
+int luDecompose(double *values, size_t n, size_t *pivots);
+
+// Solves A X = B in place for the columns of the row-major n x count buffer x,
+// given the factors and pivots of A from luDecompose
+void luSolve(const double *factors, const size_t *pivots, size_t n, double *x, size_t count);
+
+// The LU decomposition of a square matrix, PA = LU, for solving several right
+// hand sides or taking the determinant and inverse without factoring again
+class LuDecomposition
+{
+public:
+    // Throws std::invalid_argument for a matrix that is not square
+    explicit LuDecomposition(Matrix matrix);
+
+    bool singular() const { return sign_ == 0; }
+
+    // 0 for a singular matrix
+    double determinant() const;
+
+    // Throw SingularMatrixError for a singular matrix, and std::invalid_argument
+    // when b does not have one row per row of the matrix
+    std::vector<double> solve(std::span<const double> b) const;
+    Matrix solve(const Matrix &b) const;
+    Matrix inverse() const;
+
+    // L and U in one matrix, and the row swapped with each row
+    const Matrix &factors() const { return factors_; }
+    const std::vector<size_t> &pivots() const { return pivots_; }
+
+private:
+    Matrix factors_;
+    std::vector<size_t> pivots_;
+    int sign_ = 1;
+};
+
+inline double determinant(const Matrix &matrix) { return LuDecomposition(matrix).determinant(); }
+inline Matrix inverse(const Matrix &matrix) { return LuDecomposition(matrix).inverse(); }
+inline std::vector<double> solve(const Matrix &matrix, std::span<const double> b) { return LuDecomposition(matrix).solve(b); }
+inline Matrix solve(const Matrix &matrix, const Matrix &b) { return LuDecomposition(matrix).solve(b); }
+
+// The same for fixed sizes. A 2x2 matrix uses the closed form ad - bc and its
+// adjugate, as inverse2x2Matrix does; larger ones the LU kernels.
+template <size_t N>
+double determinant(const FixedMatrix<N, N> &matrix)
+{
+    if constexpr (N == 2)
+    {
+        return matrix(0, 0) * matrix(1, 1) - matrix(0, 1) * matrix(1, 0);
+    }
+    else
+    {
+        FixedMatrix<N, N> factors = matrix;
+        std::array<size_t, N> pivots;
+        double result = luDecompose(factors.data(), N, pivots.data());
+        for (size_t i = 0; i < N; ++i)
+            result *= factors(i, i);
+        return result;
+    }
+}
+
+template <size_t N>
+FixedMatrix<N, N> inverse(const FixedMatrix<N, N> &matrix)
+{
+    FixedMatrix<N, N> result;
+    if constexpr (N == 2)
+    {
+        double det = determinant(matrix);
+        if (det == 0)
+            throw SingularMatrixError();
+        result.values = {matrix(1, 1) / det, -matrix(0, 1) / det, -matrix(1, 0) / det, matrix(0, 0) / det};
+    }
+    else
+    {
+        FixedMatrix<N, N> factors = matrix;
+        std::array<size_t, N> pivots;
+        if (luDecompose(factors.data(), N, pivots.data()) == 0)
+            throw SingularMatrixError();
+        for (size_t i = 0; i < N; ++i)
+            result(i, i) = 1.0;
+        luSolve(factors.data(), pivots.data(), N, result.data(), N);
+    }
+    return result;
+}
+
+template <size_t N>
+std::array<double, N> solve(const FixedMatrix<N, N> &matrix, const std::array<double, N> &b)
+{
+    FixedMatrix<N, N> factors = matrix;
+    std::array<size_t, N> pivots;
+    if (luDecompose(factors.data(), N, pivots.data()) == 0)
+        throw SingularMatrixError();
+    std::array<double, N> x = b;
+    luSolve(factors.data(), pivots.data(), N, x.data(), 1);
+    return x;
+}
+
+#endif // MATRIX_H
@@ -0,0 +1,141 @@
+/**
+ * @file multi_expression.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "multi_expression.h"
+#include <stdexcept>
+
+namespace
+{
+    size_t countOperations(const FlatExpression &expression)
+    {
+        size_t operations = 0;
+        for (const FlatNode &node : expression.nodes())
+        {
+            if (node.op != OpCode::Constant && node.op != OpCode::Variable)
+                ++operations;
+        }
+        return operations;
+    }
+}
+
+MultiExpression::MultiExpression(std::span<const FlatExpression> formulas)
+{
+    if (formulas.empty())
+        throw std::invalid_argument("Cannot fuse an empty set of formulas");
+
+    size_t totalNodes = 0;
+    for (const FlatExpression &formula : formulas)
+    {
+        if (formula.empty())
+            throw std::invalid_argument("Cannot fuse an empty expression");
+        if (formula.variableNames() != formulas[0].variableNames())
+            throw std::invalid_argument("Fused formulas must have the same variable names");
+        totalNodes += formula.size();
+    }
+
+    // Copies every formula's nodes through one interner; a node equal to one of
+    // an earlier formula maps to that node
+    NodeInterner interner;
+    interner.reset(expression_, totalNodes);
+    std::vector<uint32_t> remap;
+    roots_.reserve(formulas.size());
+    for (const FlatExpression &formula : formulas)
+    {
+        remap.resize(formula.size());
+        for (size_t i = 0; i < formula.size(); ++i)
+        {
+            const FlatNode &node = formula.nodes()[i];
+            switch (opcodeArity(node.op))
+            {
+            case 0:
+                remap[i] = node.op == OpCode::Constant ? interner.addConstant(node.value)
+                                                       : interner.addVariable(node.operands.left);
+                break;
+            case 1:
+                remap[i] = interner.addUnary(node.op, remap[node.operands.left]);
+                break;
+            default:
+                remap[i] = interner.addBinary(node.op, remap[node.operands.left], remap[node.operands.right]);
+                break;
+            }
+        }
+        roots_.push_back(remap.back());
+
+        Bytecode separate = Bytecode::compile(formula);
+        stats_.separateOperations += countOperations(formula);
+        stats_.separateInstructions += separate.code().size();
+        stats_.separateVariableReads += separate.slots().size();
+    }
+    expression_.setVariableNames(formulas[0].variableNames());
+
+    program_ = Bytecode::compile(expression_, roots_);
+    stats_.fusedOperations = countOperations(expression_);
+    stats_.fusedInstructions = program_.code().size();
+    stats_.fusedVariableReads = program_.slots().size();
+}
+
+MultiExpression MultiExpression::compile(Parser &parser, const std::vector<std::string> &formulas,
+                                         const std::vector<std::string> &variableNames)
+{
+    std::vector<FlatExpression> parsed;
+    parsed.reserve(formulas.size());
+    for (const std::string &formula : formulas)
+        parsed.push_back(parser.parseFlat(formula, variableNames));
+    return MultiExpression(parsed);
+}
+
+void MultiExpression::evaluate(std::span<const double> values, std::span<double> out) const
+{
+    if (out.size() != roots_.size())
+    {
+        throw std::invalid_argument("Expected room for " + std::to_string(roots_.size()) + " outputs, got " +
+                                    std::to_string(out.size()));
+    }
+    program_.view().evaluateOutputs(values, out);
+}
+
+std::vector<double> MultiExpression::evaluate(std::span<const double> values) const
+{
+    std::vector<double> out(roots_.size());
+    evaluate(values, out);
+    return out;
+}
+
+Result<std::vector<double>> MultiExpression::tryEvaluate(std::span<const double> values) const
+{
+    try
+    {
+        return evaluate(values);
+    }
+    catch (const ExpressionError &error)
+    {
+        return error.error();
+    }
+}
+
+void MultiExpression::evaluateBatch(const double *const *columns, size_t n, double *const *out, ErrorMode mode) const
+{
+    evaluateRows(columns, 0, n, out, mode);
+}
+
+void MultiExpression::evaluateRows(const double *const *columns, size_t begin, size_t end, double *const *out,
+                                   ErrorMode mode) const
+{
+    program_.view().evaluateOutputRows(columns, begin, end, out, roots_.size(), mode);
+}
+
+size_t MultiExpression::slot(std::string_view name) const
+{
+    const std::vector<std::string> &names = variableNames();
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        if (names[i] == name)
+            return i;
+    }
+    throw std::out_of_range("Unknown variable: " + std::string(name));
+}
@@ -0,0 +1,93 @@
+/**
+ * @file multi_expression.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MULTI_EXPRESSION_H
+#define MULTI_EXPRESSION_H
+
+#include "bytecode.h"
+#include "flat_expression.h"
+#include "parser.h"
+#include "result.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Work per evaluation of a set of formulas, fused and one by one
+struct FusionStats
+{
+    // Operation nodes (everything but constants and variables) computed
+    size_t separateOperations = 0;
+    size_t fusedOperations = 0;
+
+    // Bytecode instructions run, loads and stores of shared values included
+    size_t separateInstructions = 0;
+    size_t fusedInstructions = 0;
+
+    // Variable values read
+    size_t separateVariableReads = 0;
+    size_t fusedVariableReads = 0;
+};
+
+// A set of formulas over the same variables compiled into one program that
+// computes all of them in a single pass. The formulas' nodes are interned into
+// one flat expression, so a subexpression that several formulas contain, such
+// as price * qty in both revenue and tax, is one node. The program computes
+// it once, keeps it in a local and loads it for every later formula.
+//
+// Every output is bit for bit what the formula gives on its own. A domain
+// error in any formula fails the whole evaluation, as evaluating the formulas
+// one after another would.
+class MultiExpression
+{
+public:
+    // Formulas parsed with the same variable names; output k is formulas[k]
+    explicit MultiExpression(std::span<const FlatExpression> formulas);
+
+    // Parses the formulas with the parser and fuses them
+    static MultiExpression compile(Parser &parser, const std::vector<std::string> &formulas,
+                                   const std::vector<std::string> &variableNames = {});
+
+    size_t outputCount() const { return roots_.size(); }
+
+    // Writes every output for one set of values; out must hold outputCount() values
+    void evaluate(std::span<const double> values, std::span<double> out) const;
+    std::vector<double> evaluate(std::span<const double> values = {}) const;
+
+    // Returns the first domain error instead of throwing it
+    Result<std::vector<double>> tryEvaluate(std::span<const double> values = {}) const;
+
+    // Evaluates n rows at once: columns[i] holds the n values of variableNames()[i],
+    // and out[k] receives the n values of output k
+    void evaluateBatch(const double *const *columns, size_t n, double *const *out,
+                       ErrorMode mode = ErrorMode::Report) const;
+    void evaluateRows(const double *const *columns, size_t begin, size_t end, double *const *out,
+                      ErrorMode mode = ErrorMode::Report) const;
+
+    // Slot of the named variable; throws std::out_of_range for an unknown name
+    size_t slot(std::string_view name) const;
+
+    const std::vector<std::string> &variableNames() const { return expression_.variableNames(); }
+
+    // The fused nodes, with the root of every output
+    const FlatExpression &expression() const { return expression_; }
+    const std::vector<uint32_t> &roots() const { return roots_; }
+
+    const Bytecode &program() const { return program_; }
+    const FusionStats &stats() const { return stats_; }
+
+private:
+    FlatExpression expression_;
+    std::vector<uint32_t> roots_;
+    Bytecode program_;
+    FusionStats stats_;
+};
+
+#endif // MULTI_EXPRESSION_H
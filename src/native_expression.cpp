@@ -0,0 +1,560 @@
+/**
+ * @file native_expression.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "native_expression.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// The generated code follows the System V calling convention, which all of
+// these use on x86-64
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__))
+#define NATIVE_EXPRESSION_X86_64
+#include <sys/mman.h>
+#endif
+
+#ifdef NATIVE_EXPRESSION_X86_64
+namespace
+{
+    // The functions the generated code calls. Wrapping them gives plain function
+    // addresses whatever overloads <cmath> declares, and they compute exactly
+    // what the matching Node classes compute.
+    double callSin(double x) { return std::sin(x); }
+    double callCos(double x) { return std::cos(x); }
+    double callTan(double x) { return std::tan(x); }
+    double callLn(double x) { return std::log(x); }
+    double callLog(double x) { return std::log10(x); }
+    double callSinh(double x) { return std::sinh(x); }
+    double callCosh(double x) { return std::cosh(x); }
+    double callTanh(double x) { return std::tanh(x); }
+    double callPow(double x, double y) { return std::pow(x, y); }
+
+    // Coth and Csch have no domain errors, so applyOperation never throws here
+    double callCoth(double x) { return applyOperation(OpCode::Coth, x, 0.0); }
+    double callCsch(double x) { return applyOperation(OpCode::Csch, x, 0.0); }
+
+    // NaN instead of the error for a negative or NaN argument; a factorial is never NaN otherwise
+    double callFactorial(double x) { return !(x >= 0.0) ? NAN : factorialValue(x); }
+
+    using UnaryFunction = double (*)(double);
+    using BinaryFunction = double (*)(double, double);
+
+    // Bytecode stack slot i lives in xmm i up to RegisterSlots, then in the frame.
+    // xmm14 and xmm15 are scratch registers.
+    constexpr int RegisterSlots = 14;
+    constexpr int Scratch = 15;
+    constexpr int ScratchZero = 14;
+
+    // Programs that would need a larger stack frame run as bytecode, which keeps deep stacks on the heap
+    constexpr size_t MaxFrameBytes = 64 * 1024;
+
+    // SSE opcodes (after the 0x0F escape byte)
+    constexpr uint8_t MoveLoad = 0x10, MoveStore = 0x11, MoveAligned = 0x28, SquareRoot = 0x51, AddDouble = 0x58,
+                      MultiplyDouble = 0x59, SubtractDouble = 0x5C, DivideDouble = 0x5E, CompareUnordered = 0x2E,
+                      ExclusiveOr = 0x57;
+
+    // Conditions of the near jumps 0x0F 0x8?
+    constexpr uint8_t Above = 0x87, NotEqual = 0x85, Parity = 0x8A, NoParity = 0x8B;
+
+    // Where a value is: an xmm register, the stack frame ([rsp + offset]), the
+    // variables ([rbx + offset]) or the constant pool (rip relative, by index)
+    struct Operand
+    {
+        enum Kind : uint8_t
+        {
+            Register,
+            Frame,
+            Variables,
+            Constant
+        };
+
+        Kind kind;
+        uint32_t value;
+
+        bool operator==(const Operand &other) const = default;
+    };
+
+    Operand xmm(int index) { return {Operand::Register, uint32_t(index)}; }
+
+    UnaryFunction unaryFunction(OpCode op)
+    {
+        switch (op)
+        {
+        case OpCode::Sin:
+            return callSin;
+        case OpCode::Cos:
+            return callCos;
+        case OpCode::Tan:
+        case OpCode::Cot:
+            return callTan;
+        case OpCode::Ln:
+            return callLn;
+        case OpCode::Log:
+            return callLog;
+        case OpCode::Sinh:
+            return callSinh;
+        case OpCode::Cosh:
+        case OpCode::Sech:
+            return callCosh;
+        case OpCode::Tanh:
+            return callTanh;
+        case OpCode::Coth:
+            return callCoth;
+        case OpCode::Csch:
+            return callCsch;
+        default:
+            return callFactorial;
+        }
+    }
+
+    // Translates one Bytecode program into a function body followed by its constant pool
+    class NativeCompiler
+    {
+    public:
+        explicit NativeCompiler(const Bytecode &program) : program_(program) {}
+
+        // False when the program needs more stack frame than MaxFrameBytes
+        bool compile(std::vector<uint8_t> &output);
+
+    private:
+        void byte(uint8_t value) { code_.push_back(value); }
+        void word(uint32_t value);
+        void patch(size_t at, uint32_t value) { std::memcpy(code_.data() + at, &value, sizeof(value)); }
+
+        // prefix [REX] 0x0F opcode ModRM: an SSE instruction with an xmm register and an operand
+        void sse(uint8_t prefix, uint8_t opcode, int reg, Operand operand);
+
+        // Emits a jump with the given condition and returns the position of its offset
+        size_t jump(uint8_t condition);
+
+        // Points the jump whose offset is at the given position to the next instruction
+        void bind(size_t at) { patch(at, uint32_t(code_.size() - (at + 4))); }
+
+        void call(const void *function);
+        uint32_t constant(double value);
+
+        Operand slot(size_t index) const;
+        Operand local(uint32_t index) const { return {Operand::Frame, uint32_t(localOffset_ + 8 * index)}; }
+
+        void move(Operand to, Operand from);
+        void arithmetic(uint8_t opcode, Operand left, Operand right);
+        void negate(Operand value);
+        void squareRoot(Operand value);
+        void reciprocal(Operand value);
+
+        // Sets the flags from comparing 0 with the value
+        void compareWithZero(Operand value);
+        void failIfZero(Operand value);
+        void failIfNan(Operand value);
+
+        // Call a libm function on the top one or two slots. Every xmm register is
+        // caller saved, so the register slots below the operands are saved around it.
+        void callUnary(UnaryFunction function, size_t depth);
+        void callBinary(BinaryFunction function, size_t depth);
+        void saveRegisters(size_t count);
+        void restoreRegisters(size_t count);
+
+        struct Fixup
+        {
+            size_t at;      // position of the rip relative offset
+            uint32_t index; // constant it points to
+        };
+
+        const Bytecode &program_;
+        std::vector<uint8_t> code_;
+        std::vector<double> pool_;
+        std::unordered_map<uint64_t, uint32_t> poolIndex_;
+        std::vector<Fixup> fixups_;
+        std::vector<size_t> errorJumps_;
+        size_t saveOffset_ = 0;
+        size_t localOffset_ = 0;
+    };
+
+    void NativeCompiler::word(uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i)
+            byte(uint8_t(value >> (8 * i)));
+    }
+
+    void NativeCompiler::sse(uint8_t prefix, uint8_t opcode, int reg, Operand operand)
+    {
+        byte(prefix);
+        uint8_t rex = 0x40 | (reg & 8 ? 0x04 : 0) | (operand.kind == Operand::Register && (operand.value & 8) ? 0x01 : 0);
+        if (rex != 0x40)
+            byte(rex);
+        byte(0x0F);
+        byte(opcode);
+
+        uint8_t regBits = uint8_t((reg & 7) << 3);
+        switch (operand.kind)
+        {
+        case Operand::Register:
+            byte(0xC0 | regBits | (operand.value & 7));
+            break;
+        case Operand::Frame: // [rsp + disp32] needs a SIB byte
+            byte(0x84 | regBits);
+            byte(0x24);
+            word(operand.value);
+            break;
+        case Operand::Variables: // [rbx + disp32]
+            byte(0x83 | regBits);
+            word(operand.value);
+            break;
+        case Operand::Constant: // [rip + disp32], patched once the pool is placed
+            byte(0x05 | regBits);
+            fixups_.push_back({code_.size(), operand.value});
+            word(0);
+            break;
+        }
+    }
+
+    size_t NativeCompiler::jump(uint8_t condition)
+    {
+        byte(0x0F);
+        byte(condition);
+        word(0);
+        return code_.size() - 4;
+    }
+
+    void NativeCompiler::call(const void *function)
+    {
+        // mov rax, imm64; call rax
+        byte(0x48);
+        byte(0xB8);
+        uint64_t address = reinterpret_cast<uintptr_t>(function);
+        for (int i = 0; i < 8; ++i)
+            byte(uint8_t(address >> (8 * i)));
+        byte(0xFF);
+        byte(0xD0);
+    }
+
+    uint32_t NativeCompiler::constant(double value)
+    {
+        auto [entry, added] = poolIndex_.try_emplace(std::bit_cast<uint64_t>(value), uint32_t(pool_.size()));
+        if (added)
+            pool_.push_back(value);
+        return entry->second;
+    }
+
+    Operand NativeCompiler::slot(size_t index) const
+    {
+        if (index < RegisterSlots)
+            return xmm(int(index));
+        return {Operand::Frame, uint32_t(8 * (index - RegisterSlots))};
+    }
+
+    void NativeCompiler::move(Operand to, Operand from)
+    {
+        if (to == from)
+            return;
+        if (to.kind == Operand::Register && from.kind == Operand::Register)
+        {
+            // movsd between registers keeps the old upper half, a false dependency on the
+            // previous value that would chain independent libm calls together; movapd does not
+            sse(0x66, MoveAligned, int(to.value), from);
+        }
+        else if (to.kind == Operand::Register)
+        {
+            sse(0xF2, MoveLoad, int(to.value), from);
+        }
+        else if (from.kind == Operand::Register)
+        {
+            sse(0xF2, MoveStore, int(from.value), to);
+        }
+        else
+        {
+            sse(0xF2, MoveLoad, Scratch, from);
+            sse(0xF2, MoveStore, Scratch, to);
+        }
+    }
+
+    void NativeCompiler::arithmetic(uint8_t opcode, Operand left, Operand right)
+    {
+        if (left.kind == Operand::Register)
+        {
+            sse(0xF2, opcode, int(left.value), right);
+            return;
+        }
+        move(xmm(Scratch), left);
+        sse(0xF2, opcode, Scratch, right);
+        move(left, xmm(Scratch));
+    }
+
+    void NativeCompiler::negate(Operand value)
+    {
+        // Flipping the sign bit is exactly what -x does, NaN and 0 included
+        move(xmm(ScratchZero), {Operand::Constant, constant(-0.0)});
+        if (value.kind == Operand::Register)
+        {
+            sse(0x66, ExclusiveOr, int(value.value), xmm(ScratchZero));
+            return;
+        }
+        move(xmm(Scratch), value);
+        sse(0x66, ExclusiveOr, Scratch, xmm(ScratchZero));
+        move(value, xmm(Scratch));
+    }
+
+    void NativeCompiler::squareRoot(Operand value)
+    {
+        int target = value.kind == Operand::Register ? int(value.value) : Scratch;
+        sse(0xF2, SquareRoot, target, value);
+        move(value, xmm(target));
+    }
+
+    void NativeCompiler::reciprocal(Operand value)
+    {
+        move(xmm(Scratch), {Operand::Constant, constant(1.0)});
+        sse(0xF2, DivideDouble, Scratch, value);
+        move(value, xmm(Scratch));
+    }
+
+    void NativeCompiler::compareWithZero(Operand value)
+    {
+        sse(0x66, ExclusiveOr, ScratchZero, xmm(ScratchZero));
+        sse(0x66, CompareUnordered, ScratchZero, value);
+    }
+
+    void NativeCompiler::failIfZero(Operand value)
+    {
+        // Equal is ZF set without PF; NaN sets both and is not an error
+        compareWithZero(value);
+        size_t nonZero = jump(NotEqual);
+        errorJumps_.push_back(jump(NoParity));
+        bind(nonZero);
+    }
+
+    void NativeCompiler::failIfNan(Operand value)
+    {
+        move(xmm(Scratch), value);
+        sse(0x66, CompareUnordered, Scratch, xmm(Scratch));
+        errorJumps_.push_back(jump(Parity));
+    }
+
+    void NativeCompiler::saveRegisters(size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+            move({Operand::Frame, uint32_t(saveOffset_ + 8 * i)}, xmm(int(i)));
+    }
+
+    void NativeCompiler::restoreRegisters(size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+            move(xmm(int(i)), {Operand::Frame, uint32_t(saveOffset_ + 8 * i)});
+    }
+
+    void NativeCompiler::callUnary(UnaryFunction function, size_t depth)
+    {
+        Operand top = slot(depth - 1);
+        size_t live = std::min<size_t>(depth - 1, RegisterSlots);
+        saveRegisters(live);
+        move(xmm(0), top);
+        call(reinterpret_cast<const void *>(function));
+        move(top, xmm(0));
+        restoreRegisters(live);
+    }
+
+    void NativeCompiler::callBinary(BinaryFunction function, size_t depth)
+    {
+        // The right operand is never in xmm0, so loading the left one first keeps it
+        Operand left = slot(depth - 2);
+        Operand right = slot(depth - 1);
+        size_t live = std::min<size_t>(depth - 2, RegisterSlots);
+        saveRegisters(live);
+        move(xmm(0), left);
+        move(xmm(1), right);
+        call(reinterpret_cast<const void *>(function));
+        move(left, xmm(0));
+        restoreRegisters(live);
+    }
+
+    bool NativeCompiler::compile(std::vector<uint8_t> &output)
+    {
+        // Frame: the slots past the registers, the save area for calls, then the locals
+        size_t spilled = program_.maxStackDepth() > RegisterSlots ? program_.maxStackDepth() - RegisterSlots : 0;
+        saveOffset_ = 8 * spilled;
+        localOffset_ = saveOffset_ + 8 * RegisterSlots;
+        size_t frameSize = (localOffset_ + 8 * program_.localCount() + 15) & ~size_t(15);
+        if (frameSize > MaxFrameBytes)
+            return false;
+
+        // push rbx; mov rbx, rdi; sub rsp, frameSize. rsp is 16 byte aligned at every call.
+        byte(0x53);
+        byte(0x48);
+        byte(0x89);
+        byte(0xFB);
+        byte(0x48);
+        byte(0x81);
+        byte(0xEC);
+        word(uint32_t(frameSize));
+
+        const double *constant = program_.constants().data();
+        const uint32_t *variable = program_.slots().data();
+        const uint32_t *local = program_.locals().data();
+        size_t depth = 0;
+        for (OpCode op : program_.code())
+        {
+            switch (op)
+            {
+            case OpCode::Constant:
+                move(slot(depth++), {Operand::Constant, this->constant(*constant++)});
+                break;
+            case OpCode::Variable:
+                move(slot(depth++), {Operand::Variables, 8 * *variable++});
+                break;
+            case OpCode::Load:
+                move(slot(depth++), this->local(*local++));
+                break;
+            case OpCode::Store:
+                move(this->local(*local++), slot(depth - 1));
+                break;
+            case OpCode::Add:
+                arithmetic(AddDouble, slot(depth - 2), slot(depth - 1));
+                --depth;
+                break;
+            case OpCode::Subtract:
+                arithmetic(SubtractDouble, slot(depth - 2), slot(depth - 1));
+                --depth;
+                break;
+            case OpCode::Multiply:
+                arithmetic(MultiplyDouble, slot(depth - 2), slot(depth - 1));
+                --depth;
+                break;
+            case OpCode::Divide:
+                failIfZero(slot(depth - 1));
+                arithmetic(DivideDouble, slot(depth - 2), slot(depth - 1));
+                --depth;
+                break;
+            case OpCode::Power:
+                callBinary(callPow, depth);
+                --depth;
+                break;
+            case OpCode::Negate:
+                negate(slot(depth - 1));
+                break;
+            case OpCode::Sqrt:
+                // 0 above the value means it is negative; NaN compares unordered and goes on to sqrt
+                compareWithZero(slot(depth - 1));
+                errorJumps_.push_back(jump(Above));
+                squareRoot(slot(depth - 1));
+                break;
+            case OpCode::Cot:
+                callUnary(callTan, depth);
+                failIfZero(slot(depth - 1));
+                reciprocal(slot(depth - 1));
+                break;
+            case OpCode::Sech:
+                callUnary(callCosh, depth);
+                reciprocal(slot(depth - 1));
+                break;
+            case OpCode::Factorial:
+                callUnary(callFactorial, depth);
+                failIfNan(slot(depth - 1));
+                break;
+            default:
+                callUnary(unaryFunction(op), depth);
+                break;
+            }
+        }
+
+        // The result is in slot 0, which is xmm0: add rsp, frameSize; pop rbx; ret
+        size_t epilogue = code_.size();
+        byte(0x48);
+        byte(0x81);
+        byte(0xC4);
+        word(uint32_t(frameSize));
+        byte(0x5B);
+        byte(0xC3);
+
+        // Domain errors return NaN through the same epilogue
+        if (!errorJumps_.empty())
+        {
+            for (size_t at : errorJumps_)
+                bind(at);
+            move(xmm(0), {Operand::Constant, this->constant(NAN)});
+            byte(0xE9);
+            word(uint32_t(epilogue - (code_.size() + 4)));
+        }
+
+        // The constant pool follows the code, 8 byte aligned, padded with int3
+        while (code_.size() % 8 != 0)
+            byte(0xCC);
+        size_t poolStart = code_.size();
+        for (const Fixup &fixup : fixups_)
+            patch(fixup.at, uint32_t(poolStart + 8 * fixup.index - (fixup.at + 4)));
+        code_.resize(poolStart + 8 * pool_.size());
+        if (!pool_.empty())
+            std::memcpy(code_.data() + poolStart, pool_.data(), 8 * pool_.size());
+
+        output = std::move(code_);
+        return true;
+    }
+}
+#endif
+
+NativeExpression::NativeExpression(CompiledExpression expression) : expression_(std::move(expression))
+{
+#ifdef NATIVE_EXPRESSION_X86_64
+    std::vector<uint8_t> code;
+    if (!NativeCompiler(expression_.program()).compile(code))
+        return;
+
+    // Written while writable, then switched to executable, never both at once
+    size_t size = code.size();
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return;
+    std::memcpy(memory, code.data(), size);
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(memory, size);
+        return;
+    }
+
+    code_ = std::shared_ptr<const void>(memory, [size](const void *code) { munmap(const_cast<void *>(code), size); });
+    function_ = reinterpret_cast<Function>(memory);
+    codeSize_ = size;
+#endif
+}
+
+bool NativeExpression::supported()
+{
+#ifdef NATIVE_EXPRESSION_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+double NativeExpression::evaluate(std::span<const double> values) const
+{
+    // The bytecode checks the number of values, and reports the error behind a NaN if there is one
+    if (function_ && values.size() >= expression_.program().variableCount())
+    {
+        double result = function_(values.data());
+        if (!std::isnan(result))
+            return result;
+    }
+    return expression_.evaluate(values);
+}
+
+Result<double> NativeExpression::tryEvaluate(std::span<const double> values) const
+{
+    if (function_ && values.size() >= expression_.program().variableCount())
+    {
+        double result = function_(values.data());
+        if (!std::isnan(result))
+            return result;
+    }
+    return expression_.tryEvaluate(values);
+}
+
+#undef NATIVE_EXPRESSION_X86_64
@@ -0,0 +1,65 @@
+/**
+ * @file native_expression.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef NATIVE_EXPRESSION_H
+#define NATIVE_EXPRESSION_H
+
+#include "compiled_expression.h"
+#include <memory>
+#include <span>
+
+// A compiled expression translated once more, into x86-64 machine code. Each
+// bytecode stack slot gets an SSE register (the deepest ones live in the
+// stack frame), arithmetic and sqrt are inline SSE2 instructions, and the
+// transcendental functions are calls into the same libm functions
+// Node::evaluate uses, so the results are bit-identical.
+//
+// On other platforms, or when the code cannot be mapped executable, native()
+// is null and evaluate runs the bytecode instead: the results are the same,
+// only slower.
+class NativeExpression
+{
+public:
+    // Takes variables[i] for slot i; see native()
+    using Function = double (*)(const double *variables);
+
+    explicit NativeExpression(CompiledExpression expression);
+
+    // True when this build can generate native code (x86-64 with the System V ABI)
+    static bool supported();
+
+    // Same result, and same errors, as Node::evaluate on the source tree. Both
+    // evaluate the left operand first, so where several operations fail they
+    // report the same one.
+    double evaluate(std::span<const double> values = {}) const;
+
+    // Returns a domain error instead of throwing it
+    Result<double> tryEvaluate(std::span<const double> values = {}) const;
+
+    // The generated function, or null without native code. It returns NaN where
+    // evaluate would report an error, as well as for expressions whose value is
+    // NaN; evaluate tells the two apart by running the bytecode for NaN results.
+    // The caller provides at least program().variableCount() values.
+    Function native() const { return function_; }
+
+    // Bytes of machine code and constants, 0 without native code
+    size_t codeSize() const { return codeSize_; }
+
+    const CompiledExpression &expression() const { return expression_; }
+    const std::vector<std::string> &variableNames() const { return expression_.variableNames(); }
+
+private:
+    CompiledExpression expression_;
+
+    // Unmaps the code when the last copy is destroyed
+    std::shared_ptr<const void> code_;
+    Function function_ = nullptr;
+    size_t codeSize_ = 0;
+};
+
+#endif // NATIVE_EXPRESSION_H
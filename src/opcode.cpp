@@ -0,0 +1,105 @@
+/**
+ * @file opcode.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "opcode.h"
+#include "result.h"
+#include <cmath>
+#include <stdexcept>
+
+void failOperation(OpCode op)
+{
+    switch (op)
+    {
+    case OpCode::Divide:
+        throw ExpressionError({ErrorCode::DivisionByZero});
+    case OpCode::Cot:
+        throw ExpressionError({ErrorCode::CotangentOfZeroTangent});
+    case OpCode::Sqrt:
+        throw ExpressionError({ErrorCode::NegativeSquareRoot});
+    case OpCode::Factorial:
+        throw ExpressionError({ErrorCode::NegativeFactorial});
+    default:
+        throw std::invalid_argument("Operation has no domain errors");
+    }
+}
+
+double applyOperation(OpCode op, double left, double right)
+{
+    switch (op)
+    {
+    case OpCode::Add:
+        return left + right;
+    case OpCode::Subtract:
+        return left - right;
+    case OpCode::Multiply:
+        return left * right;
+    case OpCode::Divide:
+        if (right == 0.0)
+            failOperation(op);
+        return left / right;
+    case OpCode::Power:
+        return std::pow(left, right);
+    case OpCode::Negate:
+        return -left;
+    case OpCode::Sin:
+        return std::sin(left);
+    case OpCode::Cos:
+        return std::cos(left);
+    case OpCode::Tan:
+        return std::tan(left);
+    case OpCode::Cot:
+    {
+        double tanValue = std::tan(left);
+        if (tanValue == 0.0)
+            failOperation(op);
+        return 1.0 / tanValue;
+    }
+    case OpCode::Ln:
+        return std::log(left);
+    case OpCode::Log:
+        return std::log10(left);
+    case OpCode::Sqrt:
+        if (left < 0.0)
+            failOperation(op);
+        return std::sqrt(left);
+    case OpCode::Sinh:
+        return std::sinh(left);
+    case OpCode::Cosh:
+        return std::cosh(left);
+    case OpCode::Tanh:
+        return std::tanh(left);
+    case OpCode::Coth:
+    {
+        double tanhVal = std::tanh(left);
+        if (tanhVal != 0)
+        {
+            return 1 / tanhVal;
+        }
+
+        // Infinity for division by zero
+        return HUGE_VAL;
+    }
+    case OpCode::Sech:
+        return 1 / std::cosh(left);
+    case OpCode::Csch:
+    {
+        double sinhVal = std::sinh(left);
+        if (sinhVal != 0)
+        {
+            return 1 / sinhVal;
+        }
+
+        // Infinity for division by zero
+        return HUGE_VAL;
+    }
+    case OpCode::Factorial:
+        return factorialValue(left);
+    default: // OpCode::Constant and OpCode::Variable have no operands
+        return left;
+    }
+}
@@ -0,0 +1,92 @@
+/**
+ * @file opcode.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef OPCODE_H
+#define OPCODE_H
+
+#include <cmath>
+#include <cstdint>
+
+// One code per node type in expression_tree.h, followed by the instructions
+// that only appear in Bytecode
+enum class OpCode : uint8_t
+{
+    Constant,
+    Variable,
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Power,
+    Negate,
+    Sin,
+    Cos,
+    Tan,
+    Cot,
+    Ln,
+    Log,
+    Sqrt,
+    Sinh,
+    Cosh,
+    Tanh,
+    Coth,
+    Sech,
+    Csch,
+    Factorial,
+
+    // Store copies the top of the stack into a local, Load pushes a local stored earlier
+    Store,
+    Load
+};
+
+// Number of operands the operation takes
+constexpr int opcodeArity(OpCode op)
+{
+    switch (op)
+    {
+    case OpCode::Constant:
+    case OpCode::Variable:
+    case OpCode::Load:
+        return 0;
+    case OpCode::Add:
+    case OpCode::Subtract:
+    case OpCode::Multiply:
+    case OpCode::Divide:
+    case OpCode::Power:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+// Applies a unary or binary operation with the same semantics (and error handling)
+// as the matching Node class. For unary operations the right operand is ignored.
+double applyOperation(OpCode op, double left, double right);
+
+// Reports an operand outside the domain of the operation by throwing the
+// ExpressionError with its ErrorCode (result.h)
+[[noreturn]] void failOperation(OpCode op);
+
+// x! as every evaluation path computes it: 2 * 3 * ... * n for n = int(x),
+// multiplied up in the same order as n * (n - 1)!. A negative or NaN x reports
+// NegativeFactorial, and x >= 171 (infinity, whose 171! has overflowed) returns
+// infinity, both before the conversion to int, which could not represent them.
+inline double factorialValue(double x)
+{
+    if (!(x >= 0.0))
+        failOperation(OpCode::Factorial);
+    if (x >= 171.0)
+        return HUGE_VAL;
+    int n = static_cast<int>(x);
+    double result = 1;
+    for (int i = 2; i <= n; ++i)
+        result *= i;
+    return result;
+}
+
+#endif // OPCODE_H
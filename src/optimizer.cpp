@@ -0,0 +1,432 @@
+/**
+ * @file optimizer.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "optimizer.h"
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    bool constantValue(const NodePtr &node, double &value)
+    {
+        if (node->opcode() != OpCode::Constant)
+            return false;
+        value = static_cast<const ConstantNode &>(*node).value();
+        return true;
+    }
+
+    bool isConstant(const NodePtr &node, double expected)
+    {
+        double value;
+        return constantValue(node, value) && value == expected && std::signbit(value) == std::signbit(expected);
+    }
+
+    // True for the operations that can report a domain error
+    bool canFailItself(OpCode op)
+    {
+        switch (op)
+        {
+        case OpCode::Divide:
+        case OpCode::Cot:
+        case OpCode::Sqrt:
+        case OpCode::Factorial:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // True for subtrees of at most budget nodes made of +, -, * and negation only,
+    // which cost less to evaluate twice than a call to std::pow
+    bool isCheap(const Node &node, size_t &budget)
+    {
+        if (budget == 0)
+            return false;
+        --budget;
+        switch (node.opcode())
+        {
+        case OpCode::Constant:
+        case OpCode::Variable:
+            return true;
+        case OpCode::Add:
+        case OpCode::Subtract:
+        case OpCode::Multiply:
+        case OpCode::Negate:
+            for (size_t i = 0; i < node.operandCount(); ++i)
+            {
+                if (!isCheap(*node.operand(i), budget))
+                    return false;
+            }
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool isCheap(const Node &node)
+    {
+        size_t budget = 3;
+        return isCheap(node, budget);
+    }
+
+    // True if applyOperation would report an error for these operands
+    bool failsAt(OpCode op, double left, double right)
+    {
+        switch (op)
+        {
+        case OpCode::Divide:
+            return right == 0.0;
+        case OpCode::Cot:
+            return std::tan(left) == 0.0;
+        case OpCode::Sqrt:
+            return left < 0.0;
+        case OpCode::Factorial:
+            // As factorialValue: negative or NaN
+            return !(left >= 0.0);
+        default:
+            return false;
+        }
+    }
+
+    NodePtr constant(double value)
+    {
+        return std::make_shared<ConstantNode>(value);
+    }
+
+    class Optimizer
+    {
+    public:
+        Optimizer(const OptimizeOptions &options, OptimizeStats &stats) : options_(options), stats_(stats) {}
+
+        // Rewrites the operands of every node before the node itself, keeping the
+        // nodes still to do on an explicit stack rather than recursing per level
+        NodePtr rewrite(const NodePtr &root)
+        {
+            std::vector<const NodePtr *> pending = {&root};
+            while (!pending.empty())
+            {
+                const NodePtr &node = *pending.back();
+                if (node->operandCount() == 0 || rewritten_.count(node.get()))
+                {
+                    pending.pop_back();
+                    continue;
+                }
+
+                bool ready = true;
+                for (size_t i = 0; i < node->operandCount(); ++i)
+                {
+                    const NodePtr &operand = node->operand(i);
+                    if (operand->operandCount() != 0 && !rewritten_.count(operand.get()))
+                    {
+                        pending.push_back(&operand);
+                        ready = false;
+                    }
+                }
+                if (ready)
+                {
+                    rewritten_.emplace(node.get(), rewriteOperation(node));
+                    pending.pop_back();
+                }
+            }
+            return rewritten(root);
+        }
+
+    private:
+        // True if evaluating the subtree can report an error, which dropping the
+        // subtree would hide. Walks with an explicit stack like rewrite, and keeps
+        // every node's answer, so a subtree is visited once however often it is asked.
+        bool canFail(const Node &root)
+        {
+            std::vector<const Node *> pending = {&root};
+            while (!pending.empty())
+            {
+                const Node *node = pending.back();
+                if (canFail_.count(node))
+                {
+                    pending.pop_back();
+                    continue;
+                }
+
+                bool fails = canFailItself(node->opcode());
+                bool ready = true;
+                for (size_t i = 0; !fails && i < node->operandCount(); ++i)
+                {
+                    auto found = canFail_.find(node->operand(i).get());
+                    if (found == canFail_.end())
+                    {
+                        pending.push_back(node->operand(i).get());
+                        ready = false;
+                    }
+                    else
+                        fails = found->second;
+                }
+                if (fails || ready)
+                {
+                    canFail_.emplace(node, fails);
+                    pending.pop_back();
+                }
+            }
+            return canFail_.at(&root);
+        }
+
+        // The rewritten node; a subtree shared by several parents is rewritten once and stays shared
+        const NodePtr &rewritten(const NodePtr &node) const
+        {
+            return node->operandCount() == 0 ? node : rewritten_.at(node.get());
+        }
+
+        NodePtr rewriteOperation(const NodePtr &node)
+        {
+            size_t count = node->operandCount();
+
+            NodePtr left = rewritten(node->operand(0));
+            NodePtr right = count == 2 ? rewritten(node->operand(1)) : nullptr;
+            OpCode op = node->opcode();
+
+            double leftValue, rightValue = 0.0;
+            if (constantValue(left, leftValue) && (!right || constantValue(right, rightValue)) &&
+                !failsAt(op, leftValue, rightValue))
+            {
+                ++stats_.constantsFolded;
+                return constant(applyOperation(op, leftValue, rightValue));
+            }
+
+            if (NodePtr simplified = simplify(op, left, right))
+                return simplified;
+
+            if (left == node->operand(0) && (!right || right == node->operand(1)))
+                return node;
+            return makeOperationNode(op, left, right);
+        }
+
+        // Returns the rewritten operation, or nullptr if no rule applies
+        NodePtr simplify(OpCode op, const NodePtr &left, const NodePtr &right)
+        {
+            switch (op)
+            {
+            case OpCode::Add:
+                return simplifyAdd(left, right);
+            case OpCode::Subtract:
+                return simplifySubtract(left, right);
+            case OpCode::Multiply:
+                return simplifyMultiply(left, right);
+            case OpCode::Divide:
+                return simplifyDivide(left, right);
+            case OpCode::Power:
+                return simplifyPower(left, right);
+            case OpCode::Negate:
+                // -(-x) is x
+                if (left->opcode() == OpCode::Negate)
+                    return identity(left->operand(0));
+                return nullptr;
+            default:
+                return nullptr;
+            }
+        }
+
+        NodePtr simplifyAdd(const NodePtr &left, const NodePtr &right)
+        {
+            // x + (-0) is x for every x; x + 0 turns -0 into +0
+            if (isConstant(right, -0.0) || (options_.fastMath && isConstant(right, 0.0)))
+                return identity(left);
+            if (isConstant(left, -0.0) || (options_.fastMath && isConstant(left, 0.0)))
+                return identity(right);
+
+            // (x + a) + b is x + (a + b)
+            double outer, inner;
+            if (options_.fastMath && constantValue(right, outer) && left->opcode() == OpCode::Add &&
+                constantValue(left->operand(1), inner))
+            {
+                ++stats_.constantsFolded;
+                return makeOperationNode(OpCode::Add, left->operand(0), constant(inner + outer));
+            }
+            return nullptr;
+        }
+
+        NodePtr simplifySubtract(const NodePtr &left, const NodePtr &right)
+        {
+            // x - 0 is x for every x
+            if (isConstant(right, 0.0) || (options_.fastMath && isConstant(right, -0.0)))
+                return identity(left);
+
+            // 0 - x is +0 where -x is -0
+            if (options_.fastMath && (isConstant(left, 0.0) || isConstant(left, -0.0)))
+            {
+                ++stats_.identitiesRemoved;
+                return makeOperationNode(OpCode::Negate, right);
+            }
+            return nullptr;
+        }
+
+        NodePtr simplifyMultiply(const NodePtr &left, const NodePtr &right)
+        {
+            if (isConstant(right, 1.0))
+                return identity(left);
+            if (isConstant(left, 1.0))
+                return identity(right);
+            if (isConstant(right, -1.0))
+            {
+                ++stats_.identitiesRemoved;
+                return makeOperationNode(OpCode::Negate, left);
+            }
+            if (isConstant(left, -1.0))
+            {
+                ++stats_.identitiesRemoved;
+                return makeOperationNode(OpCode::Negate, right);
+            }
+
+            if (!options_.fastMath)
+                return nullptr;
+
+            // x * 0 is NaN for infinite or NaN x and -0 for negative x
+            if ((isConstant(right, 0.0) && !canFail(*left)) || (isConstant(left, 0.0) && !canFail(*right)))
+            {
+                ++stats_.identitiesRemoved;
+                return constant(0.0);
+            }
+
+            // (x * a) * b is x * (a * b)
+            double outer, inner;
+            if (constantValue(right, outer) && left->opcode() == OpCode::Multiply &&
+                constantValue(left->operand(1), inner))
+            {
+                ++stats_.constantsFolded;
+                return makeOperationNode(OpCode::Multiply, left->operand(0), constant(inner * outer));
+            }
+            return nullptr;
+        }
+
+        NodePtr simplifyDivide(const NodePtr &left, const NodePtr &right)
+        {
+            double divisor;
+            if (!constantValue(right, divisor) || divisor == 0.0 || !std::isfinite(divisor))
+                return nullptr;
+
+            if (divisor == 1.0)
+                return identity(left);
+            if (divisor == -1.0)
+            {
+                ++stats_.identitiesRemoved;
+                return makeOperationNode(OpCode::Negate, left);
+            }
+
+            // The reciprocal of a power of two is exact, so both forms round the same
+            // exact quotient; any other reciprocal is rounded once more
+            int exponent;
+            double reciprocal = 1.0 / divisor;
+            bool exact = std::fabs(std::frexp(divisor, &exponent)) == 0.5;
+            if (std::isfinite(reciprocal) && (exact || options_.fastMath))
+            {
+                ++stats_.divisionsReduced;
+                return makeOperationNode(OpCode::Multiply, left, constant(reciprocal));
+            }
+            return nullptr;
+        }
+
+        NodePtr simplifyPower(const NodePtr &base, const NodePtr &exponentNode)
+        {
+            double exponent;
+            if (!constantValue(exponentNode, exponent))
+                return nullptr;
+
+            // pow(x, 1) is x and pow(x, 0) is 1 for every x, NaN included
+            if (exponent == 1.0)
+                return identity(base);
+            if (exponent == 0.0 && !canFail(*base))
+            {
+                ++stats_.powersReduced;
+                return constant(1.0);
+            }
+
+            // Negative powers would turn into divisions with their own error
+            // semantics, so only x^2, x^3 and x^4 become multiplications
+            if (!isCheap(*base))
+                return nullptr;
+            if (exponent == 2.0)
+            {
+                ++stats_.powersReduced;
+                return makeOperationNode(OpCode::Multiply, base, base);
+            }
+            if (options_.fastMath && exponent == 3.0)
+            {
+                ++stats_.powersReduced;
+                return makeOperationNode(OpCode::Multiply, makeOperationNode(OpCode::Multiply, base, base), base);
+            }
+            if (options_.fastMath && exponent == 4.0)
+            {
+                ++stats_.powersReduced;
+                NodePtr square = makeOperationNode(OpCode::Multiply, base, base);
+                return makeOperationNode(OpCode::Multiply, square, square);
+            }
+            return nullptr;
+        }
+
+        NodePtr identity(const NodePtr &operand)
+        {
+            ++stats_.identitiesRemoved;
+            return operand;
+        }
+
+        const OptimizeOptions &options_;
+        OptimizeStats &stats_;
+        std::unordered_map<const Node *, NodePtr> rewritten_;
+
+        // Answers of canFail; the nodes asked about are all kept alive by rewritten_ or the input
+        std::unordered_map<const Node *, bool> canFail_;
+    };
+}
+
+size_t countNodes(const NodePtr &root)
+{
+    // Each distinct node is counted once, as itself plus the counts of its
+    // operands, so a shared subtree is added up rather than walked per use
+    std::unordered_map<const Node *, size_t> counts;
+    std::vector<const Node *> pending = {root.get()};
+    while (!pending.empty())
+    {
+        const Node *node = pending.back();
+        if (counts.count(node))
+        {
+            pending.pop_back();
+            continue;
+        }
+
+        size_t count = 1;
+        bool ready = true;
+        for (size_t i = 0; i < node->operandCount(); ++i)
+        {
+            auto found = counts.find(node->operand(i).get());
+            if (found == counts.end())
+            {
+                pending.push_back(node->operand(i).get());
+                ready = false;
+            }
+            else
+                count = found->second > SIZE_MAX - count ? SIZE_MAX : count + found->second;
+        }
+        if (ready)
+        {
+            counts.emplace(node, count);
+            pending.pop_back();
+        }
+    }
+    return counts.at(root.get());
+}
+
+NodePtr optimize(const NodePtr &root, const OptimizeOptions &options, OptimizeStats *stats)
+{
+    OptimizeStats local;
+    OptimizeStats &counters = stats ? *stats : local;
+    counters = OptimizeStats{};
+    counters.nodesBefore = countNodes(root);
+
+    NodePtr result = Optimizer(options, counters).rewrite(root);
+    counters.nodesAfter = countNodes(result);
+    return result;
+}
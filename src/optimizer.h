@@ -0,0 +1,50 @@
+/**
+ * @file optimizer.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "expression_tree.h"
+#include <cstddef>
+
+struct OptimizeOptions
+{
+    // By default only rewrites that give the same IEEE result for every input are
+    // made, following the rules GCC uses without -ffast-math. fastMath also allows
+    // rewrites that can change the last bits or the result for special values:
+    // x^3 and x^4 as multiplications, x/c as x*(1/c) for any c, x+0 and x*0, and
+    // merging the constants of (x+a)+b and (x*a)*b.
+    bool fastMath = false;
+};
+
+// What optimize() changed
+struct OptimizeStats
+{
+    size_t nodesBefore = 0;
+    size_t nodesAfter = 0;
+    size_t constantsFolded = 0;
+    size_t powersReduced = 0;
+    size_t divisionsReduced = 0;
+    size_t identitiesRemoved = 0;
+};
+
+// Returns an equivalent tree with:
+//  - constant subtrees folded, unless evaluating them reports an error (the
+//    error is left for evaluation time)
+//  - x^2 as x*x (the correctly rounded square, as GCC does for pow(x, 2.0)) when x
+//    is cheap to evaluate twice, x^1 as x and x^0 as 1
+//  - x/c as x*(1/c) when c is a power of two, so 1/c is exact
+//  - identities dropped: x*1, x/1, x-0, x+(-0), x*-1 and x/-1 as -x, -(-x)
+// Subtrees that do not change are shared with the input tree.
+NodePtr optimize(const NodePtr &root, const OptimizeOptions &options = {}, OptimizeStats *stats = nullptr);
+
+// Number of nodes in the tree, counting shared subtrees once per use (saturating
+// at SIZE_MAX). It takes time in the number of distinct nodes, not in the count.
+size_t countNodes(const NodePtr &root);
+
+#endif // OPTIMIZER_H
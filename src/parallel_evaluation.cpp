@@ -0,0 +1,49 @@
+/**
+ * @file parallel_evaluation.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "parallel_evaluation.h"
+
+void evaluateBatchParallel(ThreadPool &pool, const CompiledExpression &expression, const double *const *columns,
+                           size_t n, double *out, size_t grain, ErrorMode mode, SimdLevel level)
+{
+    pool.parallelFor(n, grain, [&](size_t begin, size_t end)
+                     {
+                         ThreadSimdLevel kernels(level);
+                         expression.evaluateRows(columns, begin, end, out, mode);
+                     });
+}
+
+void evaluateBatchParallel(ThreadPool &pool, const Node &root, const double *const *columns, size_t n, double *out,
+                           size_t grain, ErrorMode mode, SimdLevel level)
+{
+    pool.parallelFor(n, grain, [&](size_t begin, size_t end)
+                     {
+                         ThreadSimdLevel kernels(level);
+                         root.evaluateRows(columns, begin, end, out, mode);
+                     });
+}
+
+void evaluateEachParallel(ThreadPool &pool, std::span<const CompiledExpression> expressions,
+                          std::span<const double> variables, double *out, size_t grain)
+{
+    pool.parallelFor(expressions.size(), grain, [&](size_t begin, size_t end)
+                     {
+                         for (size_t i = begin; i < end; ++i)
+                             out[i] = expressions[i].evaluate(variables);
+                     });
+}
+
+void evaluateEachParallel(ThreadPool &pool, std::span<const NodePtr> expressions, std::span<const double> variables,
+                          double *out, size_t grain)
+{
+    pool.parallelFor(expressions.size(), grain, [&](size_t begin, size_t end)
+                     {
+                         for (size_t i = begin; i < end; ++i)
+                             out[i] = expressions[i]->evaluate(variables);
+                     });
+}
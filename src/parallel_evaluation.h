@@ -0,0 +1,45 @@
+/**
+ * @file parallel_evaluation.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PARALLEL_EVALUATION_H
+#define PARALLEL_EVALUATION_H
+
+#include "batch.h"
+#include "compiled_expression.h"
+#include "expression_tree.h"
+#include "simd_math.h"
+#include "thread_pool.h"
+#include <span>
+
+// Rows per task for the row-parallel functions: big enough that the task overhead
+// does not show, small enough that stealing can even out the load
+constexpr size_t DefaultRowGrain = 16 * BatchChunkSize;
+
+// Expressions per task for the expression-parallel functions
+constexpr size_t DefaultExpressionGrain = 16;
+
+// evaluateBatch with the rows split across the pool, every task running the
+// transcendental functions on the kernels of level (whatever setSimdLevel
+// selected). With the default SimdLevel::Scalar the results are bit-identical
+// to row-by-row evaluate(), whatever the workers and the grain; pass
+// simdKernels().level for the vector kernels and the bits of evaluateBatch.
+void evaluateBatchParallel(ThreadPool &pool, const CompiledExpression &expression, const double *const *columns,
+                           size_t n, double *out, size_t grain = DefaultRowGrain, ErrorMode mode = ErrorMode::Report,
+                           SimdLevel level = SimdLevel::Scalar);
+void evaluateBatchParallel(ThreadPool &pool, const Node &root, const double *const *columns, size_t n, double *out,
+                           size_t grain = DefaultRowGrain, ErrorMode mode = ErrorMode::Report,
+                           SimdLevel level = SimdLevel::Scalar);
+
+// out[i] = expressions[i] evaluated with the given variables, with the
+// expressions split across the pool
+void evaluateEachParallel(ThreadPool &pool, std::span<const CompiledExpression> expressions,
+                          std::span<const double> variables, double *out, size_t grain = DefaultExpressionGrain);
+void evaluateEachParallel(ThreadPool &pool, std::span<const NodePtr> expressions, std::span<const double> variables,
+                          double *out, size_t grain = DefaultExpressionGrain);
+
+#endif // PARALLEL_EVALUATION_H
@@ -0,0 +1,94 @@
+/**
+ * @file parse_observer.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "parse_observer.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+void ParseTrace::onToken(std::string_view text)
+{
+    // '\n' rather than std::endl: flushing on every token is what made the old trace slow
+    output_ << "Token: " << text << '\n';
+}
+
+uint64_t HistogramSnapshot::quantile(double q) const
+{
+    if (count == 0)
+        return 0;
+
+    uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(q * count)), 1);
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BucketCount; ++bucket)
+    {
+        seen += buckets[bucket];
+        if (seen >= rank)
+        {
+            uint64_t upper = bucket == 0 ? 0 : bucket >= 64 ? UINT64_MAX : (uint64_t(1) << bucket) - 1;
+            return std::min(upper, max);
+        }
+    }
+    return max;
+}
+
+void Histogram::record(uint64_t value)
+{
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    buckets_[std::bit_width(value)].fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+HistogramSnapshot Histogram::snapshot() const
+{
+    // Not one atomic read: a parse recorded meanwhile may show in some fields only
+    HistogramSnapshot snapshot;
+    snapshot.count = count_.load(std::memory_order_relaxed);
+    snapshot.sum = sum_.load(std::memory_order_relaxed);
+    snapshot.max = max_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < HistogramSnapshot::BucketCount; ++i)
+    {
+        snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+void ParseMetricsSnapshot::write(std::ostream &output) const
+{
+    const std::pair<const char *, const HistogramSnapshot *> histograms[] = {
+        {"tokenize_ns", &tokenizeNanoseconds},
+        {"build_ns", &buildNanoseconds},
+        {"tokens", &tokens},
+        {"nodes", &nodes},
+        {"depth", &depth}};
+    for (const auto &[name, histogram] : histograms)
+    {
+        output << name << " count=" << histogram->count << " mean=" << histogram->mean()
+               << " p50=" << histogram->quantile(0.5) << " p99=" << histogram->quantile(0.99)
+               << " max=" << histogram->max << '\n';
+    }
+}
+
+void ParseMetrics::onParse(const ParseRecord &record)
+{
+    tokenizeNanoseconds_.record(static_cast<uint64_t>(record.tokenizeTime.count()));
+    buildNanoseconds_.record(static_cast<uint64_t>(record.buildTime.count()));
+    tokens_.record(record.tokens);
+    nodes_.record(record.nodes);
+    depth_.record(record.depth);
+}
+
+ParseMetricsSnapshot ParseMetrics::snapshot() const
+{
+    return {tokenizeNanoseconds_.snapshot(), buildNanoseconds_.snapshot(), tokens_.snapshot(), nodes_.snapshot(),
+            depth_.snapshot()};
+}
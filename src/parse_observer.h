@@ -0,0 +1,120 @@
+/**
+ * @file parse_observer.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PARSE_OBSERVER_H
+#define PARSE_OBSERVER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+// What the parser measured for one expression
+struct ParseRecord
+{
+    std::string_view source;
+    size_t tokens;
+    size_t nodes; // nodes stored, after repeated subexpressions are shared
+    size_t depth; // longest path from the root to a leaf, counting both
+    std::chrono::nanoseconds tokenizeTime;
+    std::chrono::nanoseconds buildTime;
+};
+
+// Receives the events of Parser::parseFlat (and so of parse and compile). The
+// parser only reports to an observer when it is built with
+// MATHPARSER_PARSE_OBSERVER defined; otherwise the hooks are compiled out.
+class ParseObserver
+{
+public:
+    virtual ~ParseObserver() = default;
+
+    // onToken is called for every token consumed, but only when this returns true
+    virtual bool observesTokens() const { return false; }
+    virtual void onToken(std::string_view text) { (void)text; }
+
+    virtual void onParse(const ParseRecord &record) { (void)record; }
+};
+
+// Writes every consumed token to a stream, one per line
+class ParseTrace : public ParseObserver
+{
+public:
+    explicit ParseTrace(std::ostream &output) : output_(output) {}
+
+    bool observesTokens() const override { return true; }
+    void onToken(std::string_view text) override;
+
+private:
+    std::ostream &output_;
+};
+
+struct HistogramSnapshot
+{
+    // Bucket 0 counts zeros, bucket b > 0 counts values in [2^(b-1), 2^b)
+    static constexpr size_t BucketCount = 65;
+
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    std::array<uint64_t, BucketCount> buckets{};
+
+    double mean() const { return count == 0 ? 0.0 : static_cast<double>(sum) / count; }
+
+    // Upper bound of the bucket holding the q-th quantile (0 <= q <= 1), at most max
+    uint64_t quantile(double q) const;
+};
+
+// Power-of-two histogram of unsigned values. Recording is a few relaxed atomic
+// additions, so many threads can record into one histogram.
+class Histogram
+{
+public:
+    void record(uint64_t value);
+    HistogramSnapshot snapshot() const;
+
+private:
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+    std::array<std::atomic<uint64_t>, HistogramSnapshot::BucketCount> buckets_{};
+};
+
+struct ParseMetricsSnapshot
+{
+    HistogramSnapshot tokenizeNanoseconds;
+    HistogramSnapshot buildNanoseconds;
+    HistogramSnapshot tokens;
+    HistogramSnapshot nodes;
+    HistogramSnapshot depth;
+
+    uint64_t parses() const { return tokens.count; }
+
+    // One line per histogram: count, mean, p50, p99 and max
+    void write(std::ostream &output) const;
+};
+
+// Collects every parse into histograms. One instance can observe parsers in
+// several threads; snapshot() may be taken at any time.
+class ParseMetrics : public ParseObserver
+{
+public:
+    void onParse(const ParseRecord &record) override;
+    ParseMetricsSnapshot snapshot() const;
+
+private:
+    Histogram tokenizeNanoseconds_;
+    Histogram buildNanoseconds_;
+    Histogram tokens_;
+    Histogram nodes_;
+    Histogram depth_;
+};
+
+#endif // PARSE_OBSERVER_H
@@ -7,547 +7,403 @@
  */
 
 #include "parser.h"
-
-std::vector<std::string> Parser::tokenize(const std::string &expression)
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+
+using grammar::binaryOpcode;
+using grammar::binaryPrecedence;
+using grammar::FactorialPrecedence;
+using grammar::functionOpcode;
+using grammar::isDigit;
+using grammar::isLetter;
+using grammar::isSpace;
+using grammar::lookupKeyword;
+using grammar::lookupSymbol;
+using grammar::UnaryPrecedence;
+
+const std::vector<Token> &Parser::tokenize(std::string_view expression)
 {
-    std::vector<std::string> tokens;
-    std::string currentToken;
+    tokens_.clear();
+
+    const char *begin = expression.data();
+    const char *end = begin + expression.size();
+    size_t i = 0;
 
-    for (size_t i = 0; i < expression.size(); ++i)
+    while (i < expression.size())
     {
         char ch = expression[i];
+        uint32_t offset = static_cast<uint32_t>(i);
 
-        if (ch == '-')
-        {
-            // If the "-" sign comes at the beginning of the expression or immediately after an operator, it is a negative number.
-            if (i == 0 || tokens.back() == "+" || tokens.back() == "-" || tokens.back() == "*" || tokens.back() == "/" || tokens.back() == "^" || tokens.back() == "(")
-            {
-                currentToken += ch;
-
-                // Skip the rest of the loop
-                continue;
-            }
-        }
-
-        if (expression.substr(i, 4) == "sinh" || expression.substr(i, 4) == "cosh" ||
-            expression.substr(i, 4) == "tanh" || expression.substr(i, 4) == "coth" ||
-            expression.substr(i, 4) == "sech" || expression.substr(i, 4) == "csch")
+        if (isSpace(ch))
         {
-            tokens.push_back(expression.substr(i, 4));
-
-            // skip 4 characters
-            i += 3;
+            ++i;
             continue;
         }
 
-        if (expression.substr(i, 3) == "sin" || expression.substr(i, 3) == "cos" ||
-            expression.substr(i, 3) == "tan" || expression.substr(i, 3) == "cot")
+        if (isDigit(ch) || ch == '.')
         {
-            tokens.push_back(expression.substr(i, 3));
+            double value = 0.0;
+            auto [next, error] = std::from_chars(begin + i, end, value);
+            if (error == std::errc::invalid_argument)
+                fail(ErrorCode::InvalidNumber, i);
+
+            // Out-of-range literals keep the overflowed/underflowed value, as strtod does
+            if (error == std::errc::result_out_of_range)
+            {
+                value = std::strtod(std::string(begin + i, next).c_str(), nullptr);
+            }
 
-            // skip 3 characters
-            i += 2;
+            size_t length = static_cast<size_t>(next - (begin + i));
+            tokens_.push_back({TokenKind::Number, offset, static_cast<uint32_t>(length), value});
+            i += length;
             continue;
         }
 
-        if (isdigit(ch) || ch == '.')
+        if (isLetter(ch))
         {
-            currentToken += ch;
-        }
-        else if (ch == '+' || ch == '-' || ch == '*' || ch == '/' || ch == '(' || ch == ')' || ch == '^')
-        {
-            if (!currentToken.empty())
+            // Function names and variables: a letter or "_" followed by letters, digits and "_"
+            size_t j = i + 1;
+            while (j < expression.size() && (isLetter(expression[j]) || isDigit(expression[j])))
             {
-                tokens.push_back(currentToken);
-                currentToken.clear();
+                ++j;
             }
-            tokens.push_back(std::string(1, ch));
-        }
-        else if (isspace(ch))
-        {
-            if (!currentToken.empty())
+
+            TokenKind kind;
+            if (!lookupKeyword(expression.substr(i, j - i), kind))
             {
-                tokens.push_back(currentToken);
-                currentToken.clear();
+                kind = TokenKind::Identifier;
             }
-        }
-
-        else if (i + 1 < expression.size() && expression.substr(i, 2) == "ln")
-        {
-            tokens.push_back("ln");
-
-            // Since 'ln' is two characters long, an extra increment.
-            i += 1;
-        }
-        else if (i + 2 < expression.size() && expression.substr(i, 3) == "log")
-        {
-            tokens.push_back("log");
-
-            // An extra increment since 'log' is three characters long.
-            i += 2;
-        }
 
-        else if (i + 3 < expression.size() && expression.substr(i, 4) == "sqrt")
-        {
-            tokens.push_back("sqrt");
-
-            // Since 'sqrt' is four characters long, an extra increment.
-            i += 3;
+            tokens_.push_back({kind, offset, static_cast<uint32_t>(j - i), 0.0});
+            i = j;
+            continue;
         }
 
-        else if (ch == '!')
-        {
-            if (!currentToken.empty())
-            {
-                tokens.push_back(currentToken);
-                currentToken.clear();
-            }
-            tokens.push_back("!");
-        }
+        TokenKind kind;
+        if (!lookupSymbol(ch, kind))
+            fail(ErrorCode::UnknownCharacter, i);
 
-        else
-        {
-            std::cerr << "Unknown character: " << ch << std::endl;
-            exit(1);
-        }
+        tokens_.push_back({kind, offset, 1, 0.0});
+        ++i;
     }
 
-    // Add the last token
-    if (!currentToken.empty())
-    {
-        tokens.push_back(currentToken);
-    }
+    return tokens_;
+}
 
-    return tokens;
+void Parser::fail(ErrorCode code, size_t position) const
+{
+    throw ExpressionError({code, position});
 }
 
-NodePtr Parser::buildTree(const std::vector<std::string> &tokens)
+std::string_view Parser::tokenText(const Token &token) const
 {
-    std::vector<NodePtr> nodeStack;
+    return source_.substr(token.offset, token.length);
+}
 
-    for (size_t i = 0; i < tokens.size(); ++i)
-    {
-        const auto &token = tokens[i];
-        std::cout << "Toke: " << token << std::endl;
-        if (isdigit(token[0]) || (token[0] == '-' && token.size() > 1))
-        {
-            // Number token (additional check for negative numbers)
-            nodeStack.push_back(std::make_shared<ConstantNode>(std::stod(token)));
-        }
-        else if (token == "+" || token == "-" || token == "*" || token == "/")
-        {
-            if (nodeStack.size() < 1 || i == tokens.size() - 1)
-            {
-                std::cerr << "Incorrect statement: There are not enough operands. " << std::endl;
-                exit(1);
-            }
-            NodePtr left = nodeStack.back();
-            nodeStack.pop_back();
+namespace
+{
+    // Returned by parsePrefix when the operand is a subexpression still to be parsed
+    const uint32_t NoNode = UINT32_MAX;
+}
 
-            // Process next token
-            i++;
-            NodePtr right;
-            if (isdigit(tokens[i][0]) || tokens[i][0] == '-')
-            {
-                right = std::make_shared<ConstantNode>(std::stod(tokens[i]));
-            }
-            else if (tokens[i] == "(")
-            {
-                // bracket balance
-                int balance = 1;
-                size_t j = i + 1;
-                for (; j < tokens.size() && balance != 0; ++j)
-                {
-                    if (tokens[j] == "(")
-                    {
-                        balance++;
-                    }
-                    else if (tokens[j] == ")")
-                    {
-                        balance--;
-                    }
-                }
-                std::vector<std::string> subTokens(tokens.begin() + i + 1, tokens.begin() + j - 1);
-                right = buildTree(subTokens);
-                i = j - 1;
-            }
-            else
-            {
-                std::cerr << "Incorrect statement: Unexpected token: " << tokens[i] << std::endl;
-                exit(1);
-            }
+const Token &Parser::advance()
+{
+    const Token &token = *cursor_++;
+#ifdef MATHPARSER_PARSE_OBSERVER
+    if (observeTokens_)
+        observer_->onToken(tokenText(token));
+#endif
+    return token;
+}
 
-            NodePtr operationNode;
-            if (token == "+")
-            {
-                operationNode = std::make_shared<AdditionNode>(left, right);
-            }
-            else if (token == "-")
-            {
-                operationNode = std::make_shared<SubtractionNode>(left, right);
-            }
-            else if (token == "*")
-            {
-                operationNode = std::make_shared<MultiplicationNode>(left, right);
-            }
-            else // token == "/"
-            {
-                operationNode = std::make_shared<DivisionNode>(left, right);
-            }
+void Parser::buildTree(const std::vector<Token> &tokens, FlatExpression &output)
+{
+    cursor_ = tokens.data();
+    end_ = tokens.data() + tokens.size();
 
-            nodeStack.push_back(operationNode);
-        }
-        else if (token == "(")
-        {
-            int balance = 1;
-            size_t j = i + 1;
-            for (; j < tokens.size() && balance != 0; ++j)
-            {
-                if (tokens[j] == "(")
-                {
-                    balance++;
-                }
-                else if (tokens[j] == ")")
-                {
-                    balance--;
-                }
-            }
+    // Every token adds at most one node
+    output.reserve(tokens.size());
+    interner_.reset(output, tokens.size(), interning_);
+    nodeDepths_.clear();
 
-            if (balance != 0)
-            {
-                std::cerr << "Incorrect statement: The parentheses are not balanced." << std::endl;
-                exit(1);
-            }
+    parseExpression();
 
-            std::vector<std::string> subTokens(tokens.begin() + i + 1, tokens.begin() + j - 1);
-            NodePtr subTree = buildTree(subTokens);
-            nodeStack.push_back(subTree);
-            i = j - 1;
-        }
-        else if (token == "^")
-        {
-            if (nodeStack.size() < 1 || i == tokens.size() - 1)
-            {
-                std::cerr << "Incorrect statement: There are not enough operands." << std::endl;
-                exit(1);
-            }
-            NodePtr base = nodeStack.back();
-            nodeStack.pop_back();
+    // A ")" left over means one more closing than opening parenthesis
+    if (cursor_ != end_)
+        fail(cursor_->kind == TokenKind::RightParen ? ErrorCode::UnbalancedParentheses : ErrorCode::UnexpectedToken,
+             cursor_->offset);
+}
 
-            // Process next token
-            i++;
-            NodePtr exponent;
-            if (isdigit(tokens[i][0]) || tokens[i][0] == '-' || tokens[i] == "(")
-            {
-                exponent = buildTree(std::vector<std::string>{tokens[i]});
-            }
-            else
-            {
-                std::cerr << "Incorrect statement: Unexpected token:" << tokens[i] << std::endl;
-                exit(1);
-            }
+uint32_t Parser::parseExpression()
+{
+    frames_.clear();
+    frames_.push_back({0, Continuation::Root, OpCode::Constant, 0});
 
-            NodePtr powerNode = std::make_shared<PowerNode>(base, exponent);
-            nodeStack.push_back(powerNode);
-        }
-        else if (token == "sin" || token == "cos" || token == "tan" || token == "cot")
+    while (true)
+    {
+        uint32_t value = parsePrefix();
+        if (value == NoNode)
+            continue;
+
+        // Applies the postfix and binary operators that bind at least as tightly as the
+        // innermost open frame. A binary operator opens a frame for its right operand;
+        // otherwise the frame is complete and value becomes the operand of the one below.
+        while (true)
         {
-            if (i == tokens.size() - 1 || tokens[i + 1] != "(")
+            const Frame &frame = frames_.back();
+            bool opened = false;
+            while (cursor_ != end_)
             {
-                std::cerr << "Incorrect statement: Parenthesis is missing for trigonometric function." << std::endl;
-                exit(1);
-            }
+                TokenKind kind = cursor_->kind;
 
-            // bracket balance
-            int balance = 1;
-            size_t j = i + 2;
-            for (; j < tokens.size() && balance != 0; ++j)
-            {
-                if (tokens[j] == "(")
+                if (kind == TokenKind::Bang)
                 {
-                    balance++;
+                    if (FactorialPrecedence < frame.minPrecedence)
+                        break;
+                    advance();
+                    value = addUnary(OpCode::Factorial, value);
+                    continue;
                 }
-                else if (tokens[j] == ")")
-                {
-                    balance--;
-                }
-            }
 
-            if (balance != 0)
-            {
-                std::cerr << "Incorrect statement: The parentheses are not balanced." << std::endl;
-                exit(1);
+                int precedence = binaryPrecedence(kind);
+                if (precedence == 0 || precedence < frame.minPrecedence)
+                    break;
+                advance();
+
+                // "^" is right associative, the others are left associative
+                frames_.push_back({kind == TokenKind::Caret ? precedence : precedence + 1, Continuation::BinaryRight,
+                                   binaryOpcode(kind), value});
+                opened = true;
+                break;
+            }
+            if (opened)
+                break;
+
+            Frame done = frames_.back();
+            frames_.pop_back();
+            switch (done.continuation)
+            {
+            case Continuation::Root:
+                return value;
+            case Continuation::Group:
+            case Continuation::Call:
+                if (cursor_ == end_)
+                    fail(ErrorCode::UnbalancedParentheses, source_.size());
+                if (cursor_->kind != TokenKind::RightParen)
+                    fail(ErrorCode::UnexpectedToken, cursor_->offset);
+                advance();
+                if (done.continuation == Continuation::Call)
+                    value = addUnary(done.op, value);
+                break;
+            case Continuation::Unary:
+                value = addUnary(done.op, value);
+                break;
+            default: // Continuation::BinaryRight
+                value = addBinary(done.op, done.left, value);
+                break;
             }
-
-            std::vector<std::string> subTokens(tokens.begin() + i + 2, tokens.begin() + j - 1);
-            NodePtr operand = buildTree(subTokens);
-
-            NodePtr trigNode;
-            if (token == "sin")
-            {
-                trigNode = std::make_shared<SinNode>(operand);
-            }
-            else if (token == "cos")
-            {
-                trigNode = std::make_shared<CosNode>(operand);
-            }
-            else if (token == "tan")
-            {
-                trigNode = std::make_shared<TanNode>(operand);
-            }
-            else // token == "cot"
-            {
-                trigNode = std::make_shared<CotNode>(operand);
-            }
-
-            nodeStack.push_back(trigNode);
-
-            // Jump to end of trigonometric expression
-            i = j - 1;
         }
-        else if (token == "ln" || token == "log")
-        {
-            if (i == tokens.size() - 1)
-            {
-                std::cerr << "Incorrect statement: The operand for the logarithmic function is missing." << std::endl;
-                exit(1);
-            }
-
-            NodePtr operand;
-            if (tokens[i + 1] == "(")
-            {
-                int balance = 1;
-                size_t j = i + 2;
-                for (; j < tokens.size() && balance != 0; ++j)
-                {
-                    if (tokens[j] == "(")
-                    {
-                        balance++;
-                    }
-                    else if (tokens[j] == ")")
-                    {
-                        balance--;
-                    }
-                }
+    }
+}
 
-                if (balance != 0)
-                {
-                    std::cerr << "Incorrect statement: The parentheses are not balanced." << std::endl;
-                    exit(1);
-                }
+uint32_t Parser::parsePrefix()
+{
+    if (cursor_ == end_)
+        fail(ErrorCode::MissingOperand, source_.size());
 
-                std::vector<std::string> subTokens(tokens.begin() + i + 2, tokens.begin() + j - 1);
-                operand = buildTree(subTokens);
-                i = j - 1;
-            }
-            else
-            {
-                operand = buildTree(std::vector<std::string>{tokens[i + 1]});
-                i++;
-            }
+    const Token &token = advance();
 
-            NodePtr logNode;
-            if (token == "ln")
-            {
-                logNode = std::make_shared<LnNode>(operand);
-            }
-            else // token == "log"
-            {
-                logNode = std::make_shared<LogNode>(operand);
-            }
+    switch (token.kind)
+    {
+    case TokenKind::Number:
+        return addLeaf(interner_.addConstant(token.value));
 
-            nodeStack.push_back(logNode);
-        }
-        else if (token == "sqrt")
+    case TokenKind::Identifier:
+    {
+        std::string_view name = tokenText(token);
+        for (size_t slot = 0; slot < variableNames_->size(); ++slot)
         {
-            if (i == tokens.size() - 1)
+            if ((*variableNames_)[slot] == name)
             {
-                std::cerr << "Incorrect statement: The operand for the square root function is missing." << std::endl;
-                exit(1);
+                return addLeaf(interner_.addVariable(static_cast<uint32_t>(slot)));
             }
+        }
+        fail(ErrorCode::UnknownVariable, token.offset);
+    }
 
-            NodePtr operand;
-            if (tokens[i + 1] == "(")
-            {
-                int balance = 1;
-                size_t j = i + 2;
-                for (; j < tokens.size() && balance != 0; ++j)
-                {
-                    if (tokens[j] == "(")
-                    {
-                        balance++;
-                    }
-                    else if (tokens[j] == ")")
-                    {
-                        balance--;
-                    }
-                }
-
-                if (balance != 0)
-                {
-                    std::cerr << "Incorrect statement: The parentheses are not balanced." << std::endl;
-                    exit(1);
-                }
+    case TokenKind::LeftParen:
+        frames_.push_back({0, Continuation::Group, OpCode::Constant, 0});
+        return NoNode;
 
-                std::vector<std::string> subTokens(tokens.begin() + i + 2, tokens.begin() + j - 1);
-                operand = buildTree(subTokens);
-                i = j - 1;
-            }
-            else
-            {
-                operand = buildTree(std::vector<std::string>{tokens[i + 1]});
-                i++;
-            }
+    case TokenKind::Minus:
+    {
+        // A literal directly after the sign is a negative number, unless "^" or "!" binds to it first
+        if (cursor_ != end_ && cursor_->kind == TokenKind::Number &&
+            (cursor_ + 1 == end_ || ((cursor_ + 1)->kind != TokenKind::Caret && (cursor_ + 1)->kind != TokenKind::Bang)))
+        {
+            return addLeaf(interner_.addConstant(-advance().value));
+        }
+        frames_.push_back({UnaryPrecedence, Continuation::Unary, OpCode::Negate, 0});
+        return NoNode;
+    }
 
-            NodePtr sqrtNode = std::make_shared<SqrtNode>(operand);
-            nodeStack.push_back(sqrtNode);
+    case TokenKind::Sin:
+    case TokenKind::Cos:
+    case TokenKind::Tan:
+    case TokenKind::Cot:
+    case TokenKind::Sinh:
+    case TokenKind::Cosh:
+    case TokenKind::Tanh:
+    case TokenKind::Coth:
+    case TokenKind::Sech:
+    case TokenKind::Csch:
+        if (cursor_ == end_ || cursor_->kind != TokenKind::LeftParen)
+            fail(ErrorCode::MissingFunctionParenthesis, token.offset + token.length);
+        advance();
+        frames_.push_back({0, Continuation::Call, functionOpcode(token.kind), 0});
+        return NoNode;
+
+    case TokenKind::Ln:
+    case TokenKind::Log:
+    case TokenKind::Sqrt:
+        // ln, log and sqrt also accept a bare operand, e.g. "sqrt 144"
+        if (cursor_ == end_)
+            fail(ErrorCode::MissingOperand, source_.size());
+        if (cursor_->kind == TokenKind::LeftParen)
+        {
+            advance();
+            frames_.push_back({0, Continuation::Call, functionOpcode(token.kind), 0});
         }
-        else if (token == "^")
+        else
         {
-            if (nodeStack.size() < 1 || i == tokens.size() - 1)
-            {
-                std::cerr << "Incorrect statement: There are not enough operands." << std::endl;
-                exit(1);
-            }
+            frames_.push_back({UnaryPrecedence, Continuation::Unary, functionOpcode(token.kind), 0});
+        }
+        return NoNode;
 
-            NodePtr base = nodeStack.back();
-            nodeStack.pop_back();
+    default:
+        fail(ErrorCode::UnexpectedToken, token.offset);
+    }
+}
 
-            // Process next token
-            i++;
-            NodePtr exponent;
+uint32_t Parser::addLeaf(uint32_t node)
+{
+    return maxDepth_ == UnlimitedDepth ? node : recordDepth(node, 1);
+}
 
-            if (tokens[i] == "(")
-            {
-                // bracket balance
-                int balance = 1;
-                size_t j = i + 1;
-                for (; j < tokens.size() && balance != 0; ++j)
-                {
-                    if (tokens[j] == "(")
-                    {
-                        balance++;
-                    }
-                    else if (tokens[j] == ")")
-                    {
-                        balance--;
-                    }
-                }
+uint32_t Parser::addUnary(OpCode op, uint32_t operand)
+{
+    uint32_t node = interner_.addUnary(op, operand);
+    return maxDepth_ == UnlimitedDepth ? node : recordDepth(node, nodeDepths_[operand] + 1);
+}
 
-                if (balance != 0)
-                {
-                    std::cerr << "Incorrect statement: The parentheses are not balanced." << std::endl;
-                    exit(1);
-                }
+uint32_t Parser::addBinary(OpCode op, uint32_t left, uint32_t right)
+{
+    uint32_t node = interner_.addBinary(op, left, right);
+    return maxDepth_ == UnlimitedDepth ? node
+                                        : recordDepth(node, std::max(nodeDepths_[left], nodeDepths_[right]) + 1);
+}
 
-                std::vector<std::string> subTokens(tokens.begin() + i + 1, tokens.begin() + j - 1);
-                exponent = buildTree(subTokens);
-                i = j - 1;
-            }
-            else
-            {
-                exponent = buildTree(std::vector<std::string>{tokens[i]});
-            }
+uint32_t Parser::recordDepth(uint32_t node, uint32_t depth)
+{
+    // An interned node that was already there has its depth recorded
+    if (node == nodeDepths_.size())
+        nodeDepths_.push_back(depth);
+    if (depth > maxDepth_)
+        fail(ErrorCode::TooDeep, (cursor_ - 1)->offset);
+    return node;
+}
 
-            NodePtr powerNode = std::make_shared<PowerNode>(base, exponent);
-            nodeStack.push_back(powerNode);
-        }
-        else if (token == "sinh" || token == "cosh" || token == "tanh" || token == "coth" || token == "sech" || token == "csch")
+FlatExpression Parser::parseFlat(const std::string &expression, const std::vector<std::string> &variableNames)
+{
+#ifdef MATHPARSER_PARSE_OBSERVER
+    if (observer_ != nullptr)
+    {
+        auto start = std::chrono::steady_clock::now();
+        const std::vector<Token> &tokens = tokenize(expression);
+        auto tokenized = std::chrono::steady_clock::now();
+        FlatExpression output = build(expression, tokens, variableNames);
+        auto built = std::chrono::steady_clock::now();
+
+        // Children come before their parents, so one pass finds every depth
+        const std::vector<FlatNode> &nodes = output.nodes();
+        depths_.resize(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i)
         {
-            if (i == tokens.size() - 1 || tokens[i + 1] != "(")
-            {
-                std::cerr << "Incorrect statement: Parenthesis missing for hyperbolic function." << std::endl;
-                exit(1);
-            }
-
-            // bracket balance
-            int balance = 1;
-            size_t j = i + 2;
-            for (; j < tokens.size() && balance != 0; ++j)
-            {
-                if (tokens[j] == "(")
-                {
-                    balance++;
-                }
-                else if (tokens[j] == ")")
-                {
-                    balance--;
-                }
-            }
-
-            if (balance != 0)
-            {
-                std::cerr << "Incorrect statement: The parentheses are not balanced." << std::endl;
-                exit(1);
-            }
-
-            std::vector<std::string> subTokens(tokens.begin() + i + 2, tokens.begin() + j - 1);
-            NodePtr operand = buildTree(subTokens);
+            int arity = opcodeArity(nodes[i].op);
+            uint32_t left = arity >= 1 ? depths_[nodes[i].operands.left] : 0;
+            uint32_t right = arity == 2 ? depths_[nodes[i].operands.right] : 0;
+            depths_[i] = std::max(left, right) + 1;
+        }
+        observer_->onParse({expression, tokens.size(), nodes.size(), depths_.empty() ? 0 : depths_.back(),
+                            tokenized - start, built - tokenized});
+        return output;
+    }
+#endif
+    return build(expression, tokenize(expression), variableNames);
+}
 
-            NodePtr hyperbolicNode;
-            if (token == "sinh")
-            {
-                hyperbolicNode = std::make_shared<SinhNode>(operand);
-            }
-            else if (token == "cosh")
-            {
-                hyperbolicNode = std::make_shared<CoshNode>(operand);
-            }
-            else if (token == "tanh")
-            {
-                hyperbolicNode = std::make_shared<TanhNode>(operand);
-            }
-            else if (token == "coth")
-            {
-                hyperbolicNode = std::make_shared<CothNode>(operand);
-            }
-            else if (token == "sech")
-            {
-                hyperbolicNode = std::make_shared<SechNode>(operand);
-            }
-            else // token == "csch"
-            {
-                hyperbolicNode = std::make_shared<CschNode>(operand);
-            }
+FlatExpression Parser::build(std::string_view expression, const std::vector<Token> &tokens,
+                             const std::vector<std::string> &variableNames)
+{
+    source_ = expression;
+    variableNames_ = &variableNames;
+    FlatExpression output;
+    buildTree(tokens, output);
+    output.setVariableNames(variableNames);
+    return output;
+}
 
-            nodeStack.push_back(hyperbolicNode);
+#ifdef MATHPARSER_PARSE_OBSERVER
+void Parser::setObserver(ParseObserver *observer)
+{
+    observer_ = observer;
+    observeTokens_ = observer != nullptr && observer->observesTokens();
+}
+#endif
 
-            // Jump to end of hyperbolic expression
-            i = j - 1;
-        }
-        else if (token == "!")
-        {
-            if (nodeStack.size() < 1)
-            {
-                std::cerr << "Incorrect statement: There are not enough operands." << std::endl;
-                exit(1);
-            }
+NodePtr Parser::parse(const std::string &expression, const std::vector<std::string> &variableNames)
+{
+    return parseFlat(expression, variableNames).toTree();
+}
 
-            NodePtr operand = nodeStack.back();
-            nodeStack.pop_back();
-            NodePtr factorialNode = std::make_shared<FactorialNode>(operand);
-            nodeStack.push_back(factorialNode);
-        }
-        else
-        {
-            std::cerr << "Unknown token: " << token << std::endl;
-            exit(1);
-        }
+CompiledExpression Parser::compile(const std::string &expression, const std::vector<std::string> &variableNames)
+{
+    return CompiledExpression(Bytecode::compile(parseFlat(expression, variableNames)), variableNames);
+}
 
-        std::cout << "NodeStack Size: " << nodeStack.size() << std::endl;
+Result<NodePtr> Parser::tryParse(const std::string &expression, const std::vector<std::string> &variableNames)
+{
+    try
+    {
+        return parse(expression, variableNames);
     }
-
-    if (nodeStack.size() != 1)
+    catch (const ExpressionError &error)
     {
-        std::cerr << "Incorrect statement: Not enough operators." << std::endl;
-        exit(1);
+        return error.error();
     }
+}
 
-    return nodeStack.back();
+Result<FlatExpression> Parser::tryParseFlat(const std::string &expression, const std::vector<std::string> &variableNames)
+{
+    try
+    {
+        return parseFlat(expression, variableNames);
+    }
+    catch (const ExpressionError &error)
+    {
+        return error.error();
+    }
 }
 
-NodePtr Parser::parse(const std::string &expression)
+Result<CompiledExpression> Parser::tryCompile(const std::string &expression, const std::vector<std::string> &variableNames)
 {
-    std::vector<std::string> tokens = tokenize(expression);
-    return buildTree(tokens);
+    try
+    {
+        return compile(expression, variableNames);
+    }
+    catch (const ExpressionError &error)
+    {
+        return error.error();
+    }
 }
@@ -10,20 +10,145 @@
 #define PARSER_H
 
 #include "expression_tree.h"
+#include "compiled_expression.h"
+#include "flat_expression.h"
+#include "grammar.h"
+#include "parse_observer.h"
+#include "result.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
 #include <vector>
 
+// What interning found in the last parsed expression
+struct InternStats
+{
+    size_t nodes;         // nodes the expression has when written out as a tree
+    size_t duplicateHits; // nodes that were already there and got shared
+};
+
 class Parser
 {
 public:
-    // Parses the expression and returns an expression tree
-    NodePtr parse(const std::string &expression);
+    // Parses the expression and returns an expression tree. Identifiers must appear
+    // in variableNames; a variable's slot is its index in that list.
+    NodePtr parse(const std::string &expression, const std::vector<std::string> &variableNames = {});
+
+    // Parses the expression into a contiguous node array
+    FlatExpression parseFlat(const std::string &expression, const std::vector<std::string> &variableNames = {});
+
+    // Parses the expression once into a program that can be evaluated for many inputs
+    CompiledExpression compile(const std::string &expression, const std::vector<std::string> &variableNames = {});
+
+    // The three functions above throw an ExpressionError (a std::runtime_error)
+    // for malformed input. These return the Error instead, with its code and
+    // the offset in the source where it was found.
+    Result<NodePtr> tryParse(const std::string &expression, const std::vector<std::string> &variableNames = {});
+    Result<FlatExpression> tryParseFlat(const std::string &expression, const std::vector<std::string> &variableNames = {});
+    Result<CompiledExpression> tryCompile(const std::string &expression, const std::vector<std::string> &variableNames = {});
+
+    // Shares repeated subexpressions while building (on by default), so the
+    // results of parse and parseFlat are DAGs: "sin(a*b) + cos(a*b)" holds a*b once.
+    // Flat expressions and compiled programs then compute a shared value once per
+    // evaluation; the tree from parse still visits it once per use.
+    void setInterning(bool enabled) { interning_ = enabled; }
+    InternStats internStats() const { return {interner_.requests(), interner_.duplicateHits()}; }
+
+    // Rejects expressions whose tree is deeper than maxDepth (nodes on the longest
+    // path from the root to a leaf) with ErrorCode::TooDeep. There is no limit by
+    // default: parsing, evaluating and destroying an expression use heap memory
+    // rather than the call stack for its depth, so any depth that fits in memory works.
+    static constexpr size_t UnlimitedDepth = SIZE_MAX;
+    void setMaxDepth(size_t maxDepth) { maxDepth_ = maxDepth; }
+    size_t maxDepth() const { return maxDepth_; }
+
+#ifdef MATHPARSER_PARSE_OBSERVER
+    // Reports every parse, and every token if the observer asks for them, to
+    // observer (nullptr to stop). Without MATHPARSER_PARSE_OBSERVER the parser
+    // has no hooks at all.
+    void setObserver(ParseObserver *observer);
+#endif
+
+    // Splits the expression into tokens. The returned buffer is owned by the
+    // parser and reused by the next call, so steady-state tokenizing does not allocate.
+    const std::vector<Token> &tokenize(std::string_view expression);
+
+    // Builds the flat expression from tokens that tokenize returned for expression.
+    // parseFlat is tokenize followed by build; the two are public so they can be timed apart.
+    FlatExpression build(std::string_view expression, const std::vector<Token> &tokens,
+                         const std::vector<std::string> &variableNames = {});
 
 private:
-    // Splits the expression into tokens
-    std::vector<std::string> tokenize(const std::string &expression);
+    // Appends the nodes for the tokens to output in a single left-to-right pass
+    void buildTree(const std::vector<Token> &tokens, FlatExpression &output);
+
+    // Parses the whole token stream. Open parentheses, function calls, unary minus
+    // and binary operators waiting for their right operand are kept in frames_
+    // instead of on the call stack, so the nesting depth is limited only by memory.
+    // Returns the index of the root node.
+    uint32_t parseExpression();
+
+    // Parses a number or a variable and returns its node. For a parenthesised group,
+    // a function call or a unary minus it opens a frame for the subexpression and
+    // returns NoNode.
+    uint32_t parsePrefix();
+
+    // What happens to the value of a subexpression once its frame is complete
+    enum class Continuation : uint8_t
+    {
+        Root,       // it is the whole expression
+        Group,      // a ")" must follow
+        Call,       // a ")" must follow, then the function op is applied
+        Unary,      // op is applied (unary minus, or ln/log/sqrt without parentheses)
+        BinaryRight // it is the right operand of op, left is the left one
+    };
+
+    // A subexpression being parsed: operators binding less tightly than minPrecedence end it
+    struct Frame
+    {
+        int minPrecedence;
+        Continuation continuation;
+        OpCode op;
+        uint32_t left;
+    };
+
+    // Add a node through the interner and check the depth limit when there is one
+    uint32_t addLeaf(uint32_t node);
+    uint32_t addUnary(OpCode op, uint32_t operand);
+    uint32_t addBinary(OpCode op, uint32_t left, uint32_t right);
+    uint32_t recordDepth(uint32_t node, uint32_t depth);
+
+    // Consumes the current token
+    const Token &advance();
+
+    // Throws the ExpressionError for code at position in the source
+    [[noreturn]] void fail(ErrorCode code, size_t position) const;
+
+    // Source text of the token, for diagnostics
+    std::string_view tokenText(const Token &token) const;
+
+    std::vector<Token> tokens_;
+    std::string_view source_;
+
+    // Read position in the token stream while building a tree
+    const Token *cursor_ = nullptr;
+    const Token *end_ = nullptr;
+    NodeInterner interner_;
+    bool interning_ = true;
+    std::vector<Frame> frames_;
+
+    // Depth of every node of the expression being built, only kept while a limit is set
+    std::vector<uint32_t> nodeDepths_;
+    size_t maxDepth_ = UnlimitedDepth;
+
+#ifdef MATHPARSER_PARSE_OBSERVER
+    ParseObserver *observer_ = nullptr;
+    bool observeTokens_ = false;
 
-    // Creates an expression tree from tokens
-    NodePtr buildTree(const std::vector<std::string> &tokens);
+    // Depth of every node of the last expression, for ParseRecord::depth
+    std::vector<uint32_t> depths_;
+#endif
+    const std::vector<std::string> *variableNames_ = nullptr;
 };
 
 #endif // PARSER_H
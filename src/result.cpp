@@ -0,0 +1,48 @@
+/**
+ * @file result.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "result.h"
+
+const char *errorMessage(ErrorCode code)
+{
+    switch (code)
+    {
+    case ErrorCode::InvalidNumber:
+        return "Invalid number";
+    case ErrorCode::UnknownCharacter:
+        return "Unknown character";
+    case ErrorCode::UnexpectedToken:
+        return "Unexpected token";
+    case ErrorCode::MissingOperand:
+        return "There are not enough operands";
+    case ErrorCode::UnknownVariable:
+        return "Unknown variable";
+    case ErrorCode::UnbalancedParentheses:
+        return "The parentheses are not balanced";
+    case ErrorCode::MissingFunctionParenthesis:
+        return "Parenthesis is missing for function";
+    case ErrorCode::TooDeep:
+        return "The expression is nested deeper than the limit";
+    case ErrorCode::DivisionByZero:
+        return "Division by 0";
+    case ErrorCode::CotangentOfZeroTangent:
+        return "Tan value is 0";
+    case ErrorCode::NegativeSquareRoot:
+        return "The square root of a negative number cannot be taken";
+    default: // ErrorCode::NegativeFactorial
+        return "Negative factorial cannot be calculated";
+    }
+}
+
+std::string Error::message() const
+{
+    std::string text = errorMessage(code);
+    if (position != NoPosition)
+        text += " at position " + std::to_string(position);
+    return text;
+}
@@ -0,0 +1,116 @@
+/**
+ * @file result.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef RESULT_H
+#define RESULT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <variant>
+
+enum class ErrorCode : uint8_t
+{
+    // Parse errors
+    InvalidNumber,
+    UnknownCharacter,
+    UnexpectedToken,
+    MissingOperand,
+    UnknownVariable,
+    UnbalancedParentheses,
+    MissingFunctionParenthesis,
+    TooDeep,
+
+    // Evaluation errors
+    DivisionByZero,
+    CotangentOfZeroTangent,
+    NegativeSquareRoot,
+    NegativeFactorial
+};
+
+// Describes the code in a sentence
+const char *errorMessage(ErrorCode code);
+
+struct Error
+{
+    // Position for errors that do not belong to a place in the source
+    static constexpr size_t NoPosition = SIZE_MAX;
+
+    ErrorCode code;
+    size_t position = NoPosition; // offset in the source text for parse errors
+
+    // The error message, with the position if there is one
+    std::string message() const;
+};
+
+// Thrown by parse, evaluate and the other functions that cannot return an
+// Error. It is a std::runtime_error, so existing catch blocks keep working.
+class ExpressionError : public std::runtime_error
+{
+public:
+    explicit ExpressionError(Error error) : std::runtime_error(error.message()), error_(error) {}
+
+    const Error &error() const { return error_; }
+
+private:
+    Error error_;
+};
+
+// Either a value or the Error that prevented it, as returned by the try*
+// functions (tryParse, tryCompile, tryEvaluate, ...)
+template <typename T>
+class Result
+{
+public:
+    Result(T value) : state_(std::in_place_index<0>, std::move(value)) {}
+    Result(Error error) : state_(std::in_place_index<1>, error) {}
+
+    bool ok() const { return state_.index() == 0; }
+    explicit operator bool() const { return ok(); }
+
+    // The value; throws the ExpressionError if there is none
+    T &value() &
+    {
+        check();
+        return *std::get_if<0>(&state_);
+    }
+    const T &value() const &
+    {
+        check();
+        return *std::get_if<0>(&state_);
+    }
+    T &&value() &&
+    {
+        check();
+        return std::move(*std::get_if<0>(&state_));
+    }
+
+    // Unchecked access, only valid when ok()
+    T &operator*() { return *std::get_if<0>(&state_); }
+    const T &operator*() const { return *std::get_if<0>(&state_); }
+    T *operator->() { return std::get_if<0>(&state_); }
+    const T *operator->() const { return std::get_if<0>(&state_); }
+
+    // Only valid when !ok()
+    const Error &error() const { return *std::get_if<1>(&state_); }
+
+    T valueOr(T fallback) const { return ok() ? **this : fallback; }
+
+private:
+    void check() const
+    {
+        if (!ok())
+            throw ExpressionError(error());
+    }
+
+    std::variant<T, Error> state_;
+};
+
+#endif // RESULT_H
@@ -1 +1,27 @@
-g++ expression_tree.cpp math_module.cpp parser.cpp test_parser.cpp -o Test
\ No newline at end of file
+SOURCES="expression_tree.cpp math_module.cpp opcode.cpp batch.cpp simd_math.cpp simd_math_sse2.cpp simd_math_avx2.cpp simd_math_avx512.cpp flat_expression.cpp bytecode.cpp compiled_expression.cpp thread_pool.cpp parallel_evaluation.cpp optimizer.cpp expression_cache.cpp native_expression.cpp gradient.cpp derivative.cpp incremental.cpp expression_library.cpp multi_expression.cpp sampler.cpp matrix.cpp parse_observer.cpp result.cpp parser.cpp"
+g++ -std=c++20 -pthread -DMATHPARSER_PARSE_OBSERVER $SOURCES test_parser.cpp -o Test
+g++ -std=c++20 -pthread -O3 $SOURCES bench_tokenizer.cpp -o BenchTokenizer
+g++ -std=c++20 -pthread -O3 $SOURCES bench_parser.cpp -o BenchParser
+g++ -std=c++20 -pthread -O3 $SOURCES bench_flat_expression.cpp -o BenchFlatExpression
+g++ -std=c++20 -pthread -O3 $SOURCES bench_bytecode.cpp -o BenchBytecode
+g++ -std=c++20 -pthread -O3 $SOURCES bench_compiled_expression.cpp -o BenchCompiledExpression
+g++ -std=c++20 -pthread -O3 $SOURCES bench_batch.cpp -o BenchBatch
+g++ -std=c++20 -pthread -O3 $SOURCES bench_simd_math.cpp -o BenchSimdMath
+g++ -std=c++20 -pthread -O3 $SOURCES bench_parallel.cpp -o BenchParallel
+g++ -std=c++20 -pthread -O3 $SOURCES bench_optimizer.cpp -o BenchOptimizer
+g++ -std=c++20 -pthread -O3 $SOURCES bench_sharing.cpp -o BenchSharing
+g++ -std=c++20 -pthread -O3 $SOURCES bench_expression_cache.cpp -o BenchExpressionCache
+g++ -std=c++20 -pthread -O3 $SOURCES bench_parse_observer.cpp -o BenchParseObserver
+g++ -std=c++20 -pthread -O3 -DMATHPARSER_PARSE_OBSERVER $SOURCES bench_parse_observer.cpp -o BenchParseObserverEnabled
+g++ -std=c++20 -pthread -O3 $SOURCES bench_errors.cpp -o BenchErrors
+g++ -std=c++20 -pthread -O3 $SOURCES corpus.cpp bench_suite.cpp -o BenchSuite
+g++ -std=c++20 -pthread -O3 $SOURCES bench_native_expression.cpp -o BenchNativeExpression
+g++ -std=c++20 -pthread -O3 $SOURCES bench_static_expression.cpp -o BenchStaticExpression
+g++ -std=c++20 -pthread -O3 $SOURCES bench_gradient.cpp -o BenchGradient
+g++ -std=c++20 -pthread -O3 $SOURCES bench_derivative.cpp -o BenchDerivative
+g++ -std=c++20 -pthread -O3 $SOURCES bench_incremental.cpp -o BenchIncremental
+g++ -std=c++20 -pthread -O3 $SOURCES mathparser_eval.cpp -o mathparser-eval
+g++ -std=c++20 -pthread -O3 $SOURCES corpus.cpp bench_expression_library.cpp -o BenchExpressionLibrary
+g++ -std=c++20 -pthread -O3 $SOURCES corpus.cpp bench_multi_expression.cpp -o BenchMultiExpression
+g++ -std=c++20 -pthread -O3 $SOURCES bench_sampler.cpp -o BenchSampler
+g++ -std=c++20 -pthread -O3 $SOURCES bench_matrix.cpp -o BenchMatrix
\ No newline at end of file
@@ -0,0 +1,399 @@
+/**
+ * @file sampler.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "sampler.h"
+#include "parallel_evaluation.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+    // Evaluates n points given as columns, writing inf or NaN outside the domain
+    void evaluatePoints(const CompiledExpression &expression, const double *const *columns, size_t n, double *out,
+                        ThreadPool *pool)
+    {
+        if (n == 0)
+            return;
+        if (pool != nullptr)
+            evaluateBatchParallel(*pool, expression, columns, n, out, BatchChunkSize, ErrorMode::Propagate,
+                                  simdKernels().level);
+        else
+            expression.evaluateBatch(columns, n, out, ErrorMode::Propagate);
+    }
+
+    // Range of the finite values, widened when they are all equal
+    void finiteRange(const double *values, size_t n, double &low, double &high)
+    {
+        low = std::numeric_limits<double>::infinity();
+        high = -low;
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (std::isfinite(values[i]))
+            {
+                low = std::min(low, values[i]);
+                high = std::max(high, values[i]);
+            }
+        }
+        if (low > high)
+        {
+            low = 0;
+            high = 1;
+        }
+        else if (low == high)
+        {
+            double pad = std::max(1.0, std::abs(low) * 1e-3);
+            low -= pad;
+            high += pad;
+        }
+    }
+
+    // The range the options give, or that of the samples
+    void viewRange(double optionLow, double optionHigh, const double *values, size_t n, double &low, double &high)
+    {
+        if (std::isnan(optionLow) || std::isnan(optionHigh))
+        {
+            finiteRange(values, n, low, high);
+            return;
+        }
+        if (!(optionLow < optionHigh) || !std::isfinite(optionHigh - optionLow))
+            throw std::invalid_argument("The value range of a plot must be finite and not empty");
+        low = optionLow;
+        high = optionHigh;
+    }
+
+    // Refinement state of an interval of the curve
+    enum class Interval : uint8_t
+    {
+        Pending, // to be tested at its midpoint
+        Done,
+        Broken // a pole: the curve is not drawn across it
+    };
+}
+
+Polyline sampleCurve(const CompiledExpression &expression, double a, double b, const CurveOptions &options)
+{
+    if (expression.program().variableCount() > 1)
+        throw std::invalid_argument("sampleCurve needs an expression of at most one variable");
+    if (!(a < b) || !std::isfinite(b - a))
+        throw std::invalid_argument("Cannot sample an empty or infinite range");
+
+    Polyline curve;
+    size_t intervals = std::max<size_t>(options.initialIntervals, 1);
+    std::vector<double> xs(intervals + 1), ys(intervals + 1);
+    for (size_t i = 0; i < intervals; ++i)
+        xs[i] = a + (b - a) * double(i) / double(intervals);
+    xs[intervals] = b;
+    const double *column = xs.data();
+    evaluatePoints(expression, &column, xs.size(), ys.data(), options.pool);
+    curve.evaluations = xs.size();
+    viewRange(options.yMin, options.yMax, ys.data(), ys.size(), curve.yMin, curve.yMax);
+
+    // Distances are measured in pixels, with values beyond the plot at its edge
+    const double scale = double(std::max<size_t>(options.height, 1)) / (curve.yMax - curve.yMin);
+    const double minWidth = (b - a) / double(std::max<size_t>(options.width, 1));
+    const double halfHeight = double(std::max<size_t>(options.height, 1)) / 2;
+    auto pixel = [&](double y) { return (std::clamp(y, curve.yMin, curve.yMax) - curve.yMin) * scale; };
+
+    // The line from a to b passes within tolerance of the midpoint, or the span is all outside the domain
+    auto straight = [&](double ya, double ym, double yb)
+    {
+        int finite = std::isfinite(ya) + std::isfinite(ym) + std::isfinite(yb);
+        if (finite == 0)
+            return true;
+        if (finite < 3)
+            return false;
+        return std::abs(pixel(ym) - (pixel(ya) + pixel(yb)) / 2) <= options.tolerance;
+    };
+
+    std::vector<Interval> state(intervals, (b - a) / double(intervals) > minWidth ? Interval::Pending : Interval::Done);
+    std::vector<double> midX, midY, nextX, nextY;
+    std::vector<Interval> nextState;
+    while (true)
+    {
+        // Every pending interval of the round is tested with one batch
+        midX.clear();
+        for (size_t i = 0; i < state.size(); ++i)
+        {
+            if (state[i] == Interval::Pending)
+                midX.push_back(0.5 * (xs[i] + xs[i + 1]));
+        }
+        if (midX.empty())
+            break;
+        midY.resize(midX.size());
+        column = midX.data();
+        evaluatePoints(expression, &column, midX.size(), midY.data(), options.pool);
+        curve.evaluations += midX.size();
+
+        nextX.clear();
+        nextY.clear();
+        nextState.clear();
+        size_t m = 0;
+        for (size_t i = 0; i < state.size(); ++i)
+        {
+            nextX.push_back(xs[i]);
+            nextY.push_back(ys[i]);
+            if (state[i] != Interval::Pending)
+            {
+                nextState.push_back(state[i]);
+                continue;
+            }
+
+            // The midpoint is kept either way; the halves go on while the curve is not straight
+            double xm = midX[m], ym = midY[m++];
+            double ya = ys[i], yb = ys[i + 1];
+            nextX.push_back(xm);
+            nextY.push_back(ym);
+            if (straight(ya, ym, yb))
+            {
+                nextState.insert(nextState.end(), {Interval::Done, Interval::Done});
+            }
+            else if (xm - xs[i] > minWidth)
+            {
+                nextState.insert(nextState.end(), {Interval::Pending, Interval::Pending});
+            }
+            else
+            {
+                // At the finest width, a jump across half the plot where the curve turns
+                // back (the midpoint is not between the ends) is a pole, not a steep slope
+                Interval left = Interval::Done, right = Interval::Done;
+                bool turns = std::isfinite(ya) && std::isfinite(ym) && std::isfinite(yb) &&
+                             (ym < std::min(ya, yb) || ym > std::max(ya, yb));
+                double leftJump = std::abs(pixel(ym) - pixel(ya)), rightJump = std::abs(pixel(yb) - pixel(ym));
+                if (turns && std::max(leftJump, rightJump) >= halfHeight)
+                    (leftJump > rightJump ? left : right) = Interval::Broken;
+                nextState.insert(nextState.end(), {left, right});
+            }
+        }
+        nextX.push_back(xs.back());
+        nextY.push_back(ys.back());
+        xs.swap(nextX);
+        ys.swap(nextY);
+        state.swap(nextState);
+    }
+
+    curve.x.reserve(xs.size());
+    curve.y.reserve(ys.size());
+    for (size_t i = 0; i < state.size(); ++i)
+    {
+        curve.x.push_back(xs[i]);
+        curve.y.push_back(ys[i]);
+        if (state[i] == Interval::Broken)
+        {
+            curve.x.push_back(0.5 * (xs[i] + xs[i + 1]));
+            curve.y.push_back(std::numeric_limits<double>::quiet_NaN());
+        }
+    }
+    curve.x.push_back(xs.back());
+    curve.y.push_back(ys.back());
+    return curve;
+}
+
+Heatmap sampleHeatmap(const CompiledExpression &expression, double x0, double x1, double y0, double y1, size_t width,
+                      size_t height, const HeatmapOptions &options)
+{
+    Heatmap map;
+    sampleHeatmap(expression, x0, x1, y0, y1, width, height, map, options);
+    return map;
+}
+
+void sampleHeatmap(const CompiledExpression &expression, double x0, double x1, double y0, double y1, size_t width,
+                   size_t height, Heatmap &map, const HeatmapOptions &options)
+{
+    if (expression.program().variableCount() > 2)
+        throw std::invalid_argument("sampleHeatmap needs an expression of at most two variables");
+    if (width == 0 || height == 0)
+        throw std::invalid_argument("Cannot sample an empty heatmap");
+
+    // Every pixel is written below, so a buffer of the right size is not cleared first
+    map.width = width;
+    map.height = height;
+    map.values.resize(width * height);
+    map.evaluations = 0;
+    const double dx = (x1 - x0) / double(width), dy = (y1 - y0) / double(height);
+
+    // Pixels are requested while a round is planned and evaluated together by flush;
+    // known marks those requested or evaluated
+    std::vector<bool> known(width * height);
+    std::vector<size_t> requested;
+    std::vector<double> xs, ys, zs;
+    auto request = [&](size_t i, size_t j)
+    {
+        size_t k = j * width + i;
+        if (!known[k])
+        {
+            known[k] = true;
+            requested.push_back(k);
+        }
+    };
+    auto flush = [&]
+    {
+        xs.resize(requested.size());
+        ys.resize(requested.size());
+        zs.resize(requested.size());
+        for (size_t t = 0; t < requested.size(); ++t)
+        {
+            xs[t] = x0 + (double(requested[t] % width) + 0.5) * dx;
+            ys[t] = y0 + (double(requested[t] / width) + 0.5) * dy;
+        }
+        const double *columns[] = {xs.data(), ys.data()};
+        evaluatePoints(expression, columns, requested.size(), zs.data(), options.pool);
+        for (size_t t = 0; t < requested.size(); ++t)
+            map.values[requested[t]] = zs[t];
+        map.evaluations += requested.size();
+        requested.clear();
+    };
+
+    // Blocks are given by their corner pixels, both included. Narrow ones are evaluated in full.
+    struct Block
+    {
+        size_t i0, j0, i1, j1;
+    };
+    auto exact = [](const Block &block) { return block.i1 - block.i0 <= 2 || block.j1 - block.j0 <= 2; };
+    auto requestAll = [&](const Block &block)
+    {
+        for (size_t j = block.j0; j <= block.j1; ++j)
+        {
+            for (size_t i = block.i0; i <= block.i1; ++i)
+                request(i, j);
+        }
+    };
+
+    // The first grid: every step pixels and the last row and column
+    size_t step = std::max<size_t>(options.initialStep, 1);
+    auto lines = [&](size_t size)
+    {
+        std::vector<size_t> result;
+        for (size_t i = 0; i + 1 < size; i += step)
+            result.push_back(i);
+        result.push_back(size - 1);
+        return result;
+    };
+    std::vector<size_t> columnLines = lines(width), rowLines = lines(height);
+    std::vector<Block> pending, next, accepted;
+    if (columnLines.size() < 2 || rowLines.size() < 2)
+    {
+        requestAll({0, 0, width - 1, height - 1});
+    }
+    else
+    {
+        for (size_t j : rowLines)
+        {
+            for (size_t i : columnLines)
+                request(i, j);
+        }
+        for (size_t r = 0; r + 1 < rowLines.size(); ++r)
+        {
+            for (size_t c = 0; c + 1 < columnLines.size(); ++c)
+                pending.push_back({columnLines[c], rowLines[r], columnLines[c + 1], rowLines[r + 1]});
+        }
+    }
+    flush();
+
+    viewRange(options.zMin, options.zMax, zs.data(), zs.size(), map.zMin, map.zMax);
+    const double scale = options.levels / (map.zMax - map.zMin);
+    auto level = [&](double z) { return (std::clamp(z, map.zMin, map.zMax) - map.zMin) * scale; };
+    auto value = [&](size_t i, size_t j) { return map.values[j * width + i]; };
+
+    while (!pending.empty())
+    {
+        // The centre and edge midpoints of every block, which are the corners of its quarters
+        for (const Block &block : pending)
+        {
+            if (exact(block))
+            {
+                requestAll(block);
+                continue;
+            }
+            size_t im = (block.i0 + block.i1) / 2, jm = (block.j0 + block.j1) / 2;
+            request(im, jm);
+            request(im, block.j0);
+            request(im, block.j1);
+            request(block.i0, jm);
+            request(block.i1, jm);
+        }
+        flush();
+
+        next.clear();
+        for (const Block &block : pending)
+        {
+            if (exact(block))
+                continue;
+
+            // Bilinear interpolation of the corners must match the five new points
+            size_t im = (block.i0 + block.i1) / 2, jm = (block.j0 + block.j1) / 2;
+            double u = double(im - block.i0) / double(block.i1 - block.i0);
+            double v = double(jm - block.j0) / double(block.j1 - block.j0);
+            double corners[] = {value(block.i0, block.j0), value(block.i1, block.j0), value(block.i0, block.j1),
+                                value(block.i1, block.j1)};
+            struct Test
+            {
+                double z, u, v;
+            } tests[] = {{value(im, jm), u, v},
+                         {value(im, block.j0), u, 0},
+                         {value(im, block.j1), u, 1},
+                         {value(block.i0, jm), 0, v},
+                         {value(block.i1, jm), 1, v}};
+
+            int finite = 0;
+            for (double z : corners)
+                finite += std::isfinite(z);
+            for (const Test &test : tests)
+                finite += std::isfinite(test.z);
+            bool smooth = finite == 0;
+            if (finite == 9)
+            {
+                double l00 = level(corners[0]), l10 = level(corners[1]), l01 = level(corners[2]),
+                       l11 = level(corners[3]);
+                smooth = true;
+                for (const Test &test : tests)
+                {
+                    double interpolated = (1 - test.v) * ((1 - test.u) * l00 + test.u * l10) +
+                                          test.v * ((1 - test.u) * l01 + test.u * l11);
+                    smooth = smooth && std::abs(level(test.z) - interpolated) <= options.tolerance;
+                }
+            }
+
+            if (smooth)
+            {
+                accepted.push_back(block);
+                continue;
+            }
+            next.push_back({block.i0, block.j0, im, jm});
+            next.push_back({im, block.j0, block.i1, jm});
+            next.push_back({block.i0, jm, im, block.j1});
+            next.push_back({im, jm, block.i1, block.j1});
+        }
+        pending.swap(next);
+    }
+
+    // Pixels of accepted blocks that no block needed are interpolated
+    for (const Block &block : accepted)
+    {
+        double z00 = value(block.i0, block.j0), z10 = value(block.i1, block.j0), z01 = value(block.i0, block.j1),
+               z11 = value(block.i1, block.j1);
+        double columnStep = 1.0 / double(block.i1 - block.i0);
+        for (size_t j = block.j0; j <= block.j1; ++j)
+        {
+            // Along a row the interpolation is linear between the block's left and right edges
+            double v = double(j - block.j0) / double(block.j1 - block.j0);
+            double left = (1 - v) * z00 + v * z01, right = (1 - v) * z10 + v * z11;
+            if (!std::isfinite(z00))
+                left = right = std::numeric_limits<double>::quiet_NaN();
+            for (size_t i = block.i0; i <= block.i1; ++i)
+            {
+                size_t k = j * width + i;
+                if (known[k])
+                    continue;
+                double u = double(i - block.i0) * columnStep;
+                map.values[k] = left + u * (right - left);
+                known[k] = true;
+            }
+        }
+    }
+}
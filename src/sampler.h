@@ -0,0 +1,107 @@
+/**
+ * @file sampler.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "compiled_expression.h"
+#include "thread_pool.h"
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+// Adaptive sampling of formulas for plots: a curve y = f(x) over [a, b] and a
+// heatmap z = f(x, y) over a rectangle. Instead of a dense fixed grid, a coarse
+// grid is refined only where straight lines (for the curve) or bilinear
+// interpolation (for the heatmap) would be visibly off at the given pixel
+// resolution: near curvature, domain edges and poles such as those of tan and
+// cot. Smooth spans keep few samples. Every round of refinement evaluates all
+// of its new points with one evaluateBatch, or evaluateBatchParallel when a
+// pool is given, in ErrorMode::Propagate: a point outside the domain comes back
+// as inf or NaN instead of throwing.
+
+struct CurveOptions
+{
+    // Pixels of the plot. Intervals are not split below (b - a) / width, and a
+    // straight line is accepted when it is within tolerance pixels of the curve.
+    size_t width = 1024;
+    size_t height = 600;
+    double tolerance = 0.25;
+
+    // Visible y range; NaN takes the range of the initial samples. Values
+    // outside it only count as far as the edge of the plot.
+    double yMin = std::numeric_limits<double>::quiet_NaN();
+    double yMax = std::numeric_limits<double>::quiet_NaN();
+
+    // Intervals of the first, uniform grid
+    size_t initialIntervals = 64;
+
+    ThreadPool *pool = nullptr;
+};
+
+// Points of a curve, ordered by x. A point whose y is not finite ends a line:
+// points outside the domain keep the inf or NaN they evaluated to, and a NaN
+// point is inserted where the curve jumps across the whole plot at a pole.
+struct Polyline
+{
+    std::vector<double> x;
+    std::vector<double> y;
+
+    // The y range used, and how many points were evaluated
+    double yMin = 0;
+    double yMax = 0;
+    size_t evaluations = 0;
+};
+
+struct HeatmapOptions
+{
+    // Colour levels of the value range; a block is filled by bilinear
+    // interpolation when that is within tolerance levels of the formula
+    double levels = 256;
+    double tolerance = 0.5;
+
+    // Value range of the colour scale; NaN takes the range of the initial samples
+    double zMin = std::numeric_limits<double>::quiet_NaN();
+    double zMax = std::numeric_limits<double>::quiet_NaN();
+
+    // Pixels between the samples of the first grid
+    size_t initialStep = 8;
+
+    ThreadPool *pool = nullptr;
+};
+
+// A width x height buffer of the values at the pixel centres, row by row:
+// values[j * width + i] is at x0 + (i + 0.5) * (x1 - x0) / width and
+// y0 + (j + 0.5) * (y1 - y0) / height
+struct Heatmap
+{
+    size_t width = 0;
+    size_t height = 0;
+    std::vector<double> values;
+
+    // The value range used, and how many pixels were evaluated rather than interpolated
+    double zMin = 0;
+    double zMax = 0;
+    size_t evaluations = 0;
+};
+
+// Samples an expression of at most one variable (slot 0 is x) over [a, b].
+// Throws std::invalid_argument for an expression of more variables or an empty range.
+Polyline sampleCurve(const CompiledExpression &expression, double a, double b, const CurveOptions &options = {});
+
+// Samples an expression of at most two variables (slot 0 is x, slot 1 is y)
+// over [x0, x1] x [y0, y1] into a width x height heatmap
+Heatmap sampleHeatmap(const CompiledExpression &expression, double x0, double x1, double y0, double y1, size_t width,
+                      size_t height, const HeatmapOptions &options = {});
+
+// Same into map, reusing its buffer: a renderer that keeps one heatmap per view
+// does not allocate (and fault in) a new buffer for every frame
+void sampleHeatmap(const CompiledExpression &expression, double x0, double x1, double y0, double y1, size_t width,
+                   size_t height, Heatmap &map, const HeatmapOptions &options = {});
+
+#endif // SAMPLER_H
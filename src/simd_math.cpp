@@ -0,0 +1,147 @@
+/**
+ * @file simd_math.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "simd_math.h"
+#include <atomic>
+#include <cmath>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SIMD_MATH_X86 1
+
+// Defined in simd_math_<isa>.cpp
+const SimdKernels &sse2SimdKernels();
+const SimdKernels &avx2SimdKernels();
+const SimdKernels &avx512SimdKernels();
+#endif
+
+namespace
+{
+    template <double (*Function)(double)>
+    void scalarUnary(const double *in, double *out, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            out[i] = Function(in[i]);
+    }
+
+    void scalarPow(const double *x, const double *y, double *out, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            out[i] = std::pow(x[i], y[i]);
+    }
+
+    // Wrappers so that the templates get plain function pointers
+    double scalarExp(double v) { return std::exp(v); }
+    double scalarLn(double v) { return std::log(v); }
+    double scalarLog10(double v) { return std::log10(v); }
+    double scalarSin(double v) { return std::sin(v); }
+    double scalarCos(double v) { return std::cos(v); }
+    double scalarTan(double v) { return std::tan(v); }
+    double scalarSinh(double v) { return std::sinh(v); }
+    double scalarCosh(double v) { return std::cosh(v); }
+    double scalarTanh(double v) { return std::tanh(v); }
+
+    const SimdKernels ScalarKernels{
+        SimdLevel::Scalar,
+        scalarUnary<scalarExp>,
+        scalarUnary<scalarLn>,
+        scalarUnary<scalarLog10>,
+        scalarUnary<scalarSin>,
+        scalarUnary<scalarCos>,
+        scalarUnary<scalarTan>,
+        scalarUnary<scalarSinh>,
+        scalarUnary<scalarCosh>,
+        scalarUnary<scalarTanh>,
+        scalarPow,
+    };
+
+    std::atomic<const SimdKernels *> &selectedKernels()
+    {
+        static std::atomic<const SimdKernels *> selected{&simdKernels(detectSimdLevel())};
+        return selected;
+    }
+
+    // Set by ThreadSimdLevel; null follows setSimdLevel
+    thread_local const SimdKernels *threadKernels = nullptr;
+}
+
+SimdLevel detectSimdLevel()
+{
+#ifdef SIMD_MATH_X86
+    static const SimdLevel level = []
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+            return SimdLevel::AVX512;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return SimdLevel::AVX2;
+        return SimdLevel::SSE2;
+    }();
+    return level;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+const SimdKernels &simdKernels()
+{
+    if (threadKernels != nullptr)
+        return *threadKernels;
+    return *selectedKernels().load(std::memory_order_relaxed);
+}
+
+SimdLevel setSimdLevel(SimdLevel level)
+{
+    if (level > detectSimdLevel())
+        level = detectSimdLevel();
+    selectedKernels().store(&simdKernels(level), std::memory_order_relaxed);
+    return level;
+}
+
+const SimdKernels &simdKernels(SimdLevel level)
+{
+    if (level > detectSimdLevel())
+        level = detectSimdLevel();
+    switch (level)
+    {
+#ifdef SIMD_MATH_X86
+    case SimdLevel::SSE2:
+        return sse2SimdKernels();
+    case SimdLevel::AVX2:
+        return avx2SimdKernels();
+    case SimdLevel::AVX512:
+        return avx512SimdKernels();
+#endif
+    default:
+        return ScalarKernels;
+    }
+}
+
+ThreadSimdLevel::ThreadSimdLevel(SimdLevel level) : previous_(threadKernels)
+{
+    threadKernels = &simdKernels(level);
+}
+
+ThreadSimdLevel::~ThreadSimdLevel()
+{
+    threadKernels = previous_;
+}
+
+const char *simdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::SSE2:
+        return "SSE2";
+    case SimdLevel::AVX2:
+        return "AVX2";
+    case SimdLevel::AVX512:
+        return "AVX-512";
+    default:
+        return "scalar";
+    }
+}
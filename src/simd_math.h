@@ -0,0 +1,92 @@
+/**
+ * @file simd_math.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef SIMD_MATH_H
+#define SIMD_MATH_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Instruction sets the array kernels are built for, from slowest to fastest
+enum class SimdLevel : uint8_t
+{
+    Scalar, // plain std:: libm calls, bit-identical to the scalar nodes
+    SSE2,   // 2 doubles per vector
+    AVX2,   // 4 doubles per vector, needs AVX2 and FMA
+    AVX512  // 8 doubles per vector, needs AVX-512F and AVX-512DQ
+};
+
+// out[i] = f(in[i]) for i < n. out may be the same array as in.
+using UnaryKernel = void (*)(const double *in, double *out, size_t n);
+
+// out[i] = f(x[i], y[i]) for i < n. out may be the same array as x or y.
+using BinaryKernel = void (*)(const double *x, const double *y, double *out, size_t n);
+
+// Array versions of the libm functions used by the expression nodes.
+//
+// The vector kernels follow libm for every special value (NaN, infinities,
+// signed zeros, negative or zero logarithm arguments, overflow and underflow).
+// For finite arguments the largest error measured against a long double
+// reference (bench_simd_math.cpp, two million arguments per function) is:
+//
+//   exp    1.01 ULP    sin, cos  0.83 ULP (|x| > 1e5 is passed to libm)
+//   ln     0.73 ULP    tan       2.19 ULP
+//   log10  1.48 ULP    sinh      2.51 ULP
+//   pow    1.84 ULP    cosh      2.69 ULP
+//                      tanh      2.29 ULP
+//
+// pow passes x <= 0 and non-finite arguments to libm. Because of these errors
+// batch results can differ from Node::evaluate in the last bits; use SimdLevel::Scalar
+// where results have to match the scalar path exactly.
+struct SimdKernels
+{
+    SimdLevel level;
+    UnaryKernel exp;
+    UnaryKernel ln;
+    UnaryKernel log10;
+    UnaryKernel sin;
+    UnaryKernel cos;
+    UnaryKernel tan;
+    UnaryKernel sinh;
+    UnaryKernel cosh;
+    UnaryKernel tanh;
+    BinaryKernel pow;
+};
+
+// Best level the CPU (and the build) supports, detected once
+SimdLevel detectSimdLevel();
+
+// Kernels of the selected level. The detected level is selected at startup.
+const SimdKernels &simdKernels();
+
+// Selects a level; levels the CPU does not support fall back to the best one it does.
+// Returns the level actually selected.
+SimdLevel setSimdLevel(SimdLevel level);
+
+// Kernels of one level, for comparing levels against each other
+const SimdKernels &simdKernels(SimdLevel level);
+
+// Selects a level for the calling thread only, over setSimdLevel, until the
+// scope ends; scopes nest. The parallel functions run each task in one, so
+// that every worker uses the kernels the caller asked for.
+class ThreadSimdLevel
+{
+public:
+    explicit ThreadSimdLevel(SimdLevel level);
+    ~ThreadSimdLevel();
+
+    ThreadSimdLevel(const ThreadSimdLevel &) = delete;
+    ThreadSimdLevel &operator=(const ThreadSimdLevel &) = delete;
+
+private:
+    const SimdKernels *previous_;
+};
+
+const char *simdLevelName(SimdLevel level);
+
+#endif // SIMD_MATH_H
@@ -0,0 +1,50 @@
+/**
+ * @file simd_math_avx512.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "simd_math.h"
+#include <cmath>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+
+// Only the kernels below are built for AVX-512; the standard headers above are not,
+// so no inline library code with AVX-512 instructions can leak into other files.
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512dq,avx2,fma")
+#pragma GCC optimize("fp-contract=off")
+
+namespace simd_avx512
+{
+    typedef double VecD __attribute__((vector_size(64)));
+    typedef int64_t VecI __attribute__((vector_size(64)));
+    constexpr int Lanes = 8;
+
+    static inline bool any(VecI mask)
+    {
+        return _mm512_movepi64_mask((__m512i)mask) != 0;
+    }
+
+    static inline VecD fusedMultiplyAdd(VecD a, VecD b, VecD c)
+    {
+        return _mm512_fmadd_pd(a, b, c);
+    }
+
+#define SIMD_MATH_FMA
+#include "simd_math_kernels.inc"
+#undef SIMD_MATH_FMA
+}
+
+const SimdKernels &avx512SimdKernels()
+{
+    static const SimdKernels kernels = simd_avx512::makeKernels(SimdLevel::AVX512);
+    return kernels;
+}
+
+#pragma GCC pop_options
+
+#endif
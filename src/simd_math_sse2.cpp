@@ -0,0 +1,41 @@
+/**
+ * @file simd_math_sse2.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "simd_math.h"
+#include <cmath>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+
+// SSE2 is part of x86-64, so no target options are needed
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+
+namespace simd_sse2
+{
+    typedef double VecD __attribute__((vector_size(16)));
+    typedef int64_t VecI __attribute__((vector_size(16)));
+    constexpr int Lanes = 2;
+
+    static inline bool any(VecI mask)
+    {
+        return _mm_movemask_pd((__m128d)mask) != 0;
+    }
+
+#include "simd_math_kernels.inc"
+}
+
+const SimdKernels &sse2SimdKernels()
+{
+    static const SimdKernels kernels = simd_sse2::makeKernels(SimdLevel::SSE2);
+    return kernels;
+}
+
+#pragma GCC pop_options
+
+#endif
@@ -0,0 +1,716 @@
+/**
+ * @file static_expression.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * Formulas parsed by the compiler. The parser in this file runs in constant
+ * evaluation and turns the literal into a type built from the templates below,
+ * whose evaluate the optimizer inlines into straight-line code.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef STATIC_EXPRESSION_H
+#define STATIC_EXPRESSION_H
+
+#include "grammar.h"
+#include "opcode.h"
+#include "result.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Every level of a formula is inlined into its parent, whatever its size
+#if defined(__GNUC__)
+#define STATIC_EXPRESSION_INLINE [[gnu::always_inline]] inline
+#else
+#define STATIC_EXPRESSION_INLINE inline
+#endif
+
+namespace static_expression
+{
+    // A string literal usable as a template argument
+    template <size_t N>
+    struct FixedString
+    {
+        char text[N] = {};
+
+        consteval FixedString(const char (&literal)[N])
+        {
+            for (size_t i = 0; i < N; ++i)
+                text[i] = literal[i];
+        }
+
+        constexpr std::string_view view() const { return {text, N - 1}; }
+    };
+
+    // An unsigned integer of up to 4096 bits: room for any decimal literal, scaled
+    // by the powers of 2 and 10 it takes to round it to a double exactly
+    class BigInteger
+    {
+    public:
+        constexpr explicit BigInteger(uint32_t value = 0)
+        {
+            limbs_[0] = value;
+            size_ = value != 0;
+        }
+
+        constexpr bool isZero() const { return size_ == 0; }
+
+        constexpr int bitLength() const
+        {
+            return size_ == 0 ? 0 : int(32 * (size_ - 1) + std::bit_width(limbs_[size_ - 1]));
+        }
+
+        // this = this * factor + addend
+        constexpr void multiplyAdd(uint32_t factor, uint32_t addend)
+        {
+            uint64_t carry = addend;
+            for (size_t i = 0; i < size_; ++i)
+            {
+                uint64_t product = uint64_t(limbs_[i]) * factor + carry;
+                limbs_[i] = uint32_t(product);
+                carry = product >> 32;
+            }
+            if (carry != 0)
+                limbs_[size_++] = uint32_t(carry);
+        }
+
+        constexpr void shiftLeft(int bits)
+        {
+            if (size_ == 0 || bits == 0)
+                return;
+            size_t words = size_t(bits) / 32;
+            int rest = bits % 32;
+            size_t size = size_ + words + 1;
+            for (size_t i = size; i-- > 0;)
+            {
+                uint32_t high = i >= words ? limbs_[i - words] : 0;
+                uint32_t low = i >= words + 1 ? limbs_[i - words - 1] : 0;
+                limbs_[i] = rest == 0 ? high : (high << rest) | (low >> (32 - rest));
+            }
+            size_ = size;
+            trim();
+        }
+
+        constexpr void shiftRightOne()
+        {
+            for (size_t i = 0; i < size_; ++i)
+                limbs_[i] = (limbs_[i] >> 1) | (limbs_[i + 1] << 31);
+            trim();
+        }
+
+        constexpr int compare(const BigInteger &other) const
+        {
+            if (size_ != other.size_)
+                return size_ < other.size_ ? -1 : 1;
+            for (size_t i = size_; i-- > 0;)
+            {
+                if (limbs_[i] != other.limbs_[i])
+                    return limbs_[i] < other.limbs_[i] ? -1 : 1;
+            }
+            return 0;
+        }
+
+        // this -= other, for other <= this
+        constexpr void subtract(const BigInteger &other)
+        {
+            int64_t borrow = 0;
+            for (size_t i = 0; i < size_; ++i)
+            {
+                int64_t difference = int64_t(limbs_[i]) - (i < other.size_ ? other.limbs_[i] : 0) - borrow;
+                borrow = difference < 0;
+                limbs_[i] = uint32_t(difference + (borrow << 32));
+            }
+            trim();
+        }
+
+    private:
+        constexpr void trim()
+        {
+            while (size_ > 0 && limbs_[size_ - 1] == 0)
+                --size_;
+        }
+
+        // Limbs past size_ are always 0, and one more than the values need stays free for the shifts
+        uint32_t limbs_[129] = {};
+        size_t size_ = 0;
+    };
+
+    // Significant digits kept from a literal. Every point halfway between two doubles
+    // has fewer, so the digits after these only decide whether the value is above one.
+    constexpr int MaxDigits = 768;
+
+    constexpr uint32_t PowersOfTen[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+    // Rounds digits * 10^exponent to the nearest double, ties to even, as std::from_chars
+    // does (and strtod beyond the range of double). truncated means nonzero digits were
+    // dropped after digits.
+    constexpr double roundDecimal(BigInteger numerator, int digitCount, int exponent, bool truncated)
+    {
+        if (numerator.isZero())
+            return 0.0;
+
+        // The decimal exponent of the first digit settles the values far out of range
+        int leading = digitCount - 1 + exponent;
+        if (leading > 309)
+            return std::numeric_limits<double>::infinity();
+        if (leading < -325)
+            return 0.0;
+
+        BigInteger denominator(1);
+        BigInteger &scaled = exponent >= 0 ? numerator : denominator;
+        for (int power = exponent >= 0 ? exponent : -exponent; power > 0; power -= 9)
+            scaled.multiplyAdd(PowersOfTen[std::min(power, 9)], 0);
+
+        // Scale so the quotient has 54 or 55 bits: 53 for the double, one to round with,
+        // and possibly one extra
+        int shift = 54 - (numerator.bitLength() - denominator.bitLength());
+        if (shift >= 0)
+            numerator.shiftLeft(shift);
+        else
+            denominator.shiftLeft(-shift);
+
+        denominator.shiftLeft(55);
+        uint64_t quotient = 0;
+        for (int bit = 55; bit >= 0; --bit)
+        {
+            if (numerator.compare(denominator) >= 0)
+            {
+                numerator.subtract(denominator);
+                quotient |= uint64_t(1) << bit;
+            }
+            denominator.shiftRightOne();
+        }
+        bool sticky = truncated || !numerator.isZero();
+        if (quotient >= uint64_t(1) << 54)
+        {
+            sticky = sticky || (quotient & 1) != 0;
+            quotient >>= 1;
+            --shift;
+        }
+
+        // The value is quotient / 2^53 * 2^binaryExponent; below the normal range the
+        // mantissa loses bits, which then take part in the rounding
+        int binaryExponent = 53 - shift;
+        if (binaryExponent < -1022)
+        {
+            int lost = -1022 - binaryExponent;
+            if (lost > 54)
+            {
+                sticky = sticky || quotient != 0;
+                quotient = 0;
+            }
+            else
+            {
+                sticky = sticky || (quotient & ((uint64_t(1) << lost) - 1)) != 0;
+                quotient >>= lost;
+            }
+            binaryExponent = -1022;
+        }
+
+        uint64_t mantissa = quotient >> 1;
+        if ((quotient & 1) != 0 && (sticky || (mantissa & 1) != 0))
+            ++mantissa;
+
+        // The mantissa's leading bit carries into the exponent field, also when rounding
+        // up reaches the next power of 2 or the smallest normal number
+        uint64_t bits = (uint64_t(binaryExponent + 1022) << 52) + mantissa;
+        if (bits >= 0x7FF0000000000000)
+            return std::numeric_limits<double>::infinity();
+        return std::bit_cast<double>(bits);
+    }
+
+    // Reads the number at text[start] as std::from_chars does in Parser::tokenize:
+    // digits with an optional ".", then an exponent if "e" or "E" is followed by
+    // digits, with an optional sign. Returns its length, 0 if there are no digits.
+    constexpr size_t scanNumber(std::string_view text, size_t start, double &value)
+    {
+        BigInteger digits;
+        int kept = 0;
+        int dropped = 0;
+        int fractionDigits = 0;
+        bool truncated = false;
+        bool anyDigit = false;
+        bool point = false;
+
+        size_t i = start;
+        for (; i < text.size(); ++i)
+        {
+            char ch = text[i];
+            if (ch == '.' && !point)
+            {
+                point = true;
+                continue;
+            }
+            if (!grammar::isDigit(ch))
+                break;
+            anyDigit = true;
+            if (point)
+                ++fractionDigits;
+            if (kept == 0 && ch == '0')
+                continue;
+            if (kept < MaxDigits)
+            {
+                digits.multiplyAdd(10, uint32_t(ch - '0'));
+                ++kept;
+            }
+            else
+            {
+                ++dropped;
+                truncated = truncated || ch != '0';
+            }
+        }
+        if (!anyDigit)
+            return 0;
+
+        int exponent = 0;
+        if (i < text.size() && (text[i] == 'e' || text[i] == 'E'))
+        {
+            size_t j = i + 1;
+            bool negative = j < text.size() && text[j] == '-';
+            if (j < text.size() && (text[j] == '+' || text[j] == '-'))
+                ++j;
+            if (j < text.size() && grammar::isDigit(text[j]))
+            {
+                // Far beyond the range of double either way, so it can saturate
+                for (; j < text.size() && grammar::isDigit(text[j]); ++j)
+                    exponent = std::min(exponent * 10 + (text[j] - '0'), 100000);
+                if (negative)
+                    exponent = -exponent;
+                i = j;
+            }
+        }
+
+        value = roundDecimal(digits, kept, exponent - fractionDigits + dropped, truncated);
+        return i - start;
+    }
+
+    // A node of the parsed formula; left is the slot of a variable
+    struct StaticNode
+    {
+        OpCode op = OpCode::Constant;
+        double value = 0.0;
+        uint32_t left = 0;
+        uint32_t right = 0;
+    };
+
+    // Every token adds at most one node, so a formula of Capacity characters fits
+    template <size_t Capacity>
+    struct StaticTree
+    {
+        StaticNode nodes[Capacity] = {};
+        uint32_t size = 0;
+        uint32_t root = 0;
+        size_t valueCount = 0; // one past the highest slot used, as Bytecode::variableCount
+        bool parses = true;
+        ErrorCode error = ErrorCode::UnexpectedToken;
+        size_t position = 0;
+    };
+
+    // Parser's grammar in constant evaluation: the same tokens, precedences and error
+    // positions, with recursion in place of Parser's explicit frames since literals are short
+    template <size_t Capacity, size_t NameCount>
+    class StaticParser
+    {
+    public:
+        constexpr StaticParser(std::string_view source, std::array<std::string_view, NameCount> names)
+            : source_(source), names_(names) {}
+
+        constexpr StaticTree<Capacity> parse()
+        {
+            tokenize();
+            if (tree_.parses)
+                tree_.root = parseExpression(0);
+
+            // A ")" left over means one more closing than opening parenthesis
+            if (tree_.parses && cursor_ != tokenCount_)
+                fail(tokens_[cursor_].kind == TokenKind::RightParen ? ErrorCode::UnbalancedParentheses
+                                                                    : ErrorCode::UnexpectedToken,
+                     tokens_[cursor_].offset);
+            return tree_;
+        }
+
+    private:
+        constexpr void fail(ErrorCode code, size_t position)
+        {
+            if (!tree_.parses)
+                return;
+            tree_.parses = false;
+            tree_.error = code;
+            tree_.position = position;
+        }
+
+        constexpr void tokenize()
+        {
+            size_t i = 0;
+            while (i < source_.size())
+            {
+                char ch = source_[i];
+                uint32_t offset = uint32_t(i);
+                if (grammar::isSpace(ch))
+                {
+                    ++i;
+                    continue;
+                }
+
+                if (grammar::isDigit(ch) || ch == '.')
+                {
+                    double value = 0.0;
+                    size_t length = scanNumber(source_, i, value);
+                    if (length == 0)
+                        return fail(ErrorCode::InvalidNumber, i);
+                    tokens_[tokenCount_++] = {TokenKind::Number, offset, uint32_t(length), value};
+                    i += length;
+                    continue;
+                }
+
+                if (grammar::isLetter(ch))
+                {
+                    size_t j = i + 1;
+                    while (j < source_.size() && (grammar::isLetter(source_[j]) || grammar::isDigit(source_[j])))
+                        ++j;
+                    TokenKind kind = TokenKind::Identifier;
+                    if (!grammar::lookupKeyword(source_.substr(i, j - i), kind))
+                        kind = TokenKind::Identifier;
+                    tokens_[tokenCount_++] = {kind, offset, uint32_t(j - i), 0.0};
+                    i = j;
+                    continue;
+                }
+
+                TokenKind kind = TokenKind::Number;
+                if (!grammar::lookupSymbol(ch, kind))
+                    return fail(ErrorCode::UnknownCharacter, i);
+                tokens_[tokenCount_++] = {kind, offset, 1, 0.0};
+                ++i;
+            }
+        }
+
+        constexpr uint32_t add(StaticNode node)
+        {
+            if (!tree_.parses)
+                return 0;
+            tree_.nodes[tree_.size] = node;
+            return tree_.size++;
+        }
+
+        constexpr uint32_t parseExpression(int minPrecedence)
+        {
+            uint32_t value = parsePrefix();
+            while (tree_.parses && cursor_ != tokenCount_)
+            {
+                TokenKind kind = tokens_[cursor_].kind;
+                if (kind == TokenKind::Bang)
+                {
+                    if (grammar::FactorialPrecedence < minPrecedence)
+                        break;
+                    ++cursor_;
+                    value = add({OpCode::Factorial, 0.0, value, 0});
+                    continue;
+                }
+
+                int precedence = grammar::binaryPrecedence(kind);
+                if (precedence == 0 || precedence < minPrecedence)
+                    break;
+                ++cursor_;
+
+                // "^" is right associative, the others are left associative
+                uint32_t right = parseExpression(kind == TokenKind::Caret ? precedence : precedence + 1);
+                value = add({grammar::binaryOpcode(kind), 0.0, value, right});
+            }
+            return value;
+        }
+
+        // The operand of a call or group, up to and including its ")"
+        constexpr uint32_t parseGroup()
+        {
+            uint32_t value = parseExpression(0);
+            if (!tree_.parses)
+                return 0;
+            if (cursor_ == tokenCount_)
+                fail(ErrorCode::UnbalancedParentheses, source_.size());
+            else if (tokens_[cursor_].kind != TokenKind::RightParen)
+                fail(ErrorCode::UnexpectedToken, tokens_[cursor_].offset);
+            ++cursor_;
+            return value;
+        }
+
+        constexpr uint32_t parsePrefix()
+        {
+            if (cursor_ == tokenCount_)
+            {
+                fail(ErrorCode::MissingOperand, source_.size());
+                return 0;
+            }
+
+            const Token token = tokens_[cursor_++];
+            switch (token.kind)
+            {
+            case TokenKind::Number:
+                return add({OpCode::Constant, token.value, 0, 0});
+
+            case TokenKind::Identifier:
+            {
+                std::string_view name = source_.substr(token.offset, token.length);
+                for (size_t slot = 0; slot < NameCount; ++slot)
+                {
+                    if (names_[slot] == name)
+                    {
+                        tree_.valueCount = std::max(tree_.valueCount, slot + 1);
+                        return add({OpCode::Variable, 0.0, uint32_t(slot), 0});
+                    }
+                }
+                fail(ErrorCode::UnknownVariable, token.offset);
+                return 0;
+            }
+
+            case TokenKind::LeftParen:
+                return parseGroup();
+
+            case TokenKind::Minus:
+            {
+                // A literal directly after the sign is a negative number, unless "^" or "!" binds to it first
+                if (cursor_ != tokenCount_ && tokens_[cursor_].kind == TokenKind::Number &&
+                    (cursor_ + 1 == tokenCount_ || (tokens_[cursor_ + 1].kind != TokenKind::Caret &&
+                                                    tokens_[cursor_ + 1].kind != TokenKind::Bang)))
+                {
+                    return add({OpCode::Constant, -tokens_[cursor_++].value, 0, 0});
+                }
+                uint32_t operand = parseExpression(grammar::UnaryPrecedence);
+                return add({OpCode::Negate, 0.0, operand, 0});
+            }
+
+            default:
+                if (!grammar::isFunction(token.kind))
+                {
+                    fail(ErrorCode::UnexpectedToken, token.offset);
+                    return 0;
+                }
+                break;
+            }
+
+            OpCode op = grammar::functionOpcode(token.kind);
+            bool parenthesis = cursor_ != tokenCount_ && tokens_[cursor_].kind == TokenKind::LeftParen;
+            if (grammar::needsParenthesis(token.kind) && !parenthesis)
+            {
+                fail(ErrorCode::MissingFunctionParenthesis, token.offset + token.length);
+                return 0;
+            }
+
+            // ln, log and sqrt also accept a bare operand, e.g. "sqrt 144"
+            if (cursor_ == tokenCount_)
+            {
+                fail(ErrorCode::MissingOperand, source_.size());
+                return 0;
+            }
+            uint32_t operand;
+            if (parenthesis)
+            {
+                ++cursor_;
+                operand = parseGroup();
+            }
+            else
+            {
+                operand = parseExpression(grammar::UnaryPrecedence);
+            }
+            return add({op, 0.0, operand, 0});
+        }
+
+        std::string_view source_;
+        std::array<std::string_view, NameCount> names_;
+        Token tokens_[Capacity] = {};
+        size_t tokenCount_ = 0;
+        size_t cursor_ = 0;
+        StaticTree<Capacity> tree_;
+    };
+
+    template <FixedString Source, FixedString... Names>
+    struct Parsed
+    {
+        static constexpr auto tree =
+            StaticParser<std::max<size_t>(Source.view().size(), 1), sizeof...(Names)>(Source.view(), {Names.view()...})
+                .parse();
+    };
+
+    // The compiler prints the template arguments of a failed assertion, so this
+    // shows the ErrorCode and position of a formula that does not parse
+    template <bool Parses, ErrorCode Error, size_t Position>
+    constexpr bool FormulaParses = Parses;
+
+    // The nodes of a formula as types. Each evaluate computes exactly what the
+    // matching Node class in expression_tree.h computes, in the same order.
+    template <double Value>
+    struct Constant
+    {
+        STATIC_EXPRESSION_INLINE static double evaluate(const double *) { return Value; }
+    };
+
+    template <uint32_t Slot>
+    struct Variable
+    {
+        STATIC_EXPRESSION_INLINE static double evaluate(const double *values) { return values[Slot]; }
+    };
+
+    template <OpCode Op, typename Operand>
+    struct Unary
+    {
+        STATIC_EXPRESSION_INLINE static double evaluate(const double *values)
+        {
+            double value = Operand::evaluate(values);
+            if constexpr (Op == OpCode::Negate)
+                return -value;
+            else if constexpr (Op == OpCode::Sin)
+                return std::sin(value);
+            else if constexpr (Op == OpCode::Cos)
+                return std::cos(value);
+            else if constexpr (Op == OpCode::Tan)
+                return std::tan(value);
+            else if constexpr (Op == OpCode::Cot)
+            {
+                double tanValue = std::tan(value);
+                if (tanValue == 0.0)
+                    failOperation(Op);
+                return 1.0 / tanValue;
+            }
+            else if constexpr (Op == OpCode::Ln)
+                return std::log(value);
+            else if constexpr (Op == OpCode::Log)
+                return std::log10(value);
+            else if constexpr (Op == OpCode::Sqrt)
+            {
+                if (value < 0.0)
+                    failOperation(Op);
+                return std::sqrt(value);
+            }
+            else if constexpr (Op == OpCode::Sinh)
+                return std::sinh(value);
+            else if constexpr (Op == OpCode::Cosh)
+                return std::cosh(value);
+            else if constexpr (Op == OpCode::Tanh)
+                return std::tanh(value);
+            else if constexpr (Op == OpCode::Coth)
+            {
+                double tanhVal = std::tanh(value);
+                return tanhVal != 0 ? 1 / tanhVal : HUGE_VAL;
+            }
+            else if constexpr (Op == OpCode::Sech)
+                return 1 / std::cosh(value);
+            else if constexpr (Op == OpCode::Csch)
+            {
+                double sinhVal = std::sinh(value);
+                return sinhVal != 0 ? 1 / sinhVal : HUGE_VAL;
+            }
+            else // OpCode::Factorial
+                return factorialValue(value);
+        }
+    };
+
+    template <OpCode Op, typename Left, typename Right>
+    struct Binary
+    {
+        STATIC_EXPRESSION_INLINE static double evaluate(const double *values)
+        {
+            // Left operand first, as every other path, so the first error reported is the same
+            double left = Left::evaluate(values);
+            double right = Right::evaluate(values);
+            if constexpr (Op == OpCode::Add)
+                return left + right;
+            else if constexpr (Op == OpCode::Subtract)
+                return left - right;
+            else if constexpr (Op == OpCode::Multiply)
+                return left * right;
+            else if constexpr (Op == OpCode::Divide)
+            {
+                if (right == 0.0)
+                    failOperation(Op);
+                return left / right;
+            }
+            else // OpCode::Power
+                return std::pow(left, right);
+        }
+    };
+
+    template <typename Parsed, uint32_t Index>
+    consteval auto makeNode()
+    {
+        constexpr StaticNode node = Parsed::tree.nodes[Index];
+        if constexpr (!Parsed::tree.parses || node.op == OpCode::Constant)
+            return Constant<node.value>{};
+        else if constexpr (node.op == OpCode::Variable)
+            return Variable<node.left>{};
+        else if constexpr (opcodeArity(node.op) == 1)
+            return Unary<node.op, decltype(makeNode<Parsed, node.left>())>{};
+        else
+            return Binary<node.op, decltype(makeNode<Parsed, node.left>()), decltype(makeNode<Parsed, node.right>())>{};
+    }
+}
+
+// A formula parsed at compile time:
+//
+//     constexpr StaticExpression<"sin(x) * x^2", "x"> f;
+//     double y = f(0.5);
+//
+// Variables bind by position, as in Parser::parse. A formula Parser would reject
+// does not compile; the error names its ErrorCode and position. The results and
+// errors are those of Parser::parse(source, names)->evaluate(values), as long as
+// the including file does not fuse multiplies and adds (-ffp-contract=fast).
+template <static_expression::FixedString Source, static_expression::FixedString... Names>
+class StaticExpression
+{
+    using Parsed = static_expression::Parsed<Source, Names...>;
+    static_assert(static_expression::FormulaParses<Parsed::tree.parses, Parsed::tree.error, Parsed::tree.position>,
+                  "The formula does not parse");
+
+public:
+    // The formula as nested static_expression::Constant, Variable, Unary and Binary types
+    using Tree = decltype(static_expression::makeNode<Parsed, Parsed::tree.root>());
+
+    static constexpr std::string_view source() { return Source.view(); }
+    static constexpr size_t nodeCount() { return Parsed::tree.size; }
+
+    // Number of values evaluate needs: one past the highest slot used
+    static constexpr size_t variableCount() { return Parsed::tree.valueCount; }
+
+    STATIC_EXPRESSION_INLINE static double evaluate(std::span<const double> values = {})
+    {
+        if (values.size() < variableCount())
+        {
+            throw std::out_of_range("Expected " + std::to_string(variableCount()) + " variable values, got " +
+                                    std::to_string(values.size()));
+        }
+        return Tree::evaluate(values.data());
+    }
+
+    static Result<double> tryEvaluate(std::span<const double> values = {})
+    {
+        try
+        {
+            return evaluate(values);
+        }
+        catch (const ExpressionError &error)
+        {
+            return error.error();
+        }
+    }
+
+    // f(x, y) evaluates with one value per name
+    template <typename... Values>
+        requires(sizeof...(Values) == sizeof...(Names))
+    STATIC_EXPRESSION_INLINE double operator()(Values... values) const
+    {
+        const std::array<double, sizeof...(Values)> array = {double(values)...};
+        return Tree::evaluate(array.data());
+    }
+};
+
+#undef STATIC_EXPRESSION_INLINE
+
+#endif // STATIC_EXPRESSION_H
@@ -6,8 +6,31 @@
  *
  */
 
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
+#include <optional>
+#include <sstream>
+#include <vector>
+#include "bytecode.h"
+#include "derivative.h"
+#include "expression_cache.h"
+#include "expression_library.h"
+#include "gradient.h"
+#include "incremental.h"
+#include "math_module.h"
+#include "matrix.h"
+#include "multi_expression.h"
+#include "native_expression.h"
+#include "optimizer.h"
+#include "parallel_evaluation.h"
 #include "parser.h"
+#include "sampler.h"
+#include "simd_math.h"
+#include "static_expression.h"
 
 int main()
 {
@@ -36,6 +59,12 @@ int main()
     std::string sechExpression = "sech(1)";
     std::string cschExpression = "csch(1)";
     std::string factorialExpression = "5!";
+    std::string scientificExpression = "1e-5 * 2.5E2";
+    std::string precedence = "2 + 3 * 4";
+    std::string leftAssociative = "10 - 4 - 3";
+    std::string rightAssociative = "2^3^2";
+    std::string unaryMinus = "-2^2 + -(1 + 2) * 3!";
+    std::string variables = "x^2 + rate * t0 - sin(x)";
 
     NodePtr root = parser.parse(expression);
     NodePtr root2 = parser.parse(subtraction);
@@ -61,6 +90,16 @@ int main()
     NodePtr sechRoot = parser.parse(sechExpression);
     NodePtr cschRoot = parser.parse(cschExpression);
     NodePtr factorialRoot = parser.parse(factorialExpression);
+    NodePtr scientificRoot = parser.parse(scientificExpression);
+    NodePtr precedenceRoot = parser.parse(precedence);
+    NodePtr leftAssociativeRoot = parser.parse(leftAssociative);
+    NodePtr rightAssociativeRoot = parser.parse(rightAssociative);
+    NodePtr unaryMinusRoot = parser.parse(unaryMinus);
+    FlatExpression flatParentheses = parser.parseFlat(parentheses2);
+    std::vector<std::string> variableNames = {"x", "rate", "t0"};
+    std::vector<double> variableValues = {3.0, 2.0, 5.0};
+    NodePtr variablesRoot = parser.parse(variables, variableNames);
+    CompiledExpression compiledVariables = parser.compile(variables, variableNames);
 
     double result = root->evaluate();
     double result2 = root2->evaluate();
@@ -98,6 +137,1314 @@ int main()
     std::cout << sechExpression << " = " << sechRoot->evaluate() << std::endl;
     std::cout << cschExpression << " = " << cschRoot->evaluate() << std::endl;
     std::cout << factorialExpression << " = " << factorialResult << std::endl;
+    std::cout << scientificExpression << " = " << scientificRoot->evaluate() << std::endl;
+    std::cout << precedence << " = " << precedenceRoot->evaluate() << std::endl;
+    std::cout << leftAssociative << " = " << leftAssociativeRoot->evaluate() << std::endl;
+    std::cout << rightAssociative << " = " << rightAssociativeRoot->evaluate() << std::endl;
+    std::cout << unaryMinus << " = " << unaryMinusRoot->evaluate() << std::endl;
+    std::cout << parentheses2 << " (flat) = " << flatParentheses.evaluate() << std::endl;
+    std::cout << variables << " = " << variablesRoot->evaluate(variableValues) << " (x = 3, rate = 2, t0 = 5)" << std::endl;
+    std::cout << variables << " (compiled) = " << compiledVariables.evaluate(variableValues) << std::endl;
 
-    return 0;
+    // The bytecode VM must give exactly the tree walker's result for every expression above
+    std::vector<std::string> allExpressions = {
+        expression, subtraction, multiplication, divide, parentheses, parentheses2, power, negative,
+        sinExpression, cosExpression, tanExpression, cotExpression, naturalLog, logBase10, sqrtExpression,
+        powerReal, powerNegativeReal, sinhExpression, coshExpression, tanhExpression, cothExpression,
+        sechExpression, cschExpression, factorialExpression, scientificExpression, precedence,
+        leftAssociative, rightAssociative, unaryMinus};
+    int mismatches = 0;
+    for (const auto &source : allExpressions)
+    {
+        NodePtr tree = parser.parse(source);
+        double expected = tree->evaluate();
+        if (Bytecode::compile(tree).evaluate() != expected || Bytecode::compile(parser.parseFlat(source)).evaluate() != expected)
+        {
+            std::cout << "Bytecode mismatch: " << source << std::endl;
+            ++mismatches;
+        }
+    }
+
+    // A plain std::vector is read as the variables, not taken as scratch and overwritten
+    std::vector<double> flatValues = variableValues;
+    if (parser.parseFlat(variables, variableNames).evaluate(flatValues) != variablesRoot->evaluate(variableValues) ||
+        flatValues != variableValues)
+        ++mismatches;
+    try
+    {
+        FlatExpression().evaluate();
+        ++mismatches;
+    }
+    catch (const std::logic_error &)
+    {
+        // An empty expression has no result node to read
+    }
+    std::cout << "Bytecode mismatches: " << mismatches << std::endl;
+
+    // Batch evaluation must match row-by-row evaluation, including across chunk
+    // boundaries, when it uses the same libm functions
+    // setSimdLevel returns the level it selects, so the detected one is kept first
+    SimdLevel simdLevel = simdKernels().level;
+    setSimdLevel(SimdLevel::Scalar);
+    std::vector<double> xs(2500), rates(2500), t0s(2500);
+    for (size_t row = 0; row < xs.size(); ++row)
+    {
+        xs[row] = row * 0.01;
+        rates[row] = 2.0 - row * 0.001;
+        t0s[row] = 5.0;
+    }
+    const double *columns[] = {xs.data(), rates.data(), t0s.data()};
+    std::vector<double> treeBatch(xs.size()), compiledBatch(xs.size());
+    variablesRoot->evaluateBatch(columns, xs.size(), treeBatch.data());
+    compiledVariables.evaluateBatch(columns, xs.size(), compiledBatch.data());
+    int batchMismatches = 0;
+    for (size_t row = 0; row < xs.size(); ++row)
+    {
+        double values[] = {xs[row], rates[row], t0s[row]};
+        double expected = variablesRoot->evaluate(values);
+        if (treeBatch[row] != expected || compiledBatch[row] != expected)
+            ++batchMismatches;
+    }
+    std::cout << "Batch mismatches: " << batchMismatches << std::endl;
+    mismatches += batchMismatches;
+
+    // Parallel evaluation gives the same bits as the single-threaded paths, with
+    // the rows split into pieces that do not line up with the batch chunks
+    ThreadPool pool(4);
+    int parallelMismatches = 0;
+    for (SimdLevel level : {SimdLevel::Scalar, simdLevel})
+    {
+        setSimdLevel(level);
+        variablesRoot->evaluateBatch(columns, xs.size(), treeBatch.data());
+        std::vector<double> treeParallel(xs.size()), compiledParallel(xs.size());
+        evaluateBatchParallel(pool, *variablesRoot, columns, xs.size(), treeParallel.data(), 300, ErrorMode::Report, level);
+        evaluateBatchParallel(pool, compiledVariables, columns, xs.size(), compiledParallel.data(), 300,
+                              ErrorMode::Report, level);
+        for (size_t row = 0; row < xs.size(); ++row)
+        {
+            if (treeParallel[row] != treeBatch[row] || compiledParallel[row] != treeBatch[row])
+                ++parallelMismatches;
+        }
+    }
+
+    // At the default settings, with the detected kernels selected, the parallel
+    // results are still the bits of row-by-row evaluate()
+    {
+        std::vector<double> treeParallel(xs.size()), compiledParallel(xs.size());
+        evaluateBatchParallel(pool, *variablesRoot, columns, xs.size(), treeParallel.data());
+        evaluateBatchParallel(pool, compiledVariables, columns, xs.size(), compiledParallel.data());
+        for (size_t row = 0; row < xs.size(); ++row)
+        {
+            double values[] = {xs[row], rates[row], t0s[row]};
+            double expected = variablesRoot->evaluate(values);
+            if (treeParallel[row] != expected || compiledParallel[row] != expected)
+                ++parallelMismatches;
+        }
+        if (simdKernels().level != simdLevel)
+            ++parallelMismatches;
+    }
+    std::vector<NodePtr> sameTree(200, variablesRoot);
+    std::vector<double> eachResults(sameTree.size());
+    evaluateEachParallel(pool, sameTree, variableValues, eachResults.data(), 7);
+    for (double result : eachResults)
+    {
+        if (result != variablesRoot->evaluate(variableValues))
+            ++parallelMismatches;
+    }
+    try
+    {
+        evaluateBatchParallel(pool, *parser.parse("(20 - x)!", variableNames), columns, xs.size(), treeBatch.data(), 300);
+        ++parallelMismatches;
+    }
+    catch (const std::runtime_error &)
+    {
+        // The negative factorials of the rows with x > 20 reach the caller
+    }
+    std::cout << "Parallel mismatches: " << parallelMismatches << std::endl;
+    mismatches += parallelMismatches;
+
+    // The SIMD kernels stay within a few ULP of libm and agree with it on special
+    // values, down to the sign of a zero
+    std::vector<double> arguments = {0.0, -0.0, 1.0, -1.0, 0.5, 1e-310, 1e-20, 3.0, 100.0, 709.0, 711.0, -746.0,
+                                     1e6, INFINITY, -INFINITY, NAN};
+    for (int i = 0; i < 1000; ++i)
+        arguments.push_back((i - 500) * 0.0173);
+    std::vector<double> exponents(arguments.size(), 2.5), results(arguments.size());
+    int simdMismatches = 0;
+    for (int level = 1; level <= static_cast<int>(detectSimdLevel()); ++level)
+    {
+        const SimdKernels &kernels = simdKernels(static_cast<SimdLevel>(level));
+        const SimdKernels &reference = simdKernels(SimdLevel::Scalar);
+        for (auto function : {&SimdKernels::exp, &SimdKernels::ln, &SimdKernels::log10, &SimdKernels::sin,
+                              &SimdKernels::cos, &SimdKernels::tan, &SimdKernels::sinh, &SimdKernels::cosh,
+                              &SimdKernels::tanh, static_cast<UnaryKernel SimdKernels::*>(nullptr)})
+        {
+            std::vector<double> expected(arguments.size());
+            if (function != nullptr)
+            {
+                (kernels.*function)(arguments.data(), results.data(), arguments.size());
+                (reference.*function)(arguments.data(), expected.data(), arguments.size());
+            }
+            else
+            {
+                kernels.pow(arguments.data(), exponents.data(), results.data(), arguments.size());
+                reference.pow(arguments.data(), exponents.data(), expected.data(), arguments.size());
+            }
+            for (size_t i = 0; i < arguments.size(); ++i)
+            {
+                double tolerance = 4 * (std::nextafter(std::fabs(expected[i]), INFINITY) - std::fabs(expected[i]));
+                bool same = std::isnan(expected[i]) ? std::isnan(results[i])
+                                                    : std::signbit(results[i]) == std::signbit(expected[i]) &&
+                                                          (results[i] == expected[i] ||
+                                                           std::fabs(results[i] - expected[i]) <= tolerance);
+                if (!same)
+                {
+                    std::cout << "SIMD mismatch (" << simdLevelName(kernels.level) << "): " << arguments[i] << " gives "
+                              << results[i] << " instead of " << expected[i] << std::endl;
+                    ++simdMismatches;
+                }
+            }
+        }
+    }
+    std::cout << "SIMD mismatches: " << simdMismatches << std::endl;
+    mismatches += simdMismatches;
+
+    // The optimizer folds constant subtrees; without fast math the rewritten trees
+    // give the same bits as the parsed ones
+    int optimizerMismatches = 0;
+    OptimizeStats stats;
+    NodePtr folded = optimize(parser.parse("sqrt(144) * x", variableNames), {}, &stats);
+    if (stats.nodesBefore != 4 || stats.nodesAfter != 3 || folded->evaluate(variableValues) != 36.0)
+        ++optimizerMismatches;
+    for (const auto &source : allExpressions)
+    {
+        NodePtr tree = parser.parse(source);
+        NodePtr optimized = optimize(tree);
+        if (countNodes(optimized) != 1 || optimized->evaluate() != tree->evaluate())
+        {
+            std::cout << "Optimizer mismatch: " << source << std::endl;
+            ++optimizerMismatches;
+        }
+    }
+    std::vector<std::string> exactRewrites = {"x * 1 - 0 + rate / 4", "-(-x) * (2 + 3!) / -1", "x^1 + rate^0 - t0 / 0.5",
+                                              "1 * x + -0 - 2^-1 * rate", "sin(x) / 1 + cot(2) * ln(rate)"};
+    std::vector<std::string> fastRewrites = {"x^2 + x^3 - rate^4", "(x * 3) * 7 + 0", "(x + 0.1) + 0.2 - x / 3",
+                                             "0 - rate * 0 + x"};
+    for (bool fastMath : {false, true})
+    {
+        for (const auto &source : fastMath ? fastRewrites : exactRewrites)
+        {
+            NodePtr tree = parser.parse(source, variableNames);
+            NodePtr optimized = optimize(tree, {fastMath});
+            for (size_t row = 0; row < xs.size(); row += 7)
+            {
+                double values[] = {xs[row], rates[row], t0s[row]};
+                double expected = tree->evaluate(values);
+                double actual = optimized->evaluate(values);
+                bool same = std::isnan(expected) ? std::isnan(actual)
+                            : fastMath       ? std::fabs(actual - expected) <= 1e-12 * (1 + std::fabs(expected))
+                                             : actual == expected;
+                if (!same)
+                {
+                    std::cout << "Optimizer mismatch: " << source << " at x = " << xs[row] << std::endl;
+                    ++optimizerMismatches;
+                    break;
+                }
+            }
+        }
+    }
+    std::cout << "Optimizer mismatches: " << optimizerMismatches << std::endl;
+    mismatches += optimizerMismatches;
+
+    // Repeated subexpressions are parsed into shared nodes and computed once by
+    // compiled programs, with the same results as the unshared expression
+    int sharingMismatches = 0;
+    std::string repeated = "sin(x * rate) + cos(x * rate) * sin(x * rate)";
+    CompiledExpression shared = parser.compile(repeated, variableNames);
+    InternStats internStats = parser.internStats();
+    FlatExpression sharedFlat = parser.parseFlat(repeated, variableNames);
+    parser.setInterning(false);
+    NodePtr unshared = parser.parse(repeated, variableNames);
+    parser.setInterning(true);
+    if (internStats.nodes != 14 || internStats.duplicateHits != 7 || sharedFlat.size() != 7 ||
+        shared.program().localCount() != 2)
+        ++sharingMismatches;
+    for (size_t row = 0; row < xs.size(); row += 7)
+    {
+        double values[] = {xs[row], rates[row], t0s[row]};
+        double expected = unshared->evaluate(values);
+        if (shared.evaluate(values) != expected || sharedFlat.evaluate(values) != expected ||
+            Bytecode::compile(optimize(parser.parse(repeated, variableNames))).evaluate(values) != expected)
+            ++sharingMismatches;
+    }
+    std::vector<double> sharedBatch(xs.size());
+    setSimdLevel(SimdLevel::Scalar);
+    shared.evaluateBatch(columns, xs.size(), sharedBatch.data());
+    unshared->evaluateBatch(columns, xs.size(), treeBatch.data());
+    setSimdLevel(simdLevel);
+    if (sharedBatch != treeBatch)
+        ++sharingMismatches;
+    std::cout << "Sharing mismatches: " << sharingMismatches << std::endl;
+    mismatches += sharingMismatches;
+
+    // The cache shares entries between spellings that differ only in whitespace,
+    // drops the least recently used entry and can be used from several threads
+    int cacheMismatches = 0;
+    ExpressionCache smallCache({.maxEntries = 2, .shards = 1});
+    auto first = smallCache.get("x * 2", variableNames);
+    if (smallCache.get(" x*2 ", variableNames) != first)
+        ++cacheMismatches;
+    smallCache.get("x + 1", variableNames);
+    smallCache.get("x - 1", variableNames);
+    if (smallCache.get("x * 2", variableNames) == first || first->compiled.evaluate(variableValues) != 6.0)
+        ++cacheMismatches;
+    ExpressionCacheStats cacheStats = smallCache.stats();
+    if (cacheStats.hits != 1 || cacheStats.misses != 4 || cacheStats.evictions != 2 || cacheStats.entries != 2)
+        ++cacheMismatches;
+    if (ExpressionCache::normalize(" sin ( x ) * 2 3") != "sin(x)*2 3" || ExpressionCache::normalize("1e -5") != "1e -5")
+        ++cacheMismatches;
+
+    ExpressionCache cache;
+    std::vector<std::string> formulas;
+    for (int i = 0; i < 50; ++i)
+        formulas.push_back("sin(x * " + std::to_string(i) + ") + rate ^ 2 - t0 / " + std::to_string(i + 1));
+    std::vector<double> expectedValues;
+    for (const auto &formula : formulas)
+        expectedValues.push_back(parser.parse(formula, variableNames)->evaluate(variableValues));
+    std::atomic<int> concurrentMismatches{0};
+    pool.parallelFor(4000, 10, [&](size_t begin, size_t end)
+                     {
+                         for (size_t i = begin; i < end; ++i)
+                         {
+                             auto entry = cache.get(formulas[i % formulas.size()], variableNames);
+                             if (entry->compiled.evaluate(variableValues) != expectedValues[i % formulas.size()] ||
+                                 entry->tree->evaluate(variableValues) != expectedValues[i % formulas.size()])
+                                 ++concurrentMismatches;
+                         }
+                     });
+    cacheStats = cache.stats();
+    if (cacheStats.hits + cacheStats.misses != 4000 || cacheStats.entries != formulas.size())
+        ++cacheMismatches;
+    cacheMismatches += concurrentMismatches;
+    std::cout << "Cache mismatches: " << cacheMismatches << std::endl;
+    mismatches += cacheMismatches;
+
+    // Bad input comes back as an Error with its code and position instead of ending the process
+    int errorMismatches = 0;
+    struct ParseErrorCase
+    {
+        std::string source;
+        ErrorCode code;
+        size_t position;
+    };
+    std::vector<ParseErrorCase> parseErrors = {{"2 + * 3", ErrorCode::UnexpectedToken, 4},
+                                               {"x + y", ErrorCode::UnknownVariable, 4},
+                                               {"(1 + 2", ErrorCode::UnbalancedParentheses, 6},
+                                               {"1 + 2)", ErrorCode::UnbalancedParentheses, 5},
+                                               {"2 $ 3", ErrorCode::UnknownCharacter, 2},
+                                               {"2 *", ErrorCode::MissingOperand, 3},
+                                               {"1 + sin x", ErrorCode::MissingFunctionParenthesis, 7}};
+    for (const auto &parseError : parseErrors)
+    {
+        Result<NodePtr> parsed = parser.tryParse(parseError.source, {"x"});
+        Result<CompiledExpression> compiled = parser.tryCompile(parseError.source, {"x"});
+        if (parsed || compiled || parsed.error().code != parseError.code ||
+            parsed.error().position != parseError.position || compiled.error().code != parseError.code)
+            ++errorMismatches;
+    }
+    try
+    {
+        parser.parse("2 $ 3");
+        ++errorMismatches;
+    }
+    catch (const ExpressionError &error)
+    {
+        if (error.error().code != ErrorCode::UnknownCharacter || std::string(error.what()) != "Unknown character at position 2")
+            ++errorMismatches;
+    }
+    if (!parser.tryParse("1 + x", {"x"}) || parser.tryParse("1 + x", {"x"}).value()->evaluate({{2.0}}) != 3.0)
+        ++errorMismatches;
+
+    std::vector<std::pair<std::string, ErrorCode>> evaluationErrors = {{"1 / (x - 2)", ErrorCode::DivisionByZero},
+                                                                       {"sqrt(x - 3)", ErrorCode::NegativeSquareRoot},
+                                                                       {"cot(x - 2)", ErrorCode::CotangentOfZeroTangent},
+                                                                       {"(x - 5)!", ErrorCode::NegativeFactorial}};
+    std::vector<double> errorInput = {2.0};
+    for (const auto &[source, code] : evaluationErrors)
+    {
+        Result<double> treeResult = parser.parse(source, {"x"})->tryEvaluate(errorInput);
+        Result<double> compiledResult = parser.compile(source, {"x"}).tryEvaluate(errorInput);
+        if (treeResult || compiledResult || treeResult.error().code != code || compiledResult.error().code != code ||
+            treeResult.error().position != Error::NoPosition)
+            ++errorMismatches;
+        if (parser.compile(source, {"x"}).tryEvaluate({{8.5}}).valueOr(NAN) != parser.parse(source, {"x"})->evaluate({{8.5}}))
+            ++errorMismatches;
+    }
+
+    // Every path evaluates the left operand of a binary operation first, so when
+    // both operands fail they all report the left one's error
+    auto errorCode = [](auto evaluate) -> std::optional<ErrorCode>
+    {
+        try
+        {
+            evaluate();
+            return std::nullopt;
+        }
+        catch (const ExpressionError &error)
+        {
+            return error.error().code;
+        }
+    };
+    std::vector<std::pair<std::string, ErrorCode>> orderErrors = {{"sqrt(x) / (x + 1)", ErrorCode::NegativeSquareRoot},
+                                                                  {"1 / (x + 1) + sqrt(x)", ErrorCode::DivisionByZero},
+                                                                  {"sqrt(x) * cot(x + 1)", ErrorCode::NegativeSquareRoot},
+                                                                  {"(x - 1)! ^ sqrt(x)", ErrorCode::NegativeFactorial}};
+    double minusOne = -1.0;
+    const double *minusOneColumn = &minusOne;
+    for (const auto &[source, code] : orderErrors)
+    {
+        NodePtr tree = parser.parse(source, {"x"});
+        CompiledExpression compiled = parser.compile(source, {"x"});
+        FlatExpression flat = parser.parseFlat(source, {"x"});
+        double out;
+        for (std::optional<ErrorCode> actual :
+             {errorCode([&] { tree->evaluate({&minusOne, 1}); }), errorCode([&] { compiled.evaluate({&minusOne, 1}); }),
+              errorCode([&] { flat.evaluate({&minusOne, 1}); }),
+              errorCode([&] { NativeExpression(compiled).evaluate({&minusOne, 1}); }),
+              errorCode([&] { tree->evaluateBatch(&minusOneColumn, 1, &out); }),
+              errorCode([&] { compiled.evaluateBatch(&minusOneColumn, 1, &out); }),
+              errorCode([&] { IncrementalExpression(flat, {&minusOne, 1}).value(); })})
+        {
+            if (actual != code)
+                ++errorMismatches;
+        }
+    }
+    if (StaticExpression<"sqrt(x) / (x + 1)", "x">::tryEvaluate({&minusOne, 1}).error().code != ErrorCode::NegativeSquareRoot ||
+        StaticExpression<"1 / (x + 1) + sqrt(x)", "x">::tryEvaluate({&minusOne, 1}).error().code != ErrorCode::DivisionByZero)
+        ++errorMismatches;
+
+    // Propagate mode gives the bad rows inf or NaN and leaves the others alone
+    std::vector<double> errorColumn = {1.0, 2.0, 3.0, -4.0};
+    const double *errorColumns[] = {errorColumn.data()};
+    std::vector<double> propagated(errorColumn.size());
+    for (const auto &[source, code] : evaluationErrors)
+    {
+        NodePtr tree = parser.parse(source, {"x"});
+        CompiledExpression compiled = parser.compile(source, {"x"});
+        std::vector<double> compiledPropagated(errorColumn.size());
+        tree->evaluateBatch(errorColumns, errorColumn.size(), propagated.data(), ErrorMode::Propagate);
+        compiled.evaluateBatch(errorColumns, errorColumn.size(), compiledPropagated.data(), ErrorMode::Propagate);
+        for (size_t row = 0; row < errorColumn.size(); ++row)
+        {
+            Result<double> expected = tree->tryEvaluate({&errorColumn[row], 1});
+            bool bad = !std::isfinite(propagated[row]);
+            if (bad == expected.ok() || (expected && std::abs(propagated[row] - *expected) > 1e-12) ||
+                std::isnan(compiledPropagated[row]) != std::isnan(propagated[row]))
+                ++errorMismatches;
+        }
+        try
+        {
+            compiled.evaluateBatch(errorColumns, errorColumn.size(), propagated.data());
+            ++errorMismatches;
+        }
+        catch (const ExpressionError &error)
+        {
+            if (error.error().code != code)
+                ++errorMismatches;
+        }
+    }
+    std::cout << "Error mismatches: " << errorMismatches << std::endl;
+    mismatches += errorMismatches;
+
+    // Expressions far deeper than the call stack allows parse, evaluate and get destroyed
+    int depthMismatches = 0;
+    const int deep = 100000;
+    // Level i wraps the ones below it in "(... + 1)", "(1 - ...)" or "sin(...)"
+    std::string opening, closing;
+    double nestedValue = 0.5;
+    for (int i = deep - 1; i >= 0; --i)
+        opening += i % 3 == 0 ? "(" : i % 3 == 1 ? "(1 - " : "sin(";
+    for (int i = 0; i < deep; ++i)
+    {
+        closing += i % 3 == 0 ? " + 1)" : ")";
+        nestedValue = i % 3 == 0 ? nestedValue + 1 : i % 3 == 1 ? 1 - nestedValue : std::sin(nestedValue);
+    }
+    std::string nested = opening + "x" + closing;
+    {
+        NodePtr tree = parser.parse(nested, {"x"});
+        CompiledExpression compiled = parser.compile(nested, {"x"});
+        double input = 0.5;
+        if (tree->depth() != size_t(deep) + 1 || tree->evaluate({&input, 1}) != nestedValue ||
+            compiled.evaluate({&input, 1}) != nestedValue || parser.parseFlat(nested, {"x"}).evaluate({&input, 1}) != nestedValue)
+            ++depthMismatches;
+        std::vector<double> deepColumn(5, 0.5), deepTreeOut(deepColumn.size()), deepCompiledOut(deepColumn.size());
+        const double *deepColumns[] = {deepColumn.data()};
+        SimdLevel previousLevel = simdKernels().level;
+        setSimdLevel(SimdLevel::Scalar);
+        tree->evaluateBatch(deepColumns, deepColumn.size(), deepTreeOut.data());
+        compiled.evaluateBatch(deepColumns, deepColumn.size(), deepCompiledOut.data());
+        setSimdLevel(previousLevel);
+        if (deepTreeOut.back() != nestedValue || deepCompiledOut.back() != nestedValue)
+            ++depthMismatches;
+        NodePtr optimizedDeep = optimize(tree);
+        if (optimizedDeep->evaluate({&input, 1}) != nestedValue || countNodes(tree) < size_t(deep))
+            ++depthMismatches;
+    }
+    {
+        // tryEvaluate takes the same deep path as evaluate, for values and for errors:
+        // a million levels over 1 / x
+        NodePtr chain = makeOperationNode(OpCode::Divide, std::make_shared<ConstantNode>(1.0),
+                                          std::make_shared<VariableNode>("x", 0));
+        for (int i = 0; i < 1000000; ++i)
+            chain = makeOperationNode(OpCode::Negate, chain);
+        double one = 1.0, zero = 0.0;
+        Result<double> deepResult = chain->tryEvaluate({&one, 1});
+        Result<double> deepError = chain->tryEvaluate({&zero, 1});
+        if (!deepResult || *deepResult != 1.0 || deepError || deepError.error().code != ErrorCode::DivisionByZero)
+            ++depthMismatches;
+    }
+
+    // x^0 and, with fastMath, x * 0 drop x only if it cannot fail, which is looked
+    // up without recursion: a million levels fold, or stay when a sqrt is at the bottom
+    for (bool failing : {false, true})
+    {
+        NodePtr chain = std::make_shared<VariableNode>("x", 0);
+        if (failing)
+            chain = makeOperationNode(OpCode::Sqrt, chain);
+        for (int i = 0; i < 1000000; ++i)
+            chain = makeOperationNode(OpCode::Sin, chain);
+        NodePtr zero = std::make_shared<ConstantNode>(0.0);
+        NodePtr power = optimize(makeOperationNode(OpCode::Power, chain, zero));
+        NodePtr product = optimize(makeOperationNode(OpCode::Multiply, chain, zero), {true});
+        if ((power->opcode() == OpCode::Constant) == failing || (product->opcode() == OpCode::Constant) == failing)
+            ++depthMismatches;
+    }
+
+    // The depth limit counts nodes from the root to the deepest leaf
+    parser.setMaxDepth(3);
+    Result<NodePtr> shallow = parser.tryParse("(1 + 2) * x", {"x"});
+    Result<NodePtr> tooDeep = parser.tryParse("((1 + 2) * 3) - x", {"x"});
+    parser.setMaxDepth(Parser::UnlimitedDepth);
+    if (!shallow || tooDeep || tooDeep.error().code != ErrorCode::TooDeep || tooDeep.error().position != 16 ||
+        !parser.tryParse("((1 + 2) * 3) - x", {"x"}))
+        ++depthMismatches;
+
+    // Factorial no longer recurses per integer; the product saturates at infinity
+    if (parser.parse("170!")->evaluate() != parser.compile("170!").evaluate() || !std::isfinite(parser.parse("170!")->evaluate()) ||
+        parser.parse("1000000000!")->evaluate() != HUGE_VAL || applyOperation(OpCode::Factorial, 1e9, 0.0) != HUGE_VAL)
+        ++depthMismatches;
+
+    // Arguments beyond int are infinite, and inf saturates too; NaN is no factorial
+    // on any path, and none of them converts such a value to int first
+    for (double x : {3e9, 1e10, HUGE_VAL, double(NAN)})
+    {
+        std::vector<double> input = {x};
+        Result<double> treeResult = parser.parse("x!", {"x"})->tryEvaluate(input);
+        Result<double> compiledResult = parser.compile("x!", {"x"}).tryEvaluate(input);
+        Result<double> nativeResult = NativeExpression(parser.compile("x!", {"x"})).tryEvaluate(input);
+        Result<double> staticResult = StaticExpression<"x!", "x">::tryEvaluate(input);
+        for (const Result<double> &result : {treeResult, compiledResult, nativeResult, staticResult})
+        {
+            if (std::isnan(x) ? result || result.error().code != ErrorCode::NegativeFactorial
+                              : !result || result.value() != HUGE_VAL)
+                ++depthMismatches;
+        }
+    }
+    std::cout << "Depth mismatches: " << depthMismatches << std::endl;
+    mismatches += depthMismatches;
+
+    // Native code gives the tree walker's exact bits, keeps values across libm calls
+    // and spills, and reports the same errors, even ones a later operation would hide
+    int nativeMismatches = 0;
+    for (const auto &source : allExpressions)
+    {
+        NativeExpression native(parser.compile(source));
+        if (native.evaluate() != parser.parse(source)->evaluate() || (NativeExpression::supported() && !native.native()))
+            ++nativeMismatches;
+    }
+    // Twenty levels of right nesting need more stack slots than there are registers
+    std::string wide = "x";
+    for (int level = 0; level < 20; ++level)
+        wide = (level % 2 ? "sin(x) * (rate - " : "cos(rate) + (t0 / ") + wide + ")";
+    for (const std::string &source : {variables, repeated, wide, std::string("t0^x^rate - -x + sqrt(t0) + sech(x) + cot(x) + csch(x) + coth(x)")})
+    {
+        NodePtr tree = parser.parse(source, variableNames);
+        NativeExpression native(parser.compile(source, variableNames));
+        for (double x : {0.5, 1.25, 3.0, -2.0})
+        {
+            double values[] = {x, 2.0 - x, 5.0};
+            if (native.evaluate(values) != tree->evaluate(values))
+                ++nativeMismatches;
+        }
+    }
+    evaluationErrors.push_back({"(1 / (x - 2))^0", ErrorCode::DivisionByZero});
+    for (const auto &[source, code] : evaluationErrors)
+    {
+        Result<double> nativeResult = NativeExpression(parser.compile(source, {"x"})).tryEvaluate(errorInput);
+        if (nativeResult || nativeResult.error().code != code)
+            ++nativeMismatches;
+    }
+    // Where both operands of an operation fail, the tree's error is the native one too
+    for (const auto &[source, code] : orderErrors)
+    {
+        NodePtr tree = parser.parse(source, {"x"});
+        NativeExpression native(parser.compile(source, {"x"}));
+        for (double x : {-3.0, -2.0, -1.0, 0.0, 1.0, 2.5})
+        {
+            Result<double> expected = tree->tryEvaluate({&x, 1});
+            Result<double> actual = native.tryEvaluate({&x, 1});
+            if (expected.ok() != actual.ok() || (expected && std::memcmp(&*expected, &*actual, sizeof(double)) != 0) ||
+                (!expected && expected.error().code != actual.error().code))
+                ++nativeMismatches;
+        }
+    }
+    if (!std::isnan(NativeExpression(parser.compile("ln(x - 3)", {"x"})).evaluate(errorInput)) ||
+        NativeExpression(parser.compile("coth(x - 2)", {"x"})).evaluate(errorInput) != HUGE_VAL)
+        ++nativeMismatches;
+    std::cout << "Native mismatches: " << nativeMismatches << std::endl;
+    mismatches += nativeMismatches;
+
+    // Formulas parsed at compile time give Parser's bits and errors
+    int staticMismatches = 0;
+    auto checkStatic = [&]<typename Formula>(Formula formula, const std::vector<std::string> &names)
+    {
+        NodePtr tree = parser.parse(std::string(Formula::source()), names);
+        for (double x : {0.5, 1.25, 3.0, -2.0})
+        {
+            double values[] = {x, 2.0 - x, 5.0};
+            if (Formula::evaluate(values) != tree->evaluate(values))
+                ++staticMismatches;
+        }
+        if constexpr (requires { formula(0.5, 1.5, 5.0); })
+        {
+            double values[] = {0.5, 1.5, 5.0};
+            if (formula(0.5, 1.5, 5.0) != tree->evaluate(values))
+                ++staticMismatches;
+        }
+    };
+    checkStatic(StaticExpression<"x^2 + rate * t0 - sin(x)", "x", "rate", "t0">{}, variableNames);
+    checkStatic(StaticExpression<"-2^2 + -(1 + 2) * 3! - -x", "x">{}, {"x"});
+    checkStatic(StaticExpression<"2^3^2 - 10 - 4 - 3 / rate", "x", "rate">{}, {"x", "rate"});
+    checkStatic(StaticExpression<"sqrt 144 + ln t0 * log(t0) / -x", "x", "rate", "t0">{}, variableNames);
+    checkStatic(StaticExpression<"t0^x^rate - -x + sqrt(t0) + sech(x) + cot(x) + csch(x) + coth(x)", "x", "rate", "t0">{},
+                variableNames);
+    checkStatic(StaticExpression<"3.14159265358979323846264338327950288 * x + 1e-5 * 2.5E2 - 4.9e-324 + 5.", "x">{}, {"x"});
+    static_assert(std::is_same_v<StaticExpression<"x * 2", "x">::Tree,
+                                 static_expression::Binary<OpCode::Multiply, static_expression::Variable<0>,
+                                                           static_expression::Constant<2.0>>>);
+    if (StaticExpression<"y", "x", "y">::variableCount() != 2 || StaticExpression<"x", "x", "y">::variableCount() != 1)
+        ++staticMismatches;
+    try
+    {
+        StaticExpression<"x + y", "x", "y">::evaluate(errorInput);
+        ++staticMismatches;
+    }
+    catch (const std::out_of_range &)
+    {
+    }
+    std::vector<Result<double>> staticErrors = {StaticExpression<"1 / (x - 2)", "x">::tryEvaluate(errorInput),
+                                                StaticExpression<"sqrt(x - 3)", "x">::tryEvaluate(errorInput),
+                                                StaticExpression<"cot(x - 2)", "x">::tryEvaluate(errorInput),
+                                                StaticExpression<"(x - 5)!", "x">::tryEvaluate(errorInput),
+                                                StaticExpression<"(1 / (x - 2))^0", "x">::tryEvaluate(errorInput)};
+    for (size_t i = 0; i < staticErrors.size(); ++i)
+    {
+        if (staticErrors[i] || staticErrors[i].error().code != evaluationErrors[i].second)
+            ++staticMismatches;
+    }
+    // The compile-time number conversion rounds exactly like the tokenizer
+    std::vector<std::string> literals = {"0.1", "2.2250738585072011e-308", "2.4703282292062327e-324", "1.7976931348623158e308",
+                                         "1.7976931348623159e308", "9007199254740993", "5.", ".5e1", "1e", "2.e-3x",
+                                         "123456789012345678901234567890e-30"};
+    char printed[32];
+    for (double value : {1.0 / 3.0, 6.02214076e23, 1e-310, 0.7, 123.456})
+    {
+        std::snprintf(printed, sizeof(printed), "%.17g", value);
+        literals.push_back(printed);
+    }
+    for (const auto &literal : literals)
+    {
+        double value = 0;
+        size_t length = static_expression::scanNumber(literal, 0, value);
+        const Token &token = parser.tokenize(literal)[0];
+        if (length != token.length || std::memcmp(&value, &token.value, sizeof(double)) != 0)
+            ++staticMismatches;
+    }
+    std::cout << "Static mismatches: " << staticMismatches << std::endl;
+    mismatches += staticMismatches;
+
+    // Reverse-mode gradients agree with central differences, and trees, flat
+    // expressions and batches give the same bits
+    int gradientMismatches = 0;
+    std::vector<std::string> differentiable = {variables, repeated, wide, "t0^x^rate - -x + sqrt(t0) + sech(x) + cot(x)",
+                                               "csch(x) * coth(rate) + tan(x) / cosh(t0) - ln(t0) * log(rate^2)",
+                                               "x^rate / (t0 - x) + (x + 4.25)! * x"};
+    std::vector<double> gradient(3), scratch;
+    for (const auto &source : differentiable)
+    {
+        NodePtr tree = parser.parse(source, variableNames);
+        GradientTape tape(parser.parseFlat(source, variableNames));
+        GradientTape treeTape(*tree);
+        for (double x : {0.5, 1.25, 3.0})
+        {
+            double values[] = {x, 2.0 - x / 2, 5.0};
+            std::vector<double> treeGradient(3);
+            if (tape.evaluate(values, gradient, scratch) != tree->evaluate(values) ||
+                treeTape.evaluate(values, treeGradient) != tree->evaluate(values) || treeGradient != gradient)
+                ++gradientMismatches;
+            for (size_t slot = 0; slot < 3; ++slot)
+            {
+                double h = 1e-6 * std::max(1.0, std::abs(values[slot]));
+                double saved = values[slot];
+                values[slot] = saved + h;
+                double above = tree->evaluate(values);
+                values[slot] = saved - h;
+                double below = tree->evaluate(values);
+                values[slot] = saved;
+                double difference = (above - below) / (2 * h);
+                if (std::abs(difference - gradient[slot]) > 1e-5 * std::max(1.0, std::abs(difference)))
+                {
+                    std::cout << "Gradient mismatch: " << source << " d/d" << variableNames[slot] << " at x = " << x
+                              << ": " << gradient[slot] << " vs " << difference << std::endl;
+                    ++gradientMismatches;
+                }
+            }
+        }
+
+        // The batch skips the gradients nobody asked for
+        std::vector<double> xs = {0.5, 1.25, 3.0}, rates = {1.75, 1.375, 0.5}, t0s(3, 5.0);
+        std::vector<double> out(3), dx(3), dt0(3, -1.0);
+        const double *columns[] = {xs.data(), rates.data(), t0s.data()};
+        double *gradients[] = {dx.data(), nullptr, dt0.data()};
+        SimdLevel previousLevel = simdKernels().level;
+        setSimdLevel(SimdLevel::Scalar);
+        tape.evaluateBatch(columns, 3, out.data(), gradients);
+        setSimdLevel(previousLevel);
+        for (size_t row = 0; row < 3; ++row)
+        {
+            double values[] = {xs[row], rates[row], t0s[row]};
+            if (out[row] != tape.evaluate(values, gradient) || dx[row] != gradient[0] ||
+                (tape.variableCount() == 3 && dt0[row] != gradient[2]))
+                ++gradientMismatches;
+        }
+    }
+    // Where the functions are singular or flat, the derivative is the one of what the node computes
+    std::vector<std::pair<std::string, std::vector<double>>> special = {
+        {"coth(x)", {-HUGE_VAL, 0}}, {"csch(x)", {-HUGE_VAL, 0}}, {"x^rate", {0, 0}},
+        {"x^(rate - 2)", {0, -HUGE_VAL}}, {"(x + 7.5)!", {0, 0}}, {"2 + 3", {0, 0}}};
+    for (const auto &[source, expected] : special)
+    {
+        GradientTape tape(parser.parseFlat(source, {"x", "rate"}));
+        double values[] = {0.0, 2.0};
+        std::vector<double> specialGradient(2, NAN);
+        tape.evaluate(values, specialGradient);
+        if (specialGradient[0] != expected[0] || (tape.variableCount() > 1 && specialGradient[1] != expected[1]))
+            ++gradientMismatches;
+    }
+    for (const auto &[source, code] : evaluationErrors)
+    {
+        Result<double> gradientResult = GradientTape(parser.parseFlat(source, {"x"})).tryEvaluate(errorInput, gradient);
+        if (gradientResult || gradientResult.error().code != code)
+            ++gradientMismatches;
+    }
+    {
+        GradientTape tape(parser.parseFlat("1 / (x - 2)", {"x"}));
+        std::vector<double> out(errorColumn.size()), dx(errorColumn.size());
+        double *gradients[] = {dx.data()};
+        tape.evaluateBatch(errorColumns, errorColumn.size(), out.data(), gradients, ErrorMode::Propagate);
+        if (std::isfinite(out[1]) || std::isfinite(dx[1]) || dx[0] != -1.0 || dx[2] != -1.0)
+            ++gradientMismatches;
+    }
+    {
+        // A tape of the deep expression runs its batch a few rows per chunk rather
+        // than taking values and adjoints for a full chunk of every node
+        GradientTape tape(parser.parseFlat(nested, {"x"}));
+        std::vector<double> xs = {0.5, -1.25, 3.0, 0.75, 2.0}, out(xs.size()), dx(xs.size());
+        const double *columns[] = {xs.data()};
+        double *gradients[] = {dx.data()};
+        SimdLevel previousLevel = simdKernels().level;
+        setSimdLevel(SimdLevel::Scalar);
+        for (size_t n : {size_t(1), xs.size()})
+        {
+            tape.evaluateBatch(columns, n, out.data(), gradients);
+            for (size_t row = 0; row < n; ++row)
+            {
+                if (out[row] != tape.evaluate({&xs[row], 1}, gradient, scratch) || dx[row] != gradient[0])
+                    ++gradientMismatches;
+            }
+        }
+        setSimdLevel(previousLevel);
+    }
+    std::cout << "Gradient mismatches: " << gradientMismatches << std::endl;
+    mismatches += gradientMismatches;
+
+    // Derivative trees agree with the reverse-mode gradient, stay small and reuse the original's nodes
+    int derivativeMismatches = 0;
+    for (const auto &source : differentiable)
+    {
+        NodePtr tree = parser.parse(source, variableNames);
+        GradientTape tape(*tree);
+        for (size_t slot = 0; slot < variableNames.size(); ++slot)
+        {
+            DerivativeStats stats;
+            NodePtr derivative = differentiate(tree, variableNames[slot], &stats);
+            if (stats.distinctNodes > 4 * FlatExpression::fromTree(*tree).size() + 8 || stats.derivativeCost > 4 * stats.originalCost + 40)
+            {
+                std::cout << "Derivative too large: " << source << " d/d" << variableNames[slot] << ": "
+                          << stats.distinctNodes << " nodes" << std::endl;
+                ++derivativeMismatches;
+            }
+            for (double x : {0.5, 1.25, 3.0})
+            {
+                double values[] = {x, 2.0 - x / 2, 5.0};
+                tape.evaluate(values, gradient);
+                double value = derivative->evaluate(values);
+                if (std::abs(value - gradient[slot]) > 1e-12 * std::max(1.0, std::abs(gradient[slot])))
+                {
+                    std::cout << "Derivative mismatch: " << source << " d/d" << variableNames[slot] << " at x = " << x
+                              << ": " << value << " vs " << gradient[slot] << std::endl;
+                    ++derivativeMismatches;
+                }
+            }
+        }
+    }
+    {
+        NodePtr sine = parser.parse("sin(x^3)", {"x"});
+        DerivativeStats stats;
+        NodePtr derivative = differentiate(sine, "x", &stats);
+        // cos(x^3) * (3 * x^2) reuses the original x^3 node
+        if (derivative->opcode() != OpCode::Multiply || derivative->operand(0)->operand(0) != sine->operand(0) ||
+            stats.sharedNodes < 2 || derivative->evaluate({{2.0}}) != std::cos(8.0) * 12.0)
+            ++derivativeMismatches;
+        NodePtr zero = differentiate(parser.parse("sin(2) * t0 + 3!", {"x", "t0"}), "x");
+        if (zero->opcode() != OpCode::Constant || zero->evaluate() != 0.0)
+            ++derivativeMismatches;
+        if (differentiate(parser.parse("coth(x)", {"x"}), "x")->evaluate({{0.0}}) != -HUGE_VAL ||
+            differentiate(parser.parse("ln(x)", {"x"}), "x")->tryEvaluate({{0.0}}).error().code != ErrorCode::DivisionByZero)
+            ++derivativeMismatches;
+    }
+    {
+        // The nested expression from the depth test, differentiated without recursion
+        NodePtr tree = parser.parse(nested, {"x"});
+        double value = 0.5, slope = 1.0;
+        for (int i = 0; i < deep; ++i)
+        {
+            slope = i % 3 == 0 ? slope : i % 3 == 1 ? -slope : std::cos(value) * slope;
+            value = i % 3 == 0 ? value + 1 : i % 3 == 1 ? 1 - value : std::sin(value);
+        }
+        double input = 0.5;
+        if (std::abs(differentiate(tree, "x")->evaluate({&input, 1}) - slope) > 1e-12)
+            ++derivativeMismatches;
+    }
+    {
+        // On a chain every cos(u) shares the chain below it: the stats count the
+        // n(n + 1) / 2 + 2n - 1 nodes per use without walking them, and compiled
+        // code computes each distinct node once
+        NodePtr chain = std::make_shared<VariableNode>("x", 0);
+        for (int i = 0; i < deep; ++i)
+            chain = makeOperationNode(OpCode::Sin, chain);
+        DerivativeStats stats;
+        NodePtr derivative = differentiate(chain, "x", &stats);
+        size_t n = deep;
+        double input = 0.5, value = 0.5, slope = 1.0;
+        for (int i = 0; i < deep; ++i)
+        {
+            slope *= std::cos(value);
+            value = std::sin(value);
+        }
+        if (stats.originalNodes != n + 1 || stats.derivativeNodes != n * (n + 1) / 2 + 2 * n - 1 ||
+            stats.distinctNodes > 3 * n + 2 ||
+            std::abs(Bytecode::compile(derivative).evaluate({&input, 1}) - slope) > 1e-12 * std::abs(slope))
+            ++derivativeMismatches;
+    }
+    std::cout << "Derivative mismatches: " << derivativeMismatches << std::endl;
+    mismatches += derivativeMismatches;
+
+    // Incremental evaluation gives the bits of a full evaluation after every change,
+    // recomputing only the nodes on the changed inputs' paths
+    int incrementalMismatches = 0;
+    for (const auto &source : differentiable)
+    {
+        FlatExpression flat = parser.parseFlat(source, variableNames);
+        std::vector<double> current = {0.5, 1.75, 5.0};
+        IncrementalExpression incremental(flat, current);
+        if (incremental.value() != flat.evaluateWith(scratch, current) || incremental.lastRecomputed() != flat.size())
+            ++incrementalMismatches;
+        for (int step = 0; step < 12; ++step)
+        {
+            size_t slot = step % incremental.variableCount();
+            current[slot] += 0.125 * (step + 1);
+            incremental.set(slot, current[slot]);
+            if (step % 4 == 3)
+                incremental.set(variableNames[(slot + 1) % 3], current[(slot + 1) % 3] -= 0.25);
+            if (incremental.value() != flat.evaluateWith(scratch, current) || incremental.lastRecomputed() > flat.size())
+                ++incrementalMismatches;
+        }
+        incremental.update(current);
+        if (incremental.value() != flat.evaluateWith(scratch, current) || incremental.lastRecomputed() != 0)
+            ++incrementalMismatches;
+    }
+    {
+        double values[] = {0.1, 2.0, 3.0};
+        IncrementalExpression incremental(parser.parseFlat("sin(x) + cos(rate) * t0", variableNames), values);
+        incremental.value();
+        incremental.set("t0", 4.0);
+        if (incremental.value() != std::sin(0.1) + std::cos(2.0) * 4.0 || incremental.lastRecomputed() != 3)
+            ++incrementalMismatches;
+
+        // (7.6)! and (7.7)! are both 7!, so the change stops at the factorial
+        IncrementalExpression step(parser.parseFlat("(x + 7.5)! + rate", variableNames), values);
+        step.value();
+        step.set(size_t(0), 0.2);
+        if (step.value() != 5042.0 || step.lastRecomputed() != 3)
+            ++incrementalMismatches;
+        try
+        {
+            step.set("unknown", 1.0);
+            ++incrementalMismatches;
+        }
+        catch (const std::out_of_range &)
+        {
+        }
+    }
+    {
+        // A failing node keeps failing until an input fixes it, from the first call on
+        double two = 2.0;
+        IncrementalExpression incremental(parser.parseFlat("1 / (x - 2) + x", {"x"}), {&two, 1});
+        Result<double> first = incremental.tryValue();
+        incremental.set(size_t(0), 4.0);
+        double fixed = incremental.value();
+        incremental.set(size_t(0), 2.0);
+        Result<double> broken = incremental.tryValue();
+        Result<double> again = incremental.tryValue();
+        incremental.set(size_t(0), 3.0);
+        if (first || first.error().code != ErrorCode::DivisionByZero || fixed != 4.5 || broken ||
+            broken.error().code != ErrorCode::DivisionByZero || again || incremental.value() != 4.0)
+            ++incrementalMismatches;
+    }
+    {
+        // The nested expression from the depth test: a change at the bottom runs up the whole chain
+        FlatExpression flat = parser.parseFlat(nested, {"x"});
+        double input = 0.5;
+        IncrementalExpression incremental(flat, {&input, 1});
+        incremental.value();
+        input = 0.75;
+        incremental.set(size_t(0), input);
+        if (incremental.value() != flat.evaluate({&input, 1}))
+            ++incrementalMismatches;
+    }
+    std::cout << "Incremental mismatches: " << incrementalMismatches << std::endl;
+    mismatches += incrementalMismatches;
+
+    // Formulas written to a library and loaded back evaluate like the compiled originals,
+    // and damaged files are rejected
+    int libraryMismatches = 0;
+    {
+        ExpressionLibraryWriter writer;
+        std::vector<std::pair<std::string, CompiledExpression>> originals;
+        for (size_t i = 0; i < allExpressions.size(); ++i)
+            originals.emplace_back("constant/" + std::to_string(i), parser.compile(allExpressions[i]));
+        for (size_t i = 0; i < differentiable.size(); ++i)
+            originals.emplace_back("variable/" + std::to_string(i), parser.compile(differentiable[i], variableNames));
+        originals.emplace_back("nested", parser.compile(nested, {"x"}));
+        for (const auto &[name, compiled] : originals)
+            writer.add(name, compiled);
+        try
+        {
+            writer.add("nested", originals[0].second);
+            ++libraryMismatches;
+        }
+        catch (const std::invalid_argument &)
+        {
+        }
+
+        std::vector<std::byte> bytes = writer.serialize();
+        ExpressionLibrary library = ExpressionLibrary::fromBytes(bytes);
+        if (library.size() != originals.size())
+            ++libraryMismatches;
+        std::vector<double> xs = {0.5, 1.25, 3.0}, rates = {1.75, 1.375, 0.5}, t0s(3, 5.0);
+        const double *columns[] = {xs.data(), rates.data(), t0s.data()};
+        for (const auto &[name, compiled] : originals)
+        {
+            LibraryExpression loaded = library.at(name);
+            bool same = loaded.name() == name && loaded.variableCount() == compiled.variableNames().size() &&
+                        loaded.program().code().data() >= reinterpret_cast<const OpCode *>(bytes.data()) &&
+                        loaded.program().code().data() < reinterpret_cast<const OpCode *>(bytes.data() + bytes.size());
+            for (size_t slot = 0; slot < loaded.variableCount(); ++slot)
+                same = same && loaded.variableName(slot) == compiled.variableNames()[slot] &&
+                       loaded.slot(compiled.variableNames()[slot]) == slot;
+
+            double input = 0.5;
+            std::vector<double> values = name == "nested" ? std::vector<double>{input} : variableValues;
+            same = same && loaded.evaluate(values) == compiled.evaluate(values) &&
+                   loaded.toCompiled().evaluate(values) == compiled.evaluate(values);
+            if (loaded.variableCount() == 3)
+            {
+                std::vector<double> loadedOut(3), compiledOut(3);
+                loaded.evaluateBatch(columns, 3, loadedOut.data());
+                compiled.evaluateBatch(columns, 3, compiledOut.data());
+                same = same && loadedOut == compiledOut;
+            }
+            if (!same)
+            {
+                std::cout << "Library mismatch: " << name << std::endl;
+                ++libraryMismatches;
+            }
+        }
+        LibraryExpression found;
+        if (library.find("missing", found) || !library.find("nested", found) || found.name() != "nested" ||
+            library[0].name() != "constant/0")
+            ++libraryMismatches;
+
+        // Through a file; an expression keeps the mapping alive after the library is gone
+        std::string path = (std::filesystem::temp_directory_path() / "test_parser.mplib").string();
+        writer.write(path);
+        LibraryExpression kept;
+        {
+            ExpressionLibrary mapped = ExpressionLibrary::open(path);
+            kept = mapped.at("variable/0");
+        }
+        if (kept.evaluate(variableValues) != compiledVariables.evaluate(variableValues))
+            ++libraryMismatches;
+        std::remove(path.c_str());
+
+        // A changed byte anywhere, a short file and another version are all refused
+        auto rejected = [](std::vector<std::byte> data)
+        {
+            try
+            {
+                ExpressionLibrary::fromBytes(data);
+                return false;
+            }
+            catch (const LibraryFormatError &)
+            {
+                return true;
+            }
+        };
+        for (size_t position : {size_t(0), size_t(60), bytes.size() / 2, bytes.size() - 1})
+        {
+            std::vector<std::byte> damaged = bytes;
+            damaged[position] ^= std::byte{0x10};
+            if (!rejected(damaged))
+                ++libraryMismatches;
+        }
+        std::vector<std::byte> newer = bytes;
+        newer[8] = std::byte{2};
+        if (!rejected(std::vector<std::byte>(bytes.begin(), bytes.end() - 8)) || !rejected(newer) || !rejected({}))
+            ++libraryMismatches;
+    }
+    std::cout << "Library mismatches: " << libraryMismatches << std::endl;
+    mismatches += libraryMismatches;
+
+    // A fused set gives every formula's own bits, for one row and for batches,
+    // including a formula that is part of another, a repeated one and leaves
+    int fusionMismatches = 0;
+    {
+        std::vector<std::string> formulas = differentiable;
+        formulas.insert(formulas.end(), {"x^2", "x^2 + sin(x^2) * rate", "x^2", "t0", "2.5", "sqrt(x - rate) * t0"});
+        MultiExpression fused = MultiExpression::compile(parser, formulas, variableNames);
+        if (fused.outputCount() != formulas.size() || fused.slot("t0") != 2 ||
+            fused.stats().fusedOperations >= fused.stats().separateOperations ||
+            fused.stats().fusedInstructions >= fused.stats().separateInstructions)
+            ++fusionMismatches;
+
+        std::vector<double> outputs = fused.evaluate(variableValues);
+        std::vector<double> xs = {0.5, 1.25, 3.0, 7.5}, rates = {1.75, 1.375, 0.5, 2.0}, t0s = {5.0, 4.0, 0.25, 9.0};
+        const double *columns[] = {xs.data(), rates.data(), t0s.data()};
+        std::vector<std::vector<double>> batch(formulas.size(), std::vector<double>(4));
+        std::vector<double *> batchColumns;
+        for (auto &column : batch)
+            batchColumns.push_back(column.data());
+        fused.evaluateBatch(columns, 4, batchColumns.data(), ErrorMode::Propagate);
+        for (size_t k = 0; k < formulas.size(); ++k)
+        {
+            CompiledExpression alone = parser.compile(formulas[k], variableNames);
+            std::vector<double> expected(4);
+            alone.evaluateBatch(columns, 4, expected.data(), ErrorMode::Propagate);
+            bool same = outputs[k] == alone.evaluate(variableValues);
+            for (size_t row = 0; row < 4; ++row)
+                same = same && std::memcmp(&batch[k][row], &expected[row], sizeof(double)) == 0;
+            if (!same)
+            {
+                std::cout << "Fusion mismatch: " << formulas[k] << std::endl;
+                ++fusionMismatches;
+            }
+        }
+
+        // sqrt(x - rate) fails for the second row, and with it the whole evaluation
+        std::vector<double> failing = {1.25, 1.375, 4.0};
+        Result<std::vector<double>> failed = fused.tryEvaluate(failing);
+        if (failed.ok() || failed.error().code != ErrorCode::NegativeSquareRoot || !std::isnan(batch.back()[1]))
+            ++fusionMismatches;
+
+        std::vector<FlatExpression> mixed;
+        mixed.push_back(parser.parseFlat("x + 1", {"x"}));
+        mixed.push_back(parser.parseFlat("y + 1", {"y"}));
+        std::vector<double> tooFew(2);
+        try
+        {
+            MultiExpression unrelated(mixed);
+            ++fusionMismatches;
+        }
+        catch (const std::invalid_argument &)
+        {
+        }
+        try
+        {
+            fused.evaluate(variableValues, tooFew);
+            ++fusionMismatches;
+        }
+        catch (const std::invalid_argument &)
+        {
+        }
+    }
+    std::cout << "Fusion mismatches: " << fusionMismatches << std::endl;
+    mismatches += fusionMismatches;
+
+    // Sampled curves keep their ends and break at poles and domain edges; heatmaps
+    // stay within the colour tolerance of evaluating every pixel
+    int samplerMismatches = 0;
+    {
+        CurveOptions curveOptions;
+        curveOptions.yMin = -10;
+        curveOptions.yMax = 10;
+        CompiledExpression tangent = parser.compile("tan(x)", {"x"});
+        Polyline poles = sampleCurve(tangent, -3, 3, curveOptions);
+        std::vector<double> breaks;
+        bool ordered = poles.x.front() == -3 && poles.x.back() == 3 && poles.evaluations < curveOptions.width;
+        for (size_t k = 0; k < poles.x.size(); ++k)
+        {
+            ordered = ordered && (k == 0 || poles.x[k] > poles.x[k - 1]);
+            if (std::isnan(poles.y[k]))
+                breaks.push_back(poles.x[k]);
+            else
+                ordered = ordered && std::abs(poles.y[k] - std::tan(poles.x[k])) < 1e-9 * std::max(1.0, std::abs(poles.y[k]));
+        }
+        double finest = 6.0 / double(curveOptions.width);
+        if (!ordered || breaks.size() != 2 || std::abs(breaks[0] + std::acos(0.0)) > finest ||
+            std::abs(breaks[1] - std::acos(0.0)) > finest)
+            ++samplerMismatches;
+
+        curveOptions.pool = &pool;
+        Polyline parallelPoles = sampleCurve(tangent, -3, 3, curveOptions);
+        if (std::memcmp(parallelPoles.y.data(), poles.y.data(), poles.y.size() * sizeof(double)) != 0 ||
+            parallelPoles.x != poles.x)
+            ++samplerMismatches;
+
+        // sqrt(1 - x^2) is only defined on [-1, 1], and the edges are found to the finest width
+        Polyline disc = sampleCurve(parser.compile("sqrt(1 - x^2)", {"x"}), -2, 2);
+        double firstDefined = 2, lastDefined = -2;
+        for (size_t k = 0; k < disc.x.size(); ++k)
+        {
+            if (std::isfinite(disc.y[k]))
+            {
+                firstDefined = std::min(firstDefined, disc.x[k]);
+                lastDefined = std::max(lastDefined, disc.x[k]);
+            }
+            else if (std::abs(disc.x[k]) <= 1)
+                ++samplerMismatches;
+        }
+        if (firstDefined + 1 > 4.0 / 1024 || 1 - lastDefined > 4.0 / 1024 || disc.yMin != 0 || disc.yMax != 1)
+            ++samplerMismatches;
+
+        // A bilinear formula is filled from a few samples; a curved one is close to every pixel
+        Heatmap plane = sampleHeatmap(parser.compile("2 * x - y + 0.5", {"x", "y"}), -1, 1, 0, 3, 100, 60);
+        bool close = plane.values.size() == 6000 && plane.evaluations < 1000;
+        for (size_t j = 0; j < 60; ++j)
+        {
+            for (size_t i = 0; i < 100; ++i)
+            {
+                double x = -1 + (i + 0.5) * 0.02, y = (j + 0.5) * 0.05;
+                close = close && std::abs(plane.values[j * 100 + i] - (2 * x - y + 0.5)) < 1e-9;
+            }
+        }
+
+        CompiledExpression wave = parser.compile("sin(x) * cos(y) + sqrt(x)", {"x", "y"});
+        HeatmapOptions heatmapOptions;
+        heatmapOptions.zMin = -1;
+        heatmapOptions.zMax = 3;
+        Heatmap waves = sampleHeatmap(wave, -1, 5, -3, 3, 200, 150, heatmapOptions);
+        double level = 4.0 / heatmapOptions.levels;
+        for (size_t j = 0; j < 150; ++j)
+        {
+            for (size_t i = 0; i < 200; ++i)
+            {
+                double point[] = {-1 + (i + 0.5) * 0.03, -3 + (j + 0.5) * 0.04};
+                double expected = wave.tryEvaluate(point).valueOr(std::numeric_limits<double>::quiet_NaN());
+                double actual = waves.values[j * 200 + i];
+                close = close && (std::isfinite(expected) ? std::abs(actual - expected) < 2 * level : std::isnan(actual));
+            }
+        }
+
+        // Sampling into a used heatmap, or with a pool, gives the same buffer
+        Heatmap reused = plane;
+        heatmapOptions.pool = &pool;
+        sampleHeatmap(wave, -1, 5, -3, 3, 200, 150, reused, heatmapOptions);
+        close = close && reused.evaluations == waves.evaluations &&
+                std::memcmp(reused.values.data(), waves.values.data(), waves.values.size() * sizeof(double)) == 0;
+        if (!close)
+            ++samplerMismatches;
+
+        auto rejects = [](auto sample)
+        {
+            try
+            {
+                sample();
+                return false;
+            }
+            catch (const std::invalid_argument &)
+            {
+                return true;
+            }
+        };
+        if (!rejects([&] { sampleCurve(compiledVariables, 0, 1); }) || !rejects([&] { sampleCurve(tangent, 1, 1); }) ||
+            !rejects([&] { sampleHeatmap(compiledVariables, 0, 1, 0, 1, 8, 8); }))
+            ++samplerMismatches;
+    }
+    std::cout << "Sampler mismatches: " << samplerMismatches << std::endl;
+    mismatches += samplerMismatches;
+
+    // LU inverse, solve and determinant against identities and known values
+    int matrixMismatches = 0;
+    {
+        auto nearly = [](const Matrix &a, const Matrix &b, double tolerance)
+        {
+            if (a.rows() != b.rows() || a.columns() != b.columns())
+                return false;
+            for (size_t k = 0; k < a.rows() * a.columns(); ++k)
+            {
+                if (std::abs(a.data()[k] - b.data()[k]) > tolerance)
+                    return false;
+            }
+            return true;
+        };
+
+        // Sizes around the LU block size, so that the blocked steps are covered
+        for (size_t n : {1, 3, 7, 64, 65, 150})
+        {
+            Matrix a(n, n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                for (size_t j = 0; j < n; ++j)
+                    a(i, j) = std::sin(double(i * 7 + j * 3 + 1)) + (i == j ? 2.0 : 0.0);
+            }
+            LuDecomposition lu(a);
+            if (!nearly(a * lu.inverse(), Matrix::identity(n), 1e-9))
+                ++matrixMismatches;
+
+            std::vector<double> b(n);
+            for (size_t i = 0; i < n; ++i)
+                b[i] = double(i) - 2.5;
+            std::vector<double> x = lu.solve(b);
+            Matrix column(n, 1);
+            std::copy(x.begin(), x.end(), column.data());
+            Matrix product = a * column;
+            for (size_t i = 0; i < n; ++i)
+            {
+                if (std::abs(product(i, 0) - b[i]) > 1e-9)
+                    ++matrixMismatches;
+            }
+
+            // det(A^T) = det(A), with the pivots taken in a different order
+            Matrix transposed(n, n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                for (size_t j = 0; j < n; ++j)
+                    transposed(i, j) = a(j, i);
+            }
+            double det = lu.determinant();
+            if (std::abs(determinant(transposed) - det) > 1e-9 * std::abs(det))
+                ++matrixMismatches;
+        }
+
+        // Known values, with a row swap, and the fixed-size path agreeing with Matrix
+        Matrix known = Matrix::fromRows({{0, 2, 1}, {1, 1, 0}, {3, 0, 1}});
+        if (std::abs(determinant(known) + 5) > 1e-12)
+            ++matrixMismatches;
+        FixedMatrix<3> fixed{{0, 2, 1, 1, 1, 0, 3, 0, 1}};
+        FixedMatrix<3> fixedInverse = inverse(fixed);
+        Matrix knownInverse = inverse(known);
+        for (size_t k = 0; k < 9; ++k)
+        {
+            if (std::abs(fixedInverse.data()[k] - knownInverse.data()[k]) > 1e-12)
+                ++matrixMismatches;
+        }
+        std::array<double, 3> fixedX = solve(fixed, std::array<double, 3>{3, 2, 4});
+        if (std::abs(fixedX[0] - 1) > 1e-12 || std::abs(fixedX[1] - 1) > 1e-12 || std::abs(fixedX[2] - 1) > 1e-12 ||
+            std::abs(determinant(fixed) + 5) > 1e-12)
+            ++matrixMismatches;
+
+        // inverse2x2Matrix is the same closed form as before, bit for bit
+        std::vector<std::vector<double>> two = {{0.1, 0.7}, {0.3, 0.9}};
+        double twoDet = 0.1 * 0.9 - 0.7 * 0.3;
+        if (inverse2x2Matrix(two) != std::vector<std::vector<double>>{{0.9 / twoDet, -0.7 / twoDet},
+                                                                      {-0.3 / twoDet, 0.1 / twoDet}})
+            ++matrixMismatches;
+
+        auto throws = [](auto run, auto expected)
+        {
+            try
+            {
+                run();
+                return false;
+            }
+            catch (const decltype(expected) &)
+            {
+                return true;
+            }
+        };
+        Matrix singular = Matrix::fromRows({{1, 2, 3}, {2, 4, 6}, {1, 0, 1}});
+        std::vector<double> three = {1, 2, 3};
+        if (determinant(singular) != 0 || !LuDecomposition(singular).singular() ||
+            !throws([&] { inverse(singular); }, SingularMatrixError()) ||
+            !throws([&] { solve(singular, three); }, SingularMatrixError()) ||
+            !throws([&] { inverse2x2Matrix({{1, 2}, {2, 4}}); }, std::runtime_error("")) ||
+            !throws([&] { inverse(FixedMatrix<2>{{1, 2, 2, 4}}); }, SingularMatrixError()))
+            ++matrixMismatches;
+
+        // A duplicated row leaves a pivot of rounding noise, not 0, past the first panel
+        Matrix duplicated(65, 65);
+        for (size_t i = 0; i < 65; ++i)
+        {
+            for (size_t j = 0; j < 65; ++j)
+                duplicated(i, j) = std::sin(double(i * i + j * 5 + 1));
+        }
+        std::copy(duplicated.row(3), duplicated.row(3) + 65, duplicated.row(64));
+        if (determinant(duplicated) != 0 || !LuDecomposition(duplicated).singular() ||
+            !throws([&] { inverse(duplicated); }, SingularMatrixError()))
+            ++matrixMismatches;
+        if (!throws([&] { LuDecomposition(Matrix(2, 3)); }, std::invalid_argument("")) ||
+            !throws([&] { solve(known, std::vector<double>{1, 2}); }, std::invalid_argument("")) ||
+            !throws([&] { known * Matrix(2, 2); }, std::invalid_argument("")) ||
+            !throws([&] { Matrix::fromRows({{1, 2}, {3}}); }, std::invalid_argument("")))
+            ++matrixMismatches;
+    }
+    std::cout << "Matrix mismatches: " << matrixMismatches << std::endl;
+    mismatches += matrixMismatches;
+
+#ifdef MATHPARSER_PARSE_OBSERVER
+    // Metrics record every parse; the token trace is one more observer
+    int observerMismatches = 0;
+    ParseMetrics metrics;
+    parser.setObserver(&metrics);
+    parser.parse("1 + 2 * 3");
+    parser.compile(repeated, variableNames);
+    parser.setObserver(nullptr);
+    parser.parse("4 - 5");
+    ParseMetricsSnapshot snapshot = metrics.snapshot();
+    if (snapshot.parses() != 2 || snapshot.tokens.sum != 5 + 20 || snapshot.nodes.sum != 5 + 7 ||
+        snapshot.depth.max != 5 || snapshot.tokens.quantile(1.0) != 20)
+        ++observerMismatches;
+    std::ostringstream trace;
+    ParseTrace tracer(trace);
+    parser.setObserver(&tracer);
+    parser.parse("sin(x)", {"x"});
+    parser.setObserver(nullptr);
+    if (trace.str() != "Token: sin\nToken: (\nToken: x\nToken: )\n")
+        ++observerMismatches;
+    std::cout << "Observer mismatches: " << observerMismatches << std::endl;
+    mismatches += observerMismatches;
+#endif
+
+    return mismatches == 0 ? 0 : 1;
 }
@@ -0,0 +1,182 @@
+/**
+ * @file thread_pool.cpp
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "thread_pool.h"
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+    void pinToCpu(std::thread &thread, size_t cpu)
+    {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu % CPU_SETSIZE, &set);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+        (void)thread;
+        (void)cpu;
+#endif
+    }
+}
+
+ThreadPool::ThreadPool(size_t workers, bool pinThreads)
+{
+    workers = std::max<size_t>(workers, 1);
+    for (size_t i = 0; i < workers; ++i)
+    {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+
+    // Queue 0 belongs to the thread calling parallelFor
+    size_t cpus = std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+    for (size_t i = 1; i < workers; ++i)
+    {
+        threads_.emplace_back(&ThreadPool::workerLoop, this, i);
+        if (pinThreads)
+            pinToCpu(threads_.back(), i % cpus);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto &thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const Body &body)
+{
+    if (count == 0)
+        return;
+    grain = std::max<size_t>(grain, 1);
+
+    std::lock_guard<std::mutex> serial(parallelForMutex_);
+    size_t tasks = (count + grain - 1) / grain;
+    if (tasks == 1 || queues_.size() == 1)
+    {
+        for (size_t begin = 0; begin < count; begin += grain)
+            body(begin, std::min(count, begin + grain));
+        return;
+    }
+
+    // Each worker starts with a contiguous run of tasks, so without stealing
+    // every thread walks through its own part of the input in order
+    remaining_ = tasks;
+    failed_ = false;
+    error_ = nullptr;
+    size_t perQueue = (tasks + queues_.size() - 1) / queues_.size();
+    for (size_t q = 0; q < queues_.size(); ++q)
+    {
+        std::lock_guard<std::mutex> lock(queues_[q]->mutex);
+        for (size_t t = q * perQueue; t < std::min(tasks, (q + 1) * perQueue); ++t)
+        {
+            queues_[q]->tasks.push_back({t * grain, std::min(count, (t + 1) * grain), &body});
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++generation_;
+    }
+    wake_.notify_all();
+
+    while (runTask(0))
+    {
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return remaining_ == 0; });
+    if (error_)
+        std::rethrow_exception(error_);
+}
+
+void ThreadPool::workerLoop(size_t index)
+{
+    size_t seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_)
+                return;
+            seen = generation_;
+        }
+
+        // All tasks of a loop are queued before the workers wake up, so once
+        // every queue is empty this worker has nothing left to do
+        while (runTask(index))
+        {
+        }
+    }
+}
+
+bool ThreadPool::runTask(size_t index)
+{
+    Task task;
+    bool found = false;
+
+    // Own queue from the front, other queues from the back
+    {
+        Queue &own = *queues_[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            found = true;
+        }
+    }
+    for (size_t i = 1; !found && i < queues_.size(); ++i)
+    {
+        Queue &victim = *queues_[(index + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            found = true;
+        }
+    }
+    if (!found)
+        return false;
+
+    if (!failed_)
+    {
+        try
+        {
+            (*task.body)(task.begin, task.end);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_)
+                error_ = std::current_exception();
+            failed_ = true;
+        }
+    }
+
+    if (--remaining_ == 0)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_.notify_all();
+    }
+    return true;
+}
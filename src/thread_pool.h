@@ -0,0 +1,84 @@
+/**
+ * @file thread_pool.h
+ * @author Fatih Küçükkarakurt (https://github.com/fkkarakurt)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that run parallel loops. Every worker owns a
+// queue of tasks; a worker whose queue runs dry steals from the far end of
+// another worker's queue, so uneven tasks even out without a central queue.
+class ThreadPool
+{
+public:
+    using Body = std::function<void(size_t begin, size_t end)>;
+
+    // workers counts the thread that calls parallelFor, so a pool of one runs
+    // everything on the caller. With pinThreads each started worker is bound to
+    // its own CPU (Linux only, ignored elsewhere).
+    explicit ThreadPool(size_t workers = std::thread::hardware_concurrency(), bool pinThreads = false);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t workerCount() const { return queues_.size(); }
+
+    // Calls body(begin, end) for consecutive pieces of at most grain indices
+    // covering 0..count-1 and returns when all of them are done. Rethrows the
+    // first exception thrown by body; the remaining pieces are skipped then.
+    // Calls from several threads are run one after the other; body must not call
+    // parallelFor on the same pool.
+    void parallelFor(size_t count, size_t grain, const Body &body);
+
+private:
+    struct Task
+    {
+        size_t begin;
+        size_t end;
+        const Body *body;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(size_t index);
+
+    // Runs one task from the worker's own queue or one stolen from another queue.
+    // Returns false when every queue is empty.
+    bool runTask(size_t index);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    size_t generation_ = 0;
+    bool stop_ = false;
+    std::atomic<size_t> remaining_{0};
+    std::atomic<bool> failed_{false};
+    std::exception_ptr error_;
+
+    std::mutex parallelForMutex_;
+};
+
+#endif // THREAD_POOL_H